@@ -35,6 +35,7 @@
 #include "sysemu/cpu-timers.h"
 #include "exec/replay-core.h"
 #include "sysemu/tcg.h"
+#include "fpu/softfloat-helpers.h"
 #include "exec/helper-proto-common.h"
 #include "tb-jmp-cache.h"
 #include "tb-hash.h"
@@ -674,6 +675,49 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     return;
 }
 
+/*
+ * Jump slot N of TB was used by tcg_gen_lookup_and_goto_ptr_cached().
+ * Return true if it caches PC, claiming it for PC if it is still unused.
+ *
+ * If DEST cannot be linked from TB, the slot is disabled instead: it is
+ * claimed with a complement that does not match the pc word, so that it
+ * never matches and the translated code stops exiting to the main loop
+ * through it, using the lookup helper instead.
+ */
+static bool tb_claim_ind_jump(TranslationBlock *tb, int n,
+                              TranslationBlock *dest, vaddr pc)
+{
+    uint64_t *cache = tb->jmp_ind_pc[n];
+    uint64_t old;
+    bool can_link = true;
+
+#ifndef CONFIG_USER_ONLY
+    /* As for direct jumps, do not chain across pages. */
+    if (((tb->pc ^ pc) & TARGET_PAGE_MASK) || tb_page_addr1(dest) != -1) {
+        can_link = false;
+    }
+#endif
+    /* An all-zero slot is unclaimed, so pc must not complement to zero. */
+    if (pc == (vaddr)-1) {
+        can_link = false;
+    }
+    if (!can_link) {
+        /* The pc word stays 0, whose complement is not 1. */
+        qatomic_cmpxchg__nocheck(&cache[1], 0, 1);
+        return false;
+    }
+    old = qatomic_cmpxchg__nocheck(&cache[1], 0, ~(uint64_t)pc);
+    if (old == 0) {
+        qatomic_set__nocheck(&cache[0], pc);
+        return true;
+    }
+    /*
+     * Claimed for PC.  A disabled slot has the complement of -2 but a
+     * zero pc word, so check that as well.
+     */
+    return old == ~(uint64_t)pc && qatomic_read__nocheck(&cache[0]) == pc;
+}
+
 static inline bool cpu_handle_halt(CPUState *cpu)
 {
 #ifndef CONFIG_USER_ONLY
@@ -1003,6 +1047,11 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                 qatomic_set(&jc->array[h].tb, tb);
             }
 
+            /* A cached indirect jump slot must be claimed even if unlinked. */
+            if (last_tb && (last_tb->jmp_ind_mask & (1 << tb_exit)) &&
+                !tb_claim_ind_jump(last_tb, tb_exit, tb, pc)) {
+                last_tb = NULL;
+            }
 #ifndef CONFIG_USER_ONLY
             /*
              * We don't take care of direct jumps when address mapping
@@ -1064,6 +1113,9 @@ int cpu_exec(CPUState *cpu)
 
     ret = cpu_exec_setjmp(cpu, &sc);
 
+    /* Let other threads see FP exception flags tracked by this one. */
+    float_lazy_inexact_sync_thread();
+
     cpu_exec_exit(cpu);
     return ret;
 }
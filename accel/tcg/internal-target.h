@@ -70,6 +70,11 @@ G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 #endif /* CONFIG_SOFTMMU */
 
 bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc);
+#ifdef CONFIG_USER_ONLY
+TranslationBlock *tb_revive(CPUState *cpu, tb_page_addr_t phys_pc,
+                            vaddr pc, uint64_t cs_base,
+                            uint32_t flags, uint32_t cflags);
+#endif
 
 /* Return the current PC from CPU, which may be cached in TB. */
 static inline vaddr log_pc(CPUState *cpu, const TranslationBlock *tb)
@@ -212,6 +212,153 @@ static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
     tcg_temp_free_i32(cpu_index);
 }
 
+/*
+ * Only call back on the accesses selected by the filter.  The kind and
+ * size of the access are known at translation time, the address range
+ * and the sampling period are checked at run time.
+ *
+ * Memory callbacks are injected in the middle of an instruction, where
+ * EBB temps of the instruction may be live, so no labels can be used.
+ * The filter is computed without branches and passed to
+ * plugin_mem_filtered_cb(), which calls back only if it matches.
+ */
+static void gen_mem_filtered_cb(struct qemu_plugin_filtered_cb *cb,
+                                qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
+{
+    TCGv_i64 match, t;
+    TCGv_i32 match32, cpu_index;
+
+    if (!(cb->size_mask & (1u << (get_memop(meminfo) & MO_SIZE)))) {
+        return;
+    }
+
+    match = tcg_temp_ebb_new_i64();
+    t = tcg_temp_ebb_new_i64();
+
+    tcg_gen_setcondi_i64(TCG_COND_GEU, match, addr, cb->addr_min);
+    if (cb->addr_max != UINT64_MAX) {
+        tcg_gen_setcondi_i64(TCG_COND_LEU, t, addr, cb->addr_max);
+        tcg_gen_and_i64(match, match, t);
+    }
+    if (cb->period > 1) {
+        TCGv_ptr ptr = gen_plugin_u64_ptr(cb->counter);
+        TCGv_i64 val = tcg_temp_ebb_new_i64();
+
+        /* if (match) counter = counter + 1 < period ? counter + 1 : 0 */
+        tcg_gen_ld_i64(val, ptr, 0);
+        tcg_gen_addi_i64(t, val, 1);
+        tcg_gen_movcond_i64(TCG_COND_GEU, t, t,
+                            tcg_constant_i64(cb->period),
+                            tcg_constant_i64(0), t);
+        tcg_gen_movcond_i64(TCG_COND_NE, val, match, tcg_constant_i64(0),
+                            t, val);
+        tcg_gen_st_i64(val, ptr, 0);
+        tcg_gen_setcondi_i64(TCG_COND_EQ, t, val, 0);
+        tcg_gen_and_i64(match, match, t);
+
+        tcg_temp_free_i64(val);
+        tcg_temp_free_ptr(ptr);
+    }
+
+    match32 = tcg_temp_ebb_new_i32();
+    tcg_gen_extrl_i64_i32(match32, match);
+    tcg_temp_free_i64(t);
+    tcg_temp_free_i64(match);
+
+    cpu_index = gen_cpu_index();
+    tcg_gen_call6(plugin_mem_filtered_cb, cb->filter_info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_i32_temp(tcg_constant_i32(meminfo)),
+                  tcgv_i64_temp(addr),
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->regular.userp)),
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->regular.f.vcpu_mem)),
+                  tcgv_i32_temp(match32));
+    tcg_temp_free_i32(cpu_index);
+    tcg_temp_free_i32(match32);
+}
+
+/*
+ * Append a record to the ring of the vcpu.  Like memory callbacks, this
+ * must not use labels, see gen_mem_filtered_cb().  In
+ * QEMU_PLUGIN_RING_DROP mode, a record that does not fit is written to
+ * the spare slot past the end of the ring and counted as lost instead.
+ * In QEMU_PLUGIN_RING_BLOCK mode the vcpu may have to wait for the
+ * reader, so the record is always appended by plugin_ring_append_full().
+ */
+static void gen_record(struct qemu_plugin_record_cb *cb, TCGv_i64 vaddr,
+                       uint32_t size, uint32_t flags)
+{
+    struct qemu_plugin_ring *ring = cb->ring;
+    qemu_plugin_u64 entry = { .score = ring->vcpus, .offset = 0 };
+    TCGv_ptr ptr, rec, off;
+    TCGv_i32 head, tmp, room;
+    TCGv_i64 lost, inc;
+
+    if (ring->mode == QEMU_PLUGIN_RING_BLOCK) {
+        TCGv_i32 cpu_index = gen_cpu_index();
+
+        tcg_gen_call5(plugin_ring_append_full, cb->info, NULL,
+                      tcgv_i32_temp(cpu_index),
+                      tcgv_ptr_temp(tcg_constant_ptr(ring)),
+                      tcgv_i64_temp(tcg_constant_i64(cb->pc)),
+                      tcgv_i64_temp(vaddr),
+                      tcgv_i64_temp(tcg_constant_i64(deposit64(size, 32, 32,
+                                                               flags))));
+        tcg_temp_free_i32(cpu_index);
+        return;
+    }
+
+    ptr = gen_plugin_u64_ptr(entry);
+    rec = tcg_temp_ebb_new_ptr();
+    off = tcg_temp_ebb_new_ptr();
+    head = tcg_temp_ebb_new_i32();
+    tmp = tcg_temp_ebb_new_i32();
+    room = tcg_temp_ebb_new_i32();
+    lost = tcg_temp_ebb_new_i64();
+    inc = tcg_temp_ebb_new_i64();
+
+    tcg_gen_ld_i32(head, ptr, offsetof(struct qemu_plugin_ring_vcpu, head));
+    tcg_gen_ld_i32(tmp, ptr, offsetof(struct qemu_plugin_ring_vcpu, tail));
+    tcg_gen_sub_i32(tmp, head, tmp);
+    tcg_gen_setcondi_i32(TCG_COND_LEU, room, tmp, ring->mask);
+
+    tcg_gen_ld_ptr(rec, ptr, offsetof(struct qemu_plugin_ring_vcpu, records));
+    tcg_gen_andi_i32(tmp, head, ring->mask);
+    tcg_gen_movcond_i32(TCG_COND_NE, tmp, room, tcg_constant_i32(0),
+                        tmp, tcg_constant_i32(ring->mask + 1));
+    tcg_gen_muli_i32(tmp, tmp, sizeof(qemu_plugin_record));
+    tcg_gen_ext_i32_ptr(off, tmp);
+    tcg_gen_add_ptr(rec, rec, off);
+    tcg_gen_st_i64(tcg_constant_i64(cb->pc), rec,
+                   offsetof(qemu_plugin_record, pc));
+    tcg_gen_st_i64(vaddr, rec, offsetof(qemu_plugin_record, vaddr));
+    tcg_gen_st_i32(tcg_constant_i32(size), rec,
+                   offsetof(qemu_plugin_record, size));
+    tcg_gen_st_i32(tcg_constant_i32(flags), rec,
+                   offsetof(qemu_plugin_record, flags));
+
+    /* Publish the record to the reader, which may be any host thread. */
+    tcg_gen_host_mb(TCG_MO_ST_ST | TCG_BAR_SC);
+    tcg_gen_add_i32(head, head, room);
+    tcg_gen_st_i32(head, ptr, offsetof(struct qemu_plugin_ring_vcpu, head));
+
+    /* lost += !room */
+    tcg_gen_xori_i32(room, room, 1);
+    tcg_gen_ld_i64(lost, ptr, offsetof(struct qemu_plugin_ring_vcpu, lost));
+    tcg_gen_extu_i32_i64(inc, room);
+    tcg_gen_add_i64(lost, lost, inc);
+    tcg_gen_st_i64(lost, ptr, offsetof(struct qemu_plugin_ring_vcpu, lost));
+
+    tcg_temp_free_i64(inc);
+    tcg_temp_free_i64(lost);
+    tcg_temp_free_i32(room);
+    tcg_temp_free_i32(tmp);
+    tcg_temp_free_i32(head);
+    tcg_temp_free_ptr(off);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(ptr);
+}
+
 static void inject_cb(struct qemu_plugin_dyn_cb *cb)
 
 {
@@ -228,6 +375,10 @@ static void inject_cb(struct qemu_plugin_dyn_cb *cb)
     case PLUGIN_CB_INLINE_STORE_U64:
         gen_inline_store_u64_cb(&cb->inline_insn);
         break;
+    case PLUGIN_CB_RECORD:
+        gen_record(&cb->record, tcg_constant_i64(cb->record.pc),
+                   cb->record.size, cb->record.flags);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -243,6 +394,19 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
             gen_mem_cb(&cb->regular, meminfo, addr);
         }
         break;
+    case PLUGIN_CB_MEM_FILTERED:
+        if (rw & cb->filtered.regular.rw) {
+            gen_mem_filtered_cb(&cb->filtered, meminfo, addr);
+        }
+        break;
+    case PLUGIN_CB_RECORD:
+        if (rw & cb->record.rw) {
+            gen_record(&cb->record, addr, memop_size(get_memop(meminfo)),
+                       cb->record.flags |
+                       (rw & QEMU_PLUGIN_MEM_W ? QEMU_PLUGIN_RECORD_MEM_W
+                                               : QEMU_PLUGIN_RECORD_MEM_R));
+        }
+        break;
     case PLUGIN_CB_INLINE_ADD_U64:
     case PLUGIN_CB_INLINE_STORE_U64:
         if (rw & cb->inline_insn.rw) {
@@ -18,20 +18,24 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/units.h"
 #include "qemu/interval-tree.h"
 #include "qemu/qtree.h"
 #include "exec/cputlb.h"
 #include "exec/log.h"
 #include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
 #include "exec/page-protection.h"
 #include "exec/tb-flush.h"
 #include "exec/translate-all.h"
+#include "qemu/plugin.h"
 #include "sysemu/tcg.h"
 #include "tcg/tcg.h"
 #include "tb-hash.h"
 #include "tb-context.h"
 #include "internal-common.h"
 #include "internal-target.h"
+#include "trace.h"
 
 
 /* List iterators for lists of tagged pointers in TranslationBlock. */
@@ -56,11 +60,84 @@ static bool tb_cmp(const void *ap, const void *bp)
             tb_page_addr1(a) == tb_page_addr1(b));
 }
 
+/*
+ * Per-page count of writes that invalidated translated code, to find
+ * the pages on which guests keep modifying code that QEMU translates.
+ */
+#define TB_WRITE_PAGES_MAX  4096
+
+typedef struct TBWritePage {
+    uint64_t page;
+    uint64_t writes;
+    uint64_t tbs;
+} TBWritePage;
+
+static QemuMutex tb_write_pages_lock;
+static GHashTable *tb_write_pages;
+
 void tb_htable_init(void)
 {
     unsigned int mode = QHT_MODE_AUTO_RESIZE;
 
     qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
+
+    qemu_mutex_init(&tb_write_pages_lock);
+    tb_write_pages = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                           NULL, g_free);
+}
+
+/* Account a write to @page that invalidated @ntbs TBs. */
+static void tb_count_write(tb_page_addr_t page, unsigned ntbs)
+{
+    uint64_t key = page;
+    TBWritePage *wp;
+
+    trace_tb_invalidate_write(page, ntbs);
+    qatomic_set(&tb_ctx.tb_write_invalidate_count,
+                tb_ctx.tb_write_invalidate_count + ntbs);
+
+    qemu_mutex_lock(&tb_write_pages_lock);
+    wp = g_hash_table_lookup(tb_write_pages, &key);
+    if (!wp && g_hash_table_size(tb_write_pages) < TB_WRITE_PAGES_MAX) {
+        wp = g_new0(TBWritePage, 1);
+        wp->page = page;
+        g_hash_table_insert(tb_write_pages, &wp->page, wp);
+    }
+    if (wp) {
+        wp->writes++;
+        wp->tbs += ntbs;
+    }
+    qemu_mutex_unlock(&tb_write_pages_lock);
+}
+
+static gint tb_write_page_cmp(gconstpointer ap, gconstpointer bp)
+{
+    const TBWritePage *a = *(const TBWritePage **)ap;
+    const TBWritePage *b = *(const TBWritePage **)bp;
+
+    return a->writes < b->writes ? 1 : a->writes > b->writes ? -1 : 0;
+}
+
+void tb_dump_write_pages(GString *buf, unsigned max)
+{
+    g_autoptr(GPtrArray) pages = g_ptr_array_new_with_free_func(g_free);
+    GHashTableIter iter;
+    TBWritePage *wp;
+
+    qemu_mutex_lock(&tb_write_pages_lock);
+    g_hash_table_iter_init(&iter, tb_write_pages);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&wp)) {
+        g_ptr_array_add(pages, g_memdup2(wp, sizeof(*wp)));
+    }
+    qemu_mutex_unlock(&tb_write_pages_lock);
+
+    g_ptr_array_sort(pages, tb_write_page_cmp);
+    for (unsigned i = 0; i < pages->len && i < max; i++) {
+        wp = g_ptr_array_index(pages, i);
+        g_string_append_printf(buf, "  page 0x%016" PRIx64 " writes=%" PRIu64
+                               " TBs=%" PRIu64 "\n",
+                               wp->page, wp->writes, wp->tbs);
+    }
 }
 
 typedef struct PageDesc PageDesc;
@@ -81,10 +158,78 @@ static inline void tb_lock_pages(const TranslationBlock *tb) { }
  */
 static IntervalTreeRoot tb_root;
 
+/*
+ * Once a write makes a code page writable again, further writes to it
+ * are not seen, so all TBs on the page must be invalidated even if the
+ * write only hits one of them.  Instead of discarding them, park them
+ * together with a copy of their guest code: when the guest executes
+ * the same code again and it is unchanged, the TB is relinked instead
+ * of retranslated.  The generated code stays in the buffer until the
+ * next tb_flush(), which also drops all parked TBs.
+ */
+typedef struct TBParked {
+    IntervalTreeNode itree;
+    TranslationBlock *tb;
+    uint8_t code[];
+} TBParked;
+
+#define TB_PARKED_MAX_BYTES  (32 * MiB)
+
+static IntervalTreeRoot tb_parked_root;
+static size_t tb_parked_bytes;
+
+static void tb_unpark(TBParked *pk)
+{
+    interval_tree_remove(&pk->itree, &tb_parked_root);
+    tb_parked_bytes -= pk->tb->size;
+    g_free(pk);
+}
+
+static void tb_unpark_all(void)
+{
+    IntervalTreeNode *n;
+
+    while ((n = interval_tree_iter_first(&tb_parked_root, 0, -1))) {
+        tb_unpark(container_of(n, TBParked, itree));
+    }
+}
+
+/* Call with mmap_lock held, after invalidating @tb. */
+static void tb_park(TranslationBlock *tb)
+{
+    tb_page_addr_t start = tb_page_addr0(tb);
+    TBParked *pk;
+
+    assert_memory_lock();
+    if (tb_parked_bytes + tb->size > TB_PARKED_MAX_BYTES) {
+        return;
+    }
+
+    pk = g_malloc(sizeof(*pk) + tb->size);
+    pk->tb = tb;
+    memcpy(pk->code, g2h_untagged(start), tb->size);
+    pk->itree.start = start;
+    pk->itree.last = start + tb->size - 1;
+    interval_tree_insert(&pk->itree, &tb_parked_root);
+    tb_parked_bytes += tb->size;
+}
+
+static bool tb_parked_unchanged(TBParked *pk)
+{
+    TranslationBlock *tb = pk->tb;
+    tb_page_addr_t p1 = tb_page_addr1(tb);
+
+    if (p1 != -1 && !(page_get_flags(p1) & PAGE_EXEC)) {
+        return false;
+    }
+    return memcmp(g2h_untagged(tb_page_addr0(tb)), pk->code, tb->size) == 0;
+}
+
 static void tb_remove_all(void)
 {
     assert_memory_lock();
     memset(&tb_root, 0, sizeof(tb_root));
+    tb_unpark_all();
 }
 
 /* Call with mmap_lock held. */
@@ -1017,20 +1162,6 @@ void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t last)
     }
 }
 
-/*
- * Invalidate all TBs which intersect with the target address page @addr.
- * Called with mmap_lock held for user-mode emulation
- * NOTE: this function must not be called while a TB is running.
- */
-static void tb_invalidate_phys_page(tb_page_addr_t addr)
-{
-    tb_page_addr_t start, last;
-
-    start = addr & TARGET_PAGE_MASK;
-    last = addr | ~TARGET_PAGE_MASK;
-    tb_invalidate_phys_range(start, last);
-}
-
 /*
  * Called with mmap_lock held. If pc is not 0 then it indicates the
  * host PC of the faulting store instruction that caused this invalidate.
@@ -1040,30 +1171,27 @@ static void tb_invalidate_phys_page(tb_page_addr_t addr)
  */
 bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc)
 {
-    TranslationBlock *current_tb;
-    bool current_tb_modified;
+    TranslationBlock *current_tb = NULL;
+    bool current_tb_modified = false;
     TranslationBlock *tb;
     PageForEachNext n;
     tb_page_addr_t last;
+    unsigned ntbs = 0;
+
+    assert_memory_lock();
 
     /*
      * Without precise smc semantics, or when outside of a TB,
-     * we can skip to invalidate.
+     * there is no current TB to stop.
      */
-#ifndef TARGET_HAS_PRECISE_SMC
-    pc = 0;
-#endif
-    if (!pc) {
-        tb_invalidate_phys_page(addr);
-        return false;
+#ifdef TARGET_HAS_PRECISE_SMC
+    if (pc) {
+        current_tb = tcg_tb_lookup(pc);
     }
-
-    assert_memory_lock();
-    current_tb = tcg_tb_lookup(pc);
+#endif
 
     last = addr | ~TARGET_PAGE_MASK;
     addr &= TARGET_PAGE_MASK;
-    current_tb_modified = false;
 
     PAGE_FOR_EACH_TB(addr, last, unused, tb, n) {
         if (current_tb == tb &&
@@ -1079,6 +1207,11 @@ bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc)
             cpu_restore_state_from_tb(current_cpu, current_tb, pc);
         }
         tb_phys_invalidate__locked(tb);
+        tb_park(tb);
+        ntbs++;
+    }
+    if (ntbs) {
+        tb_count_write(addr, ntbs);
     }
 
     if (current_tb_modified) {
@@ -1089,6 +1222,98 @@ bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc)
     }
     return false;
 }
+
+/*
+ * Relink a TB parked by tb_invalidate_phys_page_unwind() for the given
+ * lookup key, if its guest code is unchanged.  Called with mmap_lock held
+ * from tb_gen_code(); returns NULL if the block must be translated.
+ */
+TranslationBlock *tb_revive(CPUState *cpu, tb_page_addr_t phys_pc,
+                            vaddr pc, uint64_t cs_base,
+                            uint32_t flags, uint32_t cflags)
+{
+    IntervalTreeNode *node, *next;
+
+    assert_memory_lock();
+
+#ifdef CONFIG_PLUGIN
+    /* Plugins expect to instrument every translation. */
+    if (cpu->plugin_state &&
+        test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                 cpu->plugin_state->event_mask)) {
+        return NULL;
+    }
+#endif
+
+    for (node = interval_tree_iter_first(&tb_parked_root, phys_pc, phys_pc);
+         node; node = next) {
+        TBParked *pk = container_of(node, TBParked, itree);
+        TranslationBlock *tb = pk->tb, *existing_tb;
+        tb_page_addr_t p1 = tb_page_addr1(tb);
+        bool unchanged;
+
+        next = interval_tree_iter_next(node, phys_pc, phys_pc);
+        if (tb_page_addr0(tb) != phys_pc ||
+            (!(cflags & CF_PCREL) && tb->pc != pc) ||
+            tb->cs_base != cs_base ||
+            tb->flags != flags ||
+            (tb_cflags(tb) & ~CF_INVALID) != cflags) {
+            continue;
+        }
+
+        /*
+         * tb_lock_page0/1 call page_protect() for user-only, so the pages
+         * are read-only before they are compared, as in translator_loop().
+         * A store after this point faults and invalidates the block again
+         * under mmap_lock; a store before it is caught by the compare.
+         */
+        tb_lock_page0(phys_pc);
+        if (p1 != -1) {
+            tb_lock_page1(phys_pc, p1);
+        }
+        unchanged = tb_parked_unchanged(pk);
+        tb_unpark(pk);
+        if (!unchanged) {
+            continue;
+        }
+
+        /*
+         * The outgoing jumps were only removed from the destination's
+         * list on invalidation, so reset them now.  jmp_dest[] keeps its
+         * LSB set until the TB is linked, so that they stay unchained.
+         */
+        if (tb->jmp_reset_offset[0] != TB_JMP_OFFSET_INVALID) {
+            tb_reset_jump(tb, 0);
+        }
+        if (tb->jmp_reset_offset[1] != TB_JMP_OFFSET_INVALID) {
+            tb_reset_jump(tb, 1);
+        }
+        for (int i = 0; i < ARRAY_SIZE(tb->jmp_ind_pc); i++) {
+            qatomic_set(&tb->jmp_ind_pc[i][1], 0);
+            qatomic_set(&tb->jmp_ind_pc[i][0], 0);
+        }
+
+        qemu_spin_lock(&tb->jmp_lock);
+        qatomic_set(&tb->cflags, tb->cflags & ~CF_INVALID);
+        qemu_spin_unlock(&tb->jmp_lock);
+
+        existing_tb = tb_link_page(tb);
+        if (unlikely(existing_tb != tb)) {
+            /* Another thread translated the same block meanwhile. */
+            qemu_spin_lock(&tb->jmp_lock);
+            qatomic_set(&tb->cflags, tb->cflags | CF_INVALID);
+            qemu_spin_unlock(&tb->jmp_lock);
+            tb_jmp_unlink(tb);
+            return existing_tb;
+        }
+        qatomic_set(&tb->jmp_dest[0], (uintptr_t)NULL);
+        qatomic_set(&tb->jmp_dest[1], (uintptr_t)NULL);
+
+        trace_tb_revive(tb, phys_pc);
+        return tb;
+    }
+    return NULL;
+}
 #else
 /*
  * @p must be non-NULL.
@@ -1102,6 +1327,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 {
     TranslationBlock *tb;
     PageForEachNext n;
+    unsigned ntbs = 0;
 #ifdef TARGET_HAS_PRECISE_SMC
     bool current_tb_modified = false;
     TranslationBlock *current_tb = retaddr ? tcg_tb_lookup(retaddr) : NULL;
@@ -1142,8 +1368,12 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
             }
 #endif /* TARGET_HAS_PRECISE_SMC */
             tb_phys_invalidate__locked(tb);
+            ntbs++;
         }
     }
+    if (ntbs) {
+        tb_count_write(start & TARGET_PAGE_MASK, ntbs);
+    }
 
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
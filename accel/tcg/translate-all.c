@@ -305,6 +305,15 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         /* Generate a one-shot TB with 1 insn in it */
         cflags = (cflags & ~CF_COUNT_MASK) | 1;
     }
+#ifdef CONFIG_USER_ONLY
+    if (phys_pc != -1) {
+        /* Reuse an invalidated translation if its code is unchanged. */
+        tb = tb_revive(cpu, phys_pc, pc, cs_base, flags, cflags);
+        if (tb) {
+            return tb;
+        }
+    }
+#endif
 
     max_insns = cflags & CF_COUNT_MASK;
     if (max_insns == 0) {
@@ -434,6 +443,18 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
      */
     perf_report_code(pc, tb, tcg_splitwx_to_rx(gen_code_buf));
 
+    if (qemu_loglevel_mask(CPU_LOG_TB_REGALLOC) &&
+        qemu_log_in_addr_range(pc)) {
+        FILE *logfile = qemu_log_trylock();
+        if (logfile) {
+            fprintf(logfile, "REGALLOC: pc=0x%016" VADDR_PRIx " insns=%d"
+                    " size=%d spills=%u fills=%u\n",
+                    pc, tb->icount, gen_code_size,
+                    tcg_ctx->nb_spills, tcg_ctx->nb_fills);
+            qemu_log_unlock(logfile);
+        }
+    }
+
     if (qemu_loglevel_mask(CPU_LOG_TB_OUT_ASM) &&
         qemu_log_in_addr_range(pc)) {
         FILE *logfile = qemu_log_trylock();
@@ -518,6 +539,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->jmp_list_next[1] = (uintptr_t)NULL;
     tb->jmp_dest[0] = (uintptr_t)NULL;
     tb->jmp_dest[1] = (uintptr_t)NULL;
+    memset(tb->jmp_ind_pc, 0, sizeof(tb->jmp_ind_pc));
 
     /* init original jump addresses which have been set during tcg_gen_code() */
     if (tb->jmp_reset_offset[0] != TB_JMP_OFFSET_INVALID) {
@@ -23,6 +23,7 @@
 #include "tcg/tcg.h"
 #include "qemu/bitops.h"
 #include "qemu/rcu.h"
+#include "qemu/seqlock.h"
 #include "exec/cpu_ldst.h"
 #include "qemu/main-loop.h"
 #include "exec/translate-all.h"
@@ -154,6 +155,17 @@ typedef struct PageFlagsNode {
 
 static IntervalTreeRoot pageflags_root;
 
+/*
+ * Lockless lookups in pageflags_root can have false negatives while the tree
+ * is being modified.  Writers hold the mmap lock and bump this around every
+ * modification, so that readers can tell whether a negative result can be
+ * trusted without taking the mmap lock themselves.
+ */
+static QemuSeqLock pageflags_seqlock;
+
+/* Lockless attempts before page flag lookups fall back to the mmap lock */
+#define PAGEFLAGS_LOCKLESS_RETRIES  4
+
 static PageFlagsNode *pageflags_find(target_ulong start, target_ulong last)
 {
     IntervalTreeNode *n;
@@ -217,15 +229,25 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageFlagsNode *p = pageflags_find(address, address);
+    PageFlagsNode *p;
+    int i;
 
     /*
      * See util/interval-tree.c re lockless lookups: no false positives but
-     * there are false negatives.  If we find nothing, retry with the mmap
-     * lock acquired.
+     * there are false negatives.  If we find nothing, the result is only
+     * correct if the tree was not modified meanwhile; otherwise retry, and
+     * eventually take the mmap lock.
      */
-    if (p) {
-        return p->flags;
+    for (i = 0; i < PAGEFLAGS_LOCKLESS_RETRIES; i++) {
+        unsigned seq = seqlock_read_begin(&pageflags_seqlock);
+
+        p = pageflags_find(address, address);
+        if (p) {
+            return p->flags;
+        }
+        if (!seqlock_read_retry(&pageflags_seqlock, seq)) {
+            return 0;
+        }
     }
     if (have_mmap_lock()) {
         return 0;
@@ -237,6 +259,52 @@ int page_get_flags(target_ulong address)
     return p ? p->flags : 0;
 }
 
+/*
+ * A subroutine of page_get_flags_range: Return the union of the flags of
+ * [start,last], or -1 if part of the range is unmapped.
+ */
+static int pageflags_union(target_ulong start, target_ulong last)
+{
+    int flags = 0;
+
+    while (true) {
+        PageFlagsNode *p = pageflags_find(start, last);
+
+        if (!p || p->itree.start > start) {
+            return -1;
+        }
+        flags |= p->flags;
+        if (p->itree.last >= last) {
+            return flags;
+        }
+        start = p->itree.last + 1;
+    }
+}
+
+int page_get_flags_range(target_ulong start, target_ulong last)
+{
+    int i, flags;
+
+    assert(start <= last);
+
+    /* Nodes are freed with RCU, see pageflags_unset() */
+    RCU_READ_LOCK_GUARD();
+
+    for (i = 0; i < PAGEFLAGS_LOCKLESS_RETRIES; i++) {
+        unsigned seq = seqlock_read_begin(&pageflags_seqlock);
+
+        flags = pageflags_union(start, last);
+        if (!seqlock_read_retry(&pageflags_seqlock, seq)) {
+            return flags;
+        }
+    }
+
+    mmap_lock();
+    flags = pageflags_union(start, last);
+    mmap_unlock();
+    return flags;
+}
+
 /* A subroutine of page_set_flags: insert a new node for [start,last]. */
 static void pageflags_create(target_ulong start, target_ulong last, int flags)
 {
@@ -514,12 +582,16 @@ void page_set_flags(target_ulong start, target_ulong last, int flags)
 
     if (!flags || reset) {
         page_reset_target_data(start, last);
+    }
+    seqlock_write_begin(&pageflags_seqlock);
+    if (!flags || reset) {
         inval_tb |= pageflags_unset(start, last);
     }
     if (flags) {
         inval_tb |= pageflags_set_clear(start, last, flags,
                                         ~(reset ? 0 : PAGE_STICKY));
     }
+    seqlock_write_end(&pageflags_seqlock);
     if (inval_tb) {
         tb_invalidate_phys_range(start, last);
     }
@@ -542,14 +614,15 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
 
     locked = have_mmap_lock();
     while (true) {
+        unsigned seq = seqlock_read_begin(&pageflags_seqlock);
         PageFlagsNode *p = pageflags_find(start, last);
         int missing;
 
         if (!p) {
-            if (!locked) {
+            if (!locked && seqlock_read_retry(&pageflags_seqlock, seq)) {
                 /*
-                 * Lockless lookups have false negatives.
-                 * Retry with the lock held.
+                 * Lockless lookups have false negatives while the tree
+                 * is being modified.  Retry with the lock held.
                  */
                 mmap_lock();
                 locked = -1;
@@ -683,7 +756,9 @@ void page_protect(tb_page_addr_t address)
     }
 
     if (prot & PAGE_WRITE) {
+        seqlock_write_begin(&pageflags_seqlock);
         pageflags_set_clear(start, last, 0, PAGE_WRITE);
+        seqlock_write_end(&pageflags_seqlock);
         mprotect(g2h_untagged(start), last - start + 1,
                  prot & (PAGE_READ | PAGE_EXEC) ? PROT_READ : PROT_NONE);
     }
@@ -738,7 +813,9 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             start = address & TARGET_PAGE_MASK;
             len = TARGET_PAGE_SIZE;
             prot = p->flags | PAGE_WRITE;
+            seqlock_write_begin(&pageflags_seqlock);
             pageflags_set_clear(start, start + len - 1, PAGE_WRITE, 0);
+            seqlock_write_end(&pageflags_seqlock);
             current_tb_invalidated = tb_invalidate_phys_page_unwind(start, pc);
         } else {
             start = address & -host_page_size;
@@ -753,8 +830,10 @@ int page_unprotect(target_ulong address, uintptr_t pc)
                     prot |= p->flags;
                     if (p->flags & PAGE_WRITE_ORG) {
                         prot |= PAGE_WRITE;
+                        seqlock_write_begin(&pageflags_seqlock);
                         pageflags_set_clear(addr, addr + TARGET_PAGE_SIZE - 1,
                                             PAGE_WRITE, 0);
+                        seqlock_write_end(&pageflags_seqlock);
                     }
                 }
                 /*
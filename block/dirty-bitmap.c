@@ -29,6 +29,9 @@
 #include "block/blockjob.h"
 #include "block/dirty-bitmap.h"
 #include "qemu/main-loop.h"
+#include "qemu/coroutine-tls.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
 
 struct BdrvDirtyBitmap {
     BlockDriverState *bs;
@@ -71,6 +74,150 @@ static inline void bdrv_dirty_bitmaps_unlock(BlockDriverState *bs)
     qemu_mutex_unlock(&bs->dirty_bitmap_mutex);
 }
 
+/*
+ * Writes tend to hit areas that are already dirty in every enabled bitmap,
+ * and taking dirty_bitmap_mutex for them makes iothreads writing to the same
+ * node contend for nothing.  Each thread therefore remembers the chunks it
+ * recently dirtied in a small direct-mapped table.  A chunk is the smallest
+ * granularity of the enabled bitmaps, so dirtying any byte of it has set the
+ * bit covering it in all of them.
+ *
+ * Entries are tagged with bs->dirty_bitmap_gen.  Generations are unique
+ * across all nodes and are never reused, and the generation of a node changes
+ * before any of its enabled bitmaps can lose bits, so stale entries simply
+ * stop matching.  The low bits of the generation hold the chunk size.
+ */
+#define DIRTY_FILTER_CHUNK_BITS 6
+#define DIRTY_FILTER_CHUNK_MASK ((1 << DIRTY_FILTER_CHUNK_BITS) - 1)
+#define DIRTY_FILTER_HASH_BITS 9
+#define DIRTY_FILTER_ENTRIES (1 << DIRTY_FILTER_HASH_BITS)
+/* Larger writes are not worth looking up chunk by chunk */
+#define DIRTY_FILTER_MAX_CHUNKS 8
+
+typedef struct {
+    uint64_t gen;
+    uint64_t chunk;
+} DirtyFilterEntry;
+
+/* Per-thread state */
+typedef struct {
+    DirtyFilterEntry *entries;
+} DirtyFilterThreadState;
+
+/* Use get_ptr_dirty_filter_thread_state() to fetch this thread-local value */
+QEMU_DEFINE_STATIC_CO_TLS(DirtyFilterThreadState, dirty_filter_thread_state);
+
+/* This won't involve coroutines, so use __thread */
+static __thread Notifier dirty_filter_atexit_notifier;
+
+/* Last generation handed out, shifted by DIRTY_FILTER_CHUNK_BITS */
+static uint64_t dirty_bitmap_gen;
+
+/* Called at thread cleanup time */
+static void dirty_filter_atexit(Notifier *n, void *value)
+{
+    DirtyFilterThreadState *thread_state = get_ptr_dirty_filter_thread_state();
+    g_free(thread_state->entries);
+    thread_state->entries = NULL;
+}
+
+static inline DirtyFilterEntry *dirty_filter_entry(DirtyFilterEntry *entries,
+                                                   uint64_t gen, uint64_t chunk)
+{
+    uint64_t hash = (chunk ^ gen) * 0x9e3779b97f4a7c15ULL;
+    return &entries[hash >> (64 - DIRTY_FILTER_HASH_BITS)];
+}
+
+/*
+ * Return true if this thread has dirtied the whole range at generation @gen.
+ */
+static bool dirty_filter_lookup(uint64_t gen, int64_t offset, int64_t bytes)
+{
+    DirtyFilterThreadState *thread_state = get_ptr_dirty_filter_thread_state();
+    int chunk_bits = gen & DIRTY_FILTER_CHUNK_MASK;
+    uint64_t first = offset >> chunk_bits;
+    uint64_t last = (offset + bytes - 1) >> chunk_bits;
+    uint64_t chunk;
+
+    if (!thread_state->entries || last - first >= DIRTY_FILTER_MAX_CHUNKS) {
+        return false;
+    }
+
+    for (chunk = first; chunk <= last; chunk++) {
+        DirtyFilterEntry *e = dirty_filter_entry(thread_state->entries,
+                                                 gen, chunk);
+        if (e->gen != gen || e->chunk != chunk) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void dirty_filter_record(uint64_t gen, int64_t offset, int64_t bytes)
+{
+    DirtyFilterThreadState *thread_state = get_ptr_dirty_filter_thread_state();
+    int chunk_bits = gen & DIRTY_FILTER_CHUNK_MASK;
+    uint64_t first = offset >> chunk_bits;
+    uint64_t last = (offset + bytes - 1) >> chunk_bits;
+    uint64_t chunk;
+
+    if (last - first >= DIRTY_FILTER_MAX_CHUNKS) {
+        return;
+    }
+
+    if (!thread_state->entries) {
+        thread_state->entries = g_new0(DirtyFilterEntry, DIRTY_FILTER_ENTRIES);
+        dirty_filter_atexit_notifier.notify = dirty_filter_atexit;
+        qemu_thread_atexit_add(&dirty_filter_atexit_notifier);
+    }
+
+    for (chunk = first; chunk <= last; chunk++) {
+        DirtyFilterEntry *e = dirty_filter_entry(thread_state->entries,
+                                                 gen, chunk);
+        e->gen = gen;
+        e->chunk = chunk;
+    }
+}
+
+/*
+ * Invalidate what threads remember about dirty areas of @bs.  Must be called
+ * before an enabled bitmap of @bs may lose dirty bits, and when a bitmap of
+ * @bs starts recording writes.
+ *
+ * Called within bdrv_dirty_bitmaps_lock..unlock.
+ */
+static void bdrv_dirty_bitmaps_changed(BlockDriverState *bs)
+{
+    /* Without 64-bit atomics, the fast path stays disabled */
+#ifdef CONFIG_ATOMIC64
+    BdrvDirtyBitmap *bm;
+    int chunk_bits = DIRTY_FILTER_CHUNK_MASK;
+    uint64_t gen;
+
+    QLIST_FOREACH(bm, &bs->dirty_bitmaps, list) {
+        if (!bm->disabled) {
+            chunk_bits = MIN(chunk_bits, hbitmap_granularity(bm->bitmap));
+        }
+    }
+
+    gen = qatomic_fetch_add(&dirty_bitmap_gen, 1 << DIRTY_FILTER_CHUNK_BITS);
+    gen += 1 << DIRTY_FILTER_CHUNK_BITS;
+    qatomic_set(&bs->dirty_bitmap_gen, gen | chunk_bits);
+
+    /* Pairs with smp_mb() in bdrv_set_dirty() */
+    smp_mb();
+#endif
+}
+
+static inline uint64_t bdrv_dirty_bitmaps_gen(BlockDriverState *bs)
+{
+#ifdef CONFIG_ATOMIC64
+    return qatomic_read(&bs->dirty_bitmap_gen);
+#else
+    return 0;
+#endif
+}
+
 void bdrv_dirty_bitmap_lock(BdrvDirtyBitmap *bitmap)
 {
     bdrv_dirty_bitmaps_lock(bitmap->bs);
@@ -130,6 +277,7 @@ BdrvDirtyBitmap *bdrv_create_dirty_bitmap(BlockDriverState *bs,
     bitmap->disabled = false;
     bdrv_dirty_bitmaps_lock(bs);
     QLIST_INSERT_HEAD(&bs->dirty_bitmaps, bitmap, list);
+    bdrv_dirty_bitmaps_changed(bs);
     bdrv_dirty_bitmaps_unlock(bs);
     return bitmap;
 }
@@ -242,6 +390,7 @@ int bdrv_dirty_bitmap_create_successor(BdrvDirtyBitmap *bitmap, Error **errp)
 void bdrv_enable_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap)
 {
     bitmap->disabled = false;
+    bdrv_dirty_bitmaps_changed(bitmap->bs);
 }
 
 /* Called with BQL taken. */
@@ -260,6 +409,7 @@ static void bdrv_release_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap)
     assert(!bdrv_dirty_bitmap_busy(bitmap));
     assert(!bdrv_dirty_bitmap_has_successor(bitmap));
     QLIST_REMOVE(bitmap, list);
+    bdrv_dirty_bitmaps_changed(bitmap->bs);
     hbitmap_free(bitmap->bitmap);
     g_free(bitmap->name);
     g_free(bitmap);
@@ -317,6 +467,7 @@ BdrvDirtyBitmap *bdrv_reclaim_dirty_bitmap_locked(BdrvDirtyBitmap *parent,
     parent->busy = false;
     bdrv_release_dirty_bitmap_locked(successor);
     parent->successor = NULL;
+    bdrv_dirty_bitmaps_changed(parent->bs);
 
     return parent;
 }
@@ -350,6 +501,7 @@ void bdrv_dirty_bitmap_truncate(BlockDriverState *bs, int64_t bytes)
         hbitmap_truncate(bitmap->bitmap, bytes);
         bitmap->size = bytes;
     }
+    bdrv_dirty_bitmaps_changed(bs);
     bdrv_dirty_bitmaps_unlock(bs);
 }
 
@@ -560,6 +712,9 @@ void bdrv_reset_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap,
                                     int64_t offset, int64_t bytes)
 {
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
+    if (!bitmap->disabled) {
+        bdrv_dirty_bitmaps_changed(bitmap->bs);
+    }
     hbitmap_reset(bitmap->bitmap, offset, bytes);
 }
 
@@ -576,6 +731,9 @@ void bdrv_clear_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap **out)
     IO_CODE();
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
     bdrv_dirty_bitmaps_lock(bitmap->bs);
+    if (!bitmap->disabled) {
+        bdrv_dirty_bitmaps_changed(bitmap->bs);
+    }
     if (!out) {
         hbitmap_reset_all(bitmap->bitmap);
     } else {
@@ -592,7 +750,12 @@ void bdrv_restore_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap *backup)
     HBitmap *tmp = bitmap->bitmap;
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
     GLOBAL_STATE_CODE();
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    if (!bitmap->disabled) {
+        bdrv_dirty_bitmaps_changed(bitmap->bs);
+    }
     bitmap->bitmap = backup;
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
     hbitmap_free(tmp);
 }
 
@@ -627,10 +790,24 @@ void bdrv_dirty_bitmap_serialize_part(const BdrvDirtyBitmap *bitmap,
     hbitmap_serialize_part(bitmap->bitmap, buf, offset, bytes);
 }
 
+/*
+ * Deserializing may clear bits, which bdrv_set_dirty() must not miss if
+ * @bitmap is enabled.
+ */
+static void bdrv_dirty_bitmap_invalidate(BdrvDirtyBitmap *bitmap)
+{
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    if (!bitmap->disabled) {
+        bdrv_dirty_bitmaps_changed(bitmap->bs);
+    }
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
+}
+
 void bdrv_dirty_bitmap_deserialize_part(BdrvDirtyBitmap *bitmap,
                                         uint8_t *buf, uint64_t offset,
                                         uint64_t bytes, bool finish)
 {
+    bdrv_dirty_bitmap_invalidate(bitmap);
     hbitmap_deserialize_part(bitmap->bitmap, buf, offset, bytes, finish);
 }
 
@@ -638,6 +815,7 @@ void bdrv_dirty_bitmap_deserialize_zeroes(BdrvDirtyBitmap *bitmap,
                                           uint64_t offset, uint64_t bytes,
                                           bool finish)
 {
+    bdrv_dirty_bitmap_invalidate(bitmap);
     hbitmap_deserialize_zeroes(bitmap->bitmap, offset, bytes, finish);
 }
 
@@ -656,9 +834,21 @@ void bdrv_dirty_bitmap_deserialize_finish(BdrvDirtyBitmap *bitmap)
 void bdrv_set_dirty(BlockDriverState *bs, int64_t offset, int64_t bytes)
 {
     BdrvDirtyBitmap *bitmap;
+    uint64_t gen;
     IO_CODE();
 
-    if (QLIST_EMPTY(&bs->dirty_bitmaps)) {
+    if (QLIST_EMPTY(&bs->dirty_bitmaps) || bytes <= 0) {
+        return;
+    }
+
+    /*
+     * Order the write that is being recorded before reading the generation,
+     * so that a concurrent bdrv_dirty_bitmaps_changed() either sees the
+     * write when it looks at the data or makes us take the lock.
+     */
+    smp_mb();
+    gen = bdrv_dirty_bitmaps_gen(bs);
+    if (gen && dirty_filter_lookup(gen, offset, bytes)) {
         return;
     }
 
@@ -670,7 +860,12 @@ void bdrv_set_dirty(BlockDriverState *bs, int64_t offset, int64_t bytes)
         assert(!bdrv_dirty_bitmap_readonly(bitmap));
         hbitmap_set(bitmap->bitmap, offset, bytes);
     }
+    gen = bs->dirty_bitmap_gen;
     bdrv_dirty_bitmaps_unlock(bs);
+
+    if (gen) {
+        dirty_filter_record(gen, offset, bytes);
+    }
 }
 
 /**
@@ -19,6 +19,7 @@
 #define FUSE_USE_VERSION 31
 
 #include "qemu/osdep.h"
+#include "qemu/coroutine.h"
 #include "qemu/memalign.h"
 #include "block/aio.h"
 #include "block/block_int-common.h"
@@ -29,6 +30,7 @@
 #include "qapi/qapi-commands-block.h"
 #include "qemu/main-loop.h"
 #include "sysemu/block-backend.h"
+#include "sysemu/iothread.h"
 
 #include <fuse.h>
 #include <fuse_lowlevel.h>
@@ -44,14 +46,43 @@
 /* Prevent overly long bounce buffer allocations */
 #define FUSE_MAX_BOUNCE_BYTES (MIN(BDRV_REQUEST_MAX_BYTES, 64 * 1024 * 1024))
 
+/* How many request buffers a queue keeps around for reuse */
+#define FUSE_MAX_SPARE_BUFS 16
 
-typedef struct FuseExport {
+typedef struct FuseExport FuseExport;
+
+/*
+ * A queue reads requests from the FUSE device in one AioContext.  All queues
+ * of an export share the session fd: the kernel hands every request to
+ * exactly one reader, and the reply is written to the same fd.
+ */
+typedef struct FuseQueue {
+    FuseExport *exp;
+    AioContext *ctx;
+    bool fd_handler_set_up;
+
+    /* Request buffers allocated by libfuse, only accessed from @ctx */
+    void *spare_bufs[FUSE_MAX_SPARE_BUFS];
+    unsigned int nb_spare_bufs;
+} FuseQueue;
+
+/* A request that is being processed in its own coroutine */
+typedef struct FuseRequest {
+    FuseQueue *q;
+    struct fuse_buf buf;
+} FuseRequest;
+
+struct FuseExport {
     BlockExport common;
 
     struct fuse_session *fuse_session;
-    struct fuse_buf fuse_buf;
     unsigned int in_flight; /* atomic */
-    bool mounted, fd_handler_set_up;
+    bool mounted;
+
+    FuseQueue *queues;
+    size_t num_queues;
+    /* Whether the queues run in user-specified iothreads */
+    bool iothreads;
 
     char *mountpoint;
     bool writable;
@@ -62,7 +93,7 @@ typedef struct FuseExport {
     mode_t st_mode;
     uid_t st_uid;
     gid_t st_gid;
-} FuseExport;
+};
 
 static GHashTable *exports;
 static const struct fuse_lowlevel_ops fuse_ops;
@@ -74,7 +105,8 @@ static void init_exports_table(void);
 
 static int setup_fuse_export(FuseExport *exp, const char *mountpoint,
                              bool allow_other, Error **errp);
-static void read_from_fuse_export(void *opaque);
+static void fuse_queue_attach(FuseQueue *q);
+static void fuse_queue_detach(FuseQueue *q);
 
 static bool is_regular_file(const char *path, Error **errp);
 
@@ -82,24 +114,27 @@ static bool is_regular_file(const char *path, Error **errp);
 static void fuse_export_drained_begin(void *opaque)
 {
     FuseExport *exp = opaque;
+    size_t i;
 
-    aio_set_fd_handler(exp->common.ctx,
-                       fuse_session_fd(exp->fuse_session),
-                       NULL, NULL, NULL, NULL, NULL);
-    exp->fd_handler_set_up = false;
+    for (i = 0; i < exp->num_queues; i++) {
+        fuse_queue_detach(&exp->queues[i]);
+    }
 }
 
 static void fuse_export_drained_end(void *opaque)
 {
     FuseExport *exp = opaque;
+    size_t i;
 
     /* Refresh AioContext in case it changed */
     exp->common.ctx = blk_get_aio_context(exp->common.blk);
+    if (!exp->iothreads) {
+        exp->queues[0].ctx = exp->common.ctx;
+    }
 
-    aio_set_fd_handler(exp->common.ctx,
-                       fuse_session_fd(exp->fuse_session),
-                       read_from_fuse_export, NULL, NULL, NULL, exp);
-    exp->fd_handler_set_up = true;
+    for (i = 0; i < exp->num_queues; i++) {
+        fuse_queue_attach(&exp->queues[i]);
+    }
 }
 
 static bool fuse_export_drained_poll(void *opaque)
@@ -147,6 +182,32 @@ static int fuse_export_create(BlockExport *blk_exp,
      */
     blk_set_disable_request_queuing(exp->common.blk, true);
 
+    if (args->iothreads) {
+        strList *e;
+        size_t i = 0;
+
+        exp->num_queues = QAPI_LIST_LENGTH(args->iothreads);
+        exp->queues = g_new0(FuseQueue, exp->num_queues);
+        for (e = args->iothreads; e; e = e->next) {
+            IOThread *iothread = iothread_by_id(e->value);
+
+            if (!iothread) {
+                error_setg(errp, "iothread \"%s\" not found", e->value);
+                ret = -EINVAL;
+                goto fail;
+            }
+            exp->queues[i].exp = exp;
+            exp->queues[i].ctx = iothread_get_aio_context(iothread);
+            i++;
+        }
+        exp->iothreads = true;
+    } else {
+        exp->num_queues = 1;
+        exp->queues = g_new0(FuseQueue, 1);
+        exp->queues[0].exp = exp;
+        exp->queues[0].ctx = exp->common.ctx;
+    }
+
     init_exports_table();
 
     /*
@@ -234,6 +295,7 @@ static int setup_fuse_export(FuseExport *exp, const char *mountpoint,
     const char *fuse_argv[4];
     char *mount_opts;
     struct fuse_args fuse_args;
+    size_t i;
     int ret;
 
     /*
@@ -269,10 +331,20 @@ static int setup_fuse_export(FuseExport *exp, const char *mountpoint,
 
     g_hash_table_insert(exports, g_strdup(mountpoint), NULL);
 
-    aio_set_fd_handler(exp->common.ctx,
-                       fuse_session_fd(exp->fuse_session),
-                       read_from_fuse_export, NULL, NULL, NULL, exp);
-    exp->fd_handler_set_up = true;
+    /*
+     * With several queues, all but one of them find nothing to read when a
+     * request comes in.  They must not block then.
+     */
+    if (!g_unix_set_fd_nonblocking(fuse_session_fd(exp->fuse_session), true,
+                                   NULL)) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Failed to make FUSE fd non-blocking");
+        goto fail;
+    }
+
+    for (i = 0; i < exp->num_queues; i++) {
+        fuse_queue_attach(&exp->queues[i]);
+    }
 
     return 0;
 
@@ -281,48 +353,118 @@ fail:
     return ret;
 }
 
+/**
+ * Take a request buffer from @q's spare buffers.  Returns NULL if there is
+ * none, in which case libfuse allocates a new one.
+ */
+static void *fuse_queue_get_buf(FuseQueue *q)
+{
+    if (!q->nb_spare_bufs) {
+        return NULL;
+    }
+    return q->spare_bufs[--q->nb_spare_bufs];
+}
+
+/**
+ * Give a request buffer back to @q for reuse.
+ */
+static void fuse_queue_put_buf(FuseQueue *q, void *buf)
+{
+    if (q->nb_spare_bufs < FUSE_MAX_SPARE_BUFS) {
+        q->spare_bufs[q->nb_spare_bufs++] = buf;
+    } else {
+        free(buf);
+    }
+}
+
+static void fuse_export_request_done(FuseExport *exp)
+{
+    if (qatomic_fetch_dec(&exp->in_flight) == 1) {
+        aio_wait_kick(); /* wake AIO_WAIT_WHILE() */
+    }
+
+    blk_exp_unref(&exp->common);
+}
+
+/**
+ * Process a single request.  The request handlers run in this coroutine, so
+ * they can wait for I/O while the queue goes on receiving other requests.
+ */
+static void coroutine_fn fuse_co_process_request(void *opaque)
+{
+    FuseRequest *req = opaque;
+    FuseQueue *q = req->q;
+    FuseExport *exp = q->exp;
+
+    fuse_session_process_buf(exp->fuse_session, &req->buf);
+
+    fuse_queue_put_buf(q, req->buf.mem);
+    g_free(req);
+
+    fuse_export_request_done(exp);
+}
+
 /**
  * Callback to be invoked when the FUSE session FD can be read from.
  * (This is basically the FUSE event loop.)
  */
 static void read_from_fuse_export(void *opaque)
 {
-    FuseExport *exp = opaque;
+    FuseQueue *q = opaque;
+    FuseExport *exp = q->exp;
+    FuseRequest *req;
+    Coroutine *co;
     int ret;
 
     blk_exp_ref(&exp->common);
 
     qatomic_inc(&exp->in_flight);
 
+    req = g_new0(FuseRequest, 1);
+    req->q = q;
+    req->buf.mem = fuse_queue_get_buf(q);
+
     do {
-        ret = fuse_session_receive_buf(exp->fuse_session, &exp->fuse_buf);
+        ret = fuse_session_receive_buf(exp->fuse_session, &req->buf);
     } while (ret == -EINTR);
-    if (ret < 0) {
-        goto out;
+    if (ret <= 0) {
+        /* -EAGAIN means that another queue has picked up the request */
+        fuse_queue_put_buf(q, req->buf.mem);
+        g_free(req);
+        fuse_export_request_done(exp);
+        return;
     }
 
-    fuse_session_process_buf(exp->fuse_session, &exp->fuse_buf);
+    co = qemu_coroutine_create(fuse_co_process_request, req);
+    qemu_coroutine_enter(co);
+}
 
-out:
-    if (qatomic_fetch_dec(&exp->in_flight) == 1) {
-        aio_wait_kick(); /* wake AIO_WAIT_WHILE() */
-    }
+static void fuse_queue_attach(FuseQueue *q)
+{
+    aio_set_fd_handler(q->ctx, fuse_session_fd(q->exp->fuse_session),
+                       read_from_fuse_export, NULL, NULL, NULL, q);
+    q->fd_handler_set_up = true;
+}
 
-    blk_exp_unref(&exp->common);
+static void fuse_queue_detach(FuseQueue *q)
+{
+    if (q->fd_handler_set_up) {
+        aio_set_fd_handler(q->ctx, fuse_session_fd(q->exp->fuse_session),
+                           NULL, NULL, NULL, NULL, NULL);
+        q->fd_handler_set_up = false;
+    }
 }
 
 static void fuse_export_shutdown(BlockExport *blk_exp)
 {
     FuseExport *exp = container_of(blk_exp, FuseExport, common);
+    size_t i;
 
     if (exp->fuse_session) {
         fuse_session_exit(exp->fuse_session);
 
-        if (exp->fd_handler_set_up) {
-            aio_set_fd_handler(exp->common.ctx,
-                               fuse_session_fd(exp->fuse_session),
-                               NULL, NULL, NULL, NULL, NULL);
-            exp->fd_handler_set_up = false;
+        for (i = 0; i < exp->num_queues; i++) {
+            fuse_queue_detach(&exp->queues[i]);
         }
     }
 
@@ -338,6 +480,7 @@ static void fuse_export_shutdown(BlockExport *blk_exp)
 static void fuse_export_delete(BlockExport *blk_exp)
 {
     FuseExport *exp = container_of(blk_exp, FuseExport, common);
+    size_t i;
 
     if (exp->fuse_session) {
         if (exp->mounted) {
@@ -347,7 +490,14 @@ static void fuse_export_delete(BlockExport *blk_exp)
         fuse_session_destroy(exp->fuse_session);
     }
 
-    free(exp->fuse_buf.mem);
+    for (i = 0; i < exp->num_queues; i++) {
+        FuseQueue *q = &exp->queues[i];
+
+        while (q->nb_spare_bufs) {
+            free(q->spare_bufs[--q->nb_spare_bufs]);
+        }
+    }
+    g_free(exp->queues);
     g_free(exp->mountpoint);
 }
 
@@ -389,6 +539,11 @@ static void fuse_init(void *userdata, struct fuse_conn_info *conn)
     conn->max_read = FUSE_MAX_BOUNCE_BYTES;
 
     conn->max_write = MIN_NON_ZERO(BDRV_REQUEST_MAX_BYTES, conn->max_write);
+
+    /* Let fuse_reply_data() hand read data to the kernel with vmsplice() */
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE) {
+        conn->want |= FUSE_CAP_SPLICE_WRITE;
+    }
 }
 
 /**
@@ -403,21 +558,24 @@ static void fuse_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
 /**
  * Let clients get file attributes (i.e., stat() the file).
  */
-static void fuse_getattr(fuse_req_t req, fuse_ino_t inode,
-                         struct fuse_file_info *fi)
+static void coroutine_fn fuse_getattr(fuse_req_t req, fuse_ino_t inode,
+                                      struct fuse_file_info *fi)
 {
     struct stat statbuf;
     int64_t length, allocated_blocks;
     time_t now = time(NULL);
     FuseExport *exp = fuse_req_userdata(req);
 
-    length = blk_getlength(exp->common.blk);
+    GRAPH_RDLOCK_GUARD();
+
+    length = blk_co_getlength(exp->common.blk);
     if (length < 0) {
         fuse_reply_err(req, -length);
         return;
     }
 
-    allocated_blocks = bdrv_get_allocated_file_size(blk_bs(exp->common.blk));
+    allocated_blocks =
+        bdrv_co_get_allocated_file_size(blk_bs(exp->common.blk));
     if (allocated_blocks <= 0) {
         allocated_blocks = DIV_ROUND_UP(length, 512);
     } else {
@@ -441,48 +599,27 @@ static void fuse_getattr(fuse_req_t req, fuse_ino_t inode,
     fuse_reply_attr(req, &statbuf, 1.);
 }
 
-static int fuse_do_truncate(const FuseExport *exp, int64_t size,
-                            bool req_zero_write, PreallocMode prealloc)
+static int coroutine_fn fuse_do_truncate(const FuseExport *exp, int64_t size,
+                                         bool req_zero_write,
+                                         PreallocMode prealloc)
 {
-    uint64_t blk_perm, blk_shared_perm;
     BdrvRequestFlags truncate_flags = 0;
-    bool add_resize_perm;
-    int ret, ret_check;
 
-    /* Growable and writable exports have a permanent RESIZE permission */
-    add_resize_perm = !exp->growable && !exp->writable;
+    /*
+     * Growable and writable exports have a permanent RESIZE permission.
+     * Others cannot take it here because permissions can only be changed
+     * outside of coroutines.
+     */
+    if (!exp->growable && !exp->writable) {
+        return -EPERM;
+    }
 
     if (req_zero_write) {
         truncate_flags |= BDRV_REQ_ZERO_WRITE;
     }
 
-    if (add_resize_perm) {
-
-        if (!qemu_in_main_thread()) {
-            /* Changing permissions like below only works in the main thread */
-            return -EPERM;
-        }
-
-        blk_get_perm(exp->common.blk, &blk_perm, &blk_shared_perm);
-
-        ret = blk_set_perm(exp->common.blk, blk_perm | BLK_PERM_RESIZE,
-                           blk_shared_perm, NULL);
-        if (ret < 0) {
-            return ret;
-        }
-    }
-
-    ret = blk_truncate(exp->common.blk, size, true, prealloc,
-                       truncate_flags, NULL);
-
-    if (add_resize_perm) {
-        /* Must succeed, because we are only giving up the RESIZE permission */
-        ret_check = blk_set_perm(exp->common.blk, blk_perm,
-                                 blk_shared_perm, &error_abort);
-        assert(ret_check == 0);
-    }
-
-    return ret;
+    return blk_co_truncate(exp->common.blk, size, true, prealloc,
+                           truncate_flags, NULL);
 }
 
 /**
@@ -493,8 +630,9 @@ static int fuse_do_truncate(const FuseExport *exp, int64_t size,
  * without allow_other cannot be given a different UID or GID, and
  * they cannot be given non-owner access.
  */
-static void fuse_setattr(fuse_req_t req, fuse_ino_t inode, struct stat *statbuf,
-                         int to_set, struct fuse_file_info *fi)
+static void coroutine_fn fuse_setattr(fuse_req_t req, fuse_ino_t inode,
+                                      struct stat *statbuf, int to_set,
+                                      struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int supported_attrs;
@@ -573,8 +711,9 @@ static void fuse_open(fuse_req_t req, fuse_ino_t inode,
 /**
  * Handle client reads from the exported image.
  */
-static void fuse_read(fuse_req_t req, fuse_ino_t inode,
-                      size_t size, off_t offset, struct fuse_file_info *fi)
+static void coroutine_fn fuse_read(fuse_req_t req, fuse_ino_t inode,
+                                   size_t size, off_t offset,
+                                   struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int64_t length;
@@ -591,7 +730,7 @@ static void fuse_read(fuse_req_t req, fuse_ino_t inode,
      * Clients will expect short reads at EOF, so we have to limit
      * offset+size to the image length.
      */
-    length = blk_getlength(exp->common.blk);
+    length = blk_co_getlength(exp->common.blk);
     if (length < 0) {
         fuse_reply_err(req, -length);
         return;
@@ -607,9 +746,13 @@ static void fuse_read(fuse_req_t req, fuse_ino_t inode,
         return;
     }
 
-    ret = blk_pread(exp->common.blk, offset, size, buf, 0);
+    ret = blk_co_pread(exp->common.blk, offset, size, buf, 0);
     if (ret >= 0) {
-        fuse_reply_buf(req, buf, size);
+        /* Spliced if FUSE_CAP_SPLICE_WRITE was negotiated, copied otherwise */
+        struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(size);
+
+        bufv.buf[0].mem = buf;
+        fuse_reply_data(req, &bufv, 0);
     } else {
         fuse_reply_err(req, -ret);
     }
@@ -620,8 +763,9 @@ static void fuse_read(fuse_req_t req, fuse_ino_t inode,
 /**
  * Handle client writes to the exported image.
  */
-static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
-                       size_t size, off_t offset, struct fuse_file_info *fi)
+static void coroutine_fn fuse_write(fuse_req_t req, fuse_ino_t inode,
+                                    const char *buf, size_t size, off_t offset,
+                                    struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int64_t length;
@@ -642,7 +786,7 @@ static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
      * Clients will expect short writes at EOF, so we have to limit
      * offset+size to the image length.
      */
-    length = blk_getlength(exp->common.blk);
+    length = blk_co_getlength(exp->common.blk);
     if (length < 0) {
         fuse_reply_err(req, -length);
         return;
@@ -660,7 +804,7 @@ static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
         }
     }
 
-    ret = blk_pwrite(exp->common.blk, offset, size, buf, 0);
+    ret = blk_co_pwrite(exp->common.blk, offset, size, buf, 0);
     if (ret >= 0) {
         fuse_reply_write(req, size);
     } else {
@@ -671,9 +815,9 @@ static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
 /**
  * Let clients perform various fallocate() operations.
  */
-static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
-                           off_t offset, off_t length,
-                           struct fuse_file_info *fi)
+static void coroutine_fn fuse_fallocate(fuse_req_t req, fuse_ino_t inode,
+                                        int mode, off_t offset, off_t length,
+                                        struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int64_t blk_len;
@@ -684,7 +828,7 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
         return;
     }
 
-    blk_len = blk_getlength(exp->common.blk);
+    blk_len = blk_co_getlength(exp->common.blk);
     if (blk_len < 0) {
         fuse_reply_err(req, -blk_len);
         return;
@@ -725,8 +869,9 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
         do {
             int size = MIN(length, BDRV_REQUEST_MAX_BYTES);
 
-            ret = blk_pwrite_zeroes(exp->common.blk, offset, size,
-                                    BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK);
+            ret = blk_co_pwrite_zeroes(exp->common.blk, offset, size,
+                                       BDRV_REQ_MAY_UNMAP |
+                                       BDRV_REQ_NO_FALLBACK);
             if (ret == -ENOTSUP) {
                 /*
                  * fallocate() specifies to return EOPNOTSUPP for unsupported
@@ -755,8 +900,8 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
         do {
             int size = MIN(length, BDRV_REQUEST_MAX_BYTES);
 
-            ret = blk_pwrite_zeroes(exp->common.blk,
-                                    offset, size, 0);
+            ret = blk_co_pwrite_zeroes(exp->common.blk,
+                                       offset, size, 0);
             offset += size;
             length -= size;
         } while (ret == 0 && length > 0);
@@ -772,13 +917,13 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
 /**
  * Let clients fsync the exported image.
  */
-static void fuse_fsync(fuse_req_t req, fuse_ino_t inode, int datasync,
-                       struct fuse_file_info *fi)
+static void coroutine_fn fuse_fsync(fuse_req_t req, fuse_ino_t inode,
+                                    int datasync, struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int ret;
 
-    ret = blk_flush(exp->common.blk);
+    ret = blk_co_flush(exp->common.blk);
     fuse_reply_err(req, ret < 0 ? -ret : 0);
 }
 
@@ -786,8 +931,8 @@ static void fuse_fsync(fuse_req_t req, fuse_ino_t inode, int datasync,
  * Called before an FD to the exported image is closed.  (libfuse
  * notes this to be a way to return last-minute errors.)
  */
-static void fuse_flush(fuse_req_t req, fuse_ino_t inode,
-                        struct fuse_file_info *fi)
+static void coroutine_fn fuse_flush(fuse_req_t req, fuse_ino_t inode,
+                                    struct fuse_file_info *fi)
 {
     fuse_fsync(req, inode, 1, fi);
 }
@@ -796,11 +941,14 @@ static void fuse_flush(fuse_req_t req, fuse_ino_t inode,
 /**
  * Let clients inquire allocation status.
  */
-static void fuse_lseek(fuse_req_t req, fuse_ino_t inode, off_t offset,
-                       int whence, struct fuse_file_info *fi)
+static void coroutine_fn fuse_lseek(fuse_req_t req, fuse_ino_t inode,
+                                    off_t offset, int whence,
+                                    struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
 
+    GRAPH_RDLOCK_GUARD();
+
     if (whence != SEEK_HOLE && whence != SEEK_DATA) {
         fuse_reply_err(req, EINVAL);
         return;
@@ -810,8 +958,8 @@ static void fuse_lseek(fuse_req_t req, fuse_ino_t inode, off_t offset,
         int64_t pnum;
         int ret;
 
-        ret = bdrv_block_status_above(blk_bs(exp->common.blk), NULL,
-                                      offset, INT64_MAX, &pnum, NULL, NULL);
+        ret = bdrv_co_block_status_above(blk_bs(exp->common.blk), NULL,
+                                         offset, INT64_MAX, &pnum, NULL, NULL);
         if (ret < 0) {
             fuse_reply_err(req, -ret);
             return;
@@ -829,7 +977,7 @@ static void fuse_lseek(fuse_req_t req, fuse_ino_t inode, off_t offset,
              * and @blk_len (the client-visible EOF).
              */
 
-            blk_len = blk_getlength(exp->common.blk);
+            blk_len = blk_co_getlength(exp->common.blk);
             if (blk_len < 0) {
                 fuse_reply_err(req, -blk_len);
                 return;
@@ -866,6 +1014,10 @@ static void fuse_lseek(fuse_req_t req, fuse_ino_t inode, off_t offset,
 }
 #endif
 
+/*
+ * All of these are called from fuse_co_process_request(), so they run in
+ * coroutine context.
+ */
 static const struct fuse_lowlevel_ops fuse_ops = {
     .init       = fuse_init,
     .lookup     = fuse_lookup,
@@ -18,6 +18,7 @@
 #include "vhost-user-blk-server.h"
 #include "qapi/error.h"
 #include "qom/object_interfaces.h"
+#include "sysemu/iothread.h"
 #include "util/block-helpers.h"
 #include "virtio-blk-handler.h"
 
@@ -43,9 +44,12 @@ typedef struct {
 static void vu_blk_req_complete(VuBlkReq *req, size_t in_len)
 {
     VuDev *vu_dev = &req->server->vu_dev;
+    int idx = req->vq - vu_dev->vq;
 
+    vhost_user_server_lock_vq(req->server, idx);
     vu_queue_push(vu_dev, req->vq, &req->elem, in_len);
     vu_queue_notify(vu_dev, req->vq);
+    vhost_user_server_unlock_vq(req->server, idx);
 
     free(req);
 }
@@ -321,6 +325,8 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
     BlockExportOptionsVhostUserBlk *vu_opts = &opts->u.vhost_user_blk;
     uint64_t logical_block_size;
     uint16_t num_queues = VHOST_USER_BLK_NUM_QUEUES_DEFAULT;
+    g_autofree AioContext **vq_ctx = NULL;
+    g_autofree AioContext **vq_ctx_map = NULL;
 
     vexp->blkcfg.wce = 0;
 
@@ -340,6 +346,30 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
         error_setg(errp, "num-queues must be greater than 0");
         return -EINVAL;
     }
+
+    /* Virtqueues are assigned to the iothreads round-robin, like virtio-blk */
+    if (vu_opts->iothreads) {
+        size_t num_iothreads = QAPI_LIST_LENGTH(vu_opts->iothreads);
+        strList *e;
+        size_t i = 0;
+
+        vq_ctx = g_new(AioContext *, num_iothreads);
+        for (e = vu_opts->iothreads; e; e = e->next) {
+            IOThread *iothread = iothread_by_id(e->value);
+
+            if (!iothread) {
+                error_setg(errp, "iothread \"%s\" not found", e->value);
+                return -EINVAL;
+            }
+            vq_ctx[i++] = iothread_get_aio_context(iothread);
+        }
+
+        vq_ctx_map = g_new(AioContext *, num_queues);
+        for (i = 0; i < num_queues; i++) {
+            vq_ctx_map[i] = vq_ctx[i % num_iothreads];
+        }
+    }
+
     vexp->handler.blk = exp->blk;
     vexp->handler.serial = g_strdup("vhost_user_blk");
     vexp->handler.logical_block_size = logical_block_size;
@@ -361,6 +391,10 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
         return -EADDRNOTAVAIL;
     }
 
+    if (vq_ctx_map) {
+        vhost_user_server_set_vq_aio_contexts(&vexp->vu_server, vq_ctx_map);
+    }
+
     return 0;
 }
 
@@ -370,6 +404,7 @@ static void vu_blk_exp_delete(BlockExport *exp)
 
     blk_remove_aio_context_notifier(exp->blk, blk_aio_attached, blk_aio_detach,
                                     vexp);
+    vhost_user_server_free_vq_aio_contexts(&vexp->vu_server);
     g_free(vexp->handler.serial);
 }
 
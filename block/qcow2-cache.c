@@ -33,6 +33,7 @@ typedef struct Qcow2CachedTable {
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    bool     prefetched;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -108,6 +109,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
         while (i < c->size && can_clean_entry(c, i)) {
             c->entries[i].offset = 0;
             c->entries[i].lru_counter = 0;
+            c->entries[i].prefetched = false;
             i++;
             to_clean++;
         }
@@ -311,6 +313,7 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
         assert(c->entries[i].ref == 0);
         c->entries[i].offset = 0;
         c->entries[i].lru_counter = 0;
+        c->entries[i].prefetched = false;
     }
 
     qcow2_cache_table_release(c, 0, c->size);
@@ -378,6 +381,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
     c->entries[i].offset = 0;
+    c->entries[i].prefetched = false;
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -394,6 +398,14 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     /* And return the right table */
 found:
+    if (c->entries[i].prefetched) {
+        c->entries[i].prefetched = false;
+        if (c == s->l2_table_cache) {
+            s->l2_prefetch_hits++;
+        }
+        trace_qcow2_cache_prefetch_hit(qemu_coroutine_self(),
+                                       c == s->l2_table_cache, i);
+    }
     c->entries[i].ref++;
     *table = qcow2_cache_get_table_addr(c, i);
 
@@ -457,6 +469,96 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
     c->entries[i].offset = 0;
     c->entries[i].lru_counter = 0;
     c->entries[i].dirty = false;
+    c->entries[i].prefetched = false;
 
     qcow2_cache_table_release(c, i, 1);
 }
+
+/*
+ * Loads the table at @offset into an unused cache entry, unless it is cached
+ * already.  Entries that are in use are never evicted for a prefetch, so that
+ * prefetching cannot push out tables that requests have loaded meanwhile.
+ *
+ * Returns 1 if the table was loaded, 0 if it was cached already, -ENOSPC if
+ * there is no unused entry left and any other negative errno on I/O errors.
+ *
+ * Called with s->lock held.
+ */
+int coroutine_fn qcow2_cache_prefetch(BlockDriverState *bs, Qcow2Cache *c,
+                                      uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int free_index = -1;
+    int i, ret;
+
+    assert(offset != 0 && QEMU_IS_ALIGNED(offset, c->table_size));
+
+    for (i = 0; i < c->size; i++) {
+        if (c->entries[i].offset == offset) {
+            return 0;
+        }
+        if (free_index < 0 && c->entries[i].offset == 0 &&
+            c->entries[i].ref == 0) {
+            free_index = i;
+        }
+    }
+
+    if (free_index < 0) {
+        return -ENOSPC;
+    }
+
+    i = free_index;
+    trace_qcow2_cache_prefetch(qemu_coroutine_self(),
+                               c == s->l2_table_cache, offset, i);
+
+    ret = bdrv_co_pread(bs->file, offset, c->table_size,
+                        qcow2_cache_get_table_addr(c, i), 0);
+    if (ret < 0) {
+        return ret;
+    }
+
+    c->entries[i].offset = offset;
+    c->entries[i].prefetched = true;
+    c->entries[i].lru_counter = ++c->lru_counter;
+
+    return 1;
+}
+
+static int qcow2_cache_lru_compare(gconstpointer a, gconstpointer b,
+                                   gpointer opaque)
+{
+    const Qcow2CachedTable *ta = *(Qcow2CachedTable * const *) a;
+    const Qcow2CachedTable *tb = *(Qcow2CachedTable * const *) b;
+
+    /* Most recently used first */
+    if (ta->lru_counter != tb->lru_counter) {
+        return ta->lru_counter > tb->lru_counter ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Stores the offsets of up to @max cached tables in @offsets, most recently
+ * used table first.  Returns the number of offsets stored.
+ */
+int qcow2_cache_get_hot_tables(Qcow2Cache *c, uint64_t *offsets, int max)
+{
+    g_autoptr(GPtrArray) tables = g_ptr_array_sized_new(c->size);
+    int i, n;
+
+    for (i = 0; i < c->size; i++) {
+        if (c->entries[i].offset != 0) {
+            g_ptr_array_add(tables, &c->entries[i]);
+        }
+    }
+
+    g_ptr_array_sort_with_data(tables, qcow2_cache_lru_compare, NULL);
+
+    n = MIN(max, tables->len);
+    for (i = 0; i < n; i++) {
+        Qcow2CachedTable *t = g_ptr_array_index(tables, i);
+        offsets[i] = t->offset;
+    }
+
+    return n;
+}
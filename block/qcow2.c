@@ -73,6 +73,7 @@ typedef struct {
 #define  QCOW2_EXT_MAGIC_CRYPTO_HEADER 0x0537be77
 #define  QCOW2_EXT_MAGIC_BITMAPS 0x23852875
 #define  QCOW2_EXT_MAGIC_DATA_FILE 0x44415441
+#define  QCOW2_EXT_MAGIC_L2_HOT_TABLES 0x4c32484f
 
 static int coroutine_fn
 qcow2_co_preadv_compressed(BlockDriverState *bs,
@@ -432,6 +433,50 @@ qcow2_read_extensions(BlockDriverState *bs, uint64_t start_offset,
             break;
         }
 
+        case QCOW2_EXT_MAGIC_L2_HOT_TABLES:
+        {
+            Qcow2L2HotTablesHeaderExt hot_ext;
+            uint32_t i;
+
+            /* The list is only a hint, so ignore it if it is malformed */
+            if (ext.len < sizeof(hot_ext)) {
+                warn_report("Ignoring invalid L2 hot tables extension");
+                break;
+            }
+
+            ret = bdrv_co_pread(bs->file, offset, sizeof(hot_ext), &hot_ext,
+                                0);
+            if (ret < 0) {
+                error_setg_errno(errp, -ret, "l2_hot_tables_ext: "
+                                 "Could not read ext header");
+                return ret;
+            }
+
+            hot_ext.nb_tables = be32_to_cpu(hot_ext.nb_tables);
+            if (hot_ext.nb_tables > QCOW2_MAX_L2_HOT_TABLES ||
+                ext.len != sizeof(hot_ext) +
+                           hot_ext.nb_tables * sizeof(uint64_t)) {
+                warn_report("Ignoring invalid L2 hot tables extension");
+                break;
+            }
+
+            g_free(s->l2_hot_tables);
+            s->l2_hot_tables = g_new(uint64_t, hot_ext.nb_tables);
+            s->nb_l2_hot_tables = hot_ext.nb_tables;
+            ret = bdrv_co_pread(bs->file, offset + sizeof(hot_ext),
+                                hot_ext.nb_tables * sizeof(uint64_t),
+                                s->l2_hot_tables, 0);
+            if (ret < 0) {
+                error_setg_errno(errp, -ret, "l2_hot_tables_ext: "
+                                 "Could not read the list");
+                return ret;
+            }
+            for (i = 0; i < s->nb_l2_hot_tables; i++) {
+                s->l2_hot_tables[i] = be64_to_cpu(s->l2_hot_tables[i]);
+            }
+            break;
+        }
+
         default:
             /* unknown magic - save it in case we need to rewrite the header */
             /* If you add a new feature, make sure to also update the fast
@@ -701,6 +746,7 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_L2_CACHE_PREFETCH,
     NULL
 };
 
@@ -817,6 +863,12 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_L2_CACHE_PREFETCH,
+            .type = QEMU_OPT_BOOL,
+            .help = "Remember cached L2 tables on close and prefetch them "
+                    "on open",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -867,6 +919,165 @@ static void cache_clean_timer_del(BlockDriverState *bs)
     }
 }
 
+/*
+ * Loads the L2 table slice that maps the guest offset @offset into the L2
+ * cache.  The L2 table is looked up in the active L1 table, so a stale entry
+ * in the L2 hot tables list can only load an unused slice, never a cluster
+ * that is not an L2 table any more.
+ *
+ * Called with s->lock held.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_l2_prefetch_one(BlockDriverState *bs, uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t l1_index = offset >> (s->l2_bits + s->cluster_bits);
+    uint64_t l2_offset;
+    int l2_index, ret;
+
+    if (l1_index >= s->l1_size) {
+        return 0;
+    }
+
+    l2_offset = s->l1_table[l1_index] & L1E_OFFSET_MASK;
+    if (l2_offset == 0 || offset_into_cluster(s, l2_offset)) {
+        return 0;
+    }
+
+    /* The L2 cache entry size may have changed since the list was written */
+    l2_index = QEMU_ALIGN_DOWN(offset_to_l2_index(s, offset), s->l2_slice_size);
+
+    ret = qcow2_cache_prefetch(bs, s->l2_table_cache,
+                               l2_offset + l2_index * l2_entry_size(s));
+    if (ret > 0) {
+        s->l2_prefetch_tables++;
+    }
+    return ret;
+}
+
+static void coroutine_fn qcow2_l2_prefetch_entry(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcow2State *s = bs->opaque;
+    int ret = 0;
+
+    GRAPH_RDLOCK_GUARD();
+
+    trace_qcow2_l2_prefetch_start(bs, s->l2_prefetch_next,
+                                  s->nb_l2_hot_tables);
+
+    /* Stop when drained, qcow2_drain_end() resumes prefetching */
+    while (s->l2_prefetch && s->l2_prefetch_next < s->nb_l2_hot_tables &&
+           !qatomic_read(&bs->quiesce_counter)) {
+        uint64_t offset = s->l2_hot_tables[s->l2_prefetch_next++];
+
+        qemu_co_mutex_lock(&s->lock);
+        ret = qcow2_l2_prefetch_one(bs, offset);
+        qemu_co_mutex_unlock(&s->lock);
+
+        if (ret < 0) {
+            /* The cache is full or we got an I/O error; it was just a hint */
+            s->l2_prefetch_next = s->nb_l2_hot_tables;
+            break;
+        }
+    }
+
+    trace_qcow2_l2_prefetch_done(bs, s->l2_prefetch_tables, ret);
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Starts loading the L2 tables from the L2 hot tables header extension into
+ * the L2 cache in the background, if enabled and not yet done.
+ */
+static void qcow2_l2_prefetch_start(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Coroutine *co;
+
+    if (!s->l2_prefetch || s->l2_prefetch_next >= s->nb_l2_hot_tables ||
+        (s->flags & (BDRV_O_INACTIVE | BDRV_O_CHECK | BDRV_O_NO_IO)) ||
+        qatomic_read(&bs->quiesce_counter)) {
+        return;
+    }
+
+    co = qemu_coroutine_create(qcow2_l2_prefetch_entry, bs);
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(bdrv_get_aio_context(bs), co);
+}
+
+/*
+ * Replaces the L2 hot tables list by the guest offsets mapped by the L2 table
+ * slices that are currently cached, so that they can be prefetched when the
+ * image is opened next time.
+ *
+ * Returns true if the list has changed and needs to be written to the header.
+ */
+static bool qcow2_l2_hot_tables_record(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    g_autofree uint64_t *slices = g_new(uint64_t, QCOW2_MAX_L2_HOT_TABLES);
+    g_autofree uint64_t *l2_offsets = g_new(uint64_t, QCOW2_MAX_L2_HOT_TABLES);
+    g_autofree int64_t *l1_indices = g_new(int64_t, QCOW2_MAX_L2_HOT_TABLES);
+    g_autoptr(GHashTable) tables = g_hash_table_new(g_int64_hash,
+                                                    g_int64_equal);
+    uint64_t *hot_tables;
+    uint32_t nb_hot_tables = 0;
+    int i, nb_slices;
+
+    nb_slices = qcow2_cache_get_hot_tables(s->l2_table_cache, slices,
+                                           QCOW2_MAX_L2_HOT_TABLES);
+
+    /* Find the L1 index of each cached L2 table with one pass over L1 */
+    for (i = 0; i < nb_slices; i++) {
+        l2_offsets[i] = start_of_cluster(s, slices[i]);
+        l1_indices[i] = -1;
+        if (!g_hash_table_contains(tables, &l2_offsets[i])) {
+            g_hash_table_insert(tables, &l2_offsets[i], &l1_indices[i]);
+        }
+    }
+    for (i = 0; i < s->l1_size && nb_slices > 0; i++) {
+        uint64_t l2_offset = s->l1_table[i] & L1E_OFFSET_MASK;
+        int64_t *l1_index = g_hash_table_lookup(tables, &l2_offset);
+
+        if (l1_index) {
+            *l1_index = i;
+        }
+    }
+
+    hot_tables = g_new(uint64_t, MAX(nb_slices, 1));
+    for (i = 0; i < nb_slices; i++) {
+        int64_t *l1_index = g_hash_table_lookup(tables, &l2_offsets[i]);
+        uint64_t l2_index = (slices[i] - l2_offsets[i]) / l2_entry_size(s);
+
+        if (*l1_index < 0) {
+            continue;
+        }
+        hot_tables[nb_hot_tables++] =
+            ((uint64_t)*l1_index << (s->l2_bits + s->cluster_bits)) +
+            (l2_index << s->cluster_bits);
+    }
+
+    s->l2_prefetch_next = nb_hot_tables;
+    if (nb_hot_tables == s->nb_l2_hot_tables &&
+        (nb_hot_tables == 0 ||
+         !memcmp(hot_tables, s->l2_hot_tables,
+                 nb_hot_tables * sizeof(uint64_t)))) {
+        g_free(hot_tables);
+        return false;
+    }
+
+    g_free(s->l2_hot_tables);
+    s->l2_hot_tables = hot_tables;
+    s->nb_l2_hot_tables = nb_hot_tables;
+    return true;
+}
+
+static void qcow2_drain_end(BlockDriverState *bs)
+{
+    qcow2_l2_prefetch_start(bs);
+}
+
 static void qcow2_detach_aio_context(BlockDriverState *bs)
 {
     cache_clean_timer_del(bs);
@@ -979,6 +1190,7 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    bool l2_prefetch;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1079,6 +1291,9 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->l2_prefetch = qemu_opt_get_bool(opts, QCOW2_OPT_L2_CACHE_PREFETCH,
+                                       false);
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1245,6 +1460,8 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
         cache_clean_timer_init(bs, bdrv_get_aio_context(bs));
     }
 
+    s->l2_prefetch = r->l2_prefetch;
+
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     s->crypto_opts = r->crypto_opts;
 }
@@ -1889,6 +2106,8 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
 
     qemu_co_queue_init(&s->thread_task_queue);
 
+    qcow2_l2_prefetch_start(bs);
+
     return ret;
 
  fail:
@@ -1901,6 +2120,8 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     }
     g_free(s->unknown_header_fields);
     cleanup_unknown_header_ext(bs);
+    g_free(s->l2_hot_tables);
+    s->l2_hot_tables = NULL;
     qcow2_free_snapshots(bs);
     qcow2_refcount_close(bs);
     qemu_vfree(s->l1_table);
@@ -2785,6 +3006,15 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
     }
 
     if (result == 0) {
+        if (s->l2_prefetch && bdrv_is_writable(bs) &&
+            qcow2_l2_hot_tables_record(bs)) {
+            ret = qcow2_update_header(bs);
+            if (ret < 0) {
+                /* Not fatal, the next open just starts with a cold cache */
+                warn_report("Failed to store the L2 hot tables list: %s",
+                            strerror(-ret));
+            }
+        }
         qcow2_mark_clean(bs);
     }
 
@@ -2814,6 +3044,9 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     g_free(s->unknown_header_fields);
     cleanup_unknown_header_ext(bs);
 
+    g_free(s->l2_hot_tables);
+    s->l2_hot_tables = NULL;
+
     g_free(s->image_data_file);
     g_free(s->image_backing_file);
     g_free(s->image_backing_format);
@@ -2910,6 +3143,46 @@ static size_t header_ext_add(char *buf, uint32_t magic, const void *s,
     return ext_len;
 }
 
+/*
+ * Adds the L2 hot tables extension to the header.  The list is only a hint, so
+ * instead of failing the header update, only as many entries are stored as
+ * fit into the header cluster while leaving @reserved bytes for the rest of
+ * the header.
+ */
+static size_t header_ext_add_l2_hot_tables(BDRVQcow2State *s, char *buf,
+                                           size_t buflen, size_t reserved)
+{
+    Qcow2L2HotTablesHeaderExt *hot_ext;
+    uint64_t *tables;
+    size_t overhead = sizeof(QCowExtension) + sizeof(*hot_ext);
+    size_t len, ret;
+    uint32_t nb_tables, i;
+
+    if (buflen < reserved + overhead) {
+        return 0;
+    }
+
+    nb_tables = MIN(s->nb_l2_hot_tables,
+                    (buflen - reserved - overhead) / sizeof(uint64_t));
+    if (nb_tables == 0) {
+        return 0;
+    }
+
+    len = sizeof(*hot_ext) + nb_tables * sizeof(uint64_t);
+    hot_ext = g_malloc0(len);
+    hot_ext->nb_tables = cpu_to_be32(nb_tables);
+    tables = (uint64_t *)(hot_ext + 1);
+    for (i = 0; i < nb_tables; i++) {
+        tables[i] = cpu_to_be64(s->l2_hot_tables[i]);
+    }
+
+    ret = header_ext_add(buf, QCOW2_EXT_MAGIC_L2_HOT_TABLES, hot_ext, len,
+                         buflen);
+    g_free(hot_ext);
+
+    return ret;
+}
+
 /*
  * Updates the qcow2 header, including the variable length parts of it, i.e.
  * the backing file name and all extensions. qcow2 was not designed to allow
@@ -3126,6 +3399,23 @@ int qcow2_update_header(BlockDriverState *bs)
         buflen -= ret;
     }
 
+    /* L2 hot tables extension */
+    if (s->nb_l2_hot_tables > 0) {
+        /* End of header extensions and backing file name come after it */
+        size_t reserved = sizeof(QCowExtension);
+
+        QLIST_FOREACH(uext, &s->unknown_header_ext, next) {
+            reserved += sizeof(QCowExtension) + ROUND_UP(uext->len, 8);
+        }
+        if (s->image_backing_file) {
+            reserved += strlen(s->image_backing_file);
+        }
+
+        ret = header_ext_add_l2_hot_tables(s, buf, buflen, reserved);
+        buf += ret;
+        buflen -= ret;
+    }
+
     /* Keep unknown header extensions */
     QLIST_FOREACH(uext, &s->unknown_header_ext, next) {
         ret = header_ext_add(buf, uext->magic, uext->data, uext->len, buflen);
@@ -6133,6 +6423,20 @@ static QemuOptsList qcow2_amend_opts = {
     }
 };
 
+static BlockStatsSpecific *qcow2_get_specific_stats(BlockDriverState *bs)
+{
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+    BDRVQcow2State *s = bs->opaque;
+
+    stats->driver = BLOCKDEV_DRIVER_QCOW2;
+    stats->u.qcow2 = (BlockStatsSpecificQcow2) {
+        .l2_prefetch_tables = s->l2_prefetch_tables,
+        .l2_prefetch_hits = s->l2_prefetch_hits,
+    };
+
+    return stats;
+}
+
 static const char *const qcow2_strong_runtime_opts[] = {
     "encrypt." BLOCK_CRYPTO_OPT_QCOW_KEY_SECRET,
 
@@ -6176,6 +6480,7 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_measure                       = qcow2_measure,
     .bdrv_co_get_info                   = qcow2_co_get_info,
     .bdrv_get_specific_info             = qcow2_get_specific_info,
+    .bdrv_get_specific_stats            = qcow2_get_specific_stats,
 
     .bdrv_co_save_vmstate               = qcow2_co_save_vmstate,
     .bdrv_co_load_vmstate               = qcow2_co_load_vmstate,
@@ -6198,6 +6503,7 @@ BlockDriver bdrv_qcow2 = {
 
     .bdrv_detach_aio_context            = qcow2_detach_aio_context,
     .bdrv_attach_aio_context            = qcow2_attach_aio_context,
+    .bdrv_drain_end                     = qcow2_drain_end,
 
     .bdrv_supports_persistent_dirty_bitmap =
             qcow2_supports_persistent_dirty_bitmap,
@@ -117,6 +117,9 @@
 /* Must be at least 4 to cover all cases of refcount table growth */
 #define MIN_REFCOUNT_CACHE_SIZE 4 /* clusters */
 
+/* Maximum number of entries in the L2 hot tables header extension */
+#define QCOW2_MAX_L2_HOT_TABLES 4096
+
 #ifdef CONFIG_LINUX
 #define DEFAULT_L2_CACHE_MAX_SIZE (32 * MiB)
 #define DEFAULT_CACHE_CLEAN_INTERVAL 600  /* seconds */
@@ -150,6 +153,7 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_L2_CACHE_PREFETCH "l2-cache-prefetch"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -322,6 +326,12 @@ typedef struct Qcow2BitmapHeaderExt {
     uint64_t bitmap_directory_offset;
 } QEMU_PACKED Qcow2BitmapHeaderExt;
 
+/* Followed by nb_tables big-endian guest offsets mapped by L2 table slices */
+typedef struct Qcow2L2HotTablesHeaderExt {
+    uint32_t nb_tables;
+    uint32_t reserved32;
+} QEMU_PACKED Qcow2L2HotTablesHeaderExt;
+
 #define QCOW2_MAX_THREADS 4
 
 typedef struct BDRVQcow2State {
@@ -348,6 +358,19 @@ typedef struct BDRVQcow2State {
     QEMUTimer *cache_clean_timer;
     unsigned cache_clean_interval;
 
+    /*
+     * Guest offsets mapped by the L2 table slices that were cached when the
+     * image was last closed, most recently used first (from the L2 hot
+     * tables header extension).
+     * l2_prefetch_next is the index of the next entry to prefetch.
+     */
+    bool l2_prefetch;
+    uint64_t *l2_hot_tables;
+    uint32_t nb_l2_hot_tables;
+    uint32_t l2_prefetch_next;
+    uint64_t l2_prefetch_tables;
+    uint64_t l2_prefetch_hits;
+
     QLIST_HEAD(, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
@@ -1022,6 +1045,10 @@ void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
 
+int coroutine_fn GRAPH_RDLOCK
+qcow2_cache_prefetch(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset);
+int qcow2_cache_get_hot_tables(Qcow2Cache *c, uint64_t *offsets, int max);
+
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
 qcow2_check_bitmaps_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
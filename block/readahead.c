@@ -0,0 +1,725 @@
+/*
+ * readahead filter driver
+ *
+ * The driver detects sequential read streams and reads ahead of them from its
+ * child, so that subsequent requests can be served from memory.  This hides
+ * the round-trip latency of network protocols like nbd, curl or ssh for
+ * sequential guest workloads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+
+#include "qapi/error.h"
+#include "qapi/qapi-types-block-core.h"
+#include "qemu/coroutine.h"
+#include "qemu/memalign.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/range.h"
+#include "qemu/units.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "trace.h"
+
+/* Number of sequential streams that are tracked at the same time */
+#define READAHEAD_MAX_STREAMS 8
+
+typedef struct ReadaheadOpts {
+    uint64_t readahead_size;
+    uint64_t cache_size;
+    uint32_t sequential_threshold;
+} ReadaheadOpts;
+
+/*
+ * A buffer holding data that was read ahead.  All windows have the same
+ * capacity, opts.readahead_size.
+ */
+typedef struct ReadaheadWindow {
+    BlockDriverState *bs;
+    void *buf;
+
+    /*
+     * Range of the data, which starts at @data in @buf.  @bytes is 0 if the
+     * window is unused.
+     */
+    int64_t offset;
+    int64_t bytes;
+    uint8_t *data;
+
+    /* The read from the child is still in flight */
+    bool loading;
+    /* Writes to [@stale_offset, @stale_end) overlapped with the load */
+    bool stale;
+    int64_t stale_offset;
+    int64_t stale_end;
+
+    uint64_t lru;
+    /* Requests waiting for the window to finish loading */
+    CoQueue waiters;
+} ReadaheadWindow;
+
+typedef struct ReadaheadStream {
+    /* Offset at which the next request of the stream is expected */
+    int64_t next;
+    /* End of the data that has been read ahead for this stream */
+    int64_t readahead_end;
+    /* Number of sequential requests seen, 0 if the slot is unused */
+    uint32_t seq;
+    uint64_t lru;
+} ReadaheadStream;
+
+typedef struct BDRVReadaheadState {
+    ReadaheadOpts opts;
+
+    /* Protects all fields below */
+    CoMutex lock;
+
+    ReadaheadWindow *windows;
+    int nb_windows;
+    ReadaheadStream streams[READAHEAD_MAX_STREAMS];
+    uint64_t lru_counter;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t readahead_requests;
+    uint64_t readahead_bytes;
+} BDRVReadaheadState;
+
+typedef struct ReadaheadReopenState {
+    ReadaheadOpts opts;
+    ReadaheadWindow *windows;
+    int nb_windows;
+} ReadaheadReopenState;
+
+#define READAHEAD_OPT_READAHEAD_SIZE "readahead-size"
+#define READAHEAD_OPT_CACHE_SIZE "cache-size"
+#define READAHEAD_OPT_SEQUENTIAL_THRESHOLD "sequential-threshold"
+static QemuOptsList runtime_opts = {
+    .name = "readahead",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = READAHEAD_OPT_READAHEAD_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "how much data to read ahead at once, default 1M",
+        },
+        {
+            .name = READAHEAD_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "maximum amount of read ahead data, default 8M",
+        },
+        {
+            .name = READAHEAD_OPT_SEQUENTIAL_THRESHOLD,
+            .type = QEMU_OPT_NUMBER,
+            .help = "number of sequential requests after which reading "
+                "ahead starts, default 2",
+        },
+        { /* end of list */ }
+    },
+};
+
+static bool readahead_absorb_opts(ReadaheadOpts *dest, QDict *options,
+                                  BlockDriverState *child_bs, Error **errp)
+{
+    QemuOpts *opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    uint64_t threshold;
+
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        qemu_opts_del(opts);
+        return false;
+    }
+
+    dest->readahead_size =
+        qemu_opt_get_size(opts, READAHEAD_OPT_READAHEAD_SIZE, 1 * MiB);
+    dest->cache_size =
+        qemu_opt_get_size(opts, READAHEAD_OPT_CACHE_SIZE, 8 * MiB);
+    threshold =
+        qemu_opt_get_number(opts, READAHEAD_OPT_SEQUENTIAL_THRESHOLD, 2);
+
+    qemu_opts_del(opts);
+
+    if (dest->readahead_size == 0 ||
+        dest->readahead_size > BDRV_REQUEST_MAX_BYTES ||
+        !QEMU_IS_ALIGNED(dest->readahead_size,
+                         child_bs->bl.request_alignment)) {
+        error_setg(errp, "readahead-size parameter of readahead filter must "
+                   "be a non-zero multiple of the underlying node request "
+                   "alignment (%" PRIu32 ") and at most %" PRIu64,
+                   child_bs->bl.request_alignment,
+                   (uint64_t)BDRV_REQUEST_MAX_BYTES);
+        return false;
+    }
+
+    if (dest->cache_size < dest->readahead_size) {
+        error_setg(errp, "cache-size parameter of readahead filter must not "
+                   "be smaller than readahead-size");
+        return false;
+    }
+
+    if (threshold == 0 || threshold > UINT32_MAX) {
+        error_setg(errp, "sequential-threshold parameter of readahead filter "
+                   "must be between 1 and %" PRIu32, UINT32_MAX);
+        return false;
+    }
+    dest->sequential_threshold = threshold;
+
+    return true;
+}
+
+static void readahead_free_windows(ReadaheadWindow *windows, int nb_windows)
+{
+    int i;
+
+    for (i = 0; i < nb_windows; i++) {
+        qemu_vfree(windows[i].buf);
+    }
+    g_free(windows);
+}
+
+static ReadaheadWindow * GRAPH_RDLOCK
+readahead_alloc_windows(BlockDriverState *bs, const ReadaheadOpts *opts,
+                        int *nb_windows, Error **errp)
+{
+    ReadaheadWindow *windows;
+    int i, n;
+
+    n = MIN(opts->cache_size / opts->readahead_size, INT_MAX);
+    windows = g_new0(ReadaheadWindow, n);
+
+    for (i = 0; i < n; i++) {
+        windows[i].bs = bs;
+        windows[i].buf = qemu_try_blockalign(bs->file->bs,
+                                             opts->readahead_size);
+        if (!windows[i].buf) {
+            error_setg(errp, "Could not allocate readahead cache");
+            readahead_free_windows(windows, i);
+            return NULL;
+        }
+        qemu_co_queue_init(&windows[i].waiters);
+    }
+
+    *nb_windows = n;
+    return windows;
+}
+
+static int readahead_open(BlockDriverState *bs, QDict *options, int flags,
+                          Error **errp)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int ret;
+
+    GLOBAL_STATE_CODE();
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    if (!readahead_absorb_opts(&s->opts, options, bs->file->bs, errp)) {
+        return -EINVAL;
+    }
+
+    s->windows = readahead_alloc_windows(bs, &s->opts, &s->nb_windows, errp);
+    if (!s->windows) {
+        return -ENOMEM;
+    }
+
+    qemu_co_mutex_init(&s->lock);
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    return 0;
+}
+
+static void readahead_close(BlockDriverState *bs)
+{
+    BDRVReadaheadState *s = bs->opaque;
+
+    /* bdrv_close() drained the node, so no window is loading any more */
+    readahead_free_windows(s->windows, s->nb_windows);
+}
+
+static int readahead_reopen_prepare(BDRVReopenState *reopen_state,
+                                    BlockReopenQueue *queue, Error **errp)
+{
+    ReadaheadReopenState *rs = g_new0(ReadaheadReopenState, 1);
+    BlockDriverState *bs = reopen_state->bs;
+
+    GLOBAL_STATE_CODE();
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    if (!readahead_absorb_opts(&rs->opts, reopen_state->options,
+                               bs->file->bs, errp)) {
+        g_free(rs);
+        return -EINVAL;
+    }
+
+    /* Allocate here already so that committing cannot fail */
+    rs->windows = readahead_alloc_windows(bs, &rs->opts, &rs->nb_windows,
+                                          errp);
+    if (!rs->windows) {
+        g_free(rs);
+        return -ENOMEM;
+    }
+
+    reopen_state->opaque = rs;
+
+    return 0;
+}
+
+static void readahead_reopen_commit(BDRVReopenState *state)
+{
+    BDRVReadaheadState *s = state->bs->opaque;
+    ReadaheadReopenState *rs = state->opaque;
+
+    /* The node is drained, so nothing accesses the cache right now */
+    readahead_free_windows(s->windows, s->nb_windows);
+    s->opts = rs->opts;
+    s->windows = rs->windows;
+    s->nb_windows = rs->nb_windows;
+    memset(s->streams, 0, sizeof(s->streams));
+
+    g_free(rs);
+    state->opaque = NULL;
+}
+
+static void readahead_reopen_abort(BDRVReopenState *state)
+{
+    ReadaheadReopenState *rs = state->opaque;
+
+    readahead_free_windows(rs->windows, rs->nb_windows);
+    g_free(rs);
+    state->opaque = NULL;
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+readahead_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+/*
+ * Drop the part of a loaded window that overlaps [@offset, @offset + @bytes).
+ * A window can only hold one contiguous range, so if the write splits it,
+ * the larger of the two remaining parts is kept.
+ *
+ * Called with s->lock held.
+ */
+static void readahead_trim_window(ReadaheadWindow *w, int64_t offset,
+                                  int64_t bytes)
+{
+    int64_t end = w->offset + w->bytes;
+    int64_t head = offset > w->offset ? MIN(offset, end) - w->offset : 0;
+    int64_t tail = bytes < end - offset ? end - MAX(offset + bytes, w->offset)
+                                        : 0;
+
+    assert(!w->loading);
+
+    if (tail > head) {
+        w->data += w->bytes - tail;
+        w->offset = end - tail;
+        w->bytes = tail;
+    } else {
+        w->bytes = head;
+    }
+}
+
+/* Called with s->lock held */
+static ReadaheadWindow *readahead_find_window(BDRVReadaheadState *s,
+                                              int64_t offset)
+{
+    int i;
+
+    for (i = 0; i < s->nb_windows; i++) {
+        ReadaheadWindow *w = &s->windows[i];
+
+        if (w->bytes && !w->stale &&
+            offset >= w->offset && offset < w->offset + w->bytes) {
+            return w;
+        }
+    }
+    return NULL;
+}
+
+static void coroutine_fn readahead_co_load(void *opaque)
+{
+    ReadaheadWindow *w = opaque;
+    BlockDriverState *bs = w->bs;
+    BDRVReadaheadState *s = bs->opaque;
+    int ret;
+
+    /* Only loading windows can be invalidated, so w->offset is stable */
+    WITH_GRAPH_RDLOCK_GUARD() {
+        ret = bdrv_co_pread(bs->file, w->offset, w->bytes, w->buf, 0);
+    }
+    trace_readahead_load_done(bs, w->offset, w->bytes, ret);
+
+    qemu_co_mutex_lock(&s->lock);
+    w->loading = false;
+    if (ret < 0) {
+        w->bytes = 0;
+    } else if (w->stale) {
+        readahead_trim_window(w, w->stale_offset,
+                              w->stale_end - w->stale_offset);
+    }
+    w->stale = false;
+    qemu_co_queue_restart_all(&w->waiters);
+    qemu_co_mutex_unlock(&s->lock);
+
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Start reading [@offset, @offset + opts.readahead_size) into a free or the
+ * least recently used window.  Returns the number of bytes that will be read,
+ * or 0 if no window is available or @offset is at the end of the node.
+ *
+ * Called with s->lock held.
+ */
+static int64_t readahead_start(BlockDriverState *bs, int64_t offset)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int64_t length = bs->total_sectors * BDRV_SECTOR_SIZE;
+    ReadaheadWindow *w = NULL;
+    Coroutine *co;
+    int i;
+
+    if (offset >= length) {
+        return 0;
+    }
+
+    for (i = 0; i < s->nb_windows; i++) {
+        ReadaheadWindow *cand = &s->windows[i];
+
+        if (cand->loading) {
+            continue;
+        }
+        if (!cand->bytes) {
+            w = cand;
+            break;
+        }
+        if (!w || cand->lru < w->lru) {
+            w = cand;
+        }
+    }
+    if (!w) {
+        return 0;
+    }
+
+    w->offset = offset;
+    w->bytes = MIN(s->opts.readahead_size, length - offset);
+    w->data = w->buf;
+    w->loading = true;
+    w->stale = false;
+    w->lru = ++s->lru_counter;
+
+    s->readahead_requests++;
+    s->readahead_bytes += w->bytes;
+    trace_readahead_load(bs, w->offset, w->bytes);
+
+    /* Runs once the calling request yields or completes */
+    bdrv_inc_in_flight(bs);
+    co = qemu_coroutine_create(readahead_co_load, w);
+    aio_co_enter(qemu_get_current_aio_context(), co);
+
+    return w->bytes;
+}
+
+/*
+ * Account a read of [@offset, @offset + @bytes) to its stream and read ahead
+ * of the stream once it has been sequential for long enough.  Keeps up to
+ * opts.readahead_size bytes ahead of the end of the request.
+ *
+ * Called with s->lock held.
+ */
+static void readahead_update_stream(BlockDriverState *bs, int64_t offset,
+                                    int64_t bytes)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadStream *st = NULL, *victim = NULL;
+    int64_t end = offset + bytes;
+    int i;
+
+    for (i = 0; i < READAHEAD_MAX_STREAMS; i++) {
+        ReadaheadStream *cand = &s->streams[i];
+
+        if (cand->seq && cand->next == offset) {
+            st = cand;
+            break;
+        }
+        if (!victim || cand->lru < victim->lru) {
+            victim = cand;
+        }
+    }
+
+    if (!st) {
+        st = victim;
+        *st = (ReadaheadStream) {
+            .readahead_end = end,
+        };
+    }
+
+    st->next = end;
+    st->seq++;
+    st->lru = ++s->lru_counter;
+
+    if (st->seq < s->opts.sequential_threshold) {
+        return;
+    }
+
+    st->readahead_end = MAX(st->readahead_end, end);
+    while (st->readahead_end - end < s->opts.readahead_size) {
+        /* Part of the range may still be cached after an invalidation */
+        ReadaheadWindow *w = readahead_find_window(s, st->readahead_end);
+        int64_t n;
+
+        if (w) {
+            n = w->offset + w->bytes - st->readahead_end;
+        } else {
+            n = readahead_start(bs, st->readahead_end);
+            if (!n) {
+                break;
+            }
+        }
+        st->readahead_end += n;
+    }
+}
+
+/*
+ * Drop read ahead data that overlaps with a write.  Windows that are still
+ * loading may or may not see the write, so the overlapping part is dropped
+ * once they are done.  Called both before and after writing, so that a
+ * window that starts loading while the write is in flight is trimmed as
+ * well.  Streams that had read ahead over the write read it again.
+ */
+static void coroutine_fn readahead_invalidate(BlockDriverState *bs,
+                                              int64_t offset, int64_t bytes)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int i;
+
+    qemu_co_mutex_lock(&s->lock);
+    for (i = 0; i < s->nb_windows; i++) {
+        ReadaheadWindow *w = &s->windows[i];
+
+        if (!w->bytes || !ranges_overlap(w->offset, w->bytes, offset, bytes)) {
+            continue;
+        }
+        if (!w->loading) {
+            readahead_trim_window(w, offset, bytes);
+        } else if (!w->stale) {
+            w->stale = true;
+            w->stale_offset = offset;
+            w->stale_end = offset + bytes;
+        } else {
+            w->stale_offset = MIN(w->stale_offset, offset);
+            w->stale_end = MAX(w->stale_end, offset + bytes);
+        }
+    }
+
+    for (i = 0; i < READAHEAD_MAX_STREAMS; i++) {
+        ReadaheadStream *st = &s->streams[i];
+
+        if (st->seq && st->readahead_end > st->next &&
+            ranges_overlap(st->next, st->readahead_end - st->next,
+                           offset, bytes)) {
+            st->readahead_end = MAX(offset, st->next);
+        }
+    }
+    qemu_co_mutex_unlock(&s->lock);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                         QEMUIOVector *qiov, size_t qiov_offset,
+                         BdrvRequestFlags flags)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int64_t done = 0;
+
+    qemu_co_mutex_lock(&s->lock);
+    while (done < bytes) {
+        ReadaheadWindow *w = readahead_find_window(s, offset + done);
+        int64_t n;
+
+        if (!w) {
+            break;
+        }
+        if (w->loading) {
+            /* The data is on its way, which is faster than reading it again */
+            qemu_co_queue_wait(&w->waiters, &s->lock);
+            continue;
+        }
+
+        n = MIN(bytes - done, w->offset + w->bytes - (offset + done));
+        qemu_iovec_from_buf(qiov, qiov_offset + done,
+                            w->data + (offset + done - w->offset), n);
+        w->lru = ++s->lru_counter;
+        done += n;
+    }
+
+    if (done == bytes) {
+        s->hits++;
+    } else {
+        s->misses++;
+    }
+    readahead_update_stream(bs, offset, bytes);
+    qemu_co_mutex_unlock(&s->lock);
+
+    if (done == bytes) {
+        return 0;
+    }
+
+    return bdrv_co_preadv_part(bs->file, offset + done, bytes - done, qiov,
+                               qiov_offset + done, flags);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                          QEMUIOVector *qiov, size_t qiov_offset,
+                          BdrvRequestFlags flags)
+{
+    int ret;
+
+    readahead_invalidate(bs, offset, bytes);
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    readahead_invalidate(bs, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                           BdrvRequestFlags flags)
+{
+    int ret;
+
+    readahead_invalidate(bs, offset, bytes);
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    readahead_invalidate(bs, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    int ret;
+
+    readahead_invalidate(bs, offset, bytes);
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    readahead_invalidate(bs, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
+                      PreallocMode prealloc, BdrvRequestFlags flags,
+                      Error **errp)
+{
+    int ret;
+
+    readahead_invalidate(bs, 0, INT64_MAX);
+    ret = bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+    readahead_invalidate(bs, 0, INT64_MAX);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_block_status(BlockDriverState *bs, bool want_zero, int64_t offset,
+                          int64_t bytes, int64_t *pnum, int64_t *map,
+                          BlockDriverState **file)
+{
+    *pnum = bytes;
+    *map = offset;
+    *file = bs->file->bs;
+    return BDRV_BLOCK_RAW | BDRV_BLOCK_OFFSET_VALID;
+}
+
+static int coroutine_fn GRAPH_RDLOCK readahead_co_flush(BlockDriverState *bs)
+{
+    return bdrv_co_flush(bs->file->bs);
+}
+
+static BlockStatsSpecific *readahead_get_specific_stats(BlockDriverState *bs)
+{
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+    BDRVReadaheadState *s = bs->opaque;
+
+    stats->driver = BLOCKDEV_DRIVER_READAHEAD;
+    stats->u.readahead = (BlockStatsSpecificReadahead) {
+        .hits = s->hits,
+        .misses = s->misses,
+        .readahead_requests = s->readahead_requests,
+        .readahead_bytes = s->readahead_bytes,
+    };
+
+    return stats;
+}
+
+static void readahead_child_perm(BlockDriverState *bs, BdrvChild *c,
+    BdrvChildRole role, BlockReopenQueue *reopen_queue,
+    uint64_t perm, uint64_t shared, uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared, nperm, nshared);
+
+    /* Writes that bypass the filter would leave stale data in the cache */
+    *nshared &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+}
+
+static BlockDriver bdrv_readahead_filter = {
+    .format_name = "readahead",
+    .instance_size = sizeof(BDRVReadaheadState),
+
+    .bdrv_co_getlength    = readahead_co_getlength,
+    .bdrv_open            = readahead_open,
+    .bdrv_close           = readahead_close,
+
+    .bdrv_reopen_prepare  = readahead_reopen_prepare,
+    .bdrv_reopen_commit   = readahead_reopen_commit,
+    .bdrv_reopen_abort    = readahead_reopen_abort,
+
+    .bdrv_co_preadv_part = readahead_co_preadv_part,
+    .bdrv_co_pwritev_part = readahead_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes = readahead_co_pwrite_zeroes,
+    .bdrv_co_pdiscard = readahead_co_pdiscard,
+    .bdrv_co_flush = readahead_co_flush,
+    .bdrv_co_truncate = readahead_co_truncate,
+    .bdrv_co_block_status = readahead_co_block_status,
+
+    .bdrv_get_specific_stats = readahead_get_specific_stats,
+
+    .bdrv_child_perm = readahead_child_perm,
+
+    .is_filter = true,
+};
+
+static void bdrv_readahead_init(void)
+{
+    bdrv_register(&bdrv_readahead_filter);
+}
+
+block_init(bdrv_readahead_init);
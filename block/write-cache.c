@@ -0,0 +1,901 @@
+/*
+ * write-cache filter driver
+ *
+ * The driver completes guest writes as soon as their data has been copied
+ * into a bounded cache in QEMU memory and writes the data back to its child in
+ * the background.  Adjacent dirty data is written back in a single request.
+ * This hides the latency of slow backends, e.g. shared network storage, from
+ * the guest as long as the cache is not full.
+ *
+ * Like a volatile disk write cache, the cache is emptied whenever the guest
+ * flushes: A flush only completes once all data written before it has been
+ * written back and the child has been flushed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+
+#include "qapi/error.h"
+#include "qapi/qapi-types-block-core.h"
+#include "qemu/bitmap.h"
+#include "qemu/coroutine.h"
+#include "qemu/memalign.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/range.h"
+#include "qemu/units.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "trace.h"
+
+/* Minimum size of a cache line, larger if the child needs a larger alignment */
+#define WRITE_CACHE_LINE_SIZE (64 * KiB)
+
+/* Adjacent lines are written back together up to this size */
+#define WRITE_CACHE_MAX_WRITEBACK (1 * MiB)
+#define WRITE_CACHE_MAX_SEGMENTS \
+    (WRITE_CACHE_MAX_WRITEBACK / WRITE_CACHE_LINE_SIZE + 1)
+
+/* Number of writeback requests that may be in flight at the same time */
+#define WRITE_CACHE_MAX_WORKERS 4
+
+typedef struct WriteCacheOpts {
+    uint64_t cache_size;
+    uint64_t dirty_threshold;
+} WriteCacheOpts;
+
+typedef struct WriteCacheLine {
+    /* Offset of the line divided by the line size, key in s->lines */
+    int64_t index;
+    void *buf;
+
+    /* Blocks of @buf that hold data, and those not written back yet */
+    unsigned long *valid;
+    unsigned long *dirty;
+    int64_t nb_dirty;
+
+    /* Sequence number of the oldest write whose data is not written back */
+    uint64_t dirty_seq;
+
+    /* Part of the line is being written back, it must not be modified */
+    bool writeback;
+    /* Requests that rely on the line staying in the cache */
+    unsigned pinned;
+    /* Requests waiting for the writeback to complete */
+    CoQueue waiters;
+
+    QTAILQ_ENTRY(WriteCacheLine) next;
+} WriteCacheLine;
+
+typedef struct BDRVWriteCacheState {
+    WriteCacheOpts opts;
+
+    /* Fixed when opening, the granularity is the request alignment */
+    int64_t line_size;
+    int64_t granularity;
+    long bits_per_line;
+
+    /* Protects all fields below */
+    CoMutex lock;
+
+    GHashTable *lines;
+    /* All lines, in the order in which they became dirty */
+    QTAILQ_HEAD(, WriteCacheLine) line_list;
+    int64_t nb_lines;
+    int64_t dirty_bytes;
+
+    uint64_t write_seq;
+    /* Data written up to this sequence number is written back immediately */
+    uint64_t flush_seq;
+
+    /* Writes waiting for a free line */
+    CoQueue space_queue;
+    unsigned space_waiters;
+    /* Requests waiting for writeback to make progress */
+    CoQueue writeback_queue;
+
+    int nb_workers;
+    /* First writeback error since the last flush started */
+    int writeback_error;
+
+    uint64_t read_hits;
+    uint64_t write_stalls;
+    uint64_t writeback_requests;
+    uint64_t writeback_bytes;
+} BDRVWriteCacheState;
+
+#define WRITE_CACHE_OPT_CACHE_SIZE "cache-size"
+#define WRITE_CACHE_OPT_DIRTY_THRESHOLD "dirty-threshold"
+static QemuOptsList runtime_opts = {
+    .name = "write-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = WRITE_CACHE_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "maximum amount of cached data, default 32M",
+        },
+        {
+            .name = WRITE_CACHE_OPT_DIRTY_THRESHOLD,
+            .type = QEMU_OPT_SIZE,
+            .help = "amount of dirty data above which writeback starts, "
+                "default half of cache-size",
+        },
+        { /* end of list */ }
+    },
+};
+
+static bool write_cache_absorb_opts(WriteCacheOpts *dest, QDict *options,
+                                    int64_t line_size, Error **errp)
+{
+    QemuOpts *opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        qemu_opts_del(opts);
+        return false;
+    }
+
+    dest->cache_size =
+        qemu_opt_get_size(opts, WRITE_CACHE_OPT_CACHE_SIZE, 32 * MiB);
+    dest->dirty_threshold =
+        qemu_opt_get_size(opts, WRITE_CACHE_OPT_DIRTY_THRESHOLD,
+                          dest->cache_size / 2);
+
+    qemu_opts_del(opts);
+
+    if (dest->cache_size < line_size) {
+        error_setg(errp, "cache-size parameter of write-cache filter must be "
+                   "at least %" PRId64, line_size);
+        return false;
+    }
+
+    if (dest->dirty_threshold > dest->cache_size) {
+        error_setg(errp, "dirty-threshold parameter of write-cache filter "
+                   "must not be larger than cache-size");
+        return false;
+    }
+
+    return true;
+}
+
+static int write_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                            Error **errp)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+    int ret;
+
+    GLOBAL_STATE_CODE();
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    s->granularity = MAX(bs->file->bs->bl.request_alignment,
+                         BDRV_SECTOR_SIZE);
+    s->line_size = MAX(WRITE_CACHE_LINE_SIZE, s->granularity);
+    s->bits_per_line = s->line_size / s->granularity;
+
+    if (!write_cache_absorb_opts(&s->opts, options, s->line_size, errp)) {
+        return -EINVAL;
+    }
+
+    qemu_co_mutex_init(&s->lock);
+    s->lines = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&s->line_list);
+    qemu_co_queue_init(&s->space_queue);
+    qemu_co_queue_init(&s->writeback_queue);
+
+    /* FUA is emulated with a flush, which empties the cache */
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED;
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    return 0;
+}
+
+static void write_cache_free_line(BDRVWriteCacheState *s, WriteCacheLine *line)
+{
+    g_hash_table_remove(s->lines, &line->index);
+    QTAILQ_REMOVE(&s->line_list, line, next);
+    s->nb_lines--;
+    s->dirty_bytes -= line->nb_dirty * s->granularity;
+
+    qemu_vfree(line->buf);
+    g_free(line->valid);
+    g_free(line->dirty);
+    g_free(line);
+}
+
+static void write_cache_close(BlockDriverState *bs)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+
+    /*
+     * bdrv_close() flushed and drained the node.  Anything left could not be
+     * written back and is lost, just like the content of a disk write cache
+     * when the disk fails.
+     */
+    while (!QTAILQ_EMPTY(&s->line_list)) {
+        write_cache_free_line(s, QTAILQ_FIRST(&s->line_list));
+    }
+    g_hash_table_destroy(s->lines);
+}
+
+static int write_cache_reopen_prepare(BDRVReopenState *reopen_state,
+                                      BlockReopenQueue *queue, Error **errp)
+{
+    WriteCacheOpts *opts = g_new0(WriteCacheOpts, 1);
+    BDRVWriteCacheState *s = reopen_state->bs->opaque;
+
+    GLOBAL_STATE_CODE();
+
+    if (!write_cache_absorb_opts(opts, reopen_state->options, s->line_size,
+                                 errp)) {
+        g_free(opts);
+        return -EINVAL;
+    }
+
+    reopen_state->opaque = opts;
+
+    return 0;
+}
+
+static void write_cache_reopen_commit(BDRVReopenState *state)
+{
+    BDRVWriteCacheState *s = state->bs->opaque;
+
+    /*
+     * If the cache holds more lines than the new size allows, writes wait
+     * until enough of them have been written back.
+     */
+    s->opts = *(WriteCacheOpts *)state->opaque;
+    g_free(state->opaque);
+    state->opaque = NULL;
+}
+
+static void write_cache_reopen_abort(BDRVReopenState *state)
+{
+    g_free(state->opaque);
+    state->opaque = NULL;
+}
+
+static void write_cache_refresh_limits(BlockDriverState *bs, Error **errp)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+
+    /* The cache tracks whole blocks of this size */
+    bs->bl.request_alignment = MAX(bs->bl.request_alignment, s->granularity);
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+write_cache_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+/* Called with s->lock held */
+static WriteCacheLine *write_cache_find_line(BDRVWriteCacheState *s,
+                                             int64_t index)
+{
+    return g_hash_table_lookup(s->lines, &index);
+}
+
+/* Frees @line if it holds no data that is needed any more */
+static void write_cache_maybe_free_line(BDRVWriteCacheState *s,
+                                        WriteCacheLine *line)
+{
+    if (line->nb_dirty || line->writeback || line->pinned) {
+        return;
+    }
+
+    write_cache_free_line(s, line);
+    qemu_co_queue_restart_all(&s->space_queue);
+}
+
+/*
+ * Returns the oldest dirty line that is not being written back if there is a
+ * reason to write it back now, NULL otherwise.  Called with s->lock held.
+ */
+static WriteCacheLine *write_cache_next_writeback(BDRVWriteCacheState *s)
+{
+    WriteCacheLine *line;
+
+    if (s->writeback_error) {
+        return NULL;
+    }
+
+    QTAILQ_FOREACH(line, &s->line_list, next) {
+        if (!line->nb_dirty || line->writeback) {
+            continue;
+        }
+        if (s->space_waiters || s->dirty_bytes > s->opts.dirty_threshold ||
+            line->dirty_seq <= s->flush_seq) {
+            return line;
+        }
+        /* Lines are in dirty_seq order, so nothing else is due either */
+        return NULL;
+    }
+
+    return NULL;
+}
+
+typedef struct WriteCacheSegment {
+    WriteCacheLine *line;
+    long start;
+    long nb_bits;
+} WriteCacheSegment;
+
+static void coroutine_fn write_cache_co_writeback(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVWriteCacheState *s = bs->opaque;
+    WriteCacheLine *line;
+
+    qemu_co_mutex_lock(&s->lock);
+    while ((line = write_cache_next_writeback(s))) {
+        WriteCacheSegment segs[WRITE_CACHE_MAX_SEGMENTS];
+        QEMUIOVector qiov;
+        int64_t offset, bytes = 0;
+        int i, nb_segs = 0;
+        long bit;
+        int ret;
+
+        /* Collect the dirty run starting at the first dirty block of @line */
+        bit = find_first_bit(line->dirty, s->bits_per_line);
+        offset = line->index * s->line_size + bit * s->granularity;
+        qemu_iovec_init(&qiov, WRITE_CACHE_MAX_SEGMENTS);
+
+        while (true) {
+            WriteCacheSegment *seg = &segs[nb_segs++];
+            long end = find_next_zero_bit(line->dirty, s->bits_per_line, bit);
+
+            *seg = (WriteCacheSegment) {
+                .line = line,
+                .start = bit,
+                .nb_bits = end - bit,
+            };
+            line->writeback = true;
+            bitmap_clear(line->dirty, bit, seg->nb_bits);
+            line->nb_dirty -= seg->nb_bits;
+            s->dirty_bytes -= seg->nb_bits * s->granularity;
+            qemu_iovec_add(&qiov, line->buf + bit * s->granularity,
+                           seg->nb_bits * s->granularity);
+            bytes += seg->nb_bits * s->granularity;
+
+            if (end < s->bits_per_line || bytes >= WRITE_CACHE_MAX_WRITEBACK ||
+                nb_segs == WRITE_CACHE_MAX_SEGMENTS)
+            {
+                break;
+            }
+
+            /* Coalesce with the next line if its dirty data is adjacent */
+            line = write_cache_find_line(s, line->index + 1);
+            if (!line || line->writeback || !test_bit(0, line->dirty)) {
+                break;
+            }
+            bit = 0;
+        }
+
+        s->writeback_requests++;
+        s->writeback_bytes += bytes;
+        trace_write_cache_writeback(bs, offset, bytes);
+        qemu_co_mutex_unlock(&s->lock);
+
+        WITH_GRAPH_RDLOCK_GUARD() {
+            ret = bdrv_co_pwritev(bs->file, offset, bytes, &qiov, 0);
+        }
+        trace_write_cache_writeback_done(bs, offset, bytes, ret);
+        qemu_iovec_destroy(&qiov);
+
+        qemu_co_mutex_lock(&s->lock);
+        for (i = 0; i < nb_segs; i++) {
+            WriteCacheSegment *seg = &segs[i];
+
+            /* Writes to lines under writeback wait, so the data is unchanged */
+            if (ret < 0) {
+                bitmap_set(seg->line->dirty, seg->start, seg->nb_bits);
+                seg->line->nb_dirty += seg->nb_bits;
+                s->dirty_bytes += seg->nb_bits * s->granularity;
+            }
+            seg->line->writeback = false;
+            qemu_co_queue_restart_all(&seg->line->waiters);
+            write_cache_maybe_free_line(s, seg->line);
+        }
+
+        if (ret < 0) {
+            /* Keep the data and report the error on the next flush */
+            if (!s->writeback_error) {
+                s->writeback_error = ret;
+            }
+            qemu_co_queue_restart_all(&s->space_queue);
+        }
+        qemu_co_queue_restart_all(&s->writeback_queue);
+    }
+
+    s->nb_workers--;
+    qemu_co_mutex_unlock(&s->lock);
+
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Start writeback workers if there is something to write back.  They run once
+ * the calling request yields or completes.  Called with s->lock held.
+ */
+static void write_cache_kick(BlockDriverState *bs)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+
+    if (!write_cache_next_writeback(s)) {
+        return;
+    }
+
+    while (s->nb_workers < WRITE_CACHE_MAX_WORKERS) {
+        Coroutine *co = qemu_coroutine_create(write_cache_co_writeback, bs);
+
+        s->nb_workers++;
+        bdrv_inc_in_flight(bs);
+        aio_co_enter(qemu_get_current_aio_context(), co);
+    }
+}
+
+/*
+ * Returns the line with the given index, allocating it if necessary.  Waits
+ * until the line is not being written back any more, so that the caller may
+ * modify it.  Called with s->lock held, which may be dropped temporarily.
+ */
+static WriteCacheLine * coroutine_fn GRAPH_RDLOCK
+write_cache_co_get_line(BlockDriverState *bs, int64_t index, int *ret)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+    WriteCacheLine *line;
+
+    while (true) {
+        line = write_cache_find_line(s, index);
+        if (line && line->writeback) {
+            qemu_co_queue_wait(&line->waiters, &s->lock);
+            continue;
+        }
+        if (line) {
+            return line;
+        }
+
+        if (s->writeback_error) {
+            *ret = s->writeback_error;
+            return NULL;
+        }
+
+        if (s->nb_lines < s->opts.cache_size / s->line_size) {
+            break;
+        }
+
+        s->write_stalls++;
+        trace_write_cache_write_stall(bs, index * s->line_size);
+        s->space_waiters++;
+        write_cache_kick(bs);
+        qemu_co_queue_wait(&s->space_queue, &s->lock);
+        s->space_waiters--;
+    }
+
+    line = g_new0(WriteCacheLine, 1);
+    line->buf = qemu_try_blockalign(bs->file->bs, s->line_size);
+    if (!line->buf) {
+        g_free(line);
+        *ret = -ENOMEM;
+        return NULL;
+    }
+    line->index = index;
+    line->valid = bitmap_new(s->bits_per_line);
+    line->dirty = bitmap_new(s->bits_per_line);
+    qemu_co_queue_init(&line->waiters);
+
+    g_hash_table_insert(s->lines, &line->index, line);
+    QTAILQ_INSERT_TAIL(&s->line_list, line, next);
+    s->nb_lines++;
+
+    return line;
+}
+
+/*
+ * Marks [@offset, @offset + @bytes) of @line as holding new data written by
+ * the request with sequence number @seq.  Called with s->lock held.
+ */
+static void write_cache_mark_dirty(BDRVWriteCacheState *s,
+                                   WriteCacheLine *line, int64_t offset,
+                                   int64_t bytes, uint64_t seq)
+{
+    long start = offset / s->granularity;
+    long nb_bits = bytes / s->granularity;
+    long newly_dirty =
+        nb_bits - bitmap_count_one_with_offset(line->dirty, start, nb_bits);
+
+    if (!line->nb_dirty) {
+        line->dirty_seq = seq;
+        QTAILQ_REMOVE(&s->line_list, line, next);
+        QTAILQ_INSERT_TAIL(&s->line_list, line, next);
+    }
+    bitmap_set(line->valid, start, nb_bits);
+    bitmap_set(line->dirty, start, nb_bits);
+    line->nb_dirty += newly_dirty;
+    s->dirty_bytes += newly_dirty * s->granularity;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+write_cache_co_preadv_part(BlockDriverState *bs, int64_t offset,
+                           int64_t bytes, QEMUIOVector *qiov,
+                           size_t qiov_offset, BdrvRequestFlags flags)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+    g_autoptr(GPtrArray) pinned = NULL;
+    int64_t pos, end = offset + bytes;
+    bool cached = true;
+    int ret;
+    guint i;
+
+    qemu_co_mutex_lock(&s->lock);
+
+    for (pos = offset; pos < end && cached; ) {
+        int64_t index = pos / s->line_size;
+        int64_t line_end = MIN(end, (index + 1) * s->line_size);
+        WriteCacheLine *line = write_cache_find_line(s, index);
+        long start = (pos - index * s->line_size) / s->granularity;
+        long nb_bits = (line_end - pos) / s->granularity;
+
+        cached = line &&
+            find_next_zero_bit(line->valid, start + nb_bits, start) ==
+                start + nb_bits;
+        pos = line_end;
+    }
+
+    if (cached) {
+        for (pos = offset; pos < end; ) {
+            int64_t index = pos / s->line_size;
+            int64_t line_end = MIN(end, (index + 1) * s->line_size);
+            WriteCacheLine *line = write_cache_find_line(s, index);
+
+            qemu_iovec_from_buf(qiov, qiov_offset + (pos - offset),
+                                line->buf + (pos - index * s->line_size),
+                                line_end - pos);
+            pos = line_end;
+        }
+        s->read_hits++;
+        qemu_co_mutex_unlock(&s->lock);
+        return 0;
+    }
+
+    /*
+     * Keep the cached data until it has been copied over what is read from
+     * the child, which may not have it yet.
+     */
+    for (pos = QEMU_ALIGN_DOWN(offset, s->line_size); pos < end;
+         pos += s->line_size)
+    {
+        WriteCacheLine *line = write_cache_find_line(s, pos / s->line_size);
+
+        if (line) {
+            if (!pinned) {
+                pinned = g_ptr_array_new();
+            }
+            line->pinned++;
+            g_ptr_array_add(pinned, line);
+        }
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    ret = bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                              flags);
+
+    if (!pinned) {
+        return ret;
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+    for (i = 0; i < pinned->len; i++) {
+        WriteCacheLine *line = g_ptr_array_index(pinned, i);
+        int64_t line_offset = line->index * s->line_size;
+        long first = (MAX(offset, line_offset) - line_offset) / s->granularity;
+        long last = (MIN(end, line_offset + s->line_size) - line_offset) /
+                    s->granularity;
+        long bit = first;
+
+        while (ret >= 0 && bit < last) {
+            long run_end;
+
+            bit = find_next_bit(line->valid, last, bit);
+            if (bit >= last) {
+                break;
+            }
+            run_end = find_next_zero_bit(line->valid, last, bit);
+            qemu_iovec_from_buf(qiov, qiov_offset +
+                                (line_offset + bit * s->granularity - offset),
+                                line->buf + bit * s->granularity,
+                                (run_end - bit) * s->granularity);
+            bit = run_end;
+        }
+
+        line->pinned--;
+        write_cache_maybe_free_line(s, line);
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+write_cache_co_pwritev_part(BlockDriverState *bs, int64_t offset,
+                            int64_t bytes, QEMUIOVector *qiov,
+                            size_t qiov_offset, BdrvRequestFlags flags)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+    int64_t done = 0;
+    uint64_t seq;
+    int ret = 0;
+
+    qemu_co_mutex_lock(&s->lock);
+    seq = ++s->write_seq;
+
+    while (done < bytes) {
+        int64_t index = (offset + done) / s->line_size;
+        int64_t line_offset = offset + done - index * s->line_size;
+        int64_t n = MIN(bytes - done, s->line_size - line_offset);
+        WriteCacheLine *line;
+
+        line = write_cache_co_get_line(bs, index, &ret);
+        if (!line) {
+            break;
+        }
+
+        qemu_iovec_to_buf(qiov, qiov_offset + done, line->buf + line_offset, n);
+        write_cache_mark_dirty(s, line, line_offset, n, seq);
+
+        done += n;
+    }
+
+    write_cache_kick(bs);
+    qemu_co_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+write_cache_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
+                             int64_t bytes, BdrvRequestFlags flags)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+    WriteCacheLine *line, *next_line;
+    int64_t end = offset + bytes;
+    uint64_t seq;
+
+    qemu_co_mutex_lock(&s->lock);
+
+retry:
+    QTAILQ_FOREACH(line, &s->line_list, next) {
+        if (!ranges_overlap(line->index * s->line_size, s->line_size,
+                            offset, bytes)) {
+            continue;
+        }
+        if (flags & BDRV_REQ_NO_FALLBACK) {
+            /* Cached data would have to be zeroed in memory */
+            qemu_co_mutex_unlock(&s->lock);
+            return -ENOTSUP;
+        }
+        if (line->writeback) {
+            qemu_co_queue_wait(&line->waiters, &s->lock);
+            goto retry;
+        }
+    }
+
+    /*
+     * Zero cached data instead of dropping it, so that neither concurrent
+     * reads nor the writeback of the rest of the line can expose data that
+     * predates the cached data.  The zeroes are written back like any other
+     * data.
+     */
+    seq = ++s->write_seq;
+    QTAILQ_FOREACH_SAFE(line, &s->line_list, next, next_line) {
+        int64_t line_offset = line->index * s->line_size;
+        int64_t start, n;
+
+        if (!ranges_overlap(line_offset, s->line_size, offset, bytes)) {
+            continue;
+        }
+
+        start = MAX(offset, line_offset) - line_offset;
+        n = MIN(end, line_offset + s->line_size) - line_offset - start;
+        memset(line->buf + start, 0, n);
+        write_cache_mark_dirty(s, line, start, n, seq);
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    return bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+write_cache_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    /*
+     * Discarding is only a hint, so dirty data may still be written back over
+     * the discarded range afterwards.
+     */
+    return bdrv_co_pdiscard(bs->file, offset, bytes);
+}
+
+/*
+ * Returns true if data written up to @seq has not been written back yet.
+ * Called with s->lock held.
+ */
+static bool write_cache_pending(BDRVWriteCacheState *s, uint64_t seq)
+{
+    WriteCacheLine *line;
+
+    QTAILQ_FOREACH(line, &s->line_list, next) {
+        if ((line->nb_dirty || line->writeback) && line->dirty_seq <= seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Write back everything that was written before the call */
+static int coroutine_fn write_cache_co_writeback_all(BlockDriverState *bs)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+    int ret;
+
+    qemu_co_mutex_lock(&s->lock);
+
+    /* Retry writing back data that failed before */
+    s->writeback_error = 0;
+    s->flush_seq = s->write_seq;
+    write_cache_kick(bs);
+
+    while (!s->writeback_error && write_cache_pending(s, s->flush_seq)) {
+        qemu_co_queue_wait(&s->writeback_queue, &s->lock);
+    }
+
+    ret = s->writeback_error;
+    qemu_co_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+write_cache_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
+                        PreallocMode prealloc, BdrvRequestFlags flags,
+                        Error **errp)
+{
+    int ret;
+
+    /* Cached data beyond the new end of the node must not be written back */
+    ret = write_cache_co_writeback_all(bs);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to write back cached data");
+        return ret;
+    }
+
+    return bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+write_cache_co_flush(BlockDriverState *bs)
+{
+    int ret;
+
+    ret = write_cache_co_writeback_all(bs);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return bdrv_co_flush(bs->file->bs);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+write_cache_co_block_status(BlockDriverState *bs, bool want_zero,
+                            int64_t offset, int64_t bytes, int64_t *pnum,
+                            int64_t *map, BlockDriverState **file)
+{
+    BDRVWriteCacheState *s = bs->opaque;
+    WriteCacheLine *line;
+    int64_t next = offset + bytes;
+
+    qemu_co_mutex_lock(&s->lock);
+    QTAILQ_FOREACH(line, &s->line_list, next) {
+        int64_t line_offset = line->index * s->line_size;
+
+        if (offset >= line_offset && offset < line_offset + s->line_size) {
+            /* The child may not have the data yet */
+            *pnum = MIN(bytes, line_offset + s->line_size - offset);
+            qemu_co_mutex_unlock(&s->lock);
+            return BDRV_BLOCK_DATA;
+        }
+        if (line_offset > offset) {
+            next = MIN(next, line_offset);
+        }
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    *pnum = next - offset;
+    *map = offset;
+    *file = bs->file->bs;
+    return BDRV_BLOCK_RAW | BDRV_BLOCK_OFFSET_VALID;
+}
+
+static BlockStatsSpecific *write_cache_get_specific_stats(BlockDriverState *bs)
+{
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+    BDRVWriteCacheState *s = bs->opaque;
+
+    stats->driver = BLOCKDEV_DRIVER_WRITE_CACHE;
+    stats->u.write_cache = (BlockStatsSpecificWriteCache) {
+        .dirty_bytes = s->dirty_bytes,
+        .read_hits = s->read_hits,
+        .write_stalls = s->write_stalls,
+        .writeback_requests = s->writeback_requests,
+        .writeback_bytes = s->writeback_bytes,
+    };
+
+    return stats;
+}
+
+static void write_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+    BdrvChildRole role, BlockReopenQueue *reopen_queue,
+    uint64_t perm, uint64_t shared, uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared, nperm, nshared);
+
+    /* Writes that bypass the filter could be overwritten by the writeback */
+    *nshared &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+}
+
+static BlockDriver bdrv_write_cache_filter = {
+    .format_name = "write-cache",
+    .instance_size = sizeof(BDRVWriteCacheState),
+
+    .bdrv_co_getlength    = write_cache_co_getlength,
+    .bdrv_open            = write_cache_open,
+    .bdrv_close           = write_cache_close,
+
+    .bdrv_reopen_prepare  = write_cache_reopen_prepare,
+    .bdrv_reopen_commit   = write_cache_reopen_commit,
+    .bdrv_reopen_abort    = write_cache_reopen_abort,
+
+    .bdrv_refresh_limits = write_cache_refresh_limits,
+
+    .bdrv_co_preadv_part = write_cache_co_preadv_part,
+    .bdrv_co_pwritev_part = write_cache_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes = write_cache_co_pwrite_zeroes,
+    .bdrv_co_pdiscard = write_cache_co_pdiscard,
+    .bdrv_co_flush = write_cache_co_flush,
+    .bdrv_co_truncate = write_cache_co_truncate,
+    .bdrv_co_block_status = write_cache_co_block_status,
+
+    .bdrv_get_specific_stats = write_cache_get_specific_stats,
+
+    .bdrv_child_perm = write_cache_child_perm,
+
+    .is_filter = true,
+};
+
+static void bdrv_write_cache_init(void)
+{
+    bdrv_register(&bdrv_write_cache_filter);
+}
+
+block_init(bdrv_write_cache_init);
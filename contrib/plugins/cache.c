@@ -25,6 +25,10 @@ static GRand *rng;
 static int limit;
 static bool sys;
 
+/* Only simulate one in sample_period data accesses, if it is above 1 */
+static uint64_t sample_period;
+static struct qemu_plugin_scoreboard *sample_counts;
+
 enum EvictionPolicy {
     LRU,
     FIFO,
@@ -496,9 +500,20 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
         }
         g_mutex_unlock(&hashtable_lock);
 
-        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
-                                         QEMU_PLUGIN_CB_NO_REGS,
-                                         rw, data);
+        if (sample_period > 1) {
+            struct qemu_plugin_mem_filter filter = {
+                .rw = rw,
+                .period = sample_period,
+                .counter = qemu_plugin_scoreboard_u64(sample_counts),
+            };
+            qemu_plugin_register_vcpu_mem_filtered_cb(insn, vcpu_mem_access,
+                                                      QEMU_PLUGIN_CB_NO_REGS,
+                                                      &filter, data);
+        } else {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
+                                             QEMU_PLUGIN_CB_NO_REGS,
+                                             rw, data);
+        }
 
         qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
                                                QEMU_PLUGIN_CB_NO_REGS, data);
@@ -717,6 +732,10 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     }
 
     g_hash_table_destroy(miss_ht);
+
+    if (sample_counts) {
+        qemu_plugin_scoreboard_free(sample_counts);
+    }
 }
 
 static void policy_init(void)
@@ -789,6 +808,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
             limit = STRTOLL(tokens[1]);
         } else if (g_strcmp0(tokens[0], "cores") == 0) {
             cores = STRTOLL(tokens[1]);
+        } else if (g_strcmp0(tokens[0], "sample") == 0) {
+            sample_period = STRTOLL(tokens[1]);
         } else if (g_strcmp0(tokens[0], "l2cachesize") == 0) {
             use_l2 = true;
             l2_cachesize = STRTOLL(tokens[1]);
@@ -846,6 +867,10 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         return -1;
     }
 
+    if (sample_period > 1) {
+        sample_counts = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+    }
+
     l1_dcache_locks = g_new0(GMutex, cores);
     l1_icache_locks = g_new0(GMutex, cores);
     l2_ucache_locks = use_l2 ? g_new0(GMutex, cores) : NULL;
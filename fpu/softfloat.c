@@ -84,6 +84,7 @@ this code that are retained.
  */
 #include "qemu/osdep.h"
 #include <math.h>
+#include <fenv.h>
 #include "qemu/bitops.h"
 #include "fpu/softfloat.h"
 
@@ -232,13 +233,76 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 # define QEMU_SOFTFLOAT_ATTR QEMU_FLATTEN __attribute__((noinline))
 #endif
 
-static inline bool can_use_fpu(const float_status *s)
+/*
+ * The float_status whose inexact flag is currently being accumulated in
+ * the host FPU's status register, see set_float_lazy_inexact().
+ */
+static __thread float_status *lazy_inexact_owner;
+
+static void lazy_inexact_fold(float_status *s)
+{
+#ifdef FE_INEXACT
+    if (fetestexcept(FE_INEXACT)) {
+        s->float_exception_flags |= float_flag_inexact;
+    }
+#endif
+    lazy_inexact_owner = NULL;
+}
+
+static bool lazy_inexact_start(float_status *s)
+{
+#ifdef FE_INEXACT
+    if (lazy_inexact_owner != s) {
+        if (lazy_inexact_owner) {
+            lazy_inexact_fold(lazy_inexact_owner);
+        }
+        feclearexcept(FE_INEXACT);
+        lazy_inexact_owner = s;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void float_lazy_inexact_sync(float_status *s)
+{
+    if (lazy_inexact_owner == s) {
+        lazy_inexact_fold(s);
+    }
+}
+
+void float_lazy_inexact_discard(float_status *s)
+{
+    if (lazy_inexact_owner == s) {
+        lazy_inexact_owner = NULL;
+    }
+}
+
+void float_lazy_inexact_sync_thread(void)
+{
+    if (lazy_inexact_owner) {
+        lazy_inexact_fold(lazy_inexact_owner);
+    }
+}
+
+static inline bool can_use_fpu(float_status *s)
 {
     if (QEMU_NO_HARDFLOAT) {
         return false;
     }
-    return likely(s->float_exception_flags & float_flag_inexact &&
-                  s->float_rounding_mode == float_round_nearest_even);
+    if (likely(s->float_exception_flags & float_flag_inexact &&
+               s->float_rounding_mode == float_round_nearest_even)) {
+        /* Do not let the host operation set inexact for another status. */
+        if (unlikely(lazy_inexact_owner) && lazy_inexact_owner != s) {
+            lazy_inexact_fold(lazy_inexact_owner);
+        }
+        return true;
+    }
+    /* Let the host FPU compute the inexact flag, if the target allows. */
+    return unlikely(s->lazy_self == s) &&
+           s->float_rounding_mode == float_round_nearest_even &&
+           lazy_inexact_start(s);
 }
 
 /*
@@ -401,6 +465,76 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     return soft(ua.s, ub.s, s);
 }
 
+/*
+ * Conversion to integer with the host FPU.  Only zero or normal inputs
+ * whose rounded value is known to fit in the destination are handled
+ * here, so no exception other than inexact can occur; can_use_fpu()
+ * guarantees that inexact is already set.  The host always rounds to
+ * nearest-even, so other rounding modes are left to softfloat.
+ */
+#define HARD_INT32_LIMIT  2147483647.5
+#define HARD_INT64_LIMIT  0x1p63
+
+static inline bool hard_float_to_sint(double d, FloatRoundMode rmode,
+                                      double limit, int64_t *ret)
+{
+    if (!(fabs(d) < limit)) {
+        return false;
+    }
+    switch (rmode) {
+    case float_round_nearest_even:
+        *ret = rint(d);
+        return true;
+    case float_round_to_zero:
+        *ret = d;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline bool float32_to_sint_hard(float32 a, FloatRoundMode rmode,
+                                        int scale, double limit,
+                                        float_status *s, int64_t *ret)
+{
+    union_float32 ua;
+
+    ua.s = a;
+    if (unlikely(scale != 0 || !can_use_fpu(s))) {
+        return false;
+    }
+    if (QEMU_HARDFLOAT_1F32_USE_FP) {
+        if (unlikely(!(fpclassify(ua.h) == FP_NORMAL ||
+                       fpclassify(ua.h) == FP_ZERO))) {
+            return false;
+        }
+    } else if (unlikely(!float32_is_zero_or_normal(ua.s))) {
+        return false;
+    }
+    return hard_float_to_sint(ua.h, rmode, limit, ret);
+}
+
+static inline bool float64_to_sint_hard(float64 a, FloatRoundMode rmode,
+                                        int scale, double limit,
+                                        float_status *s, int64_t *ret)
+{
+    union_float64 ua;
+
+    ua.s = a;
+    if (unlikely(scale != 0 || !can_use_fpu(s))) {
+        return false;
+    }
+    if (QEMU_HARDFLOAT_1F64_USE_FP) {
+        if (unlikely(!(fpclassify(ua.h) == FP_NORMAL ||
+                       fpclassify(ua.h) == FP_ZERO))) {
+            return false;
+        }
+    } else if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        return false;
+    }
+    return hard_float_to_sint(ua.h, rmode, limit, ret);
+}
+
 /*
  * Classify a floating point number. Everything above float_class_qnan
  * is a NaN so cls >= float_class_qnan is any NaN.
@@ -2825,7 +2959,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2834,6 +2969,40 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 QEMU_FLATTEN float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ua;
+    union_float32 ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ua.s, s);
+    if (QEMU_HARDFLOAT_1F64_USE_FP) {
+        if (unlikely(!(fpclassify(ua.h) == FP_NORMAL ||
+                       fpclassify(ua.h) == FP_ZERO))) {
+            goto soft;
+        }
+    } else if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+
+    ur.h = ua.h;
+    if (unlikely(f32_is_inf(ur))) {
+        float_raise(float_flag_overflow, s);
+    } else if (unlikely(fabsf(ur.h) <= FLT_MIN) &&
+               !float64_is_zero(ua.s)) {
+        /* Leave underflow and denormal results to softfloat. */
+        goto soft;
+    }
+    return ur.s;
+
+ soft:
+    return soft_float64_to_float32(ua.s, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
@@ -2990,7 +3159,8 @@ float16 float16_round_to_int(float16 a, float_status *s)
     return float16_round_pack_canonical(&p, s);
 }
 
-float32 float32_round_to_int(float32 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_f32_round_to_int(float32 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2999,7 +3169,8 @@ float32 float32_round_to_int(float32 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
-float64 float64_round_to_int(float64 a, float_status *s)
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_f64_round_to_int(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -3008,6 +3179,56 @@ float64 float64_round_to_int(float64 a, float_status *s)
     return float64_round_pack_canonical(&p, s);
 }
 
+float32 QEMU_FLATTEN float32_round_to_int(float32 xa, float_status *s)
+{
+    union_float32 ua, ur;
+
+    ua.s = xa;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float32_input_flush1(&ua.s, s);
+    if (QEMU_HARDFLOAT_1F32_USE_FP) {
+        if (unlikely(!(fpclassify(ua.h) == FP_NORMAL ||
+                       fpclassify(ua.h) == FP_ZERO))) {
+            goto soft;
+        }
+    } else if (unlikely(!float32_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+    ur.h = rintf(ua.h);
+    return ur.s;
+
+ soft:
+    return soft_f32_round_to_int(ua.s, s);
+}
+
+float64 QEMU_FLATTEN float64_round_to_int(float64 xa, float_status *s)
+{
+    union_float64 ua, ur;
+
+    ua.s = xa;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ua.s, s);
+    if (QEMU_HARDFLOAT_1F64_USE_FP) {
+        if (unlikely(!(fpclassify(ua.h) == FP_NORMAL ||
+                       fpclassify(ua.h) == FP_ZERO))) {
+            goto soft;
+        }
+    } else if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+    ur.h = rint(ua.h);
+    return ur.s;
+
+ soft:
+    return soft_f64_round_to_int(ua.s, s);
+}
+
 bfloat16 bfloat16_round_to_int(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
@@ -3092,6 +3313,11 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (float32_to_sint_hard(a, rmode, scale, HARD_INT32_LIMIT, s, &r)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3101,6 +3327,11 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (float32_to_sint_hard(a, rmode, scale, HARD_INT64_LIMIT, s, &r)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3119,6 +3350,11 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (float64_to_sint_hard(a, rmode, scale, HARD_INT32_LIMIT, s, &r)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3128,6 +3364,11 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (float64_to_sint_hard(a, rmode, scale, HARD_INT64_LIMIT, s, &r)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -4282,6 +4523,26 @@ static bfloat16 bfloat16_minmax(bfloat16 a, bfloat16 b,
 static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
+    union_float32 ua, ub;
+
+    /*
+     * Picking one of two distinct normal numbers raises no exception,
+     * so the host can compare them regardless of the float_status.
+     * NaNs, zeroes and ties need the rules of parts_minmax.
+     */
+    ua.s = a;
+    ub.s = b;
+    float32_input_flush2(&ua.s, &ub.s, s);
+    if (likely(float32_is_normal(ua.s) && float32_is_normal(ub.s))) {
+        float fa = flags & minmax_ismag ? fabsf(ua.h) : ua.h;
+        float fb = flags & minmax_ismag ? fabsf(ub.h) : ub.h;
+
+        if (fa != fb) {
+            return (fa < fb) == !!(flags & minmax_ismin) ? ua.s : ub.s;
+        }
+    }
+    a = ua.s;
+    b = ub.s;
 
     float32_unpack_canonical(&pa, a, s);
     float32_unpack_canonical(&pb, b, s);
@@ -4293,6 +4554,22 @@ static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
 static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
+    union_float64 ua, ub;
+
+    /* As for float32_minmax. */
+    ua.s = a;
+    ub.s = b;
+    float64_input_flush2(&ua.s, &ub.s, s);
+    if (likely(float64_is_normal(ua.s) && float64_is_normal(ub.s))) {
+        double fa = flags & minmax_ismag ? fabs(ua.h) : ua.h;
+        double fb = flags & minmax_ismag ? fabs(ub.h) : ub.h;
+
+        if (fa != fb) {
+            return (fa < fb) == !!(flags & minmax_ismin) ? ua.s : ub.s;
+        }
+    }
+    a = ua.s;
+    b = ub.s;
 
     float64_unpack_canonical(&pa, a, s);
     float64_unpack_canonical(&pb, b, s);
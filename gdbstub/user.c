@@ -765,7 +765,7 @@ void gdb_syscall_handling(const char *syscall_packet)
     gdb_handlesig(gdbserver_state.c_cpu, 0, NULL, NULL, 0);
 }
 
-static bool should_catch_syscall(int num)
+bool gdb_should_catch_syscall(int num)
 {
     if (gdbserver_user_state.catch_all_syscalls) {
         return true;
@@ -778,7 +778,7 @@ static bool should_catch_syscall(int num)
 
 void gdb_syscall_entry(CPUState *cs, int num)
 {
-    if (should_catch_syscall(num)) {
+    if (gdb_should_catch_syscall(num)) {
         g_autofree char *reason = g_strdup_printf("syscall_entry:%x;", num);
         gdb_handlesig(cs, gdb_target_sigtrap(), reason, NULL, 0);
     }
@@ -786,7 +786,7 @@ void gdb_syscall_entry(CPUState *cs, int num)
 
 void gdb_syscall_return(CPUState *cs, int num)
 {
-    if (should_catch_syscall(num)) {
+    if (gdb_should_catch_syscall(num)) {
         g_autofree char *reason = g_strdup_printf("syscall_return:%x;", num);
         gdb_handlesig(cs, gdb_target_sigtrap(), reason, NULL, 0);
     }
@@ -1024,12 +1024,76 @@ void pdu_free(V9fsPDU *pdu)
     QLIST_INSERT_HEAD(&s->free_list, pdu, next);
 }
 
+static inline bool is_read_only_op(V9fsPDU *pdu)
+{
+    switch (pdu->id) {
+    case P9_TREADDIR:
+    case P9_TSTATFS:
+    case P9_TGETATTR:
+    case P9_TXATTRWALK:
+    case P9_TLOCK:
+    case P9_TGETLOCK:
+    case P9_TREADLINK:
+    case P9_TVERSION:
+    case P9_TLOPEN:
+    case P9_TATTACH:
+    case P9_TSTAT:
+    case P9_TWALK:
+    case P9_TCLUNK:
+    case P9_TFSYNC:
+    case P9_TOPEN:
+    case P9_TREAD:
+    case P9_TAUTH:
+    case P9_TFLUSH:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Whether @pdu may change the attributes of any file */
+static bool may_change_attrs(V9fsPDU *pdu)
+{
+    /* opening may truncate the file */
+    return !is_read_only_op(pdu) || pdu->id == P9_TLOPEN ||
+           pdu->id == P9_TOPEN;
+}
+
+static void v9fs_fid_cache_attr(V9fsState *s, V9fsFidState *fidp,
+                                V9fsAttrCache *attr)
+{
+    attr->expire_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                      (int64_t)s->fsconf.attr_cache_ms * SCALE_MS;
+    fidp->attr = *attr;
+}
+
+/*
+ * Returns whether the attributes cached in @fidp, including the inode
+ * generation if @need_st_gen is true, are still valid: any request that
+ * may change attributes invalidates them both when it is submitted and
+ * when it completes, so that they never miss a change that raced with
+ * reading them.
+ */
+static bool v9fs_fid_attr_cached(V9fsPDU *pdu, V9fsFidState *fidp,
+                                 bool need_st_gen)
+{
+    V9fsAttrCache *attr = &fidp->attr;
+
+    return attr->gen == pdu->s->attr_gen &&
+           (attr->read_st_gen || !need_st_gen) &&
+           qemu_clock_get_ns(QEMU_CLOCK_REALTIME) < attr->expire_ns;
+}
+
 static void coroutine_fn pdu_complete(V9fsPDU *pdu, ssize_t len)
 {
     int8_t id = pdu->id + 1; /* Response */
     V9fsState *s = pdu->s;
     int ret;
 
+    if (may_change_attrs(pdu)) {
+        s->attr_gen++;
+    }
+
     /*
      * The 9p spec requires that successfully cancelled pdus receive no reply.
      * Sending a reply would confuse clients because they would
@@ -1579,7 +1643,7 @@ static void coroutine_fn v9fs_getattr(void *opaque)
     int32_t fid;
     size_t offset = 7;
     ssize_t retval = 0;
-    struct stat stbuf;
+    V9fsAttrCache attr;
     V9fsFidState *fidp;
     uint64_t request_mask;
     V9fsStatDotl v9stat_dotl;
@@ -1598,32 +1662,28 @@ static void coroutine_fn v9fs_getattr(void *opaque)
     }
     /*
      * Currently we only support BASIC fields in stat, so there is no
-     * need to look at request_mask.
+     * need to look at request_mask except for st_gen.
      */
-    retval = v9fs_co_lstat(pdu, &fidp->path, &stbuf);
-    if (retval < 0) {
-        goto out;
+    if (v9fs_fid_attr_cached(pdu, fidp, request_mask & P9_STATS_GEN)) {
+        attr = fidp->attr;
+        trace_v9fs_getattr_cached(pdu->tag, pdu->id, fid);
+    } else {
+        retval = v9fs_co_getattr(pdu, &fidp->path, request_mask & P9_STATS_GEN,
+                                 &attr);
+        if (retval < 0) {
+            goto out;
+        }
+        v9fs_fid_cache_attr(pdu->s, fidp, &attr);
     }
-    retval = stat_to_v9stat_dotl(pdu, &stbuf, &v9stat_dotl);
+    retval = stat_to_v9stat_dotl(pdu, &attr.st, &v9stat_dotl);
     if (retval < 0) {
         goto out;
     }
 
     /*  fill st_gen if requested and supported by underlying fs */
-    if (request_mask & P9_STATS_GEN) {
-        retval = v9fs_co_st_gen(pdu, &fidp->path, stbuf.st_mode, &v9stat_dotl);
-        switch (retval) {
-        case 0:
-            /* we have valid st_gen: update result mask */
-            v9stat_dotl.st_result_mask |= P9_STATS_GEN;
-            break;
-        case -EINTR:
-            /* request cancelled, e.g. by Tflush */
-            goto out;
-        default:
-            /* failed to get st_gen: not fatal, ignore */
-            break;
-        }
+    if ((request_mask & P9_STATS_GEN) && attr.has_st_gen) {
+        v9stat_dotl.st_gen = attr.st_gen;
+        v9stat_dotl.st_result_mask |= P9_STATS_GEN;
     }
     retval = pdu_marshal(pdu, offset, "A", &v9stat_dotl);
     if (retval < 0) {
@@ -1790,6 +1850,7 @@ static void coroutine_fn v9fs_walk(void *opaque)
     V9fsPDU *pdu = opaque;
     V9fsState *s = pdu->s;
     V9fsQID qid;
+    V9fsAttrCache attr = { 0 };
 
     err = pdu_unmarshal(pdu, offset, "ddw", &fid, &newfid, &nwnames);
     if (err < 0) {
@@ -1841,6 +1902,7 @@ static void coroutine_fn v9fs_walk(void *opaque)
      * Twalk client request) as small as possible, run all the required fs
      * driver code altogether inside the following block.
      */
+    attr.gen = s->attr_gen;
     v9fs_co_run_in_worker({
         nwalked = 0;
         if (v9fs_request_cancelled(pdu)) {
@@ -1881,6 +1943,18 @@ static void coroutine_fn v9fs_walk(void *opaque)
                 v9fs_path_copy(&dpath, &pathes[nwalked]);
             }
         }
+        /*
+         * Clients usually get the attributes of the file they looked up
+         * right away, so read its inode generation as well while here.
+         */
+        if (nwnames && nwalked == nwnames) {
+            attr.read_st_gen = attr.has_st_gen = true;
+            if (s->ctx.exops.get_st_gen) {
+                attr.has_st_gen = !s->ctx.exops.get_st_gen(&s->ctx, &dpath,
+                                                           stbuf.st_mode,
+                                                           &attr.st_gen);
+            }
+        }
     });
     /*
      * Handle all the rest of this Twalk request on main thread ...
@@ -1936,6 +2010,8 @@ static void coroutine_fn v9fs_walk(void *opaque)
         v9fs_path_write_lock(s);
         v9fs_path_copy(&fidp->path, &path);
         v9fs_path_unlock(s);
+        attr.st = stbuf;
+        v9fs_fid_cache_attr(s, fidp, &attr);
     } else {
         newfidp = alloc_fid(s, newfid);
         if (newfidp == NULL) {
@@ -1944,6 +2020,8 @@ static void coroutine_fn v9fs_walk(void *opaque)
         }
         newfidp->uid = fidp->uid;
         v9fs_path_copy(&newfidp->path, &path);
+        attr.st = stbuf;
+        v9fs_fid_cache_attr(s, newfidp, &attr);
     }
 send_qids:
     err = v9fs_walk_marshal(pdu, name_idx, qids);
@@ -2264,6 +2342,18 @@ static int v9fs_xattr_read(V9fsState *s, V9fsPDU *pdu, V9fsFidState *fidp,
     return offset;
 }
 
+static void v9fs_free_dirents(struct V9fsDirEnt *e)
+{
+    struct V9fsDirEnt *next = NULL;
+
+    for (; e; e = next) {
+        next = e->next;
+        g_free(e->dent);
+        g_free(e->st);
+        g_free(e);
+    }
+}
+
 static int coroutine_fn v9fs_do_readdir_with_stat(V9fsPDU *pdu,
                                                   V9fsFidState *fidp,
                                                   uint32_t max_count)
@@ -2272,9 +2362,8 @@ static int coroutine_fn v9fs_do_readdir_with_stat(V9fsPDU *pdu,
     V9fsStat v9stat;
     int len, err = 0;
     int32_t count = 0;
-    struct stat stbuf;
     off_t saved_dir_pos;
-    struct dirent *dent;
+    struct V9fsDirEnt *entries = NULL, *e;
 
     /* save the directory position */
     saved_dir_pos = v9fs_co_telldir(pdu, fidp);
@@ -2282,57 +2371,54 @@ static int coroutine_fn v9fs_do_readdir_with_stat(V9fsPDU *pdu,
         return saved_dir_pos;
     }
 
-    while (1) {
-        v9fs_path_init(&path);
-
-        v9fs_readdir_lock(&fidp->fs.dir);
+    /*
+     * Fetch the directory entries together with their attributes in one
+     * rush. The size limit is meant for Rreaddir entries, which are smaller
+     * than the stat structures returned here, so this may fetch some more
+     * entries than fit into the response but never less.
+     */
+    err = v9fs_co_readdir_many(pdu, fidp, &entries, saved_dir_pos, max_count,
+                               true);
+    if (err < 0) {
+        goto out;
+    }
+    err = 0;
 
-        err = v9fs_co_readdir(pdu, fidp, &dent);
-        if (err || !dent) {
-            break;
-        }
-        err = v9fs_co_name_to_path(pdu, &fidp->path, dent->d_name, &path);
-        if (err < 0) {
-            break;
-        }
-        err = v9fs_co_lstat(pdu, &path, &stbuf);
+    v9fs_path_init(&path);
+    for (e = entries; e; e = e->next) {
+        v9fs_path_free(&path);
+        err = v9fs_co_name_to_path(pdu, &fidp->path, e->dent->d_name, &path);
         if (err < 0) {
             break;
         }
-        err = stat_to_v9stat(pdu, &path, dent->d_name, &stbuf, &v9stat);
+        err = stat_to_v9stat(pdu, &path, e->dent->d_name, e->st, &v9stat);
         if (err < 0) {
             break;
         }
         if ((count + v9stat.size + 2) > max_count) {
-            v9fs_readdir_unlock(&fidp->fs.dir);
-
-            /* Ran out of buffer. Set dir back to old position and return */
-            v9fs_co_seekdir(pdu, fidp, saved_dir_pos);
             v9fs_stat_free(&v9stat);
-            v9fs_path_free(&path);
-            return count;
+            break;
         }
 
         /* 11 = 7 + 4 (7 = start offset, 4 = space for storing count) */
         len = pdu_marshal(pdu, 11 + count, "S", &v9stat);
-
-        v9fs_readdir_unlock(&fidp->fs.dir);
-
+        v9fs_stat_free(&v9stat);
         if (len < 0) {
-            v9fs_co_seekdir(pdu, fidp, saved_dir_pos);
-            v9fs_stat_free(&v9stat);
-            v9fs_path_free(&path);
-            return len;
+            err = len;
+            break;
         }
         count += len;
-        v9fs_stat_free(&v9stat);
-        v9fs_path_free(&path);
-        saved_dir_pos = qemu_dirent_off(dent);
+        saved_dir_pos = qemu_dirent_off(e->dent);
     }
+    v9fs_path_free(&path);
 
-    v9fs_readdir_unlock(&fidp->fs.dir);
+    /* Set dir back to the position after the last entry returned */
+    if (e) {
+        v9fs_co_seekdir(pdu, fidp, saved_dir_pos);
+    }
 
-    v9fs_path_free(&path);
+out:
+    v9fs_free_dirents(entries);
     if (err < 0) {
         return err;
     }
@@ -2447,18 +2533,6 @@ size_t v9fs_readdir_response_size(V9fsString *name)
     return 24 + v9fs_string_size(name);
 }
 
-static void v9fs_free_dirents(struct V9fsDirEnt *e)
-{
-    struct V9fsDirEnt *next = NULL;
-
-    for (; e; e = next) {
-        next = e->next;
-        g_free(e->dent);
-        g_free(e->st);
-        g_free(e);
-    }
-}
-
 static int coroutine_fn v9fs_do_readdir(V9fsPDU *pdu, V9fsFidState *fidp,
                                         off_t offset, int32_t max_count)
 {
@@ -4130,33 +4204,6 @@ static void coroutine_fn v9fs_fs_ro(void *opaque)
     pdu_complete(pdu, -EROFS);
 }
 
-static inline bool is_read_only_op(V9fsPDU *pdu)
-{
-    switch (pdu->id) {
-    case P9_TREADDIR:
-    case P9_TSTATFS:
-    case P9_TGETATTR:
-    case P9_TXATTRWALK:
-    case P9_TLOCK:
-    case P9_TGETLOCK:
-    case P9_TREADLINK:
-    case P9_TVERSION:
-    case P9_TLOPEN:
-    case P9_TATTACH:
-    case P9_TSTAT:
-    case P9_TWALK:
-    case P9_TCLUNK:
-    case P9_TFSYNC:
-    case P9_TOPEN:
-    case P9_TREAD:
-    case P9_TAUTH:
-    case P9_TFLUSH:
-        return 1;
-    default:
-        return 0;
-    }
-}
-
 void pdu_submit(V9fsPDU *pdu, P9MsgHeader *hdr)
 {
     Coroutine *co;
@@ -4176,6 +4223,10 @@ void pdu_submit(V9fsPDU *pdu, P9MsgHeader *hdr)
         handler = pdu_co_handlers[pdu->id];
     }
 
+    if (may_change_attrs(pdu)) {
+        s->attr_gen++;
+    }
+
     qemu_co_queue_init(&pdu->complete);
     co = qemu_coroutine_create(handler, pdu);
     qemu_coroutine_enter(co);
@@ -178,6 +178,8 @@ typedef struct V9fsConf
     /* tag name for the device */
     char *tag;
     char *fsdev_id;
+    /* how long attributes cached in a fid stay valid */
+    uint32_t attr_cache_ms;
 } V9fsConf;
 
 /* 9p2000.L xattr flags (matches Linux values) */
@@ -269,6 +271,28 @@ union V9fsFidOpenState {
     void *private;
 };
 
+/*
+ * Attributes cached in a fid are only used for a short while by default,
+ * so that changes done on the host side outside of QEMU show up quickly.
+ * This is long enough for the typical Twalk followed by Tgetattr of a
+ * lookup.
+ */
+#define V9FS_ATTR_CACHE_MS 1
+
+/*
+ * Attributes of a fid, as last read from the fs driver. They are only used
+ * for a short while and as long as no request changed any attributes since
+ * they were read, see v9fs_fid_attr_cached().
+ */
+typedef struct V9fsAttrCache {
+    struct stat st;
+    uint64_t st_gen;
+    bool has_st_gen;    /* st_gen could be read */
+    bool read_st_gen;   /* reading st_gen was attempted */
+    uint64_t gen;       /* V9fsState.attr_gen when read */
+    int64_t expire_ns;
+} V9fsAttrCache;
+
 struct V9fsFidState {
     int fid_type;
     int32_t fid;
@@ -280,6 +304,7 @@ struct V9fsFidState {
     uid_t uid;
     int ref;
     bool clunked;
+    V9fsAttrCache attr;
     QSIMPLEQ_ENTRY(V9fsFidState) next;
     QSLIST_ENTRY(V9fsFidState) reclaim_next;
 };
@@ -363,6 +388,8 @@ struct V9fsState {
     uint64_t qp_ndevices; /* Amount of entries in qpd_table. */
     uint16_t qp_affix_next;
     uint64_t qp_fullpath_next;
+    /* incremented by each request that may change file attributes */
+    uint64_t attr_gen;
 };
 
 /* 9p2000.L open flags */
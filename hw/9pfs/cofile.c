@@ -22,27 +22,41 @@
 #include "qemu/main-loop.h"
 #include "coth.h"
 
-int coroutine_fn v9fs_co_st_gen(V9fsPDU *pdu, V9fsPath *path, mode_t st_mode,
-                                V9fsStatDotl *v9stat)
+/*
+ * Reads the attributes of @path, and its inode generation too if @st_gen is
+ * true, in a single trip to the worker thread. Failing to read the inode
+ * generation is not an error, it is reported in @attr->has_st_gen instead.
+ */
+int coroutine_fn v9fs_co_getattr(V9fsPDU *pdu, V9fsPath *path, bool st_gen,
+                                 V9fsAttrCache *attr)
 {
-    int err = 0;
+    int err;
     V9fsState *s = pdu->s;
 
     if (v9fs_request_cancelled(pdu)) {
         return -EINTR;
     }
-    if (s->ctx.exops.get_st_gen) {
-        v9fs_path_read_lock(s);
-        v9fs_co_run_in_worker(
-            {
-                err = s->ctx.exops.get_st_gen(&s->ctx, path, st_mode,
-                                              &v9stat->st_gen);
-                if (err < 0) {
-                    err = -errno;
-                }
-            });
-        v9fs_path_unlock(s);
-    }
+    attr->gen = s->attr_gen;
+    attr->read_st_gen = st_gen;
+    attr->has_st_gen = false;
+    v9fs_path_read_lock(s);
+    v9fs_co_run_in_worker(
+        {
+            err = s->ops->lstat(&s->ctx, path, &attr->st);
+            if (err < 0) {
+                err = -errno;
+                break;
+            }
+            /* fs drivers without support report 0 */
+            attr->st_gen = 0;
+            attr->has_st_gen = st_gen;
+            if (st_gen && s->ctx.exops.get_st_gen) {
+                attr->has_st_gen = !s->ctx.exops.get_st_gen(&s->ctx, path,
+                                                             attr->st.st_mode,
+                                                             &attr->st_gen);
+            }
+        });
+    v9fs_path_unlock(s);
     return err;
 }
 
@@ -246,6 +246,8 @@ static const VMStateDescription vmstate_virtio_9p = {
 static Property virtio_9p_properties[] = {
     DEFINE_PROP_STRING("mount_tag", V9fsVirtioState, state.fsconf.tag),
     DEFINE_PROP_STRING("fsdev", V9fsVirtioState, state.fsconf.fsdev_id),
+    DEFINE_PROP_UINT32("x-attr-cache-ms", V9fsVirtioState,
+                       state.fsconf.attr_cache_ms, V9FS_ATTR_CACHE_MS),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -484,6 +484,7 @@ static int xen_9pfs_connect(struct XenLegacyDevice *xendev)
     xen_9pdev->id = s->fsconf.fsdev_id =
         g_strdup_printf("xen9p%d", xendev->dev);
     xen_9pdev->tag = s->fsconf.tag = xenstore_read_fe_str(xendev, "tag");
+    s->fsconf.attr_cache_ms = V9FS_ATTR_CACHE_MS;
     fsdev = qemu_opts_create(qemu_find_opts("fsdev"),
             s->fsconf.tag,
             1, NULL);
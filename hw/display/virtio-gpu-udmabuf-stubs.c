@@ -17,6 +17,18 @@ void virtio_gpu_fini_udmabuf(struct virtio_gpu_simple_resource *res)
     /* nothing (stub) */
 }
 
+bool virtio_gpu_init_udmabuf_2d(struct virtio_gpu_simple_resource *res)
+{
+    /* nothing (stub) */
+    return false;
+}
+
+bool virtio_gpu_fini_udmabuf_2d(struct virtio_gpu_simple_resource *res)
+{
+    /* nothing (stub) */
+    return false;
+}
+
 int virtio_gpu_update_dmabuf(VirtIOGPU *g,
                              uint32_t scanout_id,
                              struct virtio_gpu_simple_resource *res,
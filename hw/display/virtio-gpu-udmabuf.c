@@ -12,6 +12,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qapi/error.h"
 #include "qemu/error-report.h"
 #include "qemu/units.h"
 #include "qemu/iov.h"
@@ -90,6 +91,119 @@ static void virtio_gpu_destroy_udmabuf(struct virtio_gpu_simple_resource *res)
     }
 }
 
+static void virtio_gpu_udmabuf_image_destroy(pixman_image_t *image,
+                                             void *data)
+{
+    munmap(pixman_image_get_data(image),
+           pixman_image_get_stride(image) * pixman_image_get_height(image));
+    close(GPOINTER_TO_INT(data));
+}
+
+/*
+ * Make the image of a 2D resource map the guest pages of its backing
+ * store, so that transfers to the host do not have to copy anything.  The
+ * mapping and the dmabuf belong to the image, because display surfaces
+ * can hold a reference to it after the resource has moved on.
+ */
+bool virtio_gpu_init_udmabuf_2d(struct virtio_gpu_simple_resource *res)
+{
+    pixman_format_code_t format;
+    int stride;
+    size_t size;
+    size_t pagesize = qemu_real_host_page_size();
+    pixman_image_t *image;
+    void *data;
+    int i;
+
+    /* Blob resources have no image */
+    if (!res->image) {
+        return false;
+    }
+
+    format = pixman_image_get_format(res->image);
+    stride = pixman_image_get_stride(res->image);
+    size = (size_t)stride * res->height;
+    if (iov_size(res->iov, res->iov_cnt) < size) {
+        return false;
+    }
+
+    /* udmabuf only takes whole pages */
+    for (i = 0; i < res->iov_cnt; i++) {
+        if (!QEMU_IS_ALIGNED((uintptr_t)res->iov[i].iov_base, pagesize) ||
+            !QEMU_IS_ALIGNED(res->iov[i].iov_len, pagesize)) {
+            return false;
+        }
+    }
+
+    res->dmabuf_fd = -1;
+    virtio_gpu_create_udmabuf(res);
+    if (res->dmabuf_fd < 0) {
+        return false;
+    }
+
+    data = mmap(NULL, size, PROT_READ, MAP_SHARED, res->dmabuf_fd, 0);
+    if (data == MAP_FAILED) {
+        warn_report("%s: dmabuf mmap failed: %s", __func__,
+                    strerror(errno));
+        goto err;
+    }
+
+    image = pixman_image_create_bits(format, res->width, res->height,
+                                     data, stride);
+    if (!image) {
+        munmap(data, size);
+        goto err;
+    }
+    pixman_image_set_destroy_function(image, virtio_gpu_udmabuf_image_destroy,
+                                      GINT_TO_POINTER(res->dmabuf_fd));
+
+    qemu_pixman_image_unref(res->image);
+    res->image = image;
+    res->share_handle = res->dmabuf_fd;
+    res->dmabuf_fd = -1;
+    res->zero_copy = true;
+    return true;
+
+err:
+    close(res->dmabuf_fd);
+    res->dmabuf_fd = -1;
+    return false;
+}
+
+/*
+ * Give a 2D resource a private copy of its image again, for when the
+ * backing store goes away or a transfer does not match the image layout.
+ * If that fails, the image keeps showing the guest pages.
+ */
+bool virtio_gpu_fini_udmabuf_2d(struct virtio_gpu_simple_resource *res)
+{
+    pixman_format_code_t format;
+    int stride;
+    qemu_pixman_shareable handle;
+    pixman_image_t *image;
+
+    if (!res->zero_copy) {
+        return false;
+    }
+
+    format = pixman_image_get_format(res->image);
+    stride = pixman_image_get_stride(res->image);
+
+    if (!qemu_pixman_image_new_shareable(&image, &handle, "virtio-gpu res",
+                                         format, res->width, res->height,
+                                         stride, &error_warn)) {
+        return false;
+    }
+    memcpy(pixman_image_get_data(image), pixman_image_get_data(res->image),
+           (size_t)stride * res->height);
+
+    qemu_pixman_image_unref(res->image);
+    res->image = image;
+    res->share_handle = handle;
+    res->zero_copy = false;
+    return true;
+}
+
 static int find_memory_backend_type(Object *obj, void *opaque)
 {
     bool *memfd_backend = opaque;
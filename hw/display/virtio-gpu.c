@@ -428,6 +428,62 @@ static void virtio_gpu_resource_unref(VirtIOGPU *g,
     virtio_gpu_resource_destroy(g, res, NULL);
 }
 
+static bool virtio_gpu_do_set_scanout(VirtIOGPU *g,
+                                      uint32_t scanout_id,
+                                      struct virtio_gpu_framebuffer *fb,
+                                      struct virtio_gpu_simple_resource *res,
+                                      struct virtio_gpu_rect *r,
+                                      uint32_t *error);
+
+/* Point the scanouts of @res to its current image */
+static void virtio_gpu_update_scanouts(VirtIOGPU *g,
+                                       struct virtio_gpu_simple_resource *res)
+{
+    struct virtio_gpu_scanout *scanout;
+    struct virtio_gpu_rect r;
+    uint32_t error;
+    int i;
+
+    for (i = 0; i < g->parent_obj.conf.max_outputs; i++) {
+        if (!(res->scanout_bitmask & (1 << i))) {
+            continue;
+        }
+        scanout = &g->parent_obj.scanout[i];
+        r.x = scanout->x;
+        r.y = scanout->y;
+        r.width = scanout->width;
+        r.height = scanout->height;
+        virtio_gpu_do_set_scanout(g, i, &scanout->fb, res, &r, &error);
+    }
+}
+
+/* Zero-copy only applies to 2D resources; blob resources have no image */
+static void virtio_gpu_zero_copy_attach(VirtIOGPU *g,
+                                        struct virtio_gpu_simple_resource *res)
+{
+    if (!virtio_gpu_zero_copy_enabled(g->parent_obj.conf) ||
+        res->blob_size || !res->image ||
+        !virtio_gpu_init_udmabuf_2d(res)) {
+        return;
+    }
+
+    trace_virtio_gpu_zero_copy(res->resource_id, true);
+    virtio_gpu_update_scanouts(g, res);
+}
+
+static bool virtio_gpu_zero_copy_detach(VirtIOGPU *g,
+                                        struct virtio_gpu_simple_resource *res)
+{
+    if (res->blob_size || !res->image ||
+        !virtio_gpu_fini_udmabuf_2d(res)) {
+        return false;
+    }
+
+    trace_virtio_gpu_zero_copy(res->resource_id, false);
+    virtio_gpu_update_scanouts(g, res);
+    return true;
+}
+
 static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
                                            struct virtio_gpu_ctrl_command *cmd)
 {
@@ -465,6 +521,21 @@ static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
     format = pixman_image_get_format(res->image);
     bpp = DIV_ROUND_UP(PIXMAN_FORMAT_BPP(format), 8);
     stride = pixman_image_get_stride(res->image);
+
+    if (res->zero_copy) {
+        /*
+         * The image maps the backing store.  Guests lay out the backing
+         * store like the image, and then there is nothing to copy.
+         */
+        if (t2d.offset == t2d.r.y * stride + t2d.r.x * bpp) {
+            return;
+        }
+        if (!virtio_gpu_zero_copy_detach(g, res)) {
+            cmd->error = VIRTIO_GPU_RESP_ERR_OUT_OF_MEMORY;
+            return;
+        }
+    }
+
     img_data = pixman_image_get_data(res->image);
 
     if (t2d.r.x || t2d.r.width != pixman_image_get_width(res->image)) {
@@ -922,6 +993,8 @@ virtio_gpu_resource_attach_backing(VirtIOGPU *g,
         cmd->error = VIRTIO_GPU_RESP_ERR_UNSPEC;
         return;
     }
+
+    virtio_gpu_zero_copy_attach(g, res);
 }
 
 static void
@@ -940,6 +1013,7 @@ virtio_gpu_resource_detach_backing(VirtIOGPU *g,
     if (!res) {
         return;
     }
+    virtio_gpu_zero_copy_detach(g, res);
     virtio_gpu_cleanup_mapping(g, res);
 }
 
@@ -1256,6 +1330,8 @@ static bool virtio_gpu_load_restore_mapping(VirtIOGPU *g,
 
     QTAILQ_INSERT_HEAD(&g->reslist, res, next);
     g->hostmem += res->hostmem;
+    /* The scanouts are loaded later, and will use the new image */
+    virtio_gpu_zero_copy_attach(g, res);
     return true;
 }
 
@@ -1466,6 +1542,19 @@ void virtio_gpu_device_realize(DeviceState *qdev, Error **errp)
         }
     }
 
+    if (virtio_gpu_zero_copy_enabled(g->parent_obj.conf)) {
+        if (virtio_gpu_virgl_enabled(g->parent_obj.conf) ||
+            virtio_gpu_rutabaga_enabled(g->parent_obj.conf)) {
+            error_setg(errp, "zero-copy only applies to 2D resources");
+            return;
+        }
+
+        if (!virtio_gpu_have_udmabuf()) {
+            error_setg(errp, "need udmabuf for zero-copy");
+            return;
+        }
+    }
+
     if (!virtio_gpu_base_device_realize(qdev,
                                         virtio_gpu_handle_ctrl_cb,
                                         virtio_gpu_handle_cursor_cb,
@@ -1641,6 +1730,8 @@ static Property virtio_gpu_properties[] = {
                      256 * MiB),
     DEFINE_PROP_BIT("blob", VirtIOGPU, parent_obj.conf.flags,
                     VIRTIO_GPU_FLAG_BLOB_ENABLED, false),
+    DEFINE_PROP_BIT("zero-copy", VirtIOGPU, parent_obj.conf.flags,
+                    VIRTIO_GPU_FLAG_ZERO_COPY_ENABLED, false),
     DEFINE_PROP_SIZE("hostmem", VirtIOGPU, parent_obj.conf.hostmem, 0),
     DEFINE_PROP_UINT8("x-scanout-vmstate-version", VirtIOGPU, scanout_vmstate_version, 2),
     DEFINE_PROP_END_OF_LIST(),
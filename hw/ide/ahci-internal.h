@@ -314,11 +314,14 @@ struct AHCIDevice {
     AHCIPortRegs port_regs;
     struct AHCIState *hba;
     QEMUBH *check_bh;
+    QEMUBH *main_cmd_bh;    /* Runs commands that need the BQL */
     uint8_t *lst;
     uint8_t *res_fis;
     bool done_first_drq;
     int32_t busy_slot;
     bool init_d2h_sent;
+    bool reset_pending;     /* COMRESET or SRST waiting for the main loop */
+    bool main_cmd_pending;  /* Command waiting for the main loop */
     AHCICmdHdr *cur_cmd;
     NCQTransferState ncq_tfs[AHCI_MAX_CMDS];
     MemReentrancyGuard mem_reentrancy_guard;
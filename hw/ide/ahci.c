@@ -27,6 +27,7 @@
 #include "hw/pci/pci.h"
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
+#include "block/aio-wait.h"
 
 #include "qemu/error-report.h"
 #include "qemu/log.h"
@@ -34,6 +35,7 @@
 #include "qemu/module.h"
 #include "sysemu/block-backend.h"
 #include "sysemu/dma.h"
+#include "sysemu/runstate.h"
 #include "hw/ide/pci.h"
 #include "hw/ide/ahci-pci.h"
 #include "hw/ide/ahci-sysbus.h"
@@ -45,6 +47,9 @@
 static void check_cmd(AHCIState *s, int port);
 static void handle_cmd(AHCIState *s, int port, uint8_t slot);
 static void ahci_reset_port(AHCIState *s, int port);
+static void ahci_request_port_reset(AHCIState *s, int port);
+static void ahci_request_reset(AHCIState *s);
+static void ahci_reset_bh(void *opaque);
 static bool ahci_write_fis_d2h(AHCIDevice *ad, bool d2h_fis_i);
 static void ahci_clear_cmd_issue(AHCIDevice *ad, uint8_t slot);
 static void ahci_init_d2h(AHCIDevice *ad);
@@ -179,6 +184,25 @@ static uint32_t ahci_port_read(AHCIState *s, int port, int offset)
     return val;
 }
 
+/*
+ * The lock is only needed when commands are processed in an iothread.
+ * Lock order is BQL before s->lock: vCPUs and the main loop take s->lock
+ * with the BQL held, and the iothread never takes the BQL while holding it.
+ */
+static void ahci_lock(AHCIState *s)
+{
+    if (s->iothread) {
+        qemu_rec_mutex_lock(&s->lock);
+    }
+}
+
+static void ahci_unlock(AHCIState *s)
+{
+    if (s->iothread) {
+        qemu_rec_mutex_unlock(&s->lock);
+    }
+}
+
 static void ahci_irq_raise(AHCIState *s)
 {
     DeviceState *dev_state = s->container;
@@ -207,6 +231,25 @@ static void ahci_irq_lower(AHCIState *s)
     }
 }
 
+static void ahci_update_irq(AHCIState *s)
+{
+    if (s->control_regs.irqstatus &&
+        (s->control_regs.ghc & HOST_CTL_IRQ_EN)) {
+            ahci_irq_raise(s);
+    } else {
+        ahci_irq_lower(s);
+    }
+}
+
+static void ahci_irq_bh(void *opaque)
+{
+    AHCIState *s = opaque;
+
+    ahci_lock(s);
+    ahci_update_irq(s);
+    ahci_unlock(s);
+}
+
 static void ahci_check_irq(AHCIState *s)
 {
     int i;
@@ -220,12 +263,13 @@ static void ahci_check_irq(AHCIState *s)
         }
     }
     trace_ahci_check_irq(s, old_irq, s->control_regs.irqstatus);
-    if (s->control_regs.irqstatus &&
-        (s->control_regs.ghc & HOST_CTL_IRQ_EN)) {
-            ahci_irq_raise(s);
-    } else {
-        ahci_irq_lower(s);
+
+    /* The iothread leaves the interrupt controller to the main loop */
+    if (!bql_locked()) {
+        qemu_bh_schedule(s->irq_bh);
+        return;
     }
+    ahci_update_irq(s);
 }
 
 static void ahci_trigger_irq(AHCIState *s, AHCIDevice *d,
@@ -302,6 +346,19 @@ static int ahci_cond_start_engines(AHCIDevice *ad)
     return 0;
 }
 
+/*
+ * Process the commands issued on @port.  With an iothread, that happens
+ * in the iothread rather than in the vCPU that wrote the register.
+ */
+static void ahci_kick_cmd(AHCIState *s, int port)
+{
+    if (s->iothread) {
+        qemu_bh_schedule(s->dev[port].check_bh);
+    } else {
+        check_cmd(s, port);
+    }
+}
+
 static void ahci_port_write(AHCIState *s, int port, int offset, uint32_t val)
 {
     AHCIPortRegs *pr = &s->dev[port].port_regs;
@@ -357,7 +414,7 @@ static void ahci_port_write(AHCIState *s, int port, int offset, uint32_t val)
             ahci_init_d2h(&s->dev[port]);
         }
 
-        check_cmd(s, port);
+        ahci_kick_cmd(s, port);
         break;
     case AHCI_PORT_REG_TFDATA:
     case AHCI_PORT_REG_SIG:
@@ -367,7 +424,7 @@ static void ahci_port_write(AHCIState *s, int port, int offset, uint32_t val)
     case AHCI_PORT_REG_SCR_CTL:
         if (((pr->scr_ctl & AHCI_SCR_SCTL_DET) == 1) &&
             ((val & AHCI_SCR_SCTL_DET) == 0)) {
-            ahci_reset_port(s, port);
+            ahci_request_port_reset(s, port);
         }
         pr->scr_ctl = val;
         break;
@@ -380,7 +437,7 @@ static void ahci_port_write(AHCIState *s, int port, int offset, uint32_t val)
         break;
     case AHCI_PORT_REG_CMD_ISSUE:
         pr->cmd_issue |= val;
-        check_cmd(s, port);
+        ahci_kick_cmd(s, port);
         break;
     default:
         trace_ahci_port_write_unimpl(s, port, AHCIPortReg_lookup[regnum],
@@ -443,12 +500,16 @@ static uint64_t ahci_mem_read_32(void *opaque, hwaddr addr)
  */
 static uint64_t ahci_mem_read(void *opaque, hwaddr addr, unsigned size)
 {
+    AHCIState *s = opaque;
     hwaddr aligned = addr & ~0x3;
     int ofst = addr - aligned;
-    uint64_t lo = ahci_mem_read_32(opaque, aligned);
+    uint64_t lo;
     uint64_t hi;
     uint64_t val;
 
+    ahci_lock(s);
+    lo = ahci_mem_read_32(opaque, aligned);
+
     /* if < 8 byte read does not cross 4 byte boundary */
     if (ofst + size <= 4) {
         val = lo >> (ofst * 8);
@@ -460,17 +521,16 @@ static uint64_t ahci_mem_read(void *opaque, hwaddr addr, unsigned size)
         hi = ahci_mem_read_32(opaque, aligned + 4);
         val = (hi << 32 | lo) >> (ofst * 8);
     }
+    ahci_unlock(s);
 
     trace_ahci_mem_read(opaque, size, addr, val);
     return val;
 }
 
 
-static void ahci_mem_write(void *opaque, hwaddr addr,
-                           uint64_t val, unsigned size)
+static void ahci_mem_write_locked(AHCIState *s, hwaddr addr,
+                                  uint64_t val, unsigned size)
 {
-    AHCIState *s = opaque;
-
     trace_ahci_mem_write(s, size, addr, val);
 
     /* Only aligned reads are allowed on AHCI */
@@ -491,7 +551,7 @@ static void ahci_mem_write(void *opaque, hwaddr addr,
             break;
         case AHCI_HOST_REG_CTL: /* R/W */
             if (val & HOST_CTL_RESET) {
-                ahci_reset(s);
+                ahci_request_reset(s);
             } else {
                 s->control_regs.ghc = (val & 0x3) | HOST_CTL_AHCI_EN;
                 ahci_check_irq(s);
@@ -531,6 +591,16 @@ static void ahci_mem_write(void *opaque, hwaddr addr,
     }
 }
 
+static void ahci_mem_write(void *opaque, hwaddr addr,
+                           uint64_t val, unsigned size)
+{
+    AHCIState *s = opaque;
+
+    ahci_lock(s);
+    ahci_mem_write_locked(s, addr, val, size);
+    ahci_unlock(s);
+}
+
 static const MemoryRegionOps ahci_mem_ops = {
     .read = ahci_mem_read,
     .write = ahci_mem_write,
@@ -599,6 +669,10 @@ static void check_cmd(AHCIState *s, int port)
 
     if ((pr->cmd & PORT_CMD_START) && pr->cmd_issue) {
         for (slot = 0; (slot < 32) && pr->cmd_issue; slot++) {
+            /* Stop until the main loop has reset the port or run a command */
+            if (s->dev[port].reset_pending || s->dev[port].main_cmd_pending) {
+                break;
+            }
             if (pr->cmd_issue & (1U << slot)) {
                 handle_cmd(s, port, slot);
             }
@@ -609,11 +683,28 @@ static void check_cmd(AHCIState *s, int port)
 static void ahci_check_cmd_bh(void *opaque)
 {
     AHCIDevice *ad = opaque;
+    AHCIState *s = ad->hba;
 
-    qemu_bh_delete(ad->check_bh);
-    ad->check_bh = NULL;
+    ahci_lock(s);
+    /*
+     * With an iothread, commands are picked up again by the reset, which
+     * clears PxCI, or by ahci_vm_state_change() when the VM resumes.
+     */
+    if (!s->iothread ||
+        !(s->quiesced || ad->reset_pending || !runstate_is_running())) {
+        check_cmd(s, ad->port_no);
+    }
+    ahci_unlock(s);
+}
 
-    check_cmd(ad->hba, ad->port_no);
+static void ahci_main_cmd_bh(void *opaque)
+{
+    AHCIDevice *ad = opaque;
+
+    ahci_lock(ad->hba);
+    ad->main_cmd_pending = false;
+    ahci_check_cmd_bh(ad);
+    ahci_unlock(ad->hba);
 }
 
 static void ahci_init_d2h(AHCIDevice *ad)
@@ -672,6 +763,8 @@ static void ahci_reset_port(AHCIState *s, int port)
     pr->cmd_issue = 0;
     d->busy_slot = -1;
     d->init_d2h_sent = false;
+    d->reset_pending = false;
+    d->main_cmd_pending = false;
 
     ide_state = &s->dev[port].port.ifs[0];
     if (!ide_state->blk) {
@@ -920,6 +1013,65 @@ static int prdt_tbl_entry_size(const AHCI_SG *tbl)
     return (le32_to_cpu(tbl->flags_size) & AHCI_PRDT_SIZE_MASK) + 1;
 }
 
+/*
+ * Returns whether the guest memory at @addr is RAM that can be accessed
+ * directly.  Anything else is dispatched with the BQL held, so the iothread
+ * may only DMA to RAM while it holds s->lock.
+ */
+static bool ahci_dma_is_ram(AHCIState *s, dma_addr_t addr, dma_addr_t len)
+{
+    RCU_READ_LOCK_GUARD();
+
+    while (len) {
+        hwaddr xlat, l = len;
+        MemoryRegion *mr = address_space_translate(s->as, addr, &xlat, &l,
+                                                   true,
+                                                   MEMTXATTRS_UNSPECIFIED);
+
+        if (!memory_access_is_direct(mr, true)) {
+            return false;
+        }
+        addr += l;
+        len -= l;
+    }
+    return true;
+}
+
+/*
+ * Returns whether the command table and all buffers of the command @cmd are
+ * in RAM, so that the iothread can process the command.
+ */
+static bool ahci_cmd_dma_is_ram(AHCIState *s, AHCICmdHdr *cmd)
+{
+    uint16_t prdtl = le16_to_cpu(cmd->prdtl);
+    uint64_t tbl_addr = le64_to_cpu(cmd->tbl_addr);
+    dma_addr_t prdt_len = prdtl * sizeof(AHCI_SG);
+    dma_addr_t len = prdt_len;
+    AHCI_SG *prdt;
+    bool ret = true;
+    int i;
+
+    if (!ahci_dma_is_ram(s, tbl_addr, 0x80 + prdt_len)) {
+        return false;
+    }
+    if (!prdtl) {
+        return true;
+    }
+
+    prdt = dma_memory_map(s->as, tbl_addr + 0x80, &len,
+                          DMA_DIRECTION_TO_DEVICE, MEMTXATTRS_UNSPECIFIED);
+    if (!prdt) {
+        /* Let the command fail as usual */
+        return true;
+    }
+    for (i = 0; i < len / sizeof(AHCI_SG) && ret; i++) {
+        ret = ahci_dma_is_ram(s, le64_to_cpu(prdt[i].addr),
+                              prdt_tbl_entry_size(&prdt[i]));
+    }
+    dma_memory_unmap(s->as, prdt, len, DMA_DIRECTION_TO_DEVICE, len);
+    return ret;
+}
+
 /**
  * Fetch entries in a guest-provided PRDT and convert it into a QEMU SGlist.
  * @ad: The AHCIDevice for whom we are building the SGList.
@@ -1005,6 +1157,20 @@ static int ahci_populate_sglist(AHCIDevice *ad, QEMUSGList *sglist,
                             MIN(prdt_tbl_entry_size(&tbl[i]),
                                 limit - sglist->size));
         }
+
+        /*
+         * handle_cmd() has checked the buffers before running the command
+         * in the iothread, but the guest may have changed the PRDT since.
+         */
+        for (i = 0; !bql_locked() && i < sglist->nsg; i++) {
+            if (!ahci_dma_is_ram(ad->hba, sglist->sg[i].base,
+                                 sglist->sg[i].len)) {
+                trace_ahci_populate_sglist_not_ram(ad->hba, ad->port_no);
+                qemu_sglist_destroy(sglist);
+                r = -1;
+                break;
+            }
+        }
     }
 
 out:
@@ -1043,9 +1209,8 @@ static void ncq_finish(NCQTransferState *ncq_tfs)
     ncq_tfs->used = 0;
 }
 
-static void ncq_cb(void *opaque, int ret)
+static void ncq_cb_locked(NCQTransferState *ncq_tfs, int ret)
 {
-    NCQTransferState *ncq_tfs = (NCQTransferState *)opaque;
     IDEState *ide_state = &ncq_tfs->drive->port.ifs[0];
 
     ncq_tfs->aiocb = NULL;
@@ -1070,6 +1235,44 @@ static void ncq_cb(void *opaque, int ret)
     }
 }
 
+static void ncq_cb(void *opaque, int ret)
+{
+    NCQTransferState *ncq_tfs = (NCQTransferState *)opaque;
+    AHCIState *s = ncq_tfs->drive->hba;
+
+    ahci_lock(s);
+    ncq_cb_locked(ncq_tfs, ret);
+    ahci_unlock(s);
+}
+
+/*
+ * Commands that can run in the iothread.  Others may reconfigure or cancel
+ * requests on the BlockBackend, which needs the BQL.
+ */
+static bool ahci_cmd_in_iothread(uint8_t ata_cmd)
+{
+    switch (ata_cmd) {
+    case WIN_READ:
+    case WIN_READ_EXT:
+    case WIN_READDMA:
+    case WIN_READDMA_EXT:
+    case WIN_MULTREAD:
+    case WIN_MULTREAD_EXT:
+    case WIN_WRITE:
+    case WIN_WRITE_EXT:
+    case WIN_WRITEDMA:
+    case WIN_WRITEDMA_EXT:
+    case WIN_MULTWRITE:
+    case WIN_MULTWRITE_EXT:
+    case WIN_FLUSH_CACHE:
+    case WIN_FLUSH_CACHE_EXT:
+    case WIN_DSM:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static int is_ncq(uint8_t ata_cmd)
 {
     /* Based on SATA 3.2 section 13.6.3.2 */
@@ -1274,7 +1477,7 @@ static void handle_reg_h2d_fis(AHCIState *s, int port,
                  * COMRESET or by setting and clearing the SRST bit. Therefore,
                  * the logic for this is found in ahci_init_d2h() and not here.
                  */
-                ahci_reset_port(s, port);
+                ahci_request_port_reset(s, port);
             }
             break;
         }
@@ -1287,6 +1490,13 @@ static void handle_reg_h2d_fis(AHCIState *s, int port,
         return;
     }
 
+    if (!bql_locked() && !ahci_cmd_in_iothread(cmd_fis[2])) {
+        trace_handle_reg_h2d_fis_main_loop(s, port, cmd_fis[2]);
+        ad->main_cmd_pending = true;
+        qemu_bh_schedule(ad->main_cmd_bh);
+        return;
+    }
+
     /* Decompose the FIS:
      * AHCI does not interpret FIS packets, it only forwards them.
      * SATA 1.0 describes how to decode LBA28 and CHS FIS packets.
@@ -1368,6 +1578,14 @@ static void handle_cmd(AHCIState *s, int port, uint8_t slot)
         return;
     }
 
+    /* DMA to anything but RAM needs the BQL, see ahci_lock() */
+    if (!bql_locked() && !ahci_cmd_dma_is_ram(s, cmd)) {
+        trace_handle_cmd_main_loop(s, port);
+        s->dev[port].main_cmd_pending = true;
+        qemu_bh_schedule(s->dev[port].main_cmd_bh);
+        return;
+    }
+
     tbl_addr = le64_to_cpu(cmd->tbl_addr);
     cmd_len = 0x80;
     cmd_fis = dma_memory_map(s->as, tbl_addr, &cmd_len,
@@ -1582,10 +1800,7 @@ static void ahci_cmd_done(const IDEDMA *dma)
      */
     ahci_write_fis_d2h(ad, true);
 
-    if (!(ide_state->status & ERR_STAT) &&
-        ad->port_regs.cmd_issue && !ad->check_bh) {
-        ad->check_bh = qemu_bh_new_guarded(ahci_check_cmd_bh, ad,
-                                           &ad->mem_reentrancy_guard);
+    if (!(ide_state->status & ERR_STAT) && ad->port_regs.cmd_issue) {
         qemu_bh_schedule(ad->check_bh);
     }
 }
@@ -1616,6 +1831,26 @@ void ahci_init(AHCIState *s, DeviceState *qdev)
                           "ahci-idp", 32);
 }
 
+/* Only registered with an iothread */
+static void ahci_vm_state_change(void *opaque, bool running, RunState state)
+{
+    AHCIState *s = opaque;
+    int i;
+
+    if (!running) {
+        return;
+    }
+
+    /* Pick up the commands that were issued while the VM was stopped */
+    for (i = 0; i < s->ports; i++) {
+        qemu_bh_schedule(s->dev[i].check_bh);
+    }
+}
+
+static void ahci_sync_bh(void *opaque)
+{
+}
+
 void ahci_realize(AHCIState *s, DeviceState *qdev, AddressSpace *as)
 {
     qemu_irq *irqs;
@@ -1623,6 +1858,16 @@ void ahci_realize(AHCIState *s, DeviceState *qdev, AddressSpace *as)
 
     s->as = as;
     assert(s->ports > 0);
+    s->ctx = qemu_get_aio_context();
+    if (s->iothread) {
+        s->ctx = iothread_get_aio_context(s->iothread);
+        qemu_rec_mutex_init(&s->lock);
+        s->irq_bh = qemu_bh_new(ahci_irq_bh, s);
+        s->reset_bh = qemu_bh_new_guarded(ahci_reset_bh, s,
+                                          &qdev->mem_reentrancy_guard);
+        s->vmstate = qemu_add_vm_change_state_handler(ahci_vm_state_change,
+                                                      s);
+    }
     s->dev = g_new0(AHCIDevice, s->ports);
     ahci_reg_init(s);
     irqs = qemu_allocate_irqs(ahci_irq_set, s, s->ports);
@@ -1636,6 +1881,16 @@ void ahci_realize(AHCIState *s, DeviceState *qdev, AddressSpace *as)
         ad->port_no = i;
         ad->port.dma = &ad->dma;
         ad->port.dma->ops = &ahci_dma_ops;
+        ad->port.lock = s->iothread ? &s->lock : NULL;
+        /*
+         * Like other devices that run in an iothread, rely on the lock
+         * rather than on the reentrancy guard there.
+         */
+        ad->check_bh = aio_bh_new_guarded(s->ctx, ahci_check_cmd_bh, ad,
+                                          s->iothread ? NULL :
+                                          &ad->mem_reentrancy_guard);
+        ad->main_cmd_bh = qemu_bh_new_guarded(ahci_main_cmd_bh, ad,
+                                              &ad->mem_reentrancy_guard);
         ide_bus_register_restart_cb(&ad->port);
     }
     g_free(irqs);
@@ -1645,6 +1900,18 @@ void ahci_uninit(AHCIState *s)
 {
     int i, j;
 
+    for (i = 0; i < s->ports; i++) {
+        qemu_bh_delete(s->dev[i].check_bh);
+        qemu_bh_delete(s->dev[i].main_cmd_bh);
+    }
+    if (s->iothread) {
+        qemu_del_vm_change_state_handler(s->vmstate);
+        qemu_bh_delete(s->irq_bh);
+        qemu_bh_delete(s->reset_bh);
+        /* Wait for a check_bh that the iothread may be running */
+        aio_wait_bh_oneshot(s->ctx, ahci_sync_bh, NULL);
+    }
+
     for (i = 0; i < s->ports; i++) {
         AHCIDevice *ad = &s->dev[i];
 
@@ -1655,14 +1922,68 @@ void ahci_uninit(AHCIState *s)
     }
 
     g_free(s->dev);
+    if (s->iothread) {
+        qemu_rec_mutex_destroy(&s->lock);
+    }
 }
 
-void ahci_reset(AHCIState *s)
+static bool ahci_port_busy(AHCIDevice *ad)
+{
+    IDEState *ide_state = &ad->port.ifs[0];
+    int i;
+
+    if (ad->port.dma->aiocb || ide_state->pio_aiocb ||
+        !QLIST_EMPTY(&ide_state->buffered_requests)) {
+        return true;
+    }
+    for (i = 0; i < AHCI_MAX_CMDS; i++) {
+        if (ad->ncq_tfs[i].aiocb) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * With an iothread, take the lock, stop starting commands and wait for the
+ * requests in flight.  Their completion callbacks take the lock in the
+ * iothread, so it is dropped while draining.  The main loop only, because
+ * requests cannot be cancelled or drained from an iothread.
+ */
+static void ahci_quiesce(AHCIState *s)
+{
+    int i;
+
+    if (!s->iothread) {
+        return;
+    }
+
+    qemu_rec_mutex_lock(&s->lock);
+    s->quiesced = true;
+    for (i = 0; i < s->ports; i++) {
+        while (ahci_port_busy(&s->dev[i])) {
+            qemu_rec_mutex_unlock(&s->lock);
+            blk_drain(s->dev[i].port.ifs[0].blk);
+            qemu_rec_mutex_lock(&s->lock);
+        }
+    }
+}
+
+static void ahci_resume(AHCIState *s)
+{
+    if (s->iothread) {
+        s->quiesced = false;
+        qemu_rec_mutex_unlock(&s->lock);
+    }
+}
+
+static void ahci_do_reset(AHCIState *s)
 {
     AHCIPortRegs *pr;
     int i;
 
     trace_ahci_reset(s);
+    s->reset_pending = false;
 
     s->control_regs.irqstatus = 0;
     /* AHCI Enable (AE)
@@ -1685,6 +2006,64 @@ void ahci_reset(AHCIState *s)
     }
 }
 
+void ahci_reset(AHCIState *s)
+{
+    ahci_quiesce(s);
+    ahci_do_reset(s);
+    ahci_resume(s);
+}
+
+static void ahci_reset_bh(void *opaque)
+{
+    AHCIState *s = opaque;
+    int i;
+
+    ahci_quiesce(s);
+    if (s->reset_pending) {
+        ahci_do_reset(s);
+    } else {
+        for (i = 0; i < s->ports; i++) {
+            if (s->dev[i].reset_pending) {
+                ahci_reset_port(s, i);
+            }
+        }
+    }
+    ahci_resume(s);
+}
+
+/*
+ * Resets cancel the requests in flight, which needs the BQL.  With an
+ * iothread they are left to the main loop, and the guest polls GHC.HR or
+ * PxTFD.BSY until they are done, as it would with real hardware.
+ */
+static void ahci_request_reset(AHCIState *s)
+{
+    if (!s->iothread) {
+        ahci_reset(s);
+        return;
+    }
+
+    trace_ahci_request_reset(s, -1);
+    s->control_regs.ghc |= HOST_CTL_RESET;
+    s->reset_pending = true;
+    qemu_bh_schedule(s->reset_bh);
+}
+
+static void ahci_request_port_reset(AHCIState *s, int port)
+{
+    AHCIDevice *ad = &s->dev[port];
+
+    if (!s->iothread) {
+        ahci_reset_port(s, port);
+        return;
+    }
+
+    trace_ahci_request_reset(s, port);
+    ad->port_regs.tfdata |= BUSY_STAT;
+    ad->reset_pending = true;
+    qemu_bh_schedule(s->reset_bh);
+}
+
 static const VMStateDescription vmstate_ncq_tfs = {
     .name = "ncq state",
     .version_id = 1,
@@ -1700,6 +2079,26 @@ static const VMStateDescription vmstate_ncq_tfs = {
     },
 };
 
+static bool ahci_port_pending_needed(void *opaque)
+{
+    AHCIDevice *ad = opaque;
+
+    return ad->reset_pending || ad->main_cmd_pending;
+}
+
+/* Work that an iothread left to the main loop */
+static const VMStateDescription vmstate_ahci_port_pending = {
+    .name = "ahci port/pending",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = ahci_port_pending_needed,
+    .fields = (const VMStateField[]) {
+        VMSTATE_BOOL(reset_pending, AHCIDevice),
+        VMSTATE_BOOL(main_cmd_pending, AHCIDevice),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_ahci_device = {
     .name = "ahci port",
     .version_id = 1,
@@ -1729,6 +2128,10 @@ static const VMStateDescription vmstate_ahci_device = {
                              1, vmstate_ncq_tfs, NCQTransferState),
         VMSTATE_END_OF_LIST()
     },
+    .subsections = (const VMStateDescription * const []) {
+        &vmstate_ahci_port_pending,
+        NULL
+    }
 };
 
 static int ahci_state_post_load(void *opaque, int version_id)
@@ -1800,8 +2203,11 @@ static int ahci_state_post_load(void *opaque, int version_id)
          *
          * In the case where no error was present, busy_slot will be -1,
          * and we should check to see if there are additional commands waiting.
+         * Ports with a pending reset or main loop command are handled below.
          */
-        if (ad->busy_slot == -1) {
+        if (ad->reset_pending || ad->main_cmd_pending) {
+            continue;
+        } else if (ad->busy_slot == -1) {
             check_cmd(s, i);
         } else {
             /* We are in the middle of a command, and may need to access
@@ -1813,9 +2219,45 @@ static int ahci_state_post_load(void *opaque, int version_id)
         }
     }
 
+    /*
+     * Complete what an iothread on the source had left to the main loop.
+     * Nothing is in flight yet, so resets do not need to quiesce the HBA.
+     */
+    if (s->reset_pending) {
+        ahci_do_reset(s);
+    }
+    for (i = 0; i < s->ports; i++) {
+        ad = &s->dev[i];
+        if (ad->reset_pending) {
+            ahci_reset_port(s, i);
+        } else if (ad->main_cmd_pending) {
+            ad->main_cmd_pending = false;
+            check_cmd(s, i);
+        }
+    }
+
     return 0;
 }
 
+static bool ahci_reset_pending_needed(void *opaque)
+{
+    AHCIState *s = opaque;
+
+    return s->reset_pending;
+}
+
+/* GHC.HR that an iothread left to the main loop */
+static const VMStateDescription vmstate_ahci_reset_pending = {
+    .name = "ahci/reset_pending",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = ahci_reset_pending_needed,
+    .fields = (const VMStateField[]) {
+        VMSTATE_BOOL(reset_pending, AHCIState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 const VMStateDescription vmstate_ahci = {
     .name = "ahci",
     .version_id = 1,
@@ -1832,6 +2274,10 @@ const VMStateDescription vmstate_ahci = {
         VMSTATE_UINT32_EQUAL(ports, AHCIState, NULL),
         VMSTATE_END_OF_LIST()
     },
+    .subsections = (const VMStateDescription * const []) {
+        &vmstate_ahci_reset_pending,
+        NULL
+    }
 };
 
 static const VMStateDescription vmstate_sysbus_ahci = {
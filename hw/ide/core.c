@@ -533,8 +533,9 @@ BlockAIOCB *ide_issue_trim(
 
     iocb = blk_aio_get(&trim_aiocb_info, s->blk, cb, cb_opaque);
     iocb->s = s;
-    iocb->bh = qemu_bh_new_guarded(ide_trim_bh_cb, iocb,
-                                   &DEVICE(dev)->mem_reentrancy_guard);
+    iocb->bh = aio_bh_new_guarded(qemu_get_current_aio_context(),
+                                  ide_trim_bh_cb, iocb,
+                                  &DEVICE(dev)->mem_reentrancy_guard);
     iocb->ret = 0;
     iocb->qiov = qiov;
     iocb->i = -1;
@@ -674,6 +675,9 @@ static void ide_rw_error(IDEState *s) {
 static void ide_buffered_readv_cb(void *opaque, int ret)
 {
     IDEBufferedRequest *req = opaque;
+    IDEBus *bus = req->bus;
+
+    ide_bus_lock(bus);
     if (!req->orphaned) {
         if (!ret) {
             assert(req->qiov.size == req->original_qiov->size);
@@ -686,6 +690,7 @@ static void ide_buffered_readv_cb(void *opaque, int ret)
     QLIST_REMOVE(req, list);
     qemu_vfree(qemu_iovec_buf(&req->qiov));
     g_free(req);
+    ide_bus_unlock(bus);
 }
 
 #define MAX_BUFFERED_REQS 16
@@ -706,6 +711,7 @@ BlockAIOCB *ide_buffered_readv(IDEState *s, int64_t sector_num,
     }
 
     req = g_new0(IDEBufferedRequest, 1);
+    req->bus = s->bus;
     req->original_qiov = iov;
     req->original_cb = cb;
     req->original_opaque = opaque;
@@ -876,9 +882,10 @@ int ide_handle_rw_error(IDEState *s, int error, int op)
     return action != BLOCK_ERROR_ACTION_IGNORE;
 }
 
-static void ide_dma_cb(void *opaque, int ret)
+static void ide_dma_cb(void *opaque, int ret);
+
+static void ide_dma_cb_locked(IDEState *s, int ret)
 {
-    IDEState *s = opaque;
     int n;
     int64_t sector_num;
     uint64_t offset;
@@ -968,7 +975,7 @@ static void ide_dma_cb(void *opaque, int ret)
                                            BDRV_SECTOR_SIZE, ide_dma_cb, s);
         break;
     case IDE_DMA_TRIM:
-        s->bus->dma->aiocb = dma_blk_io(blk_get_aio_context(s->blk),
+        s->bus->dma->aiocb = dma_blk_io(qemu_get_current_aio_context(),
                                         &s->sg, offset, BDRV_SECTOR_SIZE,
                                         ide_issue_trim, s, ide_dma_cb, s,
                                         DMA_DIRECTION_TO_DEVICE);
@@ -985,6 +992,15 @@ eot:
     ide_set_inactive(s, stay_active);
 }
 
+static void ide_dma_cb(void *opaque, int ret)
+{
+    IDEState *s = opaque;
+
+    ide_bus_lock(s->bus);
+    ide_dma_cb_locked(s, ret);
+    ide_bus_unlock(s->bus);
+}
+
 static void ide_sector_start_dma(IDEState *s, enum ide_dma_cmd dma_cmd)
 {
     s->status = READY_STAT | SEEK_STAT | DRQ_STAT;
@@ -1024,9 +1040,8 @@ static void ide_sector_write_timer_cb(void *opaque)
     ide_bus_set_irq(s->bus);
 }
 
-static void ide_sector_write_cb(void *opaque, int ret)
+static void ide_sector_write_cb_locked(IDEState *s, int ret)
 {
-    IDEState *s = opaque;
     int n;
 
     s->pio_aiocb = NULL;
@@ -1073,6 +1088,15 @@ static void ide_sector_write_cb(void *opaque, int ret)
     }
 }
 
+static void ide_sector_write_cb(void *opaque, int ret)
+{
+    IDEState *s = opaque;
+
+    ide_bus_lock(s->bus);
+    ide_sector_write_cb_locked(s, ret);
+    ide_bus_unlock(s->bus);
+}
+
 static void ide_sector_write(IDEState *s)
 {
     int64_t sector_num;
@@ -1102,10 +1126,8 @@ static void ide_sector_write(IDEState *s)
                                    &s->qiov, 0, ide_sector_write_cb, s);
 }
 
-static void ide_flush_cb(void *opaque, int ret)
+static void ide_flush_cb_locked(IDEState *s, int ret)
 {
-    IDEState *s = opaque;
-
     s->pio_aiocb = NULL;
 
     if (ret < 0) {
@@ -1123,6 +1145,15 @@ static void ide_flush_cb(void *opaque, int ret)
     ide_bus_set_irq(s->bus);
 }
 
+static void ide_flush_cb(void *opaque, int ret)
+{
+    IDEState *s = opaque;
+
+    ide_bus_lock(s->bus);
+    ide_flush_cb_locked(s, ret);
+    ide_bus_unlock(s->bus);
+}
+
 static void ide_flush_cache(IDEState *s)
 {
     if (s->blk == NULL) {
@@ -1195,6 +1226,7 @@ static void ide_cd_change_cb(void *opaque, bool load, Error **errp)
     IDEState *s = opaque;
     uint64_t nb_sectors;
 
+    ide_bus_lock(s->bus);
     s->tray_open = !load;
     blk_get_geometry(s->blk, &nb_sectors);
     s->nb_sectors = nb_sectors;
@@ -1210,17 +1242,20 @@ static void ide_cd_change_cb(void *opaque, bool load, Error **errp)
     s->events.new_media = true;
     s->events.eject_request = false;
     ide_bus_set_irq(s->bus);
+    ide_bus_unlock(s->bus);
 }
 
 static void ide_cd_eject_request_cb(void *opaque, bool force)
 {
     IDEState *s = opaque;
 
+    ide_bus_lock(s->bus);
     s->events.eject_request = true;
     if (force) {
         s->tray_locked = false;
     }
     ide_bus_set_irq(s->bus);
+    ide_bus_unlock(s->bus);
 }
 
 static void ide_cmd_lba48_transform(IDEState *s, int lba48)
@@ -2578,6 +2613,7 @@ static void ide_resize_cb(void *opaque)
         return;
     }
 
+    ide_bus_lock(s->bus);
     blk_get_geometry(s->blk, &nb_sectors);
     s->nb_sectors = nb_sectors;
 
@@ -2589,6 +2625,7 @@ static void ide_resize_cb(void *opaque)
         assert(s->drive_kind != IDE_CD);
         ide_identify_size(s);
     }
+    ide_bus_unlock(s->bus);
 }
 
 static const BlockDevOps ide_cd_block_ops = {
@@ -2720,16 +2757,12 @@ static void ide_restart_dma(IDEState *s, enum ide_dma_cmd dma_cmd)
     ide_start_dma(s, ide_dma_cb);
 }
 
-static void ide_restart_bh(void *opaque)
+static void ide_restart_bus(IDEBus *bus)
 {
-    IDEBus *bus = opaque;
     IDEState *s;
     bool is_read;
     int error_status;
 
-    qemu_bh_delete(bus->bh);
-    bus->bh = NULL;
-
     error_status = bus->error_status;
     if (bus->error_status == 0) {
         return;
@@ -2770,6 +2803,18 @@ static void ide_restart_bh(void *opaque)
     }
 }
 
+static void ide_restart_bh(void *opaque)
+{
+    IDEBus *bus = opaque;
+
+    qemu_bh_delete(bus->bh);
+    bus->bh = NULL;
+
+    ide_bus_lock(bus);
+    ide_restart_bus(bus);
+    ide_bus_unlock(bus);
+}
+
 static void ide_restart_cb(void *opaque, bool running, RunState state)
 {
     IDEBus *bus = opaque;
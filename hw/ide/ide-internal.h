@@ -324,6 +324,7 @@ extern const MemoryRegionPortio ide_portio2_list[];
 
 typedef struct IDEBufferedRequest {
     QLIST_ENTRY(IDEBufferedRequest) list;
+    IDEBus *bus;
     QEMUIOVector qiov;
     QEMUIOVector *original_qiov;
     BlockCompletionFunc *original_cb;
@@ -376,6 +377,20 @@ static inline IDEState *ide_bus_active_if(IDEBus *bus)
     return bus->ifs + bus->unit;
 }
 
+static inline void ide_bus_lock(IDEBus *bus)
+{
+    if (bus->lock) {
+        qemu_rec_mutex_lock(bus->lock);
+    }
+}
+
+static inline void ide_bus_unlock(IDEBus *bus)
+{
+    if (bus->lock) {
+        qemu_rec_mutex_unlock(bus->lock);
+    }
+}
+
 /* hw/ide/core.c */
 extern const VMStateDescription vmstate_ide_bus;
 
@@ -48,6 +48,8 @@
 #include "net_rx_pkt.h"
 #include "hw/virtio/vhost.h"
 #include "sysemu/qtest.h"
+#include "block/aio-wait.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 
 #define VIRTIO_NET_VM_VERSION    11
 
@@ -124,6 +126,22 @@ static int vq2q(int queue_index)
     return queue_index / 2;
 }
 
+static bool virtio_net_dataplane_pause(VirtIONet *n);
+static void virtio_net_dataplane_attach(VirtIONet *n);
+static void virtio_net_dataplane_pause_queue(VirtIONet *n, int queue_pair);
+static void virtio_net_dataplane_resume_queue(VirtIONet *n, int queue_pair);
+
+static void virtio_net_notify(VirtIONet *n, VirtQueue *vq)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+
+    if (qemu_in_iothread()) {
+        virtio_notify_irqfd(vdev, vq);
+    } else {
+        virtio_notify(vdev, vq);
+    }
+}
+
 static void flush_or_purge_queued_packets(NetClientState *nc)
 {
     if (!nc->peer) {
@@ -378,7 +396,7 @@ static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
 {
     unsigned int dropped = virtqueue_drop_all(vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(VIRTIO_NET(vdev), vq);
     }
 }
 
@@ -388,6 +406,7 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
     VirtIONetQueue *q;
     int i;
     uint8_t queue_status;
+    bool paused = virtio_net_dataplane_pause(n);
 
     virtio_net_vnet_endian_status(n, status);
     virtio_net_vhost_status(n, status);
@@ -437,6 +456,10 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             }
         }
     }
+
+    if (paused) {
+        virtio_net_dataplane_attach(n);
+    }
 }
 
 static void virtio_net_set_link_status(NetClientState *nc)
@@ -560,6 +583,9 @@ static void virtio_net_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
         return;
     }
 
+    /* Resumed when the guest enables the queue again */
+    virtio_net_dataplane_pause_queue(n, vq2q(queue_index));
+
     nc = qemu_get_subqueue(n->nic, vq2q(queue_index));
 
     if (!nc->peer) {
@@ -585,6 +611,8 @@ static void virtio_net_queue_enable(VirtIODevice *vdev, uint32_t queue_index)
         return;
     }
 
+    virtio_net_dataplane_resume_queue(n, vq2q(queue_index));
+
     nc = qemu_get_subqueue(n->nic, vq2q(queue_index));
 
     if (!nc->peer || !vdev->vhost_started) {
@@ -1585,7 +1613,12 @@ size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
 
 static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
 {
+    VirtIONet *n = VIRTIO_NET(vdev);
     VirtQueueElement *elem;
+    bool paused;
+
+    /* Commands change state that the queue pairs use */
+    paused = virtio_net_dataplane_pause(n);
 
     for (;;) {
         size_t written;
@@ -1606,6 +1639,10 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
             break;
         }
     }
+
+    if (paused) {
+        virtio_net_dataplane_attach(n);
+    }
 }
 
 /* RX */
@@ -1912,7 +1949,15 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
         if (index >= 0) {
             NetClientState *nc2 =
                 qemu_get_subqueue(n->nic, index % n->curr_queue_pairs);
-            return virtio_net_receive_rcu(nc2, buf, size, true);
+
+            /*
+             * A queue pair in another IOThread cannot be touched from here,
+             * deliver the packet on this one instead.
+             */
+            if (!n->dataplane_attached ||
+                virtio_net_get_subqueue(nc2)->aio_context == q->aio_context) {
+                return virtio_net_receive_rcu(nc2, buf, size, true);
+            }
         }
     }
 
@@ -2023,7 +2068,7 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     }
 
     virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    virtio_net_notify(n, q->rx_vq);
 
     return size;
 
@@ -2654,11 +2699,10 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIONetQueue *q = virtio_net_get_subqueue(nc);
-    VirtIODevice *vdev = VIRTIO_DEVICE(n);
     int ret;
 
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(n, q->tx_vq);
 
     g_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
@@ -2683,6 +2727,17 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 }
 
 /* TX */
+
+/* Complete the @pending packets that virtio_net_flush_tx() has filled in */
+static void virtio_net_tx_flush_used(VirtIONetQueue *q, unsigned int *pending)
+{
+    if (*pending) {
+        virtqueue_flush(q->tx_vq, *pending);
+        virtio_net_notify(q->n, q->tx_vq);
+        *pending = 0;
+    }
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
@@ -2690,10 +2745,20 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
     VirtQueueElement *elem;
     int32_t num_packets = 0;
     int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    /*
+     * Packed rings write a used descriptor per completion, and only the
+     * first one of a batch needs a barrier before it.  Complete a whole
+     * burst at once there instead of one packet at a time.
+     */
+    bool batch = virtio_vdev_has_feature(vdev, VIRTIO_F_RING_PACKED);
+    unsigned int pending = 0;
+
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
     }
 
+    RCU_READ_LOCK_GUARD();
+
     if (q->async_tx.elem) {
         virtio_queue_set_notification(q->tx_vq, 0);
         return num_packets;
@@ -2763,23 +2828,30 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
                                       out_sg, out_num, virtio_net_tx_complete);
         if (ret == 0) {
+            virtio_net_tx_flush_used(q, &pending);
             virtio_queue_set_notification(q->tx_vq, 0);
             q->async_tx.elem = elem;
             return -EBUSY;
         }
 
 drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
+        if (batch) {
+            virtqueue_fill(q->tx_vq, elem, 0, pending++);
+        } else {
+            virtqueue_push(q->tx_vq, elem, 0);
+            virtio_net_notify(n, q->tx_vq);
+        }
         g_free(elem);
 
         if (++num_packets >= n->tx_burst) {
             break;
         }
     }
+    virtio_net_tx_flush_used(q, &pending);
     return num_packets;
 
 detach:
+    virtio_net_tx_flush_used(q, &pending);
     virtqueue_detach_element(q->tx_vq, elem, 0);
     g_free(elem);
     return -EINVAL;
@@ -2941,6 +3013,37 @@ static void virtio_net_tx_bh(void *opaque)
     }
 }
 
+/* Create the TX timer or BH in @ctx, or in the main loop if @ctx is NULL */
+static void virtio_net_tx_notify_init(VirtIONetQueue *q, AioContext *ctx)
+{
+    VirtIONet *n = q->n;
+
+    if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
+        if (ctx) {
+            q->tx_timer = aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL, SCALE_NS,
+                                        virtio_net_tx_timer, q);
+        } else {
+            q->tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                       virtio_net_tx_timer, q);
+        }
+    } else {
+        q->tx_bh = aio_bh_new_guarded(ctx ?: qemu_get_aio_context(),
+                                      virtio_net_tx_bh, q,
+                                      &DEVICE(n)->mem_reentrancy_guard);
+    }
+}
+
+static void virtio_net_tx_notify_cleanup(VirtIONetQueue *q)
+{
+    if (q->tx_timer) {
+        timer_free(q->tx_timer);
+        q->tx_timer = NULL;
+    } else {
+        qemu_bh_delete(q->tx_bh);
+        q->tx_bh = NULL;
+    }
+}
+
 static void virtio_net_add_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
@@ -2952,19 +3055,15 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
                              virtio_net_handle_tx_timer);
-        n->vqs[index].tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
-                                              virtio_net_tx_timer,
-                                              &n->vqs[index]);
     } else {
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
                              virtio_net_handle_tx_bh);
-        n->vqs[index].tx_bh = qemu_bh_new_guarded(virtio_net_tx_bh, &n->vqs[index],
-                                                  &DEVICE(vdev)->mem_reentrancy_guard);
     }
 
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
+    virtio_net_tx_notify_init(&n->vqs[index], NULL);
 }
 
 static void virtio_net_del_queue(VirtIONet *n, int index)
@@ -2976,13 +3075,7 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
     qemu_purge_queued_packets(nc);
 
     virtio_del_queue(vdev, index * 2);
-    if (q->tx_timer) {
-        timer_free(q->tx_timer);
-        q->tx_timer = NULL;
-    } else {
-        qemu_bh_delete(q->tx_bh);
-        q->tx_bh = NULL;
-    }
+    virtio_net_tx_notify_cleanup(q);
     q->tx_waiting = 0;
     virtio_del_queue(vdev, index * 2 + 1);
 }
@@ -3032,6 +3125,368 @@ static void virtio_net_set_multiqueue(VirtIONet *n, int multiqueue)
     virtio_net_set_queue_pairs(n);
 }
 
+/*
+ * With the iothread or iothread-vq-mapping properties, the queue pairs are
+ * processed in IOThreads while the device runs.  The network backend of a
+ * queue pair moves its I/O handlers to the same IOThread, see
+ * qemu_set_aio_context(), so that both directions of the datapath stay in
+ * one thread.  The control virtqueue is always processed in the main loop.
+ *
+ * Main loop code that changes the state used by the queue pairs, like
+ * status changes and control commands, moves the queue pairs back to the
+ * main loop with virtio_net_dataplane_pause() for the duration.
+ */
+
+static int virtio_net_dataplane_num_queues(VirtIONet *n)
+{
+    return (n->multiqueue ? n->max_queue_pairs : 1) * 2 + 1;
+}
+
+static bool virtio_net_dataplane_can_attach(VirtIONet *n)
+{
+    int queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+
+    for (int i = 0; i < queue_pairs; i++) {
+        if (!qemu_can_set_aio_context(qemu_get_subqueue(n->nic, i)->peer)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Context: BH in IOThread */
+static void virtio_net_dataplane_attach_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+
+    virtio_net_tx_notify_init(q, q->aio_context);
+    qemu_set_aio_context(nc->peer, q->aio_context);
+
+    /* This also kicks the virtqueues to process what they already hold */
+    virtio_queue_aio_attach_host_notifier(q->rx_vq, q->aio_context);
+    virtio_queue_aio_attach_host_notifier(q->tx_vq, q->aio_context);
+
+    if (q->tx_waiting) {
+        if (q->tx_timer) {
+            timer_mod(q->tx_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + q->n->tx_timeout);
+        } else {
+            replay_bh_schedule_event(q->tx_bh);
+        }
+    }
+}
+
+/* Context: BQL held */
+static void virtio_net_dataplane_attach_queue(VirtIONetQueue *q)
+{
+    event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq), NULL);
+    event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq), NULL);
+    virtio_net_tx_notify_cleanup(q);
+
+    aio_wait_bh_oneshot(q->aio_context, virtio_net_dataplane_attach_bh, q);
+}
+
+/* Context: BQL held */
+static void virtio_net_dataplane_attach(VirtIONet *n)
+{
+    int queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+
+    assert(n->dataplane_started && !n->dataplane_attached);
+
+    /* Filters may have been added to the backends in the meantime */
+    if (!virtio_net_dataplane_can_attach(n)) {
+        return;
+    }
+
+    trace_virtio_net_dataplane_attach(n, queue_pairs);
+    n->dataplane_attached = true;
+
+    for (int i = 0; i < queue_pairs; i++) {
+        virtio_net_dataplane_attach_queue(&n->vqs[i]);
+    }
+}
+
+/* Context: BH in IOThread */
+static void virtio_net_dataplane_detach_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    virtio_queue_aio_detach_host_notifier(q->rx_vq, ctx);
+    virtio_queue_aio_detach_host_notifier(q->tx_vq, ctx);
+    qemu_set_aio_context(nc->peer, NULL);
+    virtio_net_tx_notify_cleanup(q);
+}
+
+/* Context: BQL held */
+static void virtio_net_dataplane_detach_queue(VirtIONetQueue *q)
+{
+    EventNotifier *rx_notifier = virtio_queue_get_host_notifier(q->rx_vq);
+    EventNotifier *tx_notifier = virtio_queue_get_host_notifier(q->tx_vq);
+
+    aio_wait_bh_oneshot(q->aio_context, virtio_net_dataplane_detach_bh, q);
+
+    virtio_net_tx_notify_init(q, NULL);
+    event_notifier_set_handler(rx_notifier, virtio_queue_host_notifier_read);
+    event_notifier_set_handler(tx_notifier, virtio_queue_host_notifier_read);
+
+    /* Pick up what the guest queued while no handler was attached */
+    event_notifier_set(rx_notifier);
+    event_notifier_set(tx_notifier);
+    if (q->tx_waiting) {
+        if (q->tx_timer) {
+            timer_mod(q->tx_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + q->n->tx_timeout);
+        } else {
+            replay_bh_schedule_event(q->tx_bh);
+        }
+    }
+}
+
+/* Context: BQL held */
+static void virtio_net_dataplane_detach(VirtIONet *n)
+{
+    int queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+
+    assert(n->dataplane_attached);
+
+    trace_virtio_net_dataplane_detach(n, queue_pairs);
+
+    for (int i = 0; i < queue_pairs; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        if (q->dataplane_reset) {
+            q->dataplane_reset = false;
+        } else {
+            virtio_net_dataplane_detach_queue(q);
+        }
+    }
+
+    n->dataplane_attached = false;
+}
+
+/*
+ * Move the queue pairs back to the main loop if they are processed in
+ * IOThreads.  Returns whether they were, in which case the caller moves them
+ * back with virtio_net_dataplane_attach().
+ *
+ * Context: BQL held
+ */
+static bool virtio_net_dataplane_pause(VirtIONet *n)
+{
+    if (!n->dataplane_attached) {
+        return false;
+    }
+
+    virtio_net_dataplane_detach(n);
+    return true;
+}
+
+/*
+ * Move a single queue pair back to the main loop while the guest resets one
+ * of its virtqueues, leaving the other queue pairs in their IOThreads.
+ *
+ * Context: BQL held
+ */
+static void virtio_net_dataplane_pause_queue(VirtIONet *n, int queue_pair)
+{
+    VirtIONetQueue *q = &n->vqs[queue_pair];
+    int queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+
+    if (!n->dataplane_attached || queue_pair >= queue_pairs ||
+        q->dataplane_reset) {
+        return;
+    }
+
+    virtio_net_dataplane_detach_queue(q);
+    q->dataplane_reset = true;
+}
+
+/* Context: BQL held */
+static void virtio_net_dataplane_resume_queue(VirtIONet *n, int queue_pair)
+{
+    VirtIONetQueue *q = &n->vqs[queue_pair];
+
+    if (!q->dataplane_reset) {
+        return;
+    }
+
+    assert(n->dataplane_attached);
+    q->dataplane_reset = false;
+    virtio_net_dataplane_attach_queue(q);
+}
+
+/* Context: BQL held, ioeventfd started */
+static void virtio_net_dataplane_start(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(n));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int r;
+
+    assert(!n->dataplane_started);
+
+    if (!virtio_net_dataplane_can_attach(n)) {
+        warn_report_once("virtio-net: network filters are attached to the "
+                         "backend, processing queues in the main loop");
+        return;
+    }
+
+    /*
+     * virtio_net_guest_notifier_mask() and _pending() only handle vhost.
+     * Let the transport mask the guest notifiers itself, as it does for
+     * devices without these callbacks.
+     */
+    n->dataplane_notifier_mask = vdev->use_guest_notifier_mask;
+    vdev->use_guest_notifier_mask = false;
+
+    /* Set up guest notifier (irq) */
+    r = k->set_guest_notifiers(qbus->parent,
+                               virtio_net_dataplane_num_queues(n), true);
+    if (r != 0) {
+        warn_report("virtio-net: failed to set guest notifier (%d), "
+                    "processing queues in the main loop", r);
+        vdev->use_guest_notifier_mask = n->dataplane_notifier_mask;
+        return;
+    }
+
+    n->dataplane_started = true;
+    virtio_net_dataplane_attach(n);
+}
+
+/* Context: BQL held */
+static void virtio_net_dataplane_stop(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(n));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+
+    if (!n->dataplane_started) {
+        return;
+    }
+
+    virtio_net_dataplane_pause(n);
+
+    /* Clean up guest notifier (irq) */
+    k->set_guest_notifiers(qbus->parent,
+                           virtio_net_dataplane_num_queues(n), false);
+    vdev->use_guest_notifier_mask = n->dataplane_notifier_mask;
+    n->dataplane_started = false;
+}
+
+/* Context: BQL held */
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    int r;
+
+    r = virtio_device_start_ioeventfd_impl(vdev);
+    if (r == 0 && n->vqs[0].aio_context) {
+        virtio_net_dataplane_start(n);
+    }
+    return r;
+}
+
+/* Context: BQL held */
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    virtio_net_dataplane_stop(VIRTIO_NET(vdev));
+    virtio_device_stop_ioeventfd_impl(vdev);
+}
+
+/* Context: BQL held */
+static bool virtio_net_vq_aio_context_init(VirtIONet *n, Error **errp)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    virtio_net_conf *conf = &n->net_conf;
+    g_autofree AioContext **ctx = NULL;
+    int i;
+
+    if (!conf->iothread && !conf->iothread_vq_mapping_list) {
+        return true;
+    }
+
+    if (conf->iothread && conf->iothread_vq_mapping_list) {
+        error_setg(errp,
+                   "iothread and iothread-vq-mapping properties cannot be set "
+                   "at the same time");
+        return false;
+    }
+
+    if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+        error_setg(errp,
+                   "device is incompatible with iothread "
+                   "(transport does not support notifiers)");
+        return false;
+    }
+    if (!virtio_device_ioeventfd_enabled(vdev)) {
+        error_setg(errp, "ioeventfd is required for iothread");
+        return false;
+    }
+
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+        if (!peer) {
+            error_setg(errp, "iothread requires a netdev");
+            return false;
+        }
+        if (get_vhost_net(peer)) {
+            error_setg(errp, "iothread cannot be used together with vhost");
+            return false;
+        }
+        if (!peer->info->set_aio_context) {
+            error_setg(errp, "netdev '%s' does not support iothread",
+                       peer->name);
+            return false;
+        }
+    }
+
+    ctx = g_new(AioContext *, n->max_queue_pairs);
+
+    if (conf->iothread_vq_mapping_list) {
+        /* The vq numbers in the mapping are queue pair numbers here */
+        if (!iothread_vq_mapping_apply(conf->iothread_vq_mapping_list, ctx,
+                                       n->max_queue_pairs, errp)) {
+            return false;
+        }
+    } else {
+        AioContext *iothread_ctx = iothread_get_aio_context(conf->iothread);
+
+        for (i = 0; i < n->max_queue_pairs; i++) {
+            ctx[i] = iothread_ctx;
+        }
+
+        /* Released in virtio_net_vq_aio_context_cleanup() */
+        object_ref(OBJECT(conf->iothread));
+    }
+
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        n->vqs[i].aio_context = ctx[i];
+    }
+    return true;
+}
+
+/* Context: BQL held */
+static void virtio_net_vq_aio_context_cleanup(VirtIONet *n)
+{
+    virtio_net_conf *conf = &n->net_conf;
+
+    assert(!n->dataplane_started);
+
+    if (conf->iothread_vq_mapping_list) {
+        iothread_vq_mapping_cleanup(conf->iothread_vq_mapping_list);
+    }
+
+    if (conf->iothread) {
+        object_unref(OBJECT(conf->iothread));
+    }
+}
+
 static int virtio_net_post_load_device(void *opaque, int version_id)
 {
     VirtIONet *n = opaque;
@@ -3685,6 +4140,11 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         return;
     }
     n->vqs = g_new0(VirtIONetQueue, n->max_queue_pairs);
+    if (!virtio_net_vq_aio_context_init(n, errp)) {
+        g_free(n->vqs);
+        virtio_cleanup(vdev);
+        return;
+    }
     n->curr_queue_pairs = 1;
     n->tx_timeout = n->net_conf.txtimer;
 
@@ -3776,6 +4236,7 @@ static void virtio_net_device_unrealize(DeviceState *dev)
 
     /* This will stop vhost backend if appropriate. */
     virtio_net_set_status(vdev, 0);
+    virtio_net_vq_aio_context_cleanup(n);
 
     g_free(n->netclient_name);
     n->netclient_name = NULL;
@@ -3984,6 +4445,10 @@ static Property virtio_net_properties[] = {
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
+    DEFINE_PROP_LINK("iothread", VirtIONet, net_conf.iothread, TYPE_IOTHREAD,
+                     IOThread *),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIONet,
+                                         net_conf.iothread_vq_mapping_list),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
     DEFINE_PROP_UINT16("tx_queue_size", VirtIONet, net_conf.tx_queue_size,
@@ -4022,6 +4487,8 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->queue_reset = virtio_net_queue_reset;
     vdc->queue_enable = virtio_net_queue_enable;
     vdc->set_status = virtio_net_set_status;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
@@ -43,6 +43,8 @@
  *              atomic.dn=<on|off[optional]>, \
  *              atomic.awun<N[optional]>, \
  *              atomic.awupf<N[optional]>, \
+ *              iothread=<iothread_id[optional]>, \
+ *              intc.thr=<N[optional]>,intc.time=<N[optional]>, \
  *              subsys=<subsys_id>
  *      -device nvme-ns,drive=<drive_id>,bus=<bus_name>,nsid=<nsid>,\
  *              zoned=<true|false[optional]>, \
@@ -150,6 +152,27 @@
  *   a secondary controller. The default 0 resolves to
  *   `(sriov_vq_flexible / sriov_max_vfs)`.
  *
+ * - `iothread`
+ *   Process the I/O queues in the given iothread instead of the main loop.
+ *   The admin queue always stays in the main loop. Use `iothread-vq-mapping`
+ *   to spread the I/O queue pairs over several iothreads; I/O queue pair `n`
+ *   is number `n - 1` in the mapping.
+ *
+ *   With `ioeventfd=on` and shadow doorbells enabled by the host, the
+ *   iothread polls the submission queue doorbells while it busy-waits (see
+ *   the `poll-max-ns` parameter of the iothread) and asks the host not to
+ *   ring them in the meantime.
+ *
+ * - `intc.thr`
+ *   The default Aggregation Threshold of the Interrupt Coalescing feature.
+ *   This is a 0's based number of completion queue entries. The default
+ *   value is 0.
+ *
+ * - `intc.time`
+ *   The default Aggregation Time of the Interrupt Coalescing feature, in 100
+ *   microsecond units. The default value is 0 (i.e. interrupts are not
+ *   coalesced unless the host sets the feature).
+ *
  * nvme namespace device parameters
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * - `shared`
@@ -204,8 +227,10 @@
 #include "sysemu/sysemu.h"
 #include "sysemu/block-backend.h"
 #include "sysemu/hostmem.h"
+#include "block/aio-wait.h"
 #include "hw/pci/msix.h"
 #include "hw/pci/pcie_sriov.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 #include "sysemu/spdm-socket.h"
 #include "migration/vmstate.h"
 
@@ -257,6 +282,8 @@ static const uint32_t nvme_feature_cap[NVME_FID_MAX] = {
     [NVME_ERROR_RECOVERY]           = NVME_FEAT_CAP_CHANGE | NVME_FEAT_CAP_NS,
     [NVME_VOLATILE_WRITE_CACHE]     = NVME_FEAT_CAP_CHANGE,
     [NVME_NUMBER_OF_QUEUES]         = NVME_FEAT_CAP_CHANGE,
+    [NVME_INTERRUPT_COALESCING]     = NVME_FEAT_CAP_CHANGE,
+    [NVME_INTERRUPT_VECTOR_CONF]    = NVME_FEAT_CAP_CHANGE,
     [NVME_WRITE_ATOMICITY]          = NVME_FEAT_CAP_CHANGE,
     [NVME_ASYNCHRONOUS_EVENT_CONF]  = NVME_FEAT_CAP_CHANGE,
     [NVME_TIMESTAMP]                = NVME_FEAT_CAP_CHANGE,
@@ -638,14 +665,23 @@ static void nvme_inc_sq_head(NvmeSQueue *sq)
     sq->head = (sq->head + 1) % sq->size;
 }
 
+/*
+ * Queues that run in an iothread share the head of the completion queue and
+ * the tail of the submission queue with doorbell writes from vCPU threads.
+ */
+static bool nvme_in_iothread(AioContext *ctx)
+{
+    return ctx != qemu_get_aio_context();
+}
+
 static uint8_t nvme_cq_full(NvmeCQueue *cq)
 {
-    return (cq->tail + 1) % cq->size == cq->head;
+    return (cq->tail + 1) % cq->size == qatomic_read(&cq->head);
 }
 
 static uint8_t nvme_sq_empty(NvmeSQueue *sq)
 {
-    return sq->head == sq->tail;
+    return sq->head == qatomic_read(&sq->tail);
 }
 
 static void nvme_irq_check(NvmeCtrl *n)
@@ -682,6 +718,18 @@ static void nvme_irq_assert(NvmeCtrl *n, NvmeCQueue *cq)
     }
 }
 
+/* Interrupts of queues that run in an iothread are raised by the main loop */
+static void nvme_cq_irq_notifier(EventNotifier *e)
+{
+    NvmeCQueue *cq = container_of(e, NvmeCQueue, irq_notifier);
+
+    if (!event_notifier_test_and_clear(e)) {
+        return;
+    }
+
+    nvme_irq_assert(cq->ctrl, cq);
+}
+
 static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
 {
     if (cq->irq_enabled) {
@@ -1444,6 +1492,27 @@ uint16_t nvme_bounce_mdata(NvmeCtrl *n, void *ptr, uint32_t len,
     return nvme_tx(n, &req->sg, ptr, len, dir);
 }
 
+static BlockAIOCB *nvme_dma_read_io_func(int64_t offset, QEMUIOVector *iov,
+                                         BlockCompletionFunc *cb,
+                                         void *cb_opaque, void *opaque)
+{
+    BlockBackend *blk = opaque;
+    return blk_aio_preadv(blk, offset, iov, 0, cb, cb_opaque);
+}
+
+static BlockAIOCB *nvme_dma_write_io_func(int64_t offset, QEMUIOVector *iov,
+                                          BlockCompletionFunc *cb,
+                                          void *cb_opaque, void *opaque)
+{
+    BlockBackend *blk = opaque;
+    return blk_aio_pwritev(blk, offset, iov, 0, cb, cb_opaque);
+}
+
+/*
+ * With iothread-vq-mapping, requests are submitted from the AioContext of
+ * their queue pair rather than the one of the BlockBackend, so the DMA
+ * helpers must run their bottom halves in the current one.
+ */
 static inline void nvme_blk_read(BlockBackend *blk, int64_t offset,
                                  uint32_t align, BlockCompletionFunc *cb,
                                  NvmeRequest *req)
@@ -1451,7 +1520,9 @@ static inline void nvme_blk_read(BlockBackend *blk, int64_t offset,
     assert(req->sg.flags & NVME_SG_ALLOC);
 
     if (req->sg.flags & NVME_SG_DMA) {
-        req->aiocb = dma_blk_read(blk, &req->sg.qsg, offset, align, cb, req);
+        req->aiocb = dma_blk_io(qemu_get_current_aio_context(), &req->sg.qsg,
+                                offset, align, nvme_dma_read_io_func, blk,
+                                cb, req, DMA_DIRECTION_FROM_DEVICE);
     } else {
         req->aiocb = blk_aio_preadv(blk, offset, &req->sg.iov, 0, cb, req);
     }
@@ -1464,7 +1535,9 @@ static inline void nvme_blk_write(BlockBackend *blk, int64_t offset,
     assert(req->sg.flags & NVME_SG_ALLOC);
 
     if (req->sg.flags & NVME_SG_DMA) {
-        req->aiocb = dma_blk_write(blk, &req->sg.qsg, offset, align, cb, req);
+        req->aiocb = dma_blk_io(qemu_get_current_aio_context(), &req->sg.qsg,
+                                offset, align, nvme_dma_write_io_func, blk,
+                                cb, req, DMA_DIRECTION_TO_DEVICE);
     } else {
         req->aiocb = blk_aio_pwritev(blk, offset, &req->sg.iov, 0, cb, req);
     }
@@ -1486,14 +1559,96 @@ static void nvme_update_cq_head(NvmeCQueue *cq)
     trace_pci_nvme_update_cq_head(cq->cqid, cq->head);
 }
 
+static void nvme_update_sq_eventidx(const NvmeSQueue *sq)
+{
+    uint32_t ei = sq->tail;
+
+    /*
+     * While the iothread polls the shadow doorbell, keep the event index just
+     * behind the tail so that the host does not need to ring the doorbell.
+     */
+    if (sq->polling) {
+        ei = (sq->tail + sq->size - 1) % sq->size;
+    }
+
+    trace_pci_nvme_update_sq_eventidx(sq->sqid, ei);
+
+    stl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->ei_addr, ei,
+                   MEMTXATTRS_UNSPECIFIED);
+}
+
+static void nvme_update_sq_tail(NvmeSQueue *sq)
+{
+    ldl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->db_addr, &sq->tail,
+                   MEMTXATTRS_UNSPECIFIED);
+
+    trace_pci_nvme_update_sq_tail(sq->sqid, sq->tail);
+}
+
+/*
+ * Returns true if the interrupt for the completions posted to an I/O queue
+ * should be held back, in which case the coalescing timer raises it later.
+ */
+static bool nvme_cq_coalesce(NvmeCQueue *cq, unsigned posted)
+{
+    NvmeCtrl *n = cq->ctrl;
+    uint32_t intc = qatomic_read(&n->features.int_coalescing);
+
+    if (!cq->coalesce_timer || !NVME_INTC_TIME(intc) ||
+        test_bit(cq->vector, n->features.intvc_cd)) {
+        return false;
+    }
+
+    cq->coalesced += posted;
+    if (cq->coalesced > NVME_INTC_THR(intc)) {
+        cq->coalesced = 0;
+        timer_del(cq->coalesce_timer);
+        return false;
+    }
+
+    if (!timer_pending(cq->coalesce_timer)) {
+        timer_mod(cq->coalesce_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  NVME_INTC_TIME(intc) * 100 * SCALE_US);
+    }
+
+    trace_pci_nvme_irq_coalesced(cq->cqid, cq->coalesced);
+    return true;
+}
+
+/* Context: the AioContext of the queue */
+static void nvme_cq_coalesce_timer(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    cq->coalesced = 0;
+
+    /* the host may have consumed the entries already */
+    if (qatomic_read(&cq->head) == cq->tail) {
+        return;
+    }
+
+    if (nvme_in_iothread(cq->ctx)) {
+        event_notifier_set(&cq->irq_notifier);
+    } else {
+        nvme_irq_assert(cq->ctrl, cq);
+    }
+}
+
 static void nvme_post_cqes(void *opaque)
 {
     NvmeCQueue *cq = opaque;
     NvmeCtrl *n = cq->ctrl;
     NvmeRequest *req, *next;
-    bool pending = cq->head != cq->tail;
+    bool iothread = nvme_in_iothread(cq->ctx);
+    bool pending = qatomic_read(&cq->head) != cq->tail;
+    unsigned posted = 0;
     int ret;
 
+    if (iothread) {
+        qatomic_set(&cq->stalled, false);
+    }
+
     QTAILQ_FOREACH_SAFE(req, &cq->req_list, entry, next) {
         NvmeSQueue *sq;
         hwaddr addr;
@@ -1504,7 +1659,17 @@ static void nvme_post_cqes(void *opaque)
         }
 
         if (nvme_cq_full(cq)) {
-            break;
+            if (!iothread) {
+                break;
+            }
+
+            /* Pairs with smp_mb() in nvme_process_db() */
+            qatomic_set(&cq->stalled, true);
+            smp_mb();
+            if (nvme_cq_full(cq)) {
+                break;
+            }
+            qatomic_set(&cq->stalled, false);
         }
 
         sq = req->sq;
@@ -1523,14 +1688,33 @@ static void nvme_post_cqes(void *opaque)
         QTAILQ_REMOVE(&cq->req_list, req, entry);
         nvme_inc_cq_tail(cq);
         nvme_sg_unmap(&req->sg);
+
+        /*
+         * Doorbell writes do not restart submission queues that run in an
+         * iothread, so do it here once they get a free request again.
+         */
+        if (iothread && QTAILQ_EMPTY(&sq->req_list) && sq->bh) {
+            qemu_bh_schedule(sq->bh);
+        }
         QTAILQ_INSERT_TAIL(&sq->req_list, req, entry);
+        posted++;
+    }
+
+    if (iothread) {
+        if (posted && cq->irq_enabled && !nvme_cq_coalesce(cq, posted)) {
+            event_notifier_set(&cq->irq_notifier);
+        }
+        return;
     }
+
     if (cq->tail != cq->head) {
         if (cq->irq_enabled && !pending) {
             n->cq_pending++;
         }
 
-        nvme_irq_assert(n, cq);
+        if (!nvme_cq_coalesce(cq, posted)) {
+            nvme_irq_assert(n, cq);
+        }
     }
 }
 
@@ -4691,7 +4875,8 @@ static void nvme_cq_notifier(EventNotifier *e)
 
     nvme_update_cq_head(cq);
 
-    if (cq->tail == cq->head) {
+    /* The interrupt state of queues in an iothread is not tracked */
+    if (cq->tail == cq->head && !nvme_in_iothread(cq->ctx)) {
         if (cq->irq_enabled) {
             n->cq_pending--;
         }
@@ -4713,7 +4898,12 @@ static int nvme_init_cq_ioeventfd(NvmeCQueue *cq)
         return ret;
     }
 
-    event_notifier_set_handler(&cq->notifier, nvme_cq_notifier);
+    if (nvme_in_iothread(cq->ctx)) {
+        aio_set_event_notifier(cq->ctx, &cq->notifier, nvme_cq_notifier,
+                               NULL, NULL);
+    } else {
+        event_notifier_set_handler(&cq->notifier, nvme_cq_notifier);
+    }
     memory_region_add_eventfd(&n->iomem,
                               0x1000 + offset, 4, false, 0, &cq->notifier);
 
@@ -4731,6 +4921,52 @@ static void nvme_sq_notifier(EventNotifier *e)
     nvme_process_sq(sq);
 }
 
+/* Context: the iothread of the queue, while it busy-waits */
+static bool nvme_sq_poll(void *opaque)
+{
+    EventNotifier *e = opaque;
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+    uint32_t tail;
+
+    if (QTAILQ_EMPTY(&sq->req_list)) {
+        return false;
+    }
+
+    ldl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->db_addr, &tail,
+                   MEMTXATTRS_UNSPECIFIED);
+
+    return tail != sq->head;
+}
+
+static void nvme_sq_poll_ready(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    nvme_process_sq(sq);
+}
+
+static void nvme_sq_poll_begin(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    trace_pci_nvme_sq_poll(sq->sqid, true);
+
+    sq->polling = true;
+    nvme_update_sq_eventidx(sq);
+}
+
+/* The event loop polls once more after this, in case the host raced with it */
+static void nvme_sq_poll_end(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    trace_pci_nvme_sq_poll(sq->sqid, false);
+
+    sq->polling = false;
+    nvme_update_sq_tail(sq);
+    nvme_update_sq_eventidx(sq);
+}
+
 static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
 {
     NvmeCtrl *n = sq->ctrl;
@@ -4742,23 +4978,69 @@ static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
         return ret;
     }
 
-    event_notifier_set_handler(&sq->notifier, nvme_sq_notifier);
+    if (nvme_in_iothread(sq->ctx)) {
+        aio_set_event_notifier(sq->ctx, &sq->notifier, nvme_sq_notifier,
+                               nvme_sq_poll, nvme_sq_poll_ready);
+        aio_set_event_notifier_poll(sq->ctx, &sq->notifier,
+                                    nvme_sq_poll_begin, nvme_sq_poll_end);
+    } else {
+        event_notifier_set_handler(&sq->notifier, nvme_sq_notifier);
+    }
     memory_region_add_eventfd(&n->iomem,
                               0x1000 + offset, 4, false, 0, &sq->notifier);
 
     return 0;
 }
 
+/*
+ * The reentrancy guard of the device is not thread-safe, so it does not
+ * cover queues that run in an iothread.
+ */
+static MemReentrancyGuard *nvme_queue_guard(NvmeCtrl *n, AioContext *ctx)
+{
+    return nvme_in_iothread(ctx) ? NULL : &DEVICE(n)->mem_reentrancy_guard;
+}
+
+/* Context: the AioContext of the queue */
+static void nvme_stop_sq_bh(void *opaque)
+{
+    NvmeSQueue *sq = opaque;
+
+    if (sq->ioeventfd_enabled) {
+        aio_set_event_notifier(sq->ctx, &sq->notifier, NULL, NULL, NULL);
+    }
+    qemu_bh_delete(sq->bh);
+    sq->bh = NULL;
+}
+
+/* Stop fetching commands from the submission queue */
+static void nvme_stop_sq(NvmeSQueue *sq)
+{
+    if (!sq->bh) {
+        return;
+    }
+
+    if (!nvme_in_iothread(sq->ctx)) {
+        if (sq->ioeventfd_enabled) {
+            event_notifier_set_handler(&sq->notifier, NULL);
+        }
+        qemu_bh_delete(sq->bh);
+        sq->bh = NULL;
+        return;
+    }
+
+    aio_wait_bh_oneshot(sq->ctx, nvme_stop_sq_bh, sq);
+}
+
 static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
 {
     uint16_t offset = sq->sqid << 3;
 
     n->sq[sq->sqid] = NULL;
-    qemu_bh_delete(sq->bh);
+    nvme_stop_sq(sq);
     if (sq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &sq->notifier);
-        event_notifier_set_handler(&sq->notifier, NULL);
         event_notifier_cleanup(&sq->notifier);
     }
     g_free(sq->io_req);
@@ -4767,12 +5049,50 @@ static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
     }
 }
 
+static void nvme_drain_namespaces(NvmeCtrl *n)
+{
+    NvmeNamespace *ns;
+    int i;
+
+    for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
+        ns = nvme_ns(n, i);
+        if (!ns) {
+            continue;
+        }
+
+        nvme_ns_drain(ns);
+    }
+}
+
+/* Context: the AioContext of the queue */
+static void nvme_unlink_sq(void *opaque)
+{
+    NvmeSQueue *sq = opaque;
+    NvmeCtrl *n = sq->ctrl;
+    NvmeRequest *r, *next;
+    NvmeCQueue *cq;
+
+    if (nvme_check_cqid(n, sq->cqid)) {
+        return;
+    }
+
+    cq = n->cq[sq->cqid];
+    QTAILQ_REMOVE(&cq->sq_list, sq, entry);
+
+    nvme_post_cqes(cq);
+    QTAILQ_FOREACH_SAFE(r, &cq->req_list, entry, next) {
+        if (r->sq == sq) {
+            QTAILQ_REMOVE(&cq->req_list, r, entry);
+            QTAILQ_INSERT_TAIL(&sq->req_list, r, entry);
+        }
+    }
+}
+
 static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeRequest *req)
 {
     NvmeDeleteQ *c = (NvmeDeleteQ *)&req->cmd;
-    NvmeRequest *r, *next;
+    NvmeRequest *r;
     NvmeSQueue *sq;
-    NvmeCQueue *cq;
     uint16_t qid = le16_to_cpu(c->qid);
 
     if (unlikely(!qid || nvme_check_sqid(n, qid))) {
@@ -4783,27 +5103,26 @@ static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeRequest *req)
     trace_pci_nvme_del_sq(qid);
 
     sq = n->sq[qid];
-    while (!QTAILQ_EMPTY(&sq->out_req_list)) {
-        r = QTAILQ_FIRST(&sq->out_req_list);
-        assert(r->aiocb);
-        blk_aio_cancel(r->aiocb);
+    if (nvme_in_iothread(sq->ctx)) {
+        /*
+         * Requests of the queue complete in the iothread; rather than
+         * cancelling them from here, stop the queue and let them finish.
+         */
+        nvme_stop_sq(sq);
+        nvme_drain_namespaces(n);
+        aio_wait_bh_oneshot(sq->ctx, nvme_unlink_sq, sq);
+    } else {
+        while (!QTAILQ_EMPTY(&sq->out_req_list)) {
+            r = QTAILQ_FIRST(&sq->out_req_list);
+            assert(r->aiocb);
+            blk_aio_cancel(r->aiocb);
+        }
+
+        nvme_unlink_sq(sq);
     }
 
     assert(QTAILQ_EMPTY(&sq->out_req_list));
 
-    if (!nvme_check_cqid(n, sq->cqid)) {
-        cq = n->cq[sq->cqid];
-        QTAILQ_REMOVE(&cq->sq_list, sq, entry);
-
-        nvme_post_cqes(cq);
-        QTAILQ_FOREACH_SAFE(r, &cq->req_list, entry, next) {
-            if (r->sq == sq) {
-                QTAILQ_REMOVE(&cq->req_list, r, entry);
-                QTAILQ_INSERT_TAIL(&sq->req_list, r, entry);
-            }
-        }
-    }
-
     nvme_free_sq(sq, n);
     return NVME_SUCCESS;
 }
@@ -4814,12 +5133,16 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     int i;
     NvmeCQueue *cq;
 
+    assert(n->cq[cqid]);
+    cq = n->cq[cqid];
+
     sq->ctrl = n;
     sq->dma_addr = dma_addr;
     sq->sqid = sqid;
     sq->size = size;
     sq->cqid = cqid;
     sq->head = sq->tail = 0;
+    sq->ctx = cq->ctx;
     sq->io_req = g_new0(NvmeRequest, sq->size);
 
     QTAILQ_INIT(&sq->req_list);
@@ -4829,8 +5152,8 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
         QTAILQ_INSERT_TAIL(&(sq->req_list), &sq->io_req[i], entry);
     }
 
-    sq->bh = qemu_bh_new_guarded(nvme_process_sq, sq,
-                                 &DEVICE(sq->ctrl)->mem_reentrancy_guard);
+    sq->bh = aio_bh_new_guarded(sq->ctx, nvme_process_sq, sq,
+                                nvme_queue_guard(n, sq->ctx));
 
     if (n->dbbuf_enabled) {
         sq->db_addr = n->dbbuf_dbs + (sqid << 3);
@@ -4843,8 +5166,6 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
         }
     }
 
-    assert(n->cq[cqid]);
-    cq = n->cq[cqid];
     QTAILQ_INSERT_TAIL(&(cq->sq_list), sq, entry);
     n->sq[sqid] = sq;
 }
@@ -5403,17 +5724,55 @@ static uint16_t nvme_get_log(NvmeCtrl *n, NvmeRequest *req)
     }
 }
 
+/* Context: the AioContext of the queue */
+static void nvme_stop_cq_bh(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    if (cq->ioeventfd_enabled) {
+        aio_set_event_notifier(cq->ctx, &cq->notifier, NULL, NULL, NULL);
+    }
+    qemu_bh_delete(cq->bh);
+    cq->bh = NULL;
+    timer_free(cq->coalesce_timer);
+    cq->coalesce_timer = NULL;
+}
+
+/* Stop posting completions, so that the requests can be freed */
+static void nvme_stop_cq(NvmeCQueue *cq)
+{
+    if (!cq->bh) {
+        return;
+    }
+
+    if (nvme_in_iothread(cq->ctx)) {
+        aio_wait_bh_oneshot(cq->ctx, nvme_stop_cq_bh, cq);
+        return;
+    }
+
+    if (cq->ioeventfd_enabled) {
+        event_notifier_set_handler(&cq->notifier, NULL);
+    }
+    qemu_bh_delete(cq->bh);
+    cq->bh = NULL;
+    timer_free(cq->coalesce_timer);
+    cq->coalesce_timer = NULL;
+}
+
 static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
 {
     PCIDevice *pci = PCI_DEVICE(n);
     uint16_t offset = (cq->cqid << 3) + (1 << 2);
 
     n->cq[cq->cqid] = NULL;
-    qemu_bh_delete(cq->bh);
+    nvme_stop_cq(cq);
+    if (nvme_in_iothread(cq->ctx)) {
+        event_notifier_set_handler(&cq->irq_notifier, NULL);
+        event_notifier_cleanup(&cq->irq_notifier);
+    }
     if (cq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &cq->notifier);
-        event_notifier_set_handler(&cq->notifier, NULL);
         event_notifier_cleanup(&cq->notifier);
     }
     if (msix_enabled(pci)) {
@@ -5441,11 +5800,13 @@ static uint16_t nvme_del_cq(NvmeCtrl *n, NvmeRequest *req)
         return NVME_INVALID_QUEUE_DEL;
     }
 
-    if (cq->irq_enabled && cq->tail != cq->head) {
-        n->cq_pending--;
-    }
+    if (!nvme_in_iothread(cq->ctx)) {
+        if (cq->irq_enabled && cq->tail != cq->head) {
+            n->cq_pending--;
+        }
 
-    nvme_irq_deassert(n, cq);
+        nvme_irq_deassert(n, cq);
+    }
     trace_pci_nvme_del_cq(qid);
     nvme_free_cq(cq, n);
     return NVME_SUCCESS;
@@ -5468,8 +5829,23 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     cq->irq_enabled = irq_enabled;
     cq->vector = vector;
     cq->head = cq->tail = 0;
+    cq->stalled = false;
+    cq->ctx = qemu_get_aio_context();
     QTAILQ_INIT(&cq->req_list);
     QTAILQ_INIT(&cq->sq_list);
+
+    /*
+     * Only I/O queues with MSI-X interrupts run in an iothread; pin-based
+     * interrupts are shared by all queues and tracked in the main loop.
+     */
+    if (cqid && n->ioq_ctx && msix_enabled(pci)) {
+        if (!event_notifier_init(&cq->irq_notifier, 0)) {
+            event_notifier_set_handler(&cq->irq_notifier,
+                                       nvme_cq_irq_notifier);
+            cq->ctx = n->ioq_ctx[cqid - 1];
+            trace_pci_nvme_cq_iothread(cqid);
+        }
+    }
     if (n->dbbuf_enabled) {
         cq->db_addr = n->dbbuf_dbs + (cqid << 3) + (1 << 2);
         cq->ei_addr = n->dbbuf_eis + (cqid << 3) + (1 << 2);
@@ -5481,8 +5857,16 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
         }
     }
     n->cq[cqid] = cq;
-    cq->bh = qemu_bh_new_guarded(nvme_post_cqes, cq,
-                                 &DEVICE(cq->ctrl)->mem_reentrancy_guard);
+    cq->bh = aio_bh_new_guarded(cq->ctx, nvme_post_cqes, cq,
+                                nvme_queue_guard(n, cq->ctx));
+
+    cq->coalesced = 0;
+    cq->coalesce_timer = NULL;
+    if (cqid && irq_enabled && msix_enabled(pci)) {
+        cq->coalesce_timer = aio_timer_new(cq->ctx, QEMU_CLOCK_VIRTUAL,
+                                           SCALE_NS, nvme_cq_coalesce_timer,
+                                           cq);
+    }
 }
 
 static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeRequest *req)
@@ -6237,6 +6621,21 @@ static uint16_t nvme_get_feature(NvmeCtrl *n, NvmeRequest *req)
     case NVME_ASYNCHRONOUS_EVENT_CONF:
         result = n->features.async_config;
         goto out;
+    case NVME_INTERRUPT_COALESCING:
+        result = n->features.int_coalescing;
+        goto out;
+    case NVME_INTERRUPT_VECTOR_CONF:
+        iv = dw11 & 0xffff;
+        if (iv >= n->conf_msix_qsize) {
+            return NVME_INVALID_FIELD | NVME_DNR;
+        }
+
+        result = iv;
+        if (iv == n->admin_cq.vector ||
+            test_bit(iv, n->features.intvc_cd)) {
+            result |= NVME_INTVC_NOCOALESCING;
+        }
+        goto out;
     case NVME_TIMESTAMP:
         return nvme_get_feature_timestamp(n, req);
     case NVME_HOST_BEHAVIOR_SUPPORT:
@@ -6291,9 +6690,12 @@ defaults:
         result = (n->conf_ioqpairs - 1) | ((n->conf_ioqpairs - 1) << 16);
         trace_pci_nvme_getfeat_numq(result);
         break;
+    case NVME_INTERRUPT_COALESCING:
+        result = n->params.intc_thr | n->params.intc_time << 8;
+        break;
     case NVME_INTERRUPT_VECTOR_CONF:
         iv = dw11 & 0xffff;
-        if (iv >= n->conf_ioqpairs + 1) {
+        if (iv >= n->conf_msix_qsize) {
             return NVME_INVALID_FIELD | NVME_DNR;
         }
 
@@ -6399,6 +6801,7 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeRequest *req)
     uint8_t fid = NVME_GETSETFEAT_FID(dw10);
     uint8_t save = NVME_SETFEAT_SAVE(dw10);
     uint16_t status;
+    uint16_t iv;
     int i;
     NvmeIdCtrl *id = &n->id_ctrl;
     NvmeAtomic *atomic = &n->atomic;
@@ -6520,6 +6923,26 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeRequest *req)
     case NVME_ASYNCHRONOUS_EVENT_CONF:
         n->features.async_config = dw11;
         break;
+    case NVME_INTERRUPT_COALESCING:
+        trace_pci_nvme_setfeat_intc(NVME_INTC_THR(dw11) + 1,
+                                    NVME_INTC_TIME(dw11) * 100);
+        qatomic_set(&n->features.int_coalescing, dw11 & 0xffff);
+        break;
+    case NVME_INTERRUPT_VECTOR_CONF:
+        iv = dw11 & 0xffff;
+        if (iv >= n->conf_msix_qsize) {
+            return NVME_INVALID_FIELD | NVME_DNR;
+        }
+
+        /* the admin queue interrupt is never coalesced */
+        if (dw11 & NVME_INTVC_NOCOALESCING) {
+            set_bit(iv, n->features.intvc_cd);
+        } else if (iv == n->admin_cq.vector) {
+            return NVME_INVALID_FIELD | NVME_DNR;
+        } else {
+            clear_bit(iv, n->features.intvc_cd);
+        }
+        break;
     case NVME_TIMESTAMP:
         return nvme_set_feature_timestamp(n, req);
     case NVME_HOST_BEHAVIOR_SUPPORT:
@@ -7251,22 +7674,6 @@ static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
     return NVME_INVALID_OPCODE | NVME_DNR;
 }
 
-static void nvme_update_sq_eventidx(const NvmeSQueue *sq)
-{
-    trace_pci_nvme_update_sq_eventidx(sq->sqid, sq->tail);
-
-    stl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->ei_addr, sq->tail,
-                   MEMTXATTRS_UNSPECIFIED);
-}
-
-static void nvme_update_sq_tail(NvmeSQueue *sq)
-{
-    ldl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->db_addr, &sq->tail,
-                   MEMTXATTRS_UNSPECIFIED);
-
-    trace_pci_nvme_update_sq_tail(sq->sqid, sq->tail);
-}
-
 #define NVME_ATOMIC_NO_START        0
 #define NVME_ATOMIC_START_ATOMIC    1
 #define NVME_ATOMIC_START_NONATOMIC 2
@@ -7457,16 +7864,26 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
 {
     PCIDevice *pci_dev = PCI_DEVICE(n);
     NvmeSecCtrlEntry *sctrl;
-    NvmeNamespace *ns;
     int i;
 
-    for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
-        ns = nvme_ns(n, i);
-        if (!ns) {
-            continue;
+    /* Make sure that iothreads do not submit new requests while draining */
+    for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
+        if (n->sq[i] != NULL) {
+            nvme_stop_sq(n->sq[i]);
         }
+    }
 
-        nvme_ns_drain(ns);
+    nvme_drain_namespaces(n);
+
+    /*
+     * The completion queues still hold requests of the submission queues.
+     * Stop their bottom halves and timers in their own AioContexts before
+     * the requests are freed.
+     */
+    for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
+        if (n->cq[i] != NULL) {
+            nvme_stop_cq(n->cq[i]);
+        }
     }
 
     for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
@@ -8001,6 +8418,17 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
 
         trace_pci_nvme_mmio_doorbell_cq(cq->cqid, new_head);
 
+        if (nvme_in_iothread(cq->ctx)) {
+            qatomic_set(&cq->head, new_head);
+
+            /* Pairs with smp_mb() in nvme_post_cqes() */
+            smp_mb();
+            if (qatomic_read(&cq->stalled)) {
+                qemu_bh_schedule(cq->bh);
+            }
+            return;
+        }
+
         start_sqs = nvme_cq_full(cq) ? 1 : 0;
         cq->head = new_head;
         if (!qid && n->dbbuf_enabled) {
@@ -8062,7 +8490,7 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
 
         trace_pci_nvme_mmio_doorbell_sq(sq->sqid, new_tail);
 
-        sq->tail = new_tail;
+        qatomic_set(&sq->tail, new_tail);
         if (!qid && n->dbbuf_enabled) {
             /*
              * The spec states "the host shall also update the controller's
@@ -8276,6 +8704,66 @@ static bool nvme_check_params(NvmeCtrl *n, Error **errp)
     return true;
 }
 
+static bool nvme_init_ioq_ctx(NvmeCtrl *n, Error **errp)
+{
+    uint32_t nr = n->params.max_ioqpairs;
+
+    if (!n->iothread && !n->iothread_vq_mapping_list) {
+        return true;
+    }
+
+    if (n->iothread && n->iothread_vq_mapping_list) {
+        error_setg(errp,
+                   "iothread and iothread-vq-mapping properties cannot be set "
+                   "at the same time");
+        return false;
+    }
+
+    /* Atomic writes are checked against the requests of all queues */
+    if (n->params.atomic_awun || n->params.atomic_awupf) {
+        error_setg(errp, "atomic writes are not supported with an iothread");
+        return false;
+    }
+
+    n->ioq_ctx = g_new(AioContext *, nr);
+
+    if (n->iothread_vq_mapping_list) {
+        if (!iothread_vq_mapping_apply(n->iothread_vq_mapping_list,
+                                       n->ioq_ctx, nr, errp)) {
+            g_free(n->ioq_ctx);
+            n->ioq_ctx = NULL;
+            return false;
+        }
+    } else {
+        AioContext *ctx = iothread_get_aio_context(n->iothread);
+
+        for (unsigned i = 0; i < nr; i++) {
+            n->ioq_ctx[i] = ctx;
+        }
+
+        /* Released in nvme_cleanup_ioq_ctx() */
+        object_ref(OBJECT(n->iothread));
+    }
+
+    return true;
+}
+
+static void nvme_cleanup_ioq_ctx(NvmeCtrl *n)
+{
+    if (!n->ioq_ctx) {
+        return;
+    }
+
+    if (n->iothread_vq_mapping_list) {
+        iothread_vq_mapping_cleanup(n->iothread_vq_mapping_list);
+    } else {
+        object_unref(OBJECT(n->iothread));
+    }
+
+    g_free(n->ioq_ctx);
+    n->ioq_ctx = NULL;
+}
+
 static void nvme_init_state(NvmeCtrl *n)
 {
     NvmePriCtrlCap *cap = &n->pri_ctrl_cap;
@@ -8302,6 +8790,9 @@ static void nvme_init_state(NvmeCtrl *n)
     n->cq = g_new0(NvmeCQueue *, n->params.max_ioqpairs + 1);
     n->temperature = NVME_TEMPERATURE;
     n->features.temp_thresh_hi = NVME_TEMPERATURE_WARNING;
+    n->features.int_coalescing = n->params.intc_thr |
+                                 n->params.intc_time << 8;
+    n->features.intvc_cd = bitmap_new(n->params.msix_qsize);
     n->starttime_ms = qemu_clock_get_ms(QEMU_CLOCK_VIRTUAL);
     n->aer_reqs = g_new0(NvmeRequest *, n->params.aerl + 1);
     QTAILQ_INIT(&n->aer_queue);
@@ -8806,6 +9297,10 @@ static void nvme_realize(PCIDevice *pci_dev, Error **errp)
         return;
     }
 
+    if (!pci_is_vf(pci_dev) && !nvme_init_ioq_ctx(n, errp)) {
+        return;
+    }
+
     qbus_init(&n->bus, sizeof(NvmeBus), TYPE_NVME_BUS, dev, dev->id);
 
     if (nvme_init_subsys(n, errp)) {
@@ -8852,6 +9347,7 @@ static void nvme_exit(PCIDevice *pci_dev)
     g_free(n->cq);
     g_free(n->sq);
     g_free(n->aer_reqs);
+    g_free(n->features.intvc_cd);
 
     if (n->params.cmb_size_mb) {
         g_free(n->cmb.buf);
@@ -8872,6 +9368,8 @@ static void nvme_exit(PCIDevice *pci_dev)
 
     msix_uninit(pci_dev, &n->bar0, &n->bar0);
     memory_region_del_subregion(&n->bar0, &n->iomem);
+
+    nvme_cleanup_ioq_ctx(n);
 }
 
 static Property nvme_props[] = {
@@ -8912,6 +9410,12 @@ static Property nvme_props[] = {
     DEFINE_PROP_BOOL("atomic.dn", NvmeCtrl, params.atomic_dn, 0),
     DEFINE_PROP_UINT16("atomic.awun", NvmeCtrl, params.atomic_awun, 0),
     DEFINE_PROP_UINT16("atomic.awupf", NvmeCtrl, params.atomic_awupf, 0),
+    DEFINE_PROP_LINK("iothread", NvmeCtrl, iothread, TYPE_IOTHREAD,
+                     IOThread *),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", NvmeCtrl,
+                                         iothread_vq_mapping_list),
+    DEFINE_PROP_UINT8("intc.thr", NvmeCtrl, params.intc_thr, 0),
+    DEFINE_PROP_UINT8("intc.time", NvmeCtrl, params.intc_time, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -745,6 +745,24 @@ static void nvme_ns_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (nvme_ns_needs_main_loop(ns)) {
+        bool iothread = n->ioq_ctx;
+
+        for (i = 0; subsys && i < ARRAY_SIZE(subsys->ctrls); i++) {
+            NvmeCtrl *ctrl = subsys->ctrls[i];
+
+            if (ctrl && ctrl != SUBSYS_SLOT_RSVD && ctrl->ioq_ctx) {
+                iothread = true;
+            }
+        }
+
+        if (iothread) {
+            error_setg(errp, "zoned and fdp namespaces are not supported "
+                       "by controllers with an iothread");
+            return;
+        }
+    }
+
     if (!nsid) {
         for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
             if (nvme_ns(n, i) || nvme_subsys_ns(subsys, i)) {
@@ -21,6 +21,8 @@
 #include "qemu/uuid.h"
 #include "hw/pci/pci_device.h"
 #include "hw/block/block.h"
+#include "sysemu/iothread.h"
+#include "qapi/qapi-types-virtio.h"
 
 #include "block/nvme.h"
 
@@ -490,9 +492,12 @@ typedef struct NvmeSQueue {
     uint64_t    dma_addr;
     uint64_t    db_addr;
     uint64_t    ei_addr;
+    AioContext  *ctx;
     QEMUBH      *bh;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
+    /* The iothread polls the shadow doorbell instead of waiting for kicks */
+    bool        polling;
     NvmeRequest *io_req;
     QTAILQ_HEAD(, NvmeRequest) req_list;
     QTAILQ_HEAD(, NvmeRequest) out_req_list;
@@ -511,9 +516,17 @@ typedef struct NvmeCQueue {
     uint64_t    dma_addr;
     uint64_t    db_addr;
     uint64_t    ei_addr;
+    AioContext  *ctx;
     QEMUBH      *bh;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
+    /* Raises the interrupt from the main loop for queues in an iothread */
+    EventNotifier irq_notifier;
+    /* Completions were held back because the queue was full */
+    bool        stalled;
+    /* Completions posted since the interrupt was last raised */
+    uint32_t    coalesced;
+    QEMUTimer   *coalesce_timer;
     QTAILQ_HEAD(, NvmeSQueue) sq_list;
     QTAILQ_HEAD(, NvmeRequest) req_list;
 } NvmeCQueue;
@@ -544,6 +557,8 @@ typedef struct NvmeParams {
     uint32_t  sriov_max_vq_per_vf;
     uint32_t  sriov_max_vi_per_vf;
     bool     msix_exclusive_bar;
+    uint8_t  intc_thr;
+    uint8_t  intc_time;
 
     struct {
         bool mem;
@@ -582,6 +597,9 @@ typedef struct NvmeCtrl {
     uint64_t    dbbuf_eis;
     bool        dbbuf_enabled;
 
+    IOThread                     *iothread;
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
+
     struct {
         MemoryRegion mem;
         uint8_t      *buf;
@@ -612,6 +630,8 @@ typedef struct NvmeCtrl {
     NvmeNamespace   *namespaces[NVME_MAX_NAMESPACES + 1];
     NvmeSQueue      **sq;
     NvmeCQueue      **cq;
+    /* AioContext of each I/O queue pair, indexed by qid - 1 */
+    AioContext      **ioq_ctx;
     NvmeSQueue      admin_sq;
     NvmeCQueue      admin_cq;
     NvmeIdCtrl      id_ctrl;
@@ -623,6 +643,9 @@ typedef struct NvmeCtrl {
         };
 
         uint32_t                async_config;
+        uint32_t                int_coalescing;
+        /* Interrupt vectors with coalescing disabled */
+        unsigned long           *intvc_cd;
         NvmeHostBehaviorSupport hbs;
     } features;
 
@@ -651,6 +674,15 @@ static inline NvmeNamespace *nvme_ns(NvmeCtrl *n, uint32_t nsid)
     return n->namespaces[nsid];
 }
 
+/*
+ * Zoned and FDP namespaces keep state that is shared by all queues, so they
+ * cannot be used by controllers that process I/O queues in iothreads.
+ */
+static inline bool nvme_ns_needs_main_loop(NvmeNamespace *ns)
+{
+    return ns->params.zoned || (ns->endgrp && ns->endgrp->fdp.enabled);
+}
+
 static inline NvmeCQueue *nvme_cq(NvmeRequest *req)
 {
     NvmeSQueue *sq = req->sq;
@@ -58,6 +58,17 @@ int nvme_subsys_register_ctrl(NvmeCtrl *n, Error **errp)
     NvmeSecCtrlEntry *sctrl = nvme_sctrl(n);
     int cntlid, nsid, num_rsvd, num_vfs = n->params.sriov_max_vfs;
 
+    if (n->ioq_ctx) {
+        for (nsid = 1; nsid < ARRAY_SIZE(subsys->namespaces); nsid++) {
+            NvmeNamespace *ns = subsys->namespaces[nsid];
+            if (ns && nvme_ns_needs_main_loop(ns)) {
+                error_setg(errp, "zoned and fdp namespaces are not supported "
+                           "by controllers with an iothread");
+                return -1;
+            }
+        }
+    }
+
     if (pci_is_vf(&n->parent_obj)) {
         cntlid = le16_to_cpu(sctrl->scid);
     } else {
@@ -12,6 +12,8 @@
 #include "qemu/cutils.h"
 #include "qemu/units.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/stats64.h"
 #include <linux/vfio.h>
 #include <sys/ioctl.h>
 
@@ -25,6 +27,7 @@
 #include "migration/blocker.h"
 #include "qapi/error.h"
 #include "qapi/qapi-events-vfio.h"
+#include "io/channel-buffer.h"
 #include "exec/ramlist.h"
 #include "exec/ram_addr.h"
 #include "pci.h"
@@ -47,6 +50,8 @@
 #define VFIO_MIG_FLAG_DEV_SETUP_STATE   (0xffffffffef100003ULL)
 #define VFIO_MIG_FLAG_DEV_DATA_STATE    (0xffffffffef100004ULL)
 #define VFIO_MIG_FLAG_DEV_INIT_DATA_SENT (0xffffffffef100005ULL)
+/* The stop-copy data and the config state follow in the multifd channels */
+#define VFIO_MIG_FLAG_DEV_MULTIFD_STATE (0xffffffffef100006ULL)
 
 /*
  * This is an arbitrary size based on migration of mlx5 devices, where typically
@@ -55,7 +60,31 @@
  */
 #define VFIO_MIG_DEFAULT_DATA_BUFFER_SIZE (1 * MiB)
 
-static int64_t bytes_transferred;
+/*
+ * With x-migration-multifd-transfer, the device state read in the
+ * stop-copy phase is sent through the multifd channels as a sequence of
+ * these packets, numbered by @idx.  The last one has
+ * VFIO_DEVICE_STATE_CONFIG_STATE set and carries the device config state.
+ * All fields are big endian.
+ */
+#define VFIO_DEVICE_STATE_PACKET_VER_CURRENT 0
+#define VFIO_DEVICE_STATE_CONFIG_STATE (1)
+
+typedef struct VFIODeviceStatePacket {
+    uint32_t version;
+    uint32_t idx;
+    uint32_t flags;
+    uint8_t data[];
+} QEMU_PACKED VFIODeviceStatePacket;
+
+typedef struct VFIOStateBuffer {
+    bool is_present;
+    char *data;
+    size_t len;
+} VFIOStateBuffer;
+
+/* Updated by the device state save threads too */
+static Stat64 bytes_transferred;
 
 static const char *mig_state_to_str(enum vfio_device_mig_state state)
 {
@@ -382,7 +411,7 @@ static ssize_t vfio_save_block(QEMUFile *f, VFIOMigration *migration)
     qemu_put_be64(f, VFIO_MIG_FLAG_DEV_DATA_STATE);
     qemu_put_be64(f, data_size);
     qemu_put_buffer(f, migration->data_buffer, data_size);
-    bytes_transferred += data_size;
+    stat64_add(&bytes_transferred, data_size);
 
     trace_vfio_save_block(migration->vbasedev->name, data_size);
 
@@ -421,6 +450,153 @@ static bool vfio_precopy_supported(VFIODevice *vbasedev)
     return migration->mig_flags & VFIO_MIGRATION_PRE_COPY;
 }
 
+static bool vfio_multifd_transfer_setup(VFIODevice *vbasedev, Error **errp)
+{
+    VFIOMigration *migration = vbasedev->migration;
+
+    if (vbasedev->migration_multifd_transfer == ON_OFF_AUTO_AUTO) {
+        migration->multifd_transfer = multifd_device_state_supported();
+        return true;
+    }
+
+    migration->multifd_transfer =
+        vbasedev->migration_multifd_transfer == ON_OFF_AUTO_ON;
+    if (migration->multifd_transfer && !multifd_device_state_supported()) {
+        error_setg(errp,
+                   "%s: multifd device transfer requested but unsupported in "
+                   "the current migration config", vbasedev->name);
+        return false;
+    }
+
+    return true;
+}
+
+static bool vfio_save_complete_precopy_thread_config_state(
+    VFIODevice *vbasedev, const char *idstr, uint32_t instance_id,
+    uint32_t idx, Error **errp)
+{
+    g_autoptr(QIOChannelBuffer) bioc = NULL;
+    g_autofree VFIODeviceStatePacket *packet = NULL;
+    QEMUFile *f;
+    size_t packet_len;
+    int ret;
+
+    bioc = qio_channel_buffer_new(0);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "vfio-device-config-save");
+
+    f = qemu_file_new_output(QIO_CHANNEL(bioc));
+
+    ret = vfio_save_device_config_state(f, vbasedev, errp);
+    if (ret) {
+        qemu_fclose(f);
+        return false;
+    }
+
+    ret = qemu_fflush(f);
+    if (ret) {
+        error_setg_errno(errp, -ret, "%s: config state flush failed",
+                         vbasedev->name);
+        qemu_fclose(f);
+        return false;
+    }
+
+    packet_len = sizeof(*packet) + bioc->usage;
+    packet = g_malloc0(packet_len);
+    packet->version = cpu_to_be32(VFIO_DEVICE_STATE_PACKET_VER_CURRENT);
+    packet->idx = cpu_to_be32(idx);
+    packet->flags = cpu_to_be32(VFIO_DEVICE_STATE_CONFIG_STATE);
+    memcpy(&packet->data, bioc->data, bioc->usage);
+
+    qemu_fclose(f);
+
+    if (!multifd_queue_device_state(idstr, instance_id,
+                                    (char *)packet, packet_len)) {
+        error_setg(errp, "%s: multifd config data queuing failed",
+                   vbasedev->name);
+        return false;
+    }
+
+    stat64_add(&bytes_transferred, packet_len);
+
+    return true;
+}
+
+/*
+ * Read the stop-copy device state and queue it to the multifd channels,
+ * followed by the config state.  Runs in its own thread, in parallel with
+ * the other devices and with the RAM still being sent, and without the
+ * BQL, which the migration thread holds.
+ */
+static bool vfio_save_complete_precopy_thread(
+    SaveLiveCompletePrecopyThreadData *d, Error **errp)
+{
+    VFIODevice *vbasedev = d->handler_opaque;
+    VFIOMigration *migration = vbasedev->migration;
+    g_autofree VFIODeviceStatePacket *packet = NULL;
+    bool ret = false;
+    uint32_t idx;
+
+    if (!migration->multifd_transfer) {
+        /* Nothing to do, vfio_save_complete_precopy() does the job */
+        return true;
+    }
+
+    trace_vfio_save_complete_precopy_thread_start(vbasedev->name, d->idstr,
+                                                  d->instance_id);
+
+    /* We reach here with device state STOP or STOP_COPY only */
+    if (vfio_migration_set_state(vbasedev, VFIO_DEVICE_STATE_STOP_COPY,
+                                 VFIO_DEVICE_STATE_STOP, errp)) {
+        goto out;
+    }
+
+    packet = g_malloc0(sizeof(*packet) + migration->data_buffer_size);
+    packet->version = cpu_to_be32(VFIO_DEVICE_STATE_PACKET_VER_CURRENT);
+
+    for (idx = 0; ; idx++) {
+        ssize_t data_size;
+        size_t packet_size;
+
+        if (multifd_device_state_save_thread_should_exit()) {
+            error_setg(errp, "%s: operation cancelled", vbasedev->name);
+            goto out;
+        }
+
+        data_size = read(migration->data_fd, &packet->data,
+                         migration->data_buffer_size);
+        if (data_size < 0) {
+            error_setg_errno(errp, errno,
+                             "%s: reading state buffer %" PRIu32 " failed",
+                             vbasedev->name, idx);
+            goto out;
+        } else if (data_size == 0) {
+            break;
+        }
+
+        packet->idx = cpu_to_be32(idx);
+        packet_size = sizeof(*packet) + data_size;
+
+        if (!multifd_queue_device_state(d->idstr, d->instance_id,
+                                        (char *)packet, packet_size)) {
+            error_setg(errp, "%s: multifd data queuing failed",
+                       vbasedev->name);
+            goto out;
+        }
+
+        stat64_add(&bytes_transferred, packet_size);
+        trace_vfio_save_block(vbasedev->name, data_size);
+    }
+
+    ret = vfio_save_complete_precopy_thread_config_state(vbasedev, d->idstr,
+                                                         d->instance_id,
+                                                         idx, errp);
+
+out:
+    trace_vfio_save_complete_precopy_thread_end(vbasedev->name, ret);
+
+    return ret;
+}
+
 /* ---------------------------------------------------------------------- */
 
 static int vfio_save_prepare(void *opaque, Error **errp)
@@ -460,6 +636,10 @@ static int vfio_save_setup(QEMUFile *f, void *opaque, Error **errp)
     uint64_t stop_copy_size = VFIO_MIG_DEFAULT_DATA_BUFFER_SIZE;
     int ret;
 
+    if (!vfio_multifd_transfer_setup(vbasedev, errp)) {
+        return -EINVAL;
+    }
+
     qemu_put_be64(f, VFIO_MIG_FLAG_DEV_SETUP_STATE);
 
     vfio_query_stop_copy_size(vbasedev, &stop_copy_size);
@@ -630,6 +810,13 @@ static int vfio_save_complete_precopy(QEMUFile *f, void *opaque)
     int ret;
     Error *local_err = NULL;
 
+    if (vbasedev->migration->multifd_transfer) {
+        /* vfio_save_complete_precopy_thread() sends the data */
+        qemu_put_be64(f, VFIO_MIG_FLAG_DEV_MULTIFD_STATE);
+        qemu_put_be64(f, VFIO_MIG_FLAG_END_OF_STATE);
+        return qemu_file_get_error(f);
+    }
+
     /* We reach here with device state STOP or STOP_COPY only */
     ret = vfio_migration_set_state(vbasedev, VFIO_DEVICE_STATE_STOP_COPY,
                                    VFIO_DEVICE_STATE_STOP, &local_err);
@@ -659,6 +846,12 @@ static void vfio_save_state(QEMUFile *f, void *opaque)
     Error *local_err = NULL;
     int ret;
 
+    if (vbasedev->migration->multifd_transfer) {
+        /* The config state was sent through multifd, after the data */
+        qemu_put_be64(f, VFIO_MIG_FLAG_END_OF_STATE);
+        return;
+    }
+
     ret = vfio_save_device_config_state(f, opaque, &local_err);
     if (ret) {
         error_prepend(&local_err,
@@ -668,17 +861,241 @@ static void vfio_save_state(QEMUFile *f, void *opaque)
     }
 }
 
+static void vfio_state_buffer_clear(gpointer data)
+{
+    VFIOStateBuffer *lb = data;
+
+    g_clear_pointer(&lb->data, g_free);
+    lb->is_present = false;
+}
+
+static bool vfio_load_state_buffer(void *opaque, char *data, size_t data_size,
+                                   Error **errp)
+{
+    VFIODevice *vbasedev = opaque;
+    VFIOMigration *migration = vbasedev->migration;
+    VFIODeviceStatePacket *packet = (VFIODeviceStatePacket *)data;
+    VFIOStateBuffer *lb;
+    uint32_t idx, flags;
+
+    if (!migration->multifd_transfer) {
+        error_setg(errp,
+                   "%s: got device state packet but not doing multifd "
+                   "transfer", vbasedev->name);
+        return false;
+    }
+
+    if (data_size < sizeof(*packet)) {
+        error_setg(errp, "%s: packet too short at %zu (min is %zu)",
+                   vbasedev->name, data_size, sizeof(*packet));
+        return false;
+    }
+
+    if (be32_to_cpu(packet->version) != VFIO_DEVICE_STATE_PACKET_VER_CURRENT) {
+        error_setg(errp, "%s: packet has unknown version %" PRIu32,
+                   vbasedev->name, be32_to_cpu(packet->version));
+        return false;
+    }
+
+    idx = be32_to_cpu(packet->idx);
+    flags = be32_to_cpu(packet->flags);
+
+    trace_vfio_load_state_device_buffer_incoming(vbasedev->name, idx);
+
+    QEMU_LOCK_GUARD(&migration->load_bufs_mutex);
+
+    if (idx >= migration->load_bufs->len) {
+        g_array_set_size(migration->load_bufs, idx + 1);
+    }
+
+    lb = &g_array_index(migration->load_bufs, VFIOStateBuffer, idx);
+    if (lb->is_present) {
+        error_setg(errp, "%s: state buffer %" PRIu32 " already filled",
+                   vbasedev->name, idx);
+        return false;
+    }
+
+    if (flags & VFIO_DEVICE_STATE_CONFIG_STATE) {
+        if (migration->load_buf_idx_last != UINT32_MAX) {
+            error_setg(errp, "%s: config state packet %" PRIu32
+                       " after packet %" PRIu32, vbasedev->name, idx,
+                       migration->load_buf_idx_last);
+            return false;
+        }
+        migration->load_buf_idx_last = idx;
+    }
+
+    lb->data = g_memdup2(&packet->data, data_size - sizeof(*packet));
+    lb->len = data_size - sizeof(*packet);
+    lb->is_present = true;
+
+    qemu_cond_signal(&migration->load_bufs_cond);
+
+    return true;
+}
+
+static bool vfio_load_bufs_thread_load_config(VFIODevice *vbasedev,
+                                              VFIOStateBuffer *lb,
+                                              Error **errp)
+{
+    g_autoptr(QIOChannelBuffer) bioc = NULL;
+    QEMUFile *f;
+    uint64_t data;
+    int ret;
+
+    bioc = qio_channel_buffer_new(lb->len);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "vfio-device-config-load");
+    memcpy(bioc->data, lb->data, lb->len);
+    bioc->usage = lb->len;
+
+    f = qemu_file_new_input(QIO_CHANNEL(bioc));
+
+    /* Devices' config state is loaded with the BQL, as without multifd */
+    bql_lock();
+    data = qemu_get_be64(f);
+    if (data != VFIO_MIG_FLAG_DEV_CONFIG_STATE) {
+        ret = -EINVAL;
+    } else {
+        ret = vfio_load_device_config_state(f, vbasedev);
+    }
+    bql_unlock();
+
+    qemu_fclose(f);
+
+    if (ret < 0) {
+        error_setg(errp, "%s: failed to load device config state",
+                   vbasedev->name);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Write the device state buffers received through the multifd channels to
+ * the device, in order, and finally load the config state.  Buffers are
+ * only written once the main migration stream is done with the pre-copy
+ * data, see VFIO_MIG_FLAG_DEV_MULTIFD_STATE.
+ */
+static bool vfio_load_bufs_thread(void *opaque, bool *should_quit,
+                                  Error **errp)
+{
+    VFIODevice *vbasedev = opaque;
+    VFIOMigration *migration = vbasedev->migration;
+    VFIOStateBuffer config = {};
+    bool ret;
+
+    trace_vfio_load_bufs_thread_start(vbasedev->name);
+
+    qemu_mutex_lock(&migration->load_bufs_mutex);
+    for (;;) {
+        uint32_t idx = migration->load_buf_idx;
+        VFIOStateBuffer *lb = NULL;
+        g_autofree char *buf = NULL;
+        size_t len, done;
+
+        if (qatomic_read(should_quit)) {
+            qemu_mutex_unlock(&migration->load_bufs_mutex);
+            error_setg(errp, "%s: operation cancelled", vbasedev->name);
+            ret = false;
+            goto out;
+        }
+
+        if (migration->load_bufs_ready && idx < migration->load_bufs->len) {
+            lb = &g_array_index(migration->load_bufs, VFIOStateBuffer, idx);
+        }
+        if (!lb || !lb->is_present) {
+            /* Time out to notice should_quit */
+            qemu_cond_timedwait(&migration->load_bufs_cond,
+                                &migration->load_bufs_mutex, 100);
+            continue;
+        }
+
+        if (idx == migration->load_buf_idx_last) {
+            config.data = g_steal_pointer(&lb->data);
+            config.len = lb->len;
+            break;
+        }
+
+        buf = g_steal_pointer(&lb->data);
+        len = lb->len;
+        qemu_mutex_unlock(&migration->load_bufs_mutex);
+
+        trace_vfio_load_state_device_buffer_load(vbasedev->name, idx);
+
+        for (done = 0; done < len; ) {
+            ssize_t wr_ret = write(migration->data_fd, buf + done, len - done);
+
+            if (wr_ret < 0) {
+                error_setg_errno(errp, errno,
+                                 "%s: writing state buffer %" PRIu32
+                                 " failed", vbasedev->name, idx);
+                ret = false;
+                goto out;
+            }
+            done += wr_ret;
+        }
+        stat64_add(&bytes_transferred, len);
+
+        qemu_mutex_lock(&migration->load_bufs_mutex);
+        migration->load_buf_idx++;
+    }
+    qemu_mutex_unlock(&migration->load_bufs_mutex);
+
+    ret = vfio_load_bufs_thread_load_config(vbasedev, &config, errp);
+    g_free(config.data);
+
+out:
+    trace_vfio_load_bufs_thread_end(vbasedev->name, ret);
+
+    return ret;
+}
+
 static int vfio_load_setup(QEMUFile *f, void *opaque, Error **errp)
 {
     VFIODevice *vbasedev = opaque;
+    VFIOMigration *migration = vbasedev->migration;
+    int ret;
+
+    if (!vfio_multifd_transfer_setup(vbasedev, errp)) {
+        return -EINVAL;
+    }
+
+    ret = vfio_migration_set_state(vbasedev, VFIO_DEVICE_STATE_RESUMING,
+                                   migration->device_state, errp);
+    if (ret) {
+        return ret;
+    }
 
-    return vfio_migration_set_state(vbasedev, VFIO_DEVICE_STATE_RESUMING,
-                                    vbasedev->migration->device_state, errp);
+    if (migration->multifd_transfer) {
+        qemu_mutex_init(&migration->load_bufs_mutex);
+        qemu_cond_init(&migration->load_bufs_cond);
+        migration->load_bufs = g_array_new(FALSE, TRUE,
+                                           sizeof(VFIOStateBuffer));
+        g_array_set_clear_func(migration->load_bufs, vfio_state_buffer_clear);
+        migration->load_buf_idx = 0;
+        migration->load_buf_idx_last = UINT32_MAX;
+        migration->load_bufs_ready = false;
+
+        qemu_loadvm_start_load_thread("mig/dst/vfio", vfio_load_bufs_thread,
+                                      vbasedev);
+    }
+
+    return 0;
 }
 
 static int vfio_load_cleanup(void *opaque)
 {
     VFIODevice *vbasedev = opaque;
+    VFIOMigration *migration = vbasedev->migration;
+
+    /* The load thread was joined already by qemu_loadvm_state_cleanup() */
+    if (migration->multifd_transfer) {
+        g_clear_pointer(&migration->load_bufs, g_array_unref);
+        qemu_cond_destroy(&migration->load_bufs_cond);
+        qemu_mutex_destroy(&migration->load_bufs_mutex);
+        migration->multifd_transfer = false;
+    }
 
     vfio_migration_cleanup(vbasedev);
     trace_vfio_load_cleanup(vbasedev->name);
@@ -700,6 +1117,12 @@ static int vfio_load_state(QEMUFile *f, void *opaque, int version_id)
         switch (data) {
         case VFIO_MIG_FLAG_DEV_CONFIG_STATE:
         {
+            if (vbasedev->migration->multifd_transfer) {
+                error_report("%s: got config state in the main stream but "
+                             "doing multifd transfer", vbasedev->name);
+                return -EINVAL;
+            }
+
             return vfio_load_device_config_state(f, opaque);
         }
         case VFIO_MIG_FLAG_DEV_SETUP_STATE:
@@ -726,6 +1149,22 @@ static int vfio_load_state(QEMUFile *f, void *opaque, int version_id)
             }
             break;
         }
+        case VFIO_MIG_FLAG_DEV_MULTIFD_STATE:
+        {
+            VFIOMigration *migration = vbasedev->migration;
+
+            if (!migration->multifd_transfer) {
+                error_report("%s: source does multifd transfer but not "
+                             "enabled here", vbasedev->name);
+                return -EINVAL;
+            }
+
+            WITH_QEMU_LOCK_GUARD(&migration->load_bufs_mutex) {
+                migration->load_bufs_ready = true;
+                qemu_cond_signal(&migration->load_bufs_cond);
+            }
+            break;
+        }
         case VFIO_MIG_FLAG_DEV_INIT_DATA_SENT:
         {
             if (!vfio_precopy_supported(vbasedev) ||
@@ -774,10 +1213,12 @@ static const SaveVMHandlers savevm_vfio_handlers = {
     .is_active_iterate = vfio_is_active_iterate,
     .save_live_iterate = vfio_save_iterate,
     .save_live_complete_precopy = vfio_save_complete_precopy,
+    .save_live_complete_precopy_thread = vfio_save_complete_precopy_thread,
     .save_state = vfio_save_state,
     .load_setup = vfio_load_setup,
     .load_cleanup = vfio_load_cleanup,
     .load_state = vfio_load_state,
+    .load_state_buffer = vfio_load_state_buffer,
     .switchover_ack_needed = vfio_switchover_ack_needed,
 };
 
@@ -994,12 +1435,12 @@ static int vfio_block_migration(VFIODevice *vbasedev, Error *err, Error **errp)
 
 int64_t vfio_mig_bytes_transferred(void)
 {
-    return bytes_transferred;
+    return stat64_get(&bytes_transferred);
 }
 
 void vfio_reset_bytes_transferred(void)
 {
-    bytes_transferred = 0;
+    stat64_set(&bytes_transferred, 0);
 }
 
 /*
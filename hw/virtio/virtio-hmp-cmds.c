@@ -241,6 +241,15 @@ void hmp_virtio_queue_status(Monitor *mon, const QDict *qdict)
                    s->signalled_used);
     monitor_printf(mon, "  signalled_used_valid: %s\n",
                    s->signalled_used_valid ? "true" : "false");
+    monitor_printf(mon, "  notify_sent:          %"PRIu64"\n",
+                   s->notify_sent);
+    monitor_printf(mon, "  notify_suppressed:    %"PRIu64"\n",
+                   s->notify_suppressed);
+    monitor_printf(mon, "  notify_coalesced:     %"PRIu64"\n",
+                   s->notify_coalesced);
+    monitor_printf(mon, "  irq_moderation:       %"PRIu32" us, %"PRIu32
+                   " frames\n", s->irq_moderation_usecs,
+                   s->irq_moderation_frames);
     if (s->has_last_avail_idx) {
         monitor_printf(mon, "  last_avail_idx:       %d\n",
                        s->last_avail_idx);
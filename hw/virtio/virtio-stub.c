@@ -32,6 +32,14 @@ VirtQueueStatus *qmp_x_query_virtio_queue_status(const char *path,
     return qmp_virtio_unsupported(errp);
 }
 
+void qmp_x_virtio_set_irq_moderation(const char *path, bool has_queue,
+                                     uint16_t queue, uint32_t usecs,
+                                     bool has_max_frames, uint32_t max_frames,
+                                     Error **errp)
+{
+    qmp_virtio_unsupported(errp);
+}
+
 VirtioQueueElement *qmp_x_query_virtio_queue_element(const char *path,
                                                      uint16_t queue,
                                                      bool has_index,
@@ -153,6 +153,24 @@ struct VirtQueue
     EventNotifier host_notifier;
     bool host_notifier_enabled;
     QLIST_ENTRY(VirtQueue) node;
+
+    /*
+     * Interrupt moderation, see virtio_queue_irq_moderate().  The policy
+     * can be changed from the monitor at any time, the rest belongs to
+     * the thread that processes the virtqueue.
+     */
+    uint32_t irq_mod_usecs;
+    uint32_t irq_mod_frames;
+    uint32_t irq_mod_pending;
+    bool irq_mod_irqfd;
+    int64_t irq_mod_last_ns;
+    AioContext *irq_mod_ctx; /* of irq_mod_timer, NULL until first used */
+    QEMUTimer irq_mod_timer;
+
+    /* Notification statistics, for x-query-virtio-queue-status */
+    uint64_t notify_sent;
+    uint64_t notify_suppressed;
+    uint64_t notify_coalesced;
 };
 
 const char *virtio_device_names[] = {
@@ -2264,6 +2282,8 @@ static enum virtio_device_endian virtio_current_cpu_endian(void)
     }
 }
 
+static void virtio_queue_irq_mod_reset(VirtQueue *vq);
+
 static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
 {
     vdev->vq[i].vring.desc = 0;
@@ -2282,6 +2302,7 @@ static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
     vdev->vq[i].vring.num = vdev->vq[i].vring.num_default;
     vdev->vq[i].inuse = 0;
     virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
+    virtio_queue_irq_mod_reset(&vdev->vq[i]);
 }
 
 void virtio_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
@@ -2550,12 +2571,15 @@ VirtQueue *virtio_add_queue(VirtIODevice *vdev, int queue_size,
     vdev->vq[i].vring.align = VIRTIO_PCI_VRING_ALIGN;
     vdev->vq[i].handle_output = handle_output;
     vdev->vq[i].used_elems = g_new0(VirtQueueElement, queue_size);
+    vdev->vq[i].irq_mod_usecs = vdev->irq_mod_usecs;
+    vdev->vq[i].irq_mod_frames = vdev->irq_mod_frames;
 
     return &vdev->vq[i];
 }
 
 void virtio_delete_queue(VirtQueue *vq)
 {
+    virtio_queue_irq_mod_reset(vq);
     vq->vring.num = 0;
     vq->vring.num_default = 0;
     vq->handle_output = NULL;
@@ -2672,16 +2696,8 @@ static void virtio_notify_irqfd_deferred_fn(void *opaque)
     event_notifier_set(notifier);
 }
 
-void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
+static void virtio_irqfd(VirtQueue *vq)
 {
-    WITH_RCU_READ_LOCK_GUARD() {
-        if (!virtio_should_notify(vdev, vq)) {
-            return;
-        }
-    }
-
-    trace_virtio_notify_irqfd(vdev, vq);
-
     /*
      * virtio spec 1.0 says ISR bit 0 should be ignored with MSI, but
      * windows drivers included in virtio-win 1.8.0 (circa 2015) are
@@ -2707,16 +2723,165 @@ static void virtio_irq(VirtQueue *vq)
     virtio_notify_vector(vq->vdev, vq->vector);
 }
 
+static void virtio_queue_irq_send(VirtQueue *vq, bool irqfd)
+{
+    vq->notify_sent++;
+    if (qatomic_read(&vq->irq_mod_usecs)) {
+        vq->irq_mod_last_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    }
+
+    if (irqfd) {
+        virtio_irqfd(vq);
+    } else {
+        virtio_irq(vq);
+    }
+}
+
+static void virtio_queue_irq_mod_timer_cb(void *opaque)
+{
+    VirtQueue *vq = opaque;
+
+    if (vq->irq_mod_pending) {
+        trace_virtio_queue_irq_mod_flush(vq->vdev, vq, vq->irq_mod_pending);
+        vq->irq_mod_pending = 0;
+        virtio_queue_irq_send(vq, vq->irq_mod_irqfd);
+    }
+}
+
+static void virtio_queue_irq_mod_arm(VirtQueue *vq, int64_t deadline_ns)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    if (vq->irq_mod_ctx && timer_pending(&vq->irq_mod_timer)) {
+        return;
+    }
+
+    /* The virtqueue may have moved to another thread since last time */
+    if (vq->irq_mod_ctx != ctx) {
+        aio_timer_init(ctx, &vq->irq_mod_timer, QEMU_CLOCK_VIRTUAL,
+                       SCALE_NS, virtio_queue_irq_mod_timer_cb, vq);
+        vq->irq_mod_ctx = ctx;
+    }
+    timer_mod_ns(&vq->irq_mod_timer, deadline_ns);
+}
+
+/*
+ * Interrupt moderation: while a virtqueue would interrupt the guest more
+ * often than once every irq_mod_usecs, hold the interrupts back until
+ * that interval has elapsed since the last one, or until irq_mod_frames
+ * notifications have been coalesced.  A queue that has been quiet for
+ * that long interrupts right away, so light loads see no added latency.
+ *
+ * Time is measured with the virtual clock, like the virtio-net tx timer:
+ * it does not advance while the VM is stopped, and qtest can drive it.
+ *
+ * Returns true if the notification was coalesced (or sent) here.
+ */
+static bool virtio_queue_irq_moderate(VirtQueue *vq, bool irqfd)
+{
+    uint32_t usecs = qatomic_read(&vq->irq_mod_usecs);
+    uint32_t frames = qatomic_read(&vq->irq_mod_frames);
+    int64_t now, deadline;
+
+    if (!usecs && !vq->irq_mod_pending) {
+        return false;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    deadline = vq->irq_mod_last_ns + (int64_t)usecs * SCALE_US;
+    if (!vq->irq_mod_pending && now >= deadline) {
+        return false;
+    }
+
+    vq->irq_mod_pending++;
+    vq->irq_mod_irqfd = irqfd;
+
+    if (!usecs || (frames && vq->irq_mod_pending >= frames)) {
+        trace_virtio_queue_irq_mod_flush(vq->vdev, vq, vq->irq_mod_pending);
+        vq->notify_coalesced += vq->irq_mod_pending - 1;
+        vq->irq_mod_pending = 0;
+        if (vq->irq_mod_ctx) {
+            timer_del(&vq->irq_mod_timer);
+        }
+        virtio_queue_irq_send(vq, irqfd);
+        return true;
+    }
+
+    if (vq->irq_mod_pending > 1) {
+        vq->notify_coalesced++;
+    }
+    virtio_queue_irq_mod_arm(vq, deadline);
+    return true;
+}
+
+/*
+ * Send any interrupt held back by moderation right away, from the main
+ * loop.  Used when the VM stops, so that no interrupt is lost across
+ * migration.
+ */
+static void virtio_queue_irq_mod_flush(VirtQueue *vq)
+{
+    if (vq->irq_mod_ctx) {
+        timer_del(&vq->irq_mod_timer);
+    }
+    if (vq->irq_mod_pending) {
+        trace_virtio_queue_irq_mod_flush(vq->vdev, vq, vq->irq_mod_pending);
+        vq->irq_mod_pending = 0;
+        vq->notify_sent++;
+        virtio_irq(vq);
+    }
+}
+
+static void virtio_queue_irq_mod_reset(VirtQueue *vq)
+{
+    if (vq->irq_mod_ctx) {
+        timer_del(&vq->irq_mod_timer);
+        vq->irq_mod_ctx = NULL;
+    }
+    vq->irq_mod_pending = 0;
+    vq->irq_mod_last_ns = 0;
+    vq->notify_sent = 0;
+    vq->notify_suppressed = 0;
+    vq->notify_coalesced = 0;
+}
+
+void virtio_queue_set_irq_moderation(VirtQueue *vq, uint32_t usecs,
+                                     uint32_t frames)
+{
+    qatomic_set(&vq->irq_mod_usecs, usecs);
+    qatomic_set(&vq->irq_mod_frames, frames);
+}
+
+void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
+{
+    WITH_RCU_READ_LOCK_GUARD() {
+        if (!virtio_should_notify(vdev, vq)) {
+            vq->notify_suppressed++;
+            return;
+        }
+    }
+
+    trace_virtio_notify_irqfd(vdev, vq);
+
+    if (!virtio_queue_irq_moderate(vq, true)) {
+        virtio_queue_irq_send(vq, true);
+    }
+}
+
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
 {
     WITH_RCU_READ_LOCK_GUARD() {
         if (!virtio_should_notify(vdev, vq)) {
+            vq->notify_suppressed++;
             return;
         }
     }
 
     trace_virtio_notify(vdev, vq);
-    virtio_irq(vq);
+
+    if (!virtio_queue_irq_moderate(vq, false)) {
+        virtio_queue_irq_send(vq, false);
+    }
 }
 
 void virtio_notify_config(VirtIODevice *vdev)
@@ -3429,7 +3594,15 @@ static void virtio_vmstate_change(void *opaque, bool running, RunState state)
     }
 
     if (!backend_run) {
+        int i;
+
         virtio_set_status(vdev, vdev->status);
+
+        for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+            if (vdev->vq[i].vring.num) {
+                virtio_queue_irq_mod_flush(&vdev->vq[i]);
+            }
+        }
     }
 }
 
@@ -3990,6 +4163,7 @@ static void virtio_device_free_virtqueues(VirtIODevice *vdev)
         if (vdev->vq[i].vring.num == 0) {
             break;
         }
+        virtio_queue_irq_mod_reset(&vdev->vq[i]);
         virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
     }
     g_free(vdev->vq);
@@ -4011,10 +4185,14 @@ static Property virtio_properties[] = {
     DEFINE_PROP_BOOL("use-disabled-flag", VirtIODevice, use_disabled_flag, true),
     DEFINE_PROP_BOOL("x-disable-legacy-check", VirtIODevice,
                      disable_legacy_check, false),
+    DEFINE_PROP_UINT32("x-irq-moderation-usecs", VirtIODevice,
+                       irq_mod_usecs, 0),
+    DEFINE_PROP_UINT32("x-irq-moderation-frames", VirtIODevice,
+                       irq_mod_frames, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
-static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int i, n, r, err;
@@ -4084,7 +4262,7 @@ int virtio_device_start_ioeventfd(VirtIODevice *vdev)
     return virtio_bus_start_ioeventfd(vbus);
 }
 
-static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int n, r;
@@ -4189,6 +4367,13 @@ VirtQueueStatus *qmp_x_query_virtio_queue_status(const char *path,
     status->used_idx = vdev->vq[queue].used_idx;
     status->signalled_used = vdev->vq[queue].signalled_used;
     status->signalled_used_valid = vdev->vq[queue].signalled_used_valid;
+    status->notify_sent = vdev->vq[queue].notify_sent;
+    status->notify_suppressed = vdev->vq[queue].notify_suppressed;
+    status->notify_coalesced = vdev->vq[queue].notify_coalesced;
+    status->irq_moderation_usecs =
+        qatomic_read(&vdev->vq[queue].irq_mod_usecs);
+    status->irq_moderation_frames =
+        qatomic_read(&vdev->vq[queue].irq_mod_frames);
 
     if (vdev->vhost_started) {
         VirtioDeviceClass *vdc = VIRTIO_DEVICE_GET_CLASS(vdev);
@@ -4217,6 +4402,43 @@ VirtQueueStatus *qmp_x_query_virtio_queue_status(const char *path,
     return status;
 }
 
+void qmp_x_virtio_set_irq_moderation(const char *path, bool has_queue,
+                                     uint16_t queue, uint32_t usecs,
+                                     bool has_max_frames, uint32_t max_frames,
+                                     Error **errp)
+{
+    VirtIODevice *vdev;
+    int i;
+
+    vdev = qmp_find_virtio_device(path);
+    if (vdev == NULL) {
+        error_setg(errp, "Path %s is not a VirtIODevice", path);
+        return;
+    }
+
+    if (has_queue &&
+        (queue >= VIRTIO_QUEUE_MAX || !virtio_queue_get_num(vdev, queue))) {
+        error_setg(errp, "Invalid virtqueue number %d", queue);
+        return;
+    }
+
+    if (!has_max_frames) {
+        max_frames = 0;
+    }
+
+    if (!has_queue) {
+        /* Also applies to the queues created later */
+        vdev->irq_mod_usecs = usecs;
+        vdev->irq_mod_frames = max_frames;
+    }
+
+    for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+        if (vdev->vq[i].vring.num && (!has_queue || i == queue)) {
+            virtio_queue_set_irq_moderation(&vdev->vq[i], usecs, max_frames);
+        }
+    }
+}
+
 static strList *qmp_decode_vring_desc_flags(uint16_t flags)
 {
     strList *list = NULL;
@@ -1210,6 +1210,15 @@ struct BlockDriverState {
     QemuMutex dirty_bitmap_mutex;
     QLIST_HEAD(, BdrvDirtyBitmap) dirty_bitmaps;
 
+    /*
+     * Generation of the dirty bitmap state, used by bdrv_set_dirty() to skip
+     * dirty_bitmap_mutex for areas that are already dirty.  Changed under
+     * dirty_bitmap_mutex whenever an enabled bitmap may lose dirty bits or a
+     * bitmap starts recording writes; read atomically.  0 disables the fast
+     * path.
+     */
+    uint64_t dirty_bitmap_gen;
+
     /* Offset after the highest byte written to */
     Stat64 wr_highest_offset;
 
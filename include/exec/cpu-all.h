@@ -167,6 +167,17 @@ int walk_memory_regions(void *, walk_memory_regions_fn);
 
 int page_get_flags(target_ulong address);
 
+/**
+ * page_get_flags_range:
+ * @start: first byte of range
+ * @last: last byte of range
+ *
+ * Return the union of the flags of all pages in [@start, @last], or -1 if
+ * any page is unmapped.  Like page_get_flags(), this does not take the mmap
+ * lock unless the page flags are being modified concurrently.
+ */
+int page_get_flags_range(target_ulong start, target_ulong last);
+
 /**
  * page_set_flags:
  * @start: first byte of range
@@ -141,6 +141,17 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Jump slots used by tcg_gen_lookup_and_goto_ptr_cached(), and the
+     * guest pc cached for each of them followed by its complement.  The
+     * pc is claimed once by the main loop when it first links the slot,
+     * and zero in both words means that the slot is unclaimed.  A slot
+     * that cannot be linked is disabled by a complement that does not
+     * match the pc.
+     */
+    uint8_t jmp_ind_mask;
+    uint64_t jmp_ind_pc[2][2];
 };
 
 /* The alignment given to TranslationBlock during allocation. */
@@ -53,6 +53,10 @@ this code that are retained.
 
 #include "fpu/softfloat-types.h"
 
+void float_lazy_inexact_sync(float_status *status);
+void float_lazy_inexact_discard(float_status *status);
+void float_lazy_inexact_sync_thread(void);
+
 static inline void set_float_detect_tininess(bool val, float_status *status)
 {
     status->tininess_before_rounding = val;
@@ -66,9 +70,41 @@ static inline void set_float_rounding_mode(FloatRoundMode val,
 
 static inline void set_float_exception_flags(int val, float_status *status)
 {
+#ifdef CONFIG_TCG
+    if (unlikely(status->lazy_self == status)) {
+        float_lazy_inexact_discard(status);
+    }
+#endif
     status->float_exception_flags = val;
 }
 
+/*
+ * Allow the inexact flag to be accumulated lazily by the host FPU.
+ *
+ * Hardfloat can only be used while the inexact flag is already set,
+ * because it does not compute whether the result was exact.  Guests
+ * that clear the flags often (e.g. around libm calls) therefore run
+ * most FP operations through the soft path.  With lazy tracking,
+ * hardfloat is used with inexact clear too, and the inexact flag that
+ * the host FPU accumulates in its own status register is folded into
+ * @status when the flags are read with get_float_exception_flags(),
+ * or when the vCPU leaves cpu_exec().
+ *
+ * This is only correct if inexact exceptions do not need to trap
+ * precisely, and if @status is only used by one vCPU thread.  Code that
+ * uses the host FPU outside of softfloat, e.g. helpers calling libm,
+ * must call float_lazy_inexact_sync_thread() first.
+ */
+static inline void set_float_lazy_inexact(bool val, float_status *status)
+{
+#ifdef CONFIG_TCG
+    if (!val && status->lazy_self == status) {
+        float_lazy_inexact_sync(status);
+    }
+#endif
+    status->lazy_self = val ? status : NULL;
+}
+
 static inline void set_floatx80_rounding_precision(FloatX80RoundPrec val,
                                                    float_status *status)
 {
@@ -117,6 +153,11 @@ static inline FloatRoundMode get_float_rounding_mode(float_status *status)
 
 static inline int get_float_exception_flags(float_status *status)
 {
+#ifdef CONFIG_TCG
+    if (unlikely(status->lazy_self == status)) {
+        float_lazy_inexact_sync(status);
+    }
+#endif
     return status->float_exception_flags;
 }
 
@@ -199,6 +199,12 @@ typedef struct float_status {
     bool rebias_overflow;
     /* should underflowed results add re_bias to its exponent? */
     bool rebias_underflow;
+    /*
+     * Points to this float_status if inexact may be tracked lazily by the
+     * host FPU, see set_float_lazy_inexact().  Copies of the structure
+     * do not point to themselves, so they never take part in it.
+     */
+    struct float_status *lazy_self;
 } float_status;
 
 #endif /* SOFTFLOAT_TYPES_H */
@@ -50,6 +50,15 @@ void gdbserver_fork_start(void);
  */
 void gdbserver_fork_end(CPUState *cs, pid_t pid);
 
+/**
+ * gdb_should_catch_syscall() - check if gdb wants to stop at a syscall
+ * @num: syscall number
+ *
+ * Return: true if gdb_syscall_entry() and gdb_syscall_return() may
+ * yield control to gdb for syscall @num.
+ */
+bool gdb_should_catch_syscall(int num);
+
 /**
  * gdb_syscall_entry() - inform gdb of syscall entry and yield control to it
  * @cs: CPU
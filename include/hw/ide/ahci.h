@@ -25,6 +25,8 @@
 #define HW_IDE_AHCI_H
 
 #include "exec/memory.h"
+#include "qemu/thread.h"
+#include "sysemu/iothread.h"
 
 typedef struct AHCIDevice AHCIDevice;
 
@@ -48,6 +50,15 @@ typedef struct AHCIState {
     uint32_t ports;
     qemu_irq irq;
     AddressSpace *as;
+
+    IOThread *iothread;     /* Processes commands outside the BQL if set */
+    AioContext *ctx;
+    QemuRecMutex lock;      /* With an iothread, protects all HBA state */
+    QEMUBH *irq_bh;         /* Delivers interrupts raised by the iothread */
+    QEMUBH *reset_bh;       /* Runs resets requested by the guest */
+    bool reset_pending;
+    bool quiesced;          /* No new commands are started while set */
+    VMChangeStateEntry *vmstate;
 } AHCIState;
 
 
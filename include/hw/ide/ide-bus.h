@@ -26,6 +26,11 @@ struct IDEBus {
     PortioList portio_list;
     PortioList portio2_list;
     VMChangeStateEntry *vmstate;
+    /*
+     * Taken by completion callbacks, for HBAs that process commands outside
+     * the BQL; NULL otherwise.
+     */
+    QemuRecMutex *lock;
 };
 
 #define TYPE_IDE_BUS "IDE"
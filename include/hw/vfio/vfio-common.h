@@ -24,6 +24,7 @@
 #include "exec/memory.h"
 #include "qemu/queue.h"
 #include "qemu/notify.h"
+#include "qemu/thread.h"
 #include "ui/console.h"
 #include "hw/display/ramfb.h"
 #ifdef CONFIG_LINUX
@@ -73,6 +74,17 @@ typedef struct VFIOMigration {
     uint64_t precopy_init_size;
     uint64_t precopy_dirty_size;
     bool initial_data_sent;
+
+    /* Device state is transferred through the multifd channels */
+    bool multifd_transfer;
+    /* Protects the load_bufs* fields below */
+    QemuMutex load_bufs_mutex;
+    QemuCond load_bufs_cond;
+    GArray *load_bufs;
+    uint32_t load_buf_idx;
+    uint32_t load_buf_idx_last;
+    /* The main migration stream is done with the pre-copy data */
+    bool load_bufs_ready;
 } VFIOMigration;
 
 struct VFIOGroup;
@@ -130,6 +142,7 @@ typedef struct VFIODevice {
     bool no_mmap;
     bool ram_block_discard_allowed;
     OnOffAuto enable_migration;
+    OnOffAuto migration_multifd_transfer;
     bool migration_events;
     VFIODeviceOps *ops;
     unsigned int num_irqs;
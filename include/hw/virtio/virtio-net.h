@@ -20,6 +20,8 @@
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "sysemu/iothread.h"
+#include "qapi/qapi-types-virtio.h"
 
 #include "ebpf/ebpf_rss.h"
 
@@ -56,6 +58,8 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    IOThread *iothread;
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -161,6 +165,10 @@ typedef struct VirtIONetQueue {
         VirtQueueElement *elem;
     } async_tx;
     struct VirtIONet *n;
+    /* IOThread for this queue pair, NULL if processed in the main loop */
+    AioContext *aio_context;
+    /* Moved back to the main loop on its own by a queue reset */
+    bool dataplane_reset;
 } VirtIONetQueue;
 
 struct VirtIONet {
@@ -191,6 +199,12 @@ struct VirtIONet {
     uint8_t nouni;
     uint8_t nobcast;
     uint8_t vhost_started;
+    /* Guest notifiers are set up for processing queues in IOThreads */
+    bool dataplane_started;
+    /* Queue pairs and their backends are currently handled in IOThreads */
+    bool dataplane_attached;
+    /* use_guest_notifier_mask before the dataplane started */
+    bool dataplane_notifier_mask;
     struct {
         uint32_t in_use;
         uint32_t first_multi;
@@ -167,6 +167,12 @@ struct VirtIODevice
      */
     EventNotifier config_notifier;
     bool device_iotlb_enabled;
+    /**
+     * @irq_mod_usecs, @irq_mod_frames: default interrupt moderation
+     * policy of the virtqueues, see virtio_queue_set_irq_moderation()
+     */
+    uint32_t irq_mod_usecs;
+    uint32_t irq_mod_frames;
 };
 
 struct VirtioDeviceClass {
@@ -284,6 +290,14 @@ int virtqueue_get_avail_bytes(VirtQueue *vq, unsigned int *in_bytes,
 
 void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq);
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq);
+/*
+ * Hold back the interrupts of @vq while they would be sent more often than
+ * once every @usecs microseconds, up to @frames notifications (0: no
+ * limit).  @usecs == 0 disables moderation.  Only applies to the
+ * notifications sent by QEMU, not by vhost backends.
+ */
+void virtio_queue_set_irq_moderation(VirtQueue *vq, uint32_t usecs,
+                                     uint32_t frames);
 
 int virtio_save(VirtIODevice *vdev, QEMUFile *f);
 
@@ -411,6 +425,8 @@ EventNotifier *virtio_queue_get_guest_notifier(VirtQueue *vq);
 void virtio_queue_set_guest_notifier_fd_handler(VirtQueue *vq, bool assign,
                                                 bool with_irqfd);
 int virtio_device_start_ioeventfd(VirtIODevice *vdev);
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev);
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev);
 int virtio_device_grab_ioeventfd(VirtIODevice *vdev);
 void virtio_device_release_ioeventfd(VirtIODevice *vdev);
 bool virtio_device_ioeventfd_enabled(VirtIODevice *vdev);
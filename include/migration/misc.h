@@ -111,4 +111,23 @@ bool migration_in_bg_snapshot(void);
 /* migration/block-dirty-bitmap.c */
 void dirty_bitmap_mig_init(void);
 
+/* migration/multifd-device-state.c */
+bool multifd_device_state_supported(void);
+bool multifd_queue_device_state(const char *idstr, uint32_t instance_id,
+                                char *data, size_t len);
+bool multifd_device_state_save_thread_should_exit(void);
+
+/* migration/savevm.c */
+/*
+ * A load thread runs on the destination outside the BQL until the device
+ * state has been loaded.  The incoming migration waits for all of them
+ * before it completes.  @should_quit becomes true when the migration
+ * failed and the thread should return as soon as possible.
+ */
+typedef bool (*MigrationLoadThread)(void *opaque, bool *should_quit,
+                                    Error **errp);
+void qemu_loadvm_start_load_thread(const char *name,
+                                   MigrationLoadThread function,
+                                   void *opaque);
+
 #endif
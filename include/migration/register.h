@@ -16,6 +16,15 @@
 
 #include "hw/vmstate-if.h"
 
+typedef struct SaveLiveCompletePrecopyThreadData {
+    char *idstr;
+    uint32_t instance_id;
+    void *handler_opaque;
+} SaveLiveCompletePrecopyThreadData;
+
+typedef bool (*SaveLiveCompletePrecopyThreadHandler)(
+    SaveLiveCompletePrecopyThreadData *d, Error **errp);
+
 /**
  * struct SaveVMHandlers: handler structure to finely control
  * migration of complex subsystems and devices, such as RAM, block and
@@ -103,6 +112,26 @@ typedef struct SaveVMHandlers {
      */
     int (*save_live_complete_precopy)(QEMUFile *f, void *opaque);
 
+    /* This runs outside the BQL. */
+
+    /**
+     * @save_live_complete_precopy_thread
+     *
+     * Called at the end of a precopy phase from its own thread, when
+     * multifd device state transfer is supported, in parallel with the
+     * @save_live_complete_precopy handlers and with the threads of other
+     * devices.  Sends the remaining device state through multifd
+     * channels with multifd_queue_device_state().  Should return as soon
+     * as possible when multifd_device_state_save_thread_should_exit()
+     * becomes true.
+     *
+     * @d: the idstr, instance_id and opaque of the device
+     * @errp: pointer to Error*, to store an error if it happens.
+     *
+     * Returns true to indicate success and false for errors
+     */
+    SaveLiveCompletePrecopyThreadHandler save_live_complete_precopy_thread;
+
     /* This runs both outside and inside the BQL.  */
 
     /**
@@ -227,6 +256,23 @@ typedef struct SaveVMHandlers {
      */
     int (*load_state)(QEMUFile *f, void *opaque, int version_id);
 
+    /**
+     * @load_state_buffer (invoked outside the BQL)
+     *
+     * Load device state buffer provided to qemu_loadvm_load_state_buffer()
+     * by a multifd receive thread.  May be called from several threads at
+     * once and in any order with respect to the main migration stream.
+     *
+     * @opaque: data pointer passed to register_savevm_live()
+     * @buf: the data buffer to load
+     * @len: the data length in buffer
+     * @errp: pointer to Error*, to store an error if it happens.
+     *
+     * Returns true to indicate success and false for errors
+     */
+    bool (*load_state_buffer)(void *opaque, char *buf, size_t len,
+                              Error **errp);
+
     /**
      * @load_setup
      *
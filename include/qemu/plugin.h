@@ -70,6 +70,8 @@ enum plugin_dyn_cb_type {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_COND,
     PLUGIN_CB_MEM_REGULAR,
+    PLUGIN_CB_MEM_FILTERED,
+    PLUGIN_CB_RECORD,
     PLUGIN_CB_INLINE_ADD_U64,
     PLUGIN_CB_INLINE_STORE_U64,
 };
@@ -96,6 +98,28 @@ struct qemu_plugin_conditional_cb {
     uint64_t imm;
 };
 
+/* A memory callback made only for accesses selected by a filter */
+struct qemu_plugin_filtered_cb {
+    struct qemu_plugin_regular_cb regular;
+    /* for plugin_mem_filtered_cb(), which calls regular.f.vcpu_mem */
+    TCGHelperInfo *filter_info;
+    unsigned int size_mask;
+    uint64_t addr_min;
+    uint64_t addr_max;
+    uint64_t period;
+    qemu_plugin_u64 counter;
+};
+
+/* Append a record to a ring, see struct qemu_plugin_ring */
+struct qemu_plugin_record_cb {
+    struct qemu_plugin_ring *ring;
+    TCGHelperInfo *info;
+    uint64_t pc;
+    uint32_t size;
+    uint32_t flags;
+    enum qemu_plugin_mem_rw rw;
+};
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -107,6 +131,8 @@ struct qemu_plugin_dyn_cb {
         struct qemu_plugin_regular_cb regular;
         struct qemu_plugin_conditional_cb cond;
         struct qemu_plugin_inline_cb inline_insn;
+        struct qemu_plugin_filtered_cb filtered;
+        struct qemu_plugin_record_cb record;
     };
 };
 
@@ -128,6 +154,38 @@ struct qemu_plugin_scoreboard {
     QLIST_ENTRY(qemu_plugin_scoreboard) entry;
 };
 
+/*
+ * A ring has a single-producer single-consumer circular buffer of records
+ * for each vcpu.  In QEMU_PLUGIN_RING_DROP mode the vcpu appends to it
+ * from the generated code, and writes records that do not fit to a spare
+ * slot past the end of @records.  In QEMU_PLUGIN_RING_BLOCK mode it calls
+ * plugin_ring_append_full().  The per-vcpu state lives in a scoreboard so
+ * that it follows new vcpus.
+ */
+struct qemu_plugin_ring_vcpu {
+    uint32_t head;      /* next record to write, only written by the vcpu */
+    uint32_t tail;      /* next record to read, only written by the reader */
+    uint64_t lost;
+    qemu_plugin_record *records;
+};
+
+struct qemu_plugin_ring {
+    struct qemu_plugin_scoreboard *vcpus;
+    uint32_t mask;
+    enum qemu_plugin_ring_mode mode;
+    /* Wakes up vcpus waiting for room, in QEMU_PLUGIN_RING_BLOCK mode */
+    QemuMutex lock;
+    QemuCond room;
+    unsigned int waiters;
+    QLIST_ENTRY(qemu_plugin_ring) entry;
+};
+
+void plugin_ring_append_full(uint32_t cpu_index, void *ring, uint64_t pc,
+                             uint64_t vaddr, uint64_t size_flags);
+void plugin_mem_filtered_cb(uint32_t cpu_index, uint32_t meminfo,
+                            uint64_t vaddr, void *userp, void *cb,
+                            uint32_t match);
+
 /* Internal context for this TranslationBlock */
 struct qemu_plugin_tb {
     GPtrArray *insns;
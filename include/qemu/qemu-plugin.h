@@ -65,11 +65,15 @@ typedef uint64_t qemu_plugin_id_t;
  *
  * version 4:
  * - added qemu_plugin_read_memory_vaddr
+ *
+ * version 5:
+ * - added qemu_plugin_register_vcpu_mem_filtered_cb
+ * - added trace record rings: qemu_plugin_ring_new and friends
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 4
+#define QEMU_PLUGIN_VERSION 5
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -682,6 +686,58 @@ void qemu_plugin_register_vcpu_mem_cb(struct qemu_plugin_insn *insn,
                                       enum qemu_plugin_mem_rw rw,
                                       void *userdata);
 
+/**
+ * struct qemu_plugin_mem_filter - select memory accesses to call back on
+ * @rw: select reads, writes or both
+ * @addr_min: lowest virtual address to select
+ * @addr_max: highest virtual address to select; 0 means no upper limit
+ * @size_mask: access sizes to select, bit N selecting accesses of 1 << N
+ *             bytes; 0 selects all sizes
+ * @period: select only one in @period of the accesses that pass the
+ *          other checks; 0 and 1 select all of them
+ * @counter: per-vcpu counter used to track @period, unused otherwise
+ *
+ * An access is selected if it matches @rw and @size_mask and if its
+ * virtual address is within [@addr_min, @addr_max]. The counter is
+ * incremented for each such access and the access is selected when it
+ * reaches @period, which resets it to zero. Sharing a counter between
+ * several instructions samples their accesses as a whole.
+ */
+struct qemu_plugin_mem_filter {
+    enum qemu_plugin_mem_rw rw;
+    uint64_t addr_min;
+    uint64_t addr_max;
+    unsigned int size_mask;
+    uint64_t period;
+    qemu_plugin_u64 counter;
+};
+
+/**
+ * qemu_plugin_register_vcpu_mem_filtered_cb() - register filtered memory
+ * access callback
+ * @insn: handle for instruction to instrument
+ * @cb: callback of type qemu_plugin_vcpu_mem_cb_t
+ * @flags: (currently unused) callback flags
+ * @filter: which accesses to call back on
+ * @userdata: opaque pointer for userdata
+ *
+ * This is like qemu_plugin_register_vcpu_mem_cb(), but the callback is
+ * only made for the accesses selected by @filter. The kind and size of
+ * the access are checked at translation time, so accesses that are
+ * filtered out on those cost nothing. The address range and sampling
+ * period are computed at run time by the generated code. Accesses that
+ * they filter out still make a helper call into QEMU, which returns
+ * without calling into the plugin. The contents of @filter are copied
+ * and it does not need to outlive the call.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_filtered_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_mem_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    const struct qemu_plugin_mem_filter *filter,
+    void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - inline op for mem access
  * @insn: handle for instruction to instrument
@@ -1001,4 +1057,150 @@ void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
 QEMU_PLUGIN_API
 uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
 
+/**
+ * typedef qemu_plugin_record - compact trace record
+ * @pc: virtual address of the instruction or TB
+ * @vaddr: virtual address of the memory access, or @pc for execution
+ * @size: size in bytes of the TB, instruction or memory access
+ * @flags: kind of the record, ORed with the flags given at registration
+ */
+typedef struct {
+    uint64_t pc;
+    uint64_t vaddr;
+    uint32_t size;
+    uint32_t flags;
+} qemu_plugin_record;
+
+/**
+ * enum qemu_plugin_record_flags - kind of a trace record
+ *
+ * @QEMU_PLUGIN_RECORD_TB: execution of a TB
+ * @QEMU_PLUGIN_RECORD_INSN: execution of an instruction
+ * @QEMU_PLUGIN_RECORD_MEM_R: memory read
+ * @QEMU_PLUGIN_RECORD_MEM_W: memory write
+ *
+ * Bits from QEMU_PLUGIN_RECORD_USER_SHIFT up are never set by QEMU and
+ * can be used by the plugin to tag the records of a registration.
+ */
+enum qemu_plugin_record_flags {
+    QEMU_PLUGIN_RECORD_TB    = 1 << 0,
+    QEMU_PLUGIN_RECORD_INSN  = 1 << 1,
+    QEMU_PLUGIN_RECORD_MEM_R = 1 << 2,
+    QEMU_PLUGIN_RECORD_MEM_W = 1 << 3,
+};
+
+#define QEMU_PLUGIN_RECORD_USER_SHIFT 16
+
+/**
+ * enum qemu_plugin_ring_mode - what to do when a ring is full
+ *
+ * @QEMU_PLUGIN_RING_DROP: drop the record and count it as lost
+ * @QEMU_PLUGIN_RING_BLOCK: stop the vcpu until the ring is read
+ */
+enum qemu_plugin_ring_mode {
+    QEMU_PLUGIN_RING_DROP,
+    QEMU_PLUGIN_RING_BLOCK,
+};
+
+/**
+ * qemu_plugin_ring_new() - alloc a new trace record ring
+ * @n_records: number of records per vcpu, a power of 2 up to 1 << 24
+ * @mode: what to do when the ring of a vcpu is full
+ *
+ * A ring holds a circular buffer of records for each vcpu. The records
+ * registered with the qemu_plugin_register_*_record() functions are
+ * appended without calling into the plugin, and can be read in bulk with
+ * qemu_plugin_ring_read() from any thread. In QEMU_PLUGIN_RING_DROP mode
+ * they are appended by the generated code itself.
+ *
+ * In QEMU_PLUGIN_RING_BLOCK mode, the plugin must keep reading the ring
+ * until the end of execution or no vcpu will make progress.
+ *
+ * Returns a pointer to the new ring. It must be freed using
+ * qemu_plugin_ring_free, once no translated code can record into it.
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_ring *qemu_plugin_ring_new(size_t n_records,
+                                              enum qemu_plugin_ring_mode mode);
+
+/**
+ * qemu_plugin_ring_free() - free a trace record ring
+ * @ring: ring to free
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_ring_free(struct qemu_plugin_ring *ring);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_record() - record TB executions
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @ring: ring to record into
+ * @flags: flags to add to the records, from QEMU_PLUGIN_RECORD_USER_SHIFT
+ *
+ * Append a QEMU_PLUGIN_RECORD_TB record to the ring of the executing vcpu
+ * each time @tb is executed.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_tb_exec_record(struct qemu_plugin_tb *tb,
+                                              struct qemu_plugin_ring *ring,
+                                              uint32_t flags);
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_record() - record insn executions
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @ring: ring to record into
+ * @flags: flags to add to the records, from QEMU_PLUGIN_RECORD_USER_SHIFT
+ *
+ * Append a QEMU_PLUGIN_RECORD_INSN record to the ring of the executing
+ * vcpu each time @insn is executed.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_insn_exec_record(struct qemu_plugin_insn *insn,
+                                                struct qemu_plugin_ring *ring,
+                                                uint32_t flags);
+
+/**
+ * qemu_plugin_register_vcpu_mem_record() - record memory accesses
+ * @insn: handle for instruction to instrument
+ * @ring: ring to record into
+ * @rw: record reads, writes or both
+ * @flags: flags to add to the records, from QEMU_PLUGIN_RECORD_USER_SHIFT
+ *
+ * Append a QEMU_PLUGIN_RECORD_MEM_R or QEMU_PLUGIN_RECORD_MEM_W record to
+ * the ring of the executing vcpu for every memory access of @insn.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_record(struct qemu_plugin_insn *insn,
+                                          struct qemu_plugin_ring *ring,
+                                          enum qemu_plugin_mem_rw rw,
+                                          uint32_t flags);
+
+/**
+ * qemu_plugin_ring_read() - read records from the ring of a vcpu
+ * @ring: ring to read
+ * @vcpu_index: vcpu whose records to read
+ * @records: buffer for the records
+ * @n: size of @records, in records
+ *
+ * Records of a vcpu are read in the order they were appended. Only one
+ * thread at a time should read the ring of a given vcpu.
+ *
+ * Returns the number of records copied to @records, 0 if there are none.
+ */
+QEMU_PLUGIN_API
+size_t qemu_plugin_ring_read(struct qemu_plugin_ring *ring,
+                             unsigned int vcpu_index,
+                             qemu_plugin_record *records, size_t n);
+
+/**
+ * qemu_plugin_ring_lost() - count records dropped from the ring of a vcpu
+ * @ring: ring to query
+ * @vcpu_index: vcpu to query
+ *
+ * Returns the number of records dropped because the ring was full, which
+ * is always 0 in QEMU_PLUGIN_RING_BLOCK mode.
+ */
+QEMU_PLUGIN_API
+uint64_t qemu_plugin_ring_lost(struct qemu_plugin_ring *ring,
+                               unsigned int vcpu_index);
+
 #endif /* QEMU_QEMU_PLUGIN_H */
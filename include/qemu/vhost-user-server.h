@@ -16,14 +16,16 @@
 #include "io/channel-file.h"
 #include "io/net-listener.h"
 #include "qapi/error.h"
+#include "qemu/thread.h"
 #include "standard-headers/linux/virtio_blk.h"
 
 /* A kick fd that we monitor on behalf of libvhost-user */
 typedef struct VuFdWatch {
     VuDev *vu_dev;
     int fd; /*kick fd*/
-    void *pvt;
+    void *pvt; /* virtqueue index */
     vu_watch_cb cb;
+    bool removed; /* protected by the virtqueue lock */
     QTAILQ_ENTRY(VuFdWatch) next;
 } VuFdWatch;
 
@@ -31,7 +33,9 @@ typedef struct VuFdWatch {
  * VuServer:
  * A vhost-user server instance with user-defined VuDevIface callbacks.
  * Vhost-user device backends can be implemented using VuServer. VuDevIface
- * callbacks and virtqueue kicks run in the given AioContext.
+ * callbacks and virtqueue kicks run in the given AioContext, unless the
+ * virtqueue was assigned its own AioContext with
+ * vhost_user_server_set_vq_aio_contexts().
  */
 typedef struct {
     QIONetListener *listener;
@@ -41,10 +45,19 @@ typedef struct {
     const VuDevIface *vu_iface;
 
     unsigned int in_flight; /* atomic */
+    bool wait_idle; /* atomic */
+
+    /*
+     * Per-virtqueue AioContexts, NULL if all virtqueues are processed in
+     * ctx.  vq_locks[i] is held while virtqueue i is processed in
+     * vq_ctx[i], and all of them while a vhost-user message is processed.
+     */
+    AioContext **vq_ctx;
+    QemuRecMutex *vq_locks;
+    bool vq_locks_held;
 
     /* Protected by ctx lock */
     bool in_qio_channel_yield;
-    bool wait_idle;
     bool quiescing;
     VuDev vu_dev;
     QIOChannel *ioc; /* The I/O channel with the client */
@@ -63,6 +76,12 @@ bool vhost_user_server_start(VuServer *server,
 
 void vhost_user_server_stop(VuServer *server);
 
+void vhost_user_server_set_vq_aio_contexts(VuServer *server,
+                                           AioContext **vq_ctx);
+void vhost_user_server_free_vq_aio_contexts(VuServer *server);
+void vhost_user_server_lock_vq(VuServer *server, int idx);
+void vhost_user_server_unlock_vq(VuServer *server, int idx);
+
 void vhost_user_server_inc_in_flight(VuServer *server);
 void vhost_user_server_dec_in_flight(VuServer *server);
 bool vhost_user_server_has_in_flight(VuServer *server);
@@ -33,6 +33,7 @@ TCGv_ptr tcg_global_mem_new_ptr(TCGv_ptr reg, intptr_t off, const char *name);
 void gen_set_label(TCGLabel *l);
 void tcg_gen_br(TCGLabel *l);
 void tcg_gen_mb(TCGBar);
+void tcg_gen_host_mb(TCGBar);
 
 /**
  * tcg_gen_exit_tb() - output exit_tb TCG operation
@@ -74,6 +75,23 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_lookup_and_goto_ptr_cached() - jump to a cached TB, or look it up
+ * @pc: Guest address of the target TB, in a temp that survives branches
+ *
+ * Compare @pc against the targets cached in the jump slots that this TB
+ * has not used for tcg_gen_goto_tb(), and chain directly to the matching
+ * TB.  Otherwise, behave like tcg_gen_lookup_and_goto_ptr().  Each slot
+ * caches the first target that the main loop links it to.
+ *
+ * The translator must only use this when all of the CPU state that is
+ * used to look up the next TB, other than @pc, is the same every time
+ * the jump is executed, e.g. for indirect branches that do not change
+ * the processor mode.  Since it takes all the free slots, it must be the
+ * last exit of the TB: tcg_gen_goto_tb() may not be called afterwards.
+ */
+void tcg_gen_lookup_and_goto_ptr_cached(TCGv_i64 pc);
+
 void tcg_gen_plugin_cb(unsigned from);
 void tcg_gen_plugin_mem_cb(TCGv_i64 addr, unsigned meminfo);
 
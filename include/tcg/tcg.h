@@ -221,6 +221,12 @@ struct TCGLabel {
     QSIMPLEQ_HEAD(, TCGLabelUse) branches;
     QSIMPLEQ_HEAD(, TCGRelocation) relocs;
     QSIMPLEQ_ENTRY(TCGLabel) next;
+    /*
+     * Register contents at the only branch to this label, for
+     * restoring at the label when it cannot be reached by falling
+     * through; NULL when not recorded.
+     */
+    struct TCGTemp **reg_to_temp;
 };
 
 typedef struct TCGPool {
@@ -476,8 +482,9 @@ struct TCGContext {
     tcg_insn_unit *code_buf;      /* pointer for start of tb */
     tcg_insn_unit *code_ptr;      /* pointer for running end of tb */
 
-#ifdef CONFIG_DEBUG_TCG
     int goto_tb_issue_mask;
+    int goto_tb_ind_mask;         /* slots used by lookup_and_goto_ptr_cached */
+#ifdef CONFIG_DEBUG_TCG
     const TCGOpcode *vecop_list;
 #endif
 
@@ -544,6 +551,10 @@ struct TCGContext {
        It does not take into account fixed registers */
     TCGTemp *reg_to_temp[TCG_TARGET_NB_REGS];
 
+    /* Register allocator statistics for the current TB. */
+    unsigned nb_spills;
+    unsigned nb_fills;
+
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     uint64_t *gen_insn_data;
 
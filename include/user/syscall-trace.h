@@ -39,5 +39,21 @@ static inline void record_syscall_return(CPUState *cpu, int num, abi_long ret)
     gdb_syscall_return(cpu, num);
 }
 
+/*
+ * Return true if the hooks above have anything to do for syscall @num,
+ * so that a caller can skip them only when it returns false.
+ */
+static inline bool syscall_is_traced(CPUState *cpu, int num)
+{
+#ifdef CONFIG_PLUGIN
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_SYSCALL, cpu->plugin_state->event_mask) ||
+        test_bit(QEMU_PLUGIN_EV_VCPU_SYSCALL_RET,
+                 cpu->plugin_state->event_mask)) {
+        return true;
+    }
+#endif
+    return gdb_should_catch_syscall(num);
+}
+
 
 #endif /* SYSCALL_TRACE_H */
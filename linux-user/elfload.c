@@ -3212,6 +3212,7 @@ static void load_elf_image(const char *image_name, const ImageSource *src,
     info->nsegs = 0;
     info->pt_dynamic_addr = 0;
 
+    mmap_lock_range(0, -1);
     mmap_lock();
 
     /*
@@ -3463,6 +3464,7 @@ static void load_elf_image(const char *image_name, const ImageSource *src,
     debuginfo_report_elf(image_name, src->fd, load_bias);
 
     mmap_unlock();
+    mmap_unlock_range();
 
     close(src->fd);
     return;
@@ -487,9 +487,11 @@ int load_flt_binary(struct linux_binprm *bprm, struct image_info *info)
     stack_len += (bprm->envc + 1) * 4; /* the envp array */
 
 
+    mmap_lock_range(0, -1);
     mmap_lock();
     res = load_flat_file(bprm, libinfo, 0, &stack_len);
     mmap_unlock();
+    mmap_unlock_range();
 
     if (is_error(res)) {
             return res;
@@ -26,6 +26,7 @@
 #include "user-mmap.h"
 #include "target_mman.h"
 #include "qemu/interval-tree.h"
+#include "qemu/queue.h"
 
 #ifdef TARGET_ARM
 #include "target/arm/cpu-features.h"
@@ -54,11 +55,95 @@ bool have_mmap_lock(void)
     return mmap_lock_count > 0 ? true : false;
 }
 
+/*
+ * Guest address ranges whose mappings are being changed.  A thread
+ * holding a range may drop mmap_lock while it performs the host
+ * syscalls, so that changes to disjoint ranges proceed concurrently.
+ */
+typedef struct MmapRange {
+    abi_ulong start;
+    abi_ulong last;
+    QLIST_ENTRY(MmapRange) next;
+} MmapRange;
+
+static pthread_mutex_t mmap_range_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mmap_range_cond = PTHREAD_COND_INITIALIZER;
+static QLIST_HEAD(, MmapRange) mmap_ranges =
+    QLIST_HEAD_INITIALIZER(mmap_ranges);
+static __thread MmapRange mmap_thread_range;
+static __thread int mmap_range_count;
+
+static bool mmap_range_busy(abi_ulong start, abi_ulong last)
+{
+    MmapRange *r;
+
+    QLIST_FOREACH(r, &mmap_ranges, next) {
+        if (r->start <= last && start <= r->last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void mmap_lock_range(abi_ulong start, abi_ulong last)
+{
+    MmapRange *r = &mmap_thread_range;
+
+    if (mmap_range_count++) {
+        /* Nested users must stay within the range locked by the caller. */
+        assert(r->start <= start && last <= r->last);
+        return;
+    }
+
+    /* Ranges are always locked before mmap_lock, to avoid deadlocks. */
+    assert(!have_mmap_lock());
+
+    pthread_mutex_lock(&mmap_range_mutex);
+    while (mmap_range_busy(start, last)) {
+        pthread_cond_wait(&mmap_range_cond, &mmap_range_mutex);
+    }
+    r->start = start;
+    r->last = last;
+    QLIST_INSERT_HEAD(&mmap_ranges, r, next);
+    pthread_mutex_unlock(&mmap_range_mutex);
+}
+
+void mmap_unlock_range(void)
+{
+    assert(mmap_range_count > 0);
+    if (--mmap_range_count) {
+        return;
+    }
+
+    pthread_mutex_lock(&mmap_range_mutex);
+    QLIST_REMOVE(&mmap_thread_range, next);
+    pthread_cond_broadcast(&mmap_range_cond);
+    pthread_mutex_unlock(&mmap_range_mutex);
+}
+
+static inline void mmap_unlock_range_guard(void *unused)
+{
+    mmap_unlock_range();
+}
+
+#define WITH_MMAP_RANGE_GUARD(start, last)                          \
+    for (int _mmap_range_iter                                       \
+             __attribute__((cleanup(mmap_unlock_range_guard)))      \
+             = (mmap_lock_range(start, last), 0);                   \
+         _mmap_range_iter == 0; _mmap_range_iter = 1)
+
 /* Grab lock to make sure things are in a consistent state after fork().  */
 void mmap_fork_start(void)
 {
-    if (mmap_lock_count)
+    if (mmap_lock_count || mmap_range_count) {
         abort();
+    }
+
+    /* Wait for all in-flight range operations; new ones block on the mutex. */
+    pthread_mutex_lock(&mmap_range_mutex);
+    while (!QLIST_EMPTY(&mmap_ranges)) {
+        pthread_cond_wait(&mmap_range_cond, &mmap_range_mutex);
+    }
     pthread_mutex_lock(&mmap_mutex);
 }
 
@@ -66,8 +151,12 @@ void mmap_fork_end(int child)
 {
     if (child) {
         pthread_mutex_init(&mmap_mutex, NULL);
+        pthread_mutex_init(&mmap_range_mutex, NULL);
+        pthread_cond_init(&mmap_range_cond, NULL);
+        QLIST_INIT(&mmap_ranges);
     } else {
         pthread_mutex_unlock(&mmap_mutex);
+        pthread_mutex_unlock(&mmap_range_mutex);
     }
 }
 
@@ -195,6 +284,38 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
     host_last = ROUND_UP(last, host_page_size) - 1;
     nranges = 0;
 
+    mmap_lock_range(host_start, host_last);
+
+    /*
+     * If neither the old nor the new protection allows execution, no
+     * translated code can depend on these pages and page_unprotect()
+     * will not touch them.  With one guest page per host page nothing
+     * else needs to be merged, so the host protection can be changed
+     * without holding mmap_lock; the range lock keeps out any other
+     * change to the same pages.
+     *
+     * The page flags are only updated after the host call, so this is
+     * limited to adding permissions: until then, the page flags allow no
+     * more than the host does, and a fault in the meantime is reported
+     * to the guest as it would have been before the call.
+     */
+    if (host_page_size <= TARGET_PAGE_SIZE && !(page_flags & PAGE_EXEC)) {
+        int old_flags = page_get_flags_range(start, last);
+
+        if (old_flags != -1 && !(old_flags & PAGE_EXEC) &&
+            !(old_flags & ~page_flags & (PAGE_READ | PAGE_WRITE))) {
+            ret = mprotect(g2h_untagged(start), len,
+                           target_to_host_prot(target_prot));
+            if (ret == 0) {
+                WITH_MMAP_LOCK_GUARD() {
+                    page_set_flags(start, last, page_flags);
+                }
+            }
+            mmap_unlock_range();
+            return ret;
+        }
+    }
+
     mmap_lock();
 
     if (host_last - host_start < host_page_size) {
@@ -265,6 +386,7 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
 
  error:
     mmap_unlock();
+    mmap_unlock_range();
     return ret;
 }
 
@@ -951,6 +1073,8 @@ static abi_long target_mmap__locked(abi_ulong start, abi_ulong len,
 abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
                      int flags, int fd, off_t offset)
 {
+    int host_page_size = qemu_real_host_page_size();
+    bool fixed = flags & (MAP_FIXED | MAP_FIXED_NOREPLACE);
     abi_long ret;
     int page_flags;
 
@@ -978,7 +1102,7 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
         errno = EINVAL;
         return -1;
     }
-    if (flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) {
+    if (fixed) {
         if (start & ~TARGET_PAGE_MASK) {
             errno = EINVAL;
             return -1;
@@ -987,6 +1111,13 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
             errno = ENOMEM;
             return -1;
         }
+
+        /*
+         * Other mappings are placed in unmapped space, which nobody
+         * else can be changing the protection of.
+         */
+        mmap_lock_range(start & -host_page_size,
+                        ROUND_UP(start + len - 1, host_page_size) - 1);
     }
 
     mmap_lock();
@@ -995,6 +1126,9 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
                               page_flags, fd, offset);
 
     mmap_unlock();
+    if (fixed) {
+        mmap_unlock_range();
+    }
 
     /*
      * If we're mapping shared memory, ensure we generate code for parallel
@@ -1073,6 +1207,7 @@ static int mmap_reserve_or_unmap(abi_ulong start, abi_ulong len)
 
 int target_munmap(abi_ulong start, abi_ulong len)
 {
+    int host_page_size = qemu_real_host_page_size();
     int ret;
 
     trace_target_munmap(start, len);
@@ -1087,6 +1222,8 @@ int target_munmap(abi_ulong start, abi_ulong len)
         return -1;
     }
 
+    mmap_lock_range(start & -host_page_size,
+                    ROUND_UP(start + len - 1, host_page_size) - 1);
     mmap_lock();
     ret = mmap_reserve_or_unmap(start, len);
     if (likely(ret == 0)) {
@@ -1094,6 +1231,7 @@ int target_munmap(abi_ulong start, abi_ulong len)
         shm_region_rm_complete(start, start + len - 1);
     }
     mmap_unlock();
+    mmap_unlock_range();
 
     return ret;
 }
@@ -1102,6 +1240,7 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
                        abi_ulong new_size, unsigned long flags,
                        abi_ulong new_addr)
 {
+    abi_ulong range_start, range_last;
     int prot;
     void *host_addr;
 
@@ -1114,6 +1253,17 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
         return -1;
     }
 
+    /*
+     * Lock both the old and the new location.  A single covering range
+     * is coarser than needed, but mremap is rare enough not to matter.
+     */
+    range_start = old_addr;
+    range_last = old_addr + MAX(old_size, new_size) - 1;
+    if (flags & MREMAP_FIXED) {
+        range_start = MIN(range_start, new_addr);
+        range_last = MAX(range_last, new_addr + new_size - 1);
+    }
+    mmap_lock_range(range_start, range_last);
     mmap_lock();
 
     if (flags & MREMAP_FIXED) {
@@ -1188,6 +1338,7 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
         shm_region_rm_complete(new_addr, new_addr + new_size - 1);
     }
     mmap_unlock();
+    mmap_unlock_range();
     return new_addr;
 }
 
@@ -1240,8 +1391,11 @@ abi_long target_madvise(abi_ulong start, abi_ulong len_in, int advice)
      * success, which is broken but some userspace programs fail to work
      * otherwise. Completely implementing such emulation is quite complicated
      * though.
+     *
+     * The range lock keeps the mappings stable, so the host syscall does
+     * not need mmap_lock.
      */
-    mmap_lock();
+    mmap_lock_range(start, start + len - 1);
     switch (advice) {
     case MADV_WIPEONFORK:
     case MADV_KEEPONFORK:
@@ -1251,11 +1405,13 @@ abi_long target_madvise(abi_ulong start, abi_ulong len_in, int advice)
         if (page_check_range(start, len, PAGE_PASSTHROUGH)) {
             ret = get_errno(madvise(g2h_untagged(start), len, advice));
             if ((advice == MADV_DONTNEED) && (ret == 0)) {
-                page_reset_target_data(start, start + len - 1);
+                WITH_MMAP_LOCK_GUARD() {
+                    page_reset_target_data(start, start + len - 1);
+                }
             }
         }
     }
-    mmap_unlock();
+    mmap_unlock_range();
 
     return ret;
 }
@@ -1359,6 +1515,11 @@ abi_ulong target_shmat(CPUArchState *cpu_env, int shmid,
         return -TARGET_EINVAL;
     }
 
+    /*
+     * Without an address the placement is only known under mmap_lock,
+     * so lock the whole address space; shmat is rare enough.
+     */
+    WITH_MMAP_RANGE_GUARD(shmaddr, shmaddr ? shmaddr + m_len - 1 : -1)
     WITH_MMAP_LOCK_GUARD() {
         bool mapped = false;
         void *want, *test;
@@ -1466,6 +1627,8 @@ abi_long target_shmdt(abi_ulong shmaddr)
 
     /* shmdt pointers are always untagged */
 
+    /* The size of the segment is only known once we hold mmap_lock. */
+    WITH_MMAP_RANGE_GUARD(shmaddr, -1)
     WITH_MMAP_LOCK_GUARD() {
         abi_ulong last = shm_region_find(shmaddr);
         if (last == 0) {
@@ -13881,3 +13881,34 @@ abi_long do_syscall(CPUArchState *cpu_env, int num, abi_long arg1,
     record_syscall_return(cpu, num, ret);
     return ret;
 }
+
+/*
+ * Issue the system calls listed in passthrough.list directly on the
+ * host.  This may be called from within translated code, so that these
+ * calls need not leave the CPU loop; return false if @num must go
+ * through do_syscall() instead, including when it is being traced.
+ */
+bool do_syscall_passthrough(CPUArchState *cpu_env, int num, abi_long arg1,
+                            abi_long arg2, abi_long *ret)
+{
+    long host_num;
+
+    switch (num) {
+#define PASSTHROUGH(name)                       \
+    case TARGET_NR_##name:                      \
+        host_num = __NR_##name;                 \
+        break;
+#include "passthrough.list"
+#undef PASSTHROUGH
+    default:
+        return false;
+    }
+
+    if (unlikely(qemu_loglevel_mask(LOG_STRACE) ||
+                 syscall_is_traced(env_cpu(cpu_env), num))) {
+        return false;
+    }
+
+    *ret = get_errno(syscall(host_num, (long)arg1, (long)arg2));
+    return true;
+}
@@ -55,6 +55,17 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
                        abi_ulong new_addr);
 abi_long target_madvise(abi_ulong start, abi_ulong len_in, int advice);
 abi_ulong mmap_find_vma(abi_ulong, abi_ulong, abi_ulong);
+
+/*
+ * mmap_lock_range: Lock the guest addresses [start, last] against
+ * concurrent mapping changes.  Changes to disjoint ranges may run in
+ * parallel; page flags are still updated under mmap_lock, which must
+ * be taken after the range.  Calls may nest as long as the inner range
+ * is contained in the outer one; mmap_lock_range(0, -1) locks the whole
+ * guest address space.
+ */
+void mmap_lock_range(abi_ulong start, abi_ulong last);
+void mmap_unlock_range(void);
 void mmap_fork_start(void);
 void mmap_fork_end(int child);
 
@@ -0,0 +1,260 @@
+/*
+ * Multifd device state migration
+ *
+ * Copyright (C) 2024 Red Hat, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/lockable.h"
+#include "qemu/thread.h"
+#include "migration/misc.h"
+#include "migration.h"
+#include "multifd.h"
+#include "options.h"
+#include "trace.h"
+
+typedef struct MultiFDDeviceStateSaveThread {
+    QemuThread thread;
+    SaveLiveCompletePrecopyThreadHandler hdlr;
+    SaveLiveCompletePrecopyThreadData data;
+} MultiFDDeviceStateSaveThread;
+
+typedef struct MultiFDSendDeviceState {
+    /* Serializes multifd_queue_device_state() callers */
+    QemuMutex queue_job_mutex;
+    MultiFDSendData *send_data;
+
+    /* Protects the fields below */
+    QemuMutex threads_mutex;
+    GList *threads;
+    Error *threads_error;
+    bool threads_abort; /* atomic */
+} MultiFDSendDeviceState;
+
+static MultiFDSendDeviceState *multifd_send_device_state;
+
+void multifd_device_state_send_setup(void)
+{
+    assert(!multifd_send_device_state);
+    multifd_send_device_state = g_new0(MultiFDSendDeviceState, 1);
+
+    qemu_mutex_init(&multifd_send_device_state->queue_job_mutex);
+    multifd_send_device_state->send_data = multifd_send_data_alloc();
+
+    qemu_mutex_init(&multifd_send_device_state->threads_mutex);
+}
+
+void multifd_device_state_send_cleanup(void)
+{
+    if (!multifd_send_device_state) {
+        return;
+    }
+
+    /* The migration thread must have joined the save threads already */
+    assert(!multifd_send_device_state->threads);
+
+    error_free(multifd_send_device_state->threads_error);
+    qemu_mutex_destroy(&multifd_send_device_state->threads_mutex);
+
+    g_clear_pointer(&multifd_send_device_state->send_data, g_free);
+    qemu_mutex_destroy(&multifd_send_device_state->queue_job_mutex);
+
+    g_clear_pointer(&multifd_send_device_state, g_free);
+}
+
+void multifd_device_state_clear(MultiFDDeviceState_t *device_state)
+{
+    g_clear_pointer(&device_state->idstr, g_free);
+    g_clear_pointer(&device_state->buf, g_free);
+    device_state->buf_len = 0;
+}
+
+static void multifd_device_state_iov(MultiFDSendParams *p)
+{
+    MultiFDDeviceState_t *device_state = &p->data->u.device_state;
+
+    assert(p->iovs_num == 0);
+
+    p->iov[0].iov_base = p->packet_device_state;
+    p->iov[0].iov_len = sizeof(*p->packet_device_state);
+
+    p->iov[1].iov_base = device_state->buf;
+    p->iov[1].iov_len = device_state->buf_len;
+
+    p->iovs_num = 2;
+}
+
+void multifd_device_state_send_prepare(MultiFDSendParams *p)
+{
+    MultiFDDeviceState_t *device_state = &p->data->u.device_state;
+
+    assert(p->data->type == MULTIFD_PAYLOAD_DEVICE_STATE);
+
+    multifd_device_state_iov(p);
+
+    p->next_packet_size = device_state->buf_len;
+    p->flags = MULTIFD_FLAG_DEVICE_STATE;
+
+    multifd_device_state_fill_packet(p);
+}
+
+/*
+ * Queue @len bytes of @data, which belong to the device state of
+ * @idstr / @instance_id, for transfer through one of the multifd channels.
+ * The data is copied.  Can be called from several threads at once.
+ *
+ * Returns true on success, false if the migration is failing.
+ */
+bool multifd_queue_device_state(const char *idstr, uint32_t instance_id,
+                                char *data, size_t len)
+{
+    MultiFDDeviceState_t *device_state;
+
+    QEMU_LOCK_GUARD(&multifd_send_device_state->queue_job_mutex);
+
+    assert(multifd_payload_empty(multifd_send_device_state->send_data));
+
+    multifd_set_payload_type(multifd_send_device_state->send_data,
+                             MULTIFD_PAYLOAD_DEVICE_STATE);
+    device_state = &multifd_send_device_state->send_data->u.device_state;
+    device_state->idstr = g_strdup(idstr);
+    device_state->instance_id = instance_id;
+    device_state->buf = g_memdup2(data, len);
+    device_state->buf_len = len;
+
+    if (!multifd_send(&multifd_send_device_state->send_data)) {
+        MultiFDSendData *send_data = multifd_send_device_state->send_data;
+
+        multifd_device_state_clear(&send_data->u.device_state);
+        multifd_set_payload_type(send_data, MULTIFD_PAYLOAD_NONE);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Whether device state can currently be transferred through the multifd
+ * channels.  The device state packets need the socket based, uncompressed
+ * multifd stream; their buffers are freed as soon as they are written, so
+ * zero-copy send cannot be used either.
+ */
+bool multifd_device_state_supported(void)
+{
+    return migrate_multifd() && !migrate_mapped_ram() &&
+        !migrate_zero_copy_send() &&
+        migrate_multifd_compression() == MULTIFD_COMPRESSION_NONE;
+}
+
+static void *multifd_device_state_save_thread(void *opaque)
+{
+    MultiFDDeviceStateSaveThread *t = opaque;
+    Error *local_err = NULL;
+
+    trace_multifd_device_state_save_thread_start(t->data.idstr,
+                                                 t->data.instance_id);
+
+    if (!t->hdlr(&t->data, &local_err)) {
+        assert(local_err);
+
+        WITH_QEMU_LOCK_GUARD(&multifd_send_device_state->threads_mutex) {
+            if (!multifd_send_device_state->threads_error) {
+                multifd_send_device_state->threads_error = local_err;
+                local_err = NULL;
+            }
+        }
+        error_free(local_err);
+
+        /* No point in the other threads going on */
+        multifd_abort_device_state_save_threads();
+    }
+
+    trace_multifd_device_state_save_thread_end(t->data.idstr,
+                                               t->data.instance_id);
+
+    return NULL;
+}
+
+/*
+ * Whether a device state save thread should stop early because the
+ * migration failed or was cancelled.  To be polled by the
+ * save_live_complete_precopy_thread handlers.
+ */
+bool multifd_device_state_save_thread_should_exit(void)
+{
+    return qatomic_read(&multifd_send_device_state->threads_abort);
+}
+
+/*
+ * Start a thread running @hdlr for the device @idstr / @instance_id.
+ * Takes ownership of @idstr.
+ */
+void multifd_spawn_device_state_save_thread(
+    SaveLiveCompletePrecopyThreadHandler hdlr,
+    char *idstr, uint32_t instance_id, void *opaque)
+{
+    MultiFDDeviceStateSaveThread *t = g_new0(MultiFDDeviceStateSaveThread, 1);
+
+    assert(multifd_device_state_supported());
+
+    t->hdlr = hdlr;
+    t->data.idstr = idstr;
+    t->data.instance_id = instance_id;
+    t->data.handler_opaque = opaque;
+
+    WITH_QEMU_LOCK_GUARD(&multifd_send_device_state->threads_mutex) {
+        multifd_send_device_state->threads =
+            g_list_append(multifd_send_device_state->threads, t);
+    }
+
+    qemu_thread_create(&t->thread, "mig/src/dev_state",
+                       multifd_device_state_save_thread, t,
+                       QEMU_THREAD_JOINABLE);
+}
+
+void multifd_abort_device_state_save_threads(void)
+{
+    qatomic_set(&multifd_send_device_state->threads_abort, true);
+}
+
+/*
+ * Wait for all the device state save threads to finish.
+ *
+ * Returns false and sets the migration error if any of them failed.
+ */
+bool multifd_join_device_state_save_threads(void)
+{
+    MigrationState *s = migrate_get_current();
+    GList *threads;
+    Error *err;
+
+    WITH_QEMU_LOCK_GUARD(&multifd_send_device_state->threads_mutex) {
+        threads = g_steal_pointer(&multifd_send_device_state->threads);
+    }
+
+    for (GList *l = threads; l; l = l->next) {
+        MultiFDDeviceStateSaveThread *t = l->data;
+
+        qemu_thread_join(&t->thread);
+        g_free(t->data.idstr);
+        g_free(t);
+    }
+    g_list_free(threads);
+
+    WITH_QEMU_LOCK_GUARD(&multifd_send_device_state->threads_mutex) {
+        err = g_steal_pointer(&multifd_send_device_state->threads_error);
+    }
+    qatomic_set(&multifd_send_device_state->threads_abort, false);
+
+    if (err) {
+        migrate_set_error(s, err);
+        error_free(err);
+        return false;
+    }
+
+    return true;
+}
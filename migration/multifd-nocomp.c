@@ -356,7 +356,7 @@ int multifd_ram_flush_and_sync(void)
         }
     }
 
-    return multifd_send_sync_main();
+    return multifd_send_sync_main(MULTIFD_SYNC_ALL);
 }
 
 bool multifd_send_prepare_common(MultiFDSendParams *p)
@@ -24,6 +24,7 @@
 #include "socket.h"
 #include "tls.h"
 #include "qemu-file.h"
+#include "savevm.h"
 #include "trace.h"
 #include "multifd.h"
 #include "threadinfo.h"
@@ -209,10 +210,10 @@ void multifd_send_fill_packet(MultiFDSendParams *p)
 
     memset(packet, 0, p->packet_len);
 
-    packet->magic = cpu_to_be32(MULTIFD_MAGIC);
-    packet->version = cpu_to_be32(MULTIFD_VERSION);
+    packet->hdr.magic = cpu_to_be32(MULTIFD_MAGIC);
+    packet->hdr.version = cpu_to_be32(MULTIFD_VERSION);
 
-    packet->flags = cpu_to_be32(p->flags);
+    packet->hdr.flags = cpu_to_be32(p->flags);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
 
     packet_num = qatomic_fetch_inc(&multifd_send_state->packet_num);
@@ -228,12 +229,34 @@ void multifd_send_fill_packet(MultiFDSendParams *p)
                             p->flags, p->next_packet_size);
 }
 
-static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
+void multifd_device_state_fill_packet(MultiFDSendParams *p)
 {
-    const MultiFDPacket_t *packet = p->packet;
-    uint32_t magic = be32_to_cpu(packet->magic);
-    uint32_t version = be32_to_cpu(packet->version);
-    int ret = 0;
+    MultiFDDeviceState_t *device_state = &p->data->u.device_state;
+    MultiFDPacketDeviceState_t *packet = p->packet_device_state;
+
+    memset(packet, 0, sizeof(*packet));
+
+    packet->hdr.magic = cpu_to_be32(MULTIFD_MAGIC);
+    packet->hdr.version = cpu_to_be32(MULTIFD_VERSION);
+    packet->hdr.flags = cpu_to_be32(p->flags);
+
+    pstrcpy(packet->idstr, sizeof(packet->idstr), device_state->idstr);
+    packet->instance_id = cpu_to_be32(device_state->instance_id);
+    packet->next_packet_size = cpu_to_be32(p->next_packet_size);
+
+    p->packets_sent++;
+
+    trace_multifd_send_fill_device_state(p->id, device_state->idstr,
+                                         device_state->instance_id,
+                                         p->next_packet_size);
+}
+
+static int multifd_recv_unfill_packet_header(MultiFDRecvParams *p,
+                                             const MultiFDPacketHdr_t *hdr,
+                                             Error **errp)
+{
+    uint32_t magic = be32_to_cpu(hdr->magic);
+    uint32_t version = be32_to_cpu(hdr->version);
 
     if (magic != MULTIFD_MAGIC) {
         error_setg(errp, "multifd: received packet magic %x, expected %x",
@@ -247,7 +270,31 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
-    p->flags = be32_to_cpu(packet->flags);
+    p->flags = be32_to_cpu(hdr->flags);
+
+    return 0;
+}
+
+static int multifd_recv_unfill_packet_device_state(MultiFDRecvParams *p,
+                                                   Error **errp)
+{
+    MultiFDPacketDeviceState_t *packet = p->packet_dev_state;
+
+    packet->instance_id = be32_to_cpu(packet->instance_id);
+    p->next_packet_size = be32_to_cpu(packet->next_packet_size);
+    p->packets_recved++;
+
+    trace_multifd_recv_unfill_device_state(p->id, packet->idstr,
+                                           packet->instance_id,
+                                           p->next_packet_size);
+    return 0;
+}
+
+static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
+{
+    const MultiFDPacket_t *packet = p->packet;
+    int ret = 0;
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
     p->packets_recved++;
@@ -296,6 +343,10 @@ static void multifd_send_kick_main(MultiFDSendParams *p)
  * Switching is safe because both the migration thread and the channel
  * thread have barriers in place to serialize access.
  *
+ * Several threads can call this function at the same time (the migration
+ * thread for RAM and the device state save threads); a channel is claimed
+ * by atomically setting its pending_job_preparing flag.
+ *
  * Returns true if succeed, false otherwise.
  */
 bool multifd_send(MultiFDSendData **send_data)
@@ -317,28 +368,32 @@ bool multifd_send(MultiFDSendData **send_data)
      * using more channels, so ensure it doesn't overflow if the
      * limit is lower now.
      */
-    next_channel %= migrate_multifd_channels();
-    for (i = next_channel;; i = (i + 1) % migrate_multifd_channels()) {
+    i = qatomic_read(&next_channel) % migrate_multifd_channels();
+    for (;; i = (i + 1) % migrate_multifd_channels()) {
         if (multifd_send_should_exit()) {
+            /* Pass the wakeup on to any other thread waiting to send */
+            qemu_sem_post(&multifd_send_state->channels_ready);
             return false;
         }
         p = &multifd_send_state->params[i];
         /*
-         * Lockless read to p->pending_job is safe, because only multifd
-         * sender thread can clear it.
+         * pending_job_preparing is only cleared by the multifd sender
+         * thread, after pending_job; whoever sets it owns the channel
+         * until it has posted the job.
          */
-        if (qatomic_read(&p->pending_job) == false) {
-            next_channel = (i + 1) % migrate_multifd_channels();
+        if (qatomic_cmpxchg(&p->pending_job_preparing, false, true) == false) {
+            qatomic_set(&next_channel, (i + 1) % migrate_multifd_channels());
             break;
         }
     }
 
     /*
-     * Make sure we read p->pending_job before all the rest.  Pairs with
-     * qatomic_store_release() in multifd_send_thread().
+     * Make sure we read p->pending_job_preparing before all the rest.
+     * Pairs with qatomic_store_release() in multifd_send_thread().
      */
     smp_mb_acquire();
 
+    assert(!qatomic_read(&p->pending_job));
     assert(multifd_payload_empty(p->data));
 
     /*
@@ -460,11 +515,16 @@ static bool multifd_send_cleanup_channel(MultiFDSendParams *p, Error **errp)
     qemu_sem_destroy(&p->sem_sync);
     g_free(p->name);
     p->name = NULL;
+    if (p->data && p->data->type == MULTIFD_PAYLOAD_DEVICE_STATE) {
+        multifd_device_state_clear(&p->data->u.device_state);
+    }
     g_free(p->data);
     p->data = NULL;
     p->packet_len = 0;
     g_free(p->packet);
     p->packet = NULL;
+    g_free(p->packet_device_state);
+    p->packet_device_state = NULL;
     multifd_send_state->ops->send_cleanup(p, errp);
     assert(!p->iov);
 
@@ -503,6 +563,7 @@ void multifd_send_shutdown(void)
         }
     }
 
+    multifd_device_state_send_cleanup();
     multifd_send_cleanup_state();
 }
 
@@ -523,11 +584,18 @@ static int multifd_zero_copy_flush(QIOChannel *c)
     return ret;
 }
 
-int multifd_send_sync_main(void)
+/*
+ * Wait until all the channels have sent the jobs queued to them so far.
+ * With MULTIFD_SYNC_ALL, each channel also sends a SYNC packet that the
+ * destination waits for in multifd_recv_sync_main().
+ */
+int multifd_send_sync_main(MultiFDSyncReq req)
 {
     int i;
     bool flush_zero_copy;
 
+    assert(req != MULTIFD_SYNC_NONE);
+
     flush_zero_copy = migrate_zero_copy_send();
 
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -543,8 +611,8 @@ int multifd_send_sync_main(void)
          * We should be the only user so far, so not possible to be set by
          * others concurrently.
          */
-        assert(qatomic_read(&p->pending_sync) == false);
-        qatomic_set(&p->pending_sync, true);
+        assert(qatomic_read(&p->pending_sync) == MULTIFD_SYNC_NONE);
+        qatomic_set(&p->pending_sync, req);
         qemu_sem_post(&p->sem);
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -600,15 +668,24 @@ static void *multifd_send_thread(void *opaque)
          * qatomic_store_release() in multifd_send().
          */
         if (qatomic_load_acquire(&p->pending_job)) {
+            bool is_device_state =
+                p->data->type == MULTIFD_PAYLOAD_DEVICE_STATE;
+
             p->iovs_num = 0;
             assert(!multifd_payload_empty(p->data));
 
-            ret = multifd_send_state->ops->send_prepare(p, &local_err);
-            if (ret != 0) {
-                break;
+            if (is_device_state) {
+                multifd_device_state_send_prepare(p);
+            } else {
+                ret = multifd_send_state->ops->send_prepare(p, &local_err);
+                if (ret != 0) {
+                    break;
+                }
             }
 
             if (migrate_mapped_ram()) {
+                assert(!is_device_state);
+
                 ret = file_write_ramblock_iov(p->c, p->iov, p->iovs_num,
                                               &p->data->u.ram, &local_err);
             } else {
@@ -621,10 +698,20 @@ static void *multifd_send_thread(void *opaque)
                 break;
             }
 
-            stat64_add(&mig_stats.multifd_bytes,
-                       p->next_packet_size + p->packet_len);
+            if (is_device_state) {
+                stat64_add(&mig_stats.multifd_bytes,
+                           p->next_packet_size +
+                           sizeof(*p->packet_device_state));
+            } else {
+                stat64_add(&mig_stats.multifd_bytes,
+                           p->next_packet_size + p->packet_len);
+            }
 
             p->next_packet_size = 0;
+            if (is_device_state) {
+                multifd_device_state_clear(&p->data->u.device_state);
+                p->flags = 0;
+            }
             multifd_set_payload_type(p->data, MULTIFD_PAYLOAD_NONE);
 
             /*
@@ -633,15 +720,18 @@ static void *multifd_send_thread(void *opaque)
              * multifd_send().
              */
             qatomic_store_release(&p->pending_job, false);
+            qatomic_store_release(&p->pending_job_preparing, false);
         } else {
             /*
              * If not a normal job, must be a sync request.  Note that
              * pending_sync is a standalone flag (unlike pending_job), so
              * it doesn't require explicit memory barriers.
              */
-            assert(qatomic_read(&p->pending_sync));
+            MultiFDSyncReq req = qatomic_read(&p->pending_sync);
+
+            assert(req != MULTIFD_SYNC_NONE);
 
-            if (use_packets) {
+            if (use_packets && req == MULTIFD_SYNC_ALL) {
                 p->flags = MULTIFD_FLAG_SYNC;
                 multifd_send_fill_packet(p);
                 ret = qio_channel_write_all(p->c, (void *)p->packet,
@@ -654,7 +744,7 @@ static void *multifd_send_thread(void *opaque)
                 p->flags = 0;
             }
 
-            qatomic_set(&p->pending_sync, false);
+            qatomic_set(&p->pending_sync, MULTIFD_SYNC_NONE);
             qemu_sem_post(&p->sem_sync);
         }
     }
@@ -840,6 +930,8 @@ bool multifd_send_setup(void)
             p->packet_len = sizeof(MultiFDPacket_t)
                           + sizeof(uint64_t) * page_count;
             p->packet = g_malloc0(p->packet_len);
+            p->packet_device_state =
+                g_malloc0(sizeof(*p->packet_device_state));
         }
         p->name = g_strdup_printf("mig/src/send_%d", i);
         p->write_flags = 0;
@@ -875,6 +967,8 @@ bool multifd_send_setup(void)
         assert(p->iov);
     }
 
+    multifd_device_state_send_setup();
+
     return true;
 
 err:
@@ -952,6 +1046,9 @@ static void multifd_recv_terminate_threads(Error *err)
             migrate_set_state(&s->state, s->state,
                               MIGRATION_STATUS_FAILED);
         }
+
+        /* Device state load threads may be waiting for our data */
+        qemu_loadvm_abort_load_threads();
     }
 
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -1014,6 +1111,8 @@ static void multifd_recv_cleanup_channel(MultiFDRecvParams *p)
     p->packet_len = 0;
     g_free(p->packet);
     p->packet = NULL;
+    g_free(p->packet_dev_state);
+    p->packet_dev_state = NULL;
     g_free(p->normal);
     p->normal = NULL;
     g_free(p->zero);
@@ -1115,6 +1214,34 @@ void multifd_recv_sync_main(void)
     trace_multifd_recv_sync_main(multifd_recv_state->packet_num);
 }
 
+static int multifd_device_state_recv(MultiFDRecvParams *p, Error **errp)
+{
+    g_autofree char *dev_state_buf = NULL;
+    int ret;
+
+    dev_state_buf = g_malloc(p->next_packet_size);
+
+    ret = qio_channel_read_all(p->c, dev_state_buf, p->next_packet_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (p->packet_dev_state->idstr[sizeof(p->packet_dev_state->idstr) - 1]
+        != 0) {
+        error_setg(errp, "unterminated multifd device state idstr");
+        return -1;
+    }
+
+    if (!qemu_loadvm_load_state_buffer(p->packet_dev_state->idstr,
+                                       p->packet_dev_state->instance_id,
+                                       dev_state_buf, p->next_packet_size,
+                                       errp)) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
 static void *multifd_recv_thread(void *opaque)
 {
     MultiFDRecvParams *p = opaque;
@@ -1127,7 +1254,11 @@ static void *multifd_recv_thread(void *opaque)
 
     while (true) {
         uint32_t flags = 0;
+        bool is_device_state = false;
         bool has_data = false;
+        uint8_t *pkt_buf;
+        size_t pkt_len;
+
         p->normal_num = 0;
 
         if (use_packets) {
@@ -1135,14 +1266,55 @@ static void *multifd_recv_thread(void *opaque)
                 break;
             }
 
+            /*
+             * Both packet types start with the same header; read it first
+             * to know how much more to read.
+             */
             ret = qio_channel_read_all_eof(p->c, (void *)p->packet,
-                                           p->packet_len, &local_err);
+                                           sizeof(MultiFDPacketHdr_t),
+                                           &local_err);
             if (ret == 0 || ret == -1) {   /* 0: EOF  -1: Error */
                 break;
             }
 
             qemu_mutex_lock(&p->mutex);
-            ret = multifd_recv_unfill_packet(p, &local_err);
+            ret = multifd_recv_unfill_packet_header(p, &p->packet->hdr,
+                                                    &local_err);
+            if (ret) {
+                qemu_mutex_unlock(&p->mutex);
+                break;
+            }
+
+            is_device_state = p->flags & MULTIFD_FLAG_DEVICE_STATE;
+            if (is_device_state) {
+                memcpy(&p->packet_dev_state->hdr, &p->packet->hdr,
+                       sizeof(MultiFDPacketHdr_t));
+                pkt_buf = (uint8_t *)p->packet_dev_state
+                    + sizeof(MultiFDPacketHdr_t);
+                pkt_len = sizeof(*p->packet_dev_state)
+                    - sizeof(MultiFDPacketHdr_t);
+            } else {
+                pkt_buf = (uint8_t *)p->packet + sizeof(MultiFDPacketHdr_t);
+                pkt_len = p->packet_len - sizeof(MultiFDPacketHdr_t);
+            }
+
+            ret = qio_channel_read_all_eof(p->c, (char *)pkt_buf, pkt_len,
+                                           &local_err);
+            if (ret == 0 || ret == -1) {   /* 0: EOF  -1: Error */
+                /* the source only closes the channel between packets */
+                if (ret == 0) {
+                    error_setg(&local_err, "multifd: unexpected EOF after "
+                               "packet header on channel %u", p->id);
+                }
+                qemu_mutex_unlock(&p->mutex);
+                break;
+            }
+
+            if (is_device_state) {
+                ret = multifd_recv_unfill_packet_device_state(p, &local_err);
+            } else {
+                ret = multifd_recv_unfill_packet(p, &local_err);
+            }
             if (ret) {
                 qemu_mutex_unlock(&p->mutex);
                 break;
@@ -1151,7 +1323,9 @@ static void *multifd_recv_thread(void *opaque)
             flags = p->flags;
             /* recv methods don't know how to handle the SYNC flag */
             p->flags &= ~MULTIFD_FLAG_SYNC;
-            if (!(flags & MULTIFD_FLAG_SYNC)) {
+            if (is_device_state) {
+                has_data = p->next_packet_size > 0;
+            } else if (!(flags & MULTIFD_FLAG_SYNC)) {
                 has_data = p->normal_num || p->zero_num;
             }
             qemu_mutex_unlock(&p->mutex);
@@ -1182,10 +1356,19 @@ static void *multifd_recv_thread(void *opaque)
         }
 
         if (has_data) {
-            ret = multifd_recv_state->ops->recv(p, &local_err);
+            if (is_device_state) {
+                assert(use_packets);
+                ret = multifd_device_state_recv(p, &local_err);
+            } else {
+                ret = multifd_recv_state->ops->recv(p, &local_err);
+            }
             if (ret != 0) {
                 break;
             }
+        } else if (is_device_state) {
+            error_setg(&local_err,
+                       "multifd: received empty device state packet");
+            break;
         }
 
         if (use_packets) {
@@ -1258,6 +1441,7 @@ int multifd_recv_setup(Error **errp)
             p->packet_len = sizeof(MultiFDPacket_t)
                 + sizeof(uint64_t) * page_count;
             p->packet = g_malloc0(p->packet_len);
+            p->packet_dev_state = g_malloc0(sizeof(*p->packet_dev_state));
         }
         p->name = g_strdup_printf("mig/dst/recv_%d", i);
         p->normal = g_new0(ram_addr_t, page_count);
@@ -14,6 +14,7 @@
 #define QEMU_MIGRATION_MULTIFD_H
 
 #include "exec/target_page.h"
+#include "migration/register.h"
 #include "ram.h"
 
 typedef struct MultiFDRecvData MultiFDRecvData;
@@ -28,7 +29,16 @@ void multifd_recv_shutdown(void);
 bool multifd_recv_all_channels_created(void);
 void multifd_recv_new_channel(QIOChannel *ioc, Error **errp);
 void multifd_recv_sync_main(void);
-int multifd_send_sync_main(void);
+
+typedef enum {
+    MULTIFD_SYNC_NONE = 0,
+    /* Wait until the channels have sent everything queued so far */
+    MULTIFD_SYNC_LOCAL,
+    /* The same, and send a SYNC packet to the destination */
+    MULTIFD_SYNC_ALL,
+} MultiFDSyncReq;
+
+int multifd_send_sync_main(MultiFDSyncReq req);
 bool multifd_queue_page(RAMBlock *block, ram_addr_t offset);
 bool multifd_recv(void);
 MultiFDRecvData *multifd_get_recv_data(void);
@@ -46,6 +56,12 @@ MultiFDRecvData *multifd_get_recv_data(void);
 #define MULTIFD_FLAG_UADK (8 << 1)
 #define MULTIFD_FLAG_QATZIP (16 << 1)
 
+/*
+ * If set it means that this packet contains device state
+ * (MultiFDPacketDeviceState_t), not RAM data (MultiFDPacket_t).
+ */
+#define MULTIFD_FLAG_DEVICE_STATE (1 << 6)
+
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
@@ -53,6 +69,11 @@ typedef struct {
     uint32_t magic;
     uint32_t version;
     uint32_t flags;
+} __attribute__((packed)) MultiFDPacketHdr_t;
+
+typedef struct {
+    MultiFDPacketHdr_t hdr;
+
     /* maximum number of allocated pages */
     uint32_t pages_alloc;
     /* non zero pages */
@@ -73,6 +94,16 @@ typedef struct {
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
 
+typedef struct {
+    MultiFDPacketHdr_t hdr;
+
+    char idstr[256];
+    uint32_t instance_id;
+
+    /* size of the next packet that contains the actual data */
+    uint32_t next_packet_size;
+} __attribute__((packed)) MultiFDPacketDeviceState_t;
+
 typedef struct {
     /* number of used pages */
     uint32_t num;
@@ -90,13 +121,22 @@ struct MultiFDRecvData {
     off_t file_offset;
 };
 
+typedef struct {
+    char *idstr;
+    uint32_t instance_id;
+    char *buf;
+    size_t buf_len;
+} MultiFDDeviceState_t;
+
 typedef enum {
     MULTIFD_PAYLOAD_NONE,
     MULTIFD_PAYLOAD_RAM,
+    MULTIFD_PAYLOAD_DEVICE_STATE,
 } MultiFDPayloadType;
 
 typedef union MultiFDPayload {
     MultiFDPages_t ram;
+    MultiFDDeviceState_t device_state;
 } MultiFDPayload;
 
 struct MultiFDSendData {
@@ -146,19 +186,27 @@ typedef struct {
      * The sender thread has work to do if either of below boolean is set.
      *
      * @pending_job:  a job is pending
-     * @pending_sync: a sync request is pending
+     * @pending_sync: a sync request is pending, see MultiFDSyncReq
      *
      * For both of these fields, they're only set by the requesters, and
      * cleared by the multifd sender threads.
+     *
+     * @pending_job_preparing: a requester claimed the channel and is
+     * handing over its data.  Set by the requesters with cmpxchg, so that
+     * several threads can call multifd_send() at once, and cleared by the
+     * multifd sender thread after @pending_job.
      */
     bool pending_job;
-    bool pending_sync;
+    bool pending_job_preparing;
+    MultiFDSyncReq pending_sync;
     MultiFDSendData *data;
 
     /* thread local variables. No locking required */
 
     /* pointer to the packet */
     MultiFDPacket_t *packet;
+    /* pointer to the device state packet */
+    MultiFDPacketDeviceState_t *packet_device_state;
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     /* packets sent through this channel */
@@ -207,6 +255,8 @@ typedef struct {
 
     /* pointer to the packet */
     MultiFDPacket_t *packet;
+    /* pointer to the device state packet */
+    MultiFDPacketDeviceState_t *packet_dev_state;
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     /* packets received through this channel */
@@ -341,4 +391,16 @@ int multifd_ram_flush_and_sync(void);
 size_t multifd_ram_payload_size(void);
 void multifd_ram_fill_packet(MultiFDSendParams *p);
 int multifd_ram_unfill_packet(MultiFDRecvParams *p, Error **errp);
+
+void multifd_device_state_fill_packet(MultiFDSendParams *p);
+void multifd_device_state_clear(MultiFDDeviceState_t *device_state);
+void multifd_device_state_send_setup(void);
+void multifd_device_state_send_cleanup(void);
+void multifd_device_state_send_prepare(MultiFDSendParams *p);
+void multifd_spawn_device_state_save_thread(
+    SaveLiveCompletePrecopyThreadHandler hdlr,
+    char *idstr, uint32_t instance_id, void *opaque);
+bool multifd_join_device_state_save_threads(void);
+void multifd_abort_device_state_save_threads(void);
+
 #endif
@@ -38,6 +38,7 @@
 #include "migration/global_state.h"
 #include "migration/channel-block.h"
 #include "ram.h"
+#include "multifd.h"
 #include "qemu-file.h"
 #include "savevm.h"
 #include "postcopy-ram.h"
@@ -1494,8 +1495,35 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 {
     int64_t start_ts_each, end_ts_each;
     SaveStateEntry *se;
+    bool multifd_device_state = multifd_device_state_supported();
     int ret;
 
+    if (multifd_device_state) {
+        /*
+         * Start the device state save threads first, so that they run in
+         * parallel with the save_live_complete_precopy handlers below.
+         */
+        QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+            SaveLiveCompletePrecopyThreadHandler hdlr;
+
+            if (!se->ops ||
+                (in_postcopy && se->ops->has_postcopy &&
+                 se->ops->has_postcopy(se->opaque)) ||
+                !se->ops->save_live_complete_precopy_thread) {
+                continue;
+            }
+
+            if (se->ops->is_active && !se->ops->is_active(se->opaque)) {
+                continue;
+            }
+
+            hdlr = se->ops->save_live_complete_precopy_thread;
+            multifd_spawn_device_state_save_thread(hdlr, g_strdup(se->idstr),
+                                                   se->instance_id,
+                                                   se->opaque);
+        }
+    }
+
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (!se->ops ||
             (in_postcopy && se->ops->has_postcopy &&
@@ -1520,16 +1548,46 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
         save_section_footer(f, se);
         if (ret < 0) {
             qemu_file_set_error(f, ret);
-            return -1;
+            goto ret_fail_abort_threads;
         }
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_save("iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
     }
 
+    if (multifd_device_state) {
+        if (migrate_has_error(migrate_get_current())) {
+            multifd_abort_device_state_save_threads();
+        }
+
+        if (!multifd_join_device_state_save_threads()) {
+            qemu_file_set_error(f, -EINVAL);
+            return -1;
+        }
+
+        /*
+         * The device state is only queued to the multifd channels so far.
+         * Make sure it is on the wire before the migration can complete
+         * and the channels get shut down.
+         */
+        ret = multifd_send_sync_main(MULTIFD_SYNC_LOCAL);
+        if (ret < 0) {
+            qemu_file_set_error(f, ret);
+            return -1;
+        }
+    }
+
     trace_vmstate_downtime_checkpoint("src-iterable-saved");
 
     return 0;
+
+ret_fail_abort_threads:
+    if (multifd_device_state) {
+        multifd_abort_device_state_save_threads();
+        multifd_join_device_state_save_threads();
+    }
+
+    return -1;
 }
 
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
@@ -1813,6 +1871,34 @@ static SaveStateEntry *find_se(const char *idstr, uint32_t instance_id)
     return NULL;
 }
 
+/*
+ * Hand a device state buffer that arrived through a multifd channel to
+ * the load_state_buffer handler of its device.  Called from the multifd
+ * receive threads, without the BQL.
+ */
+bool qemu_loadvm_load_state_buffer(const char *idstr, uint32_t instance_id,
+                                   char *buf, size_t len, Error **errp)
+{
+    SaveStateEntry *se;
+
+    se = find_se(idstr, instance_id);
+    if (!se) {
+        error_setg(errp,
+                   "Unknown idstr %s or instance id %u for load state buffer",
+                   idstr, instance_id);
+        return false;
+    }
+
+    if (!se->ops || !se->ops->load_state_buffer) {
+        error_setg(errp,
+                   "idstr %s / instance %u has no load state buffer operation",
+                   idstr, instance_id);
+        return false;
+    }
+
+    return se->ops->load_state_buffer(se->opaque, buf, len, errp);
+}
+
 enum LoadVMExitCodes {
     /* Allow a command to quit all layers of nested loadvm loops */
     LOADVM_QUIT     =  1,
@@ -2760,6 +2846,107 @@ static void qemu_loadvm_state_switchover_ack_needed(MigrationIncomingState *mis)
     trace_loadvm_state_switchover_ack_needed(mis->switchover_ack_pending_num);
 }
 
+typedef struct LoadThread {
+    QemuThread thread;
+    MigrationLoadThread function;
+    void *opaque;
+} LoadThread;
+
+/* Threads started by the load_setup handlers, see qemu_loadvm_state() */
+static QemuMutex load_threads_lock;
+static GList *load_threads;
+static Error *load_threads_error;
+static bool load_threads_should_quit; /* atomic */
+
+static void __attribute__((constructor)) load_threads_init(void)
+{
+    qemu_mutex_init(&load_threads_lock);
+}
+
+static void *qemu_loadvm_load_thread(void *opaque)
+{
+    LoadThread *t = opaque;
+    Error *local_err = NULL;
+
+    if (!t->function(t->opaque, &load_threads_should_quit, &local_err)) {
+        assert(local_err);
+
+        WITH_QEMU_LOCK_GUARD(&load_threads_lock) {
+            if (!load_threads_error) {
+                load_threads_error = local_err;
+                local_err = NULL;
+            }
+        }
+        error_free(local_err);
+
+        /* No point in the other threads going on */
+        qemu_loadvm_abort_load_threads();
+    }
+
+    return NULL;
+}
+
+/*
+ * Start a thread that runs @function in parallel with the loading of the
+ * main migration stream, e.g. to consume device state arriving through
+ * the multifd channels.  @function must return once *@should_quit is set.
+ *
+ * Only to be called from load_setup handlers; the incoming migration
+ * waits for all the load threads before running the VM.
+ */
+void qemu_loadvm_start_load_thread(const char *name,
+                                   MigrationLoadThread function,
+                                   void *opaque)
+{
+    LoadThread *t = g_new0(LoadThread, 1);
+
+    t->function = function;
+    t->opaque = opaque;
+
+    WITH_QEMU_LOCK_GUARD(&load_threads_lock) {
+        load_threads = g_list_append(load_threads, t);
+    }
+
+    trace_loadvm_start_load_thread(name);
+    qemu_thread_create(&t->thread, name, qemu_loadvm_load_thread, t,
+                       QEMU_THREAD_JOINABLE);
+}
+
+void qemu_loadvm_abort_load_threads(void)
+{
+    qatomic_set(&load_threads_should_quit, true);
+}
+
+/* Returns false, setting @errp, if any of the load threads failed */
+static bool qemu_loadvm_join_load_threads(Error **errp)
+{
+    GList *threads;
+    Error *err;
+
+    WITH_QEMU_LOCK_GUARD(&load_threads_lock) {
+        threads = g_steal_pointer(&load_threads);
+    }
+
+    for (GList *l = threads; l; l = l->next) {
+        LoadThread *t = l->data;
+
+        qemu_thread_join(&t->thread);
+        g_free(t);
+    }
+    g_list_free(threads);
+
+    WITH_QEMU_LOCK_GUARD(&load_threads_lock) {
+        err = g_steal_pointer(&load_threads_error);
+    }
+
+    if (err) {
+        error_propagate(errp, err);
+        return false;
+    }
+
+    return true;
+}
+
 static int qemu_loadvm_state_setup(QEMUFile *f, Error **errp)
 {
     ERRP_GUARD();
@@ -2767,6 +2954,8 @@ static int qemu_loadvm_state_setup(QEMUFile *f, Error **errp)
     int ret;
 
     trace_loadvm_state_setup();
+    qatomic_set(&load_threads_should_quit, false);
+
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (!se->ops || !se->ops->load_setup) {
             continue;
@@ -2791,8 +2980,30 @@ static int qemu_loadvm_state_setup(QEMUFile *f, Error **errp)
 void qemu_loadvm_state_cleanup(void)
 {
     SaveStateEntry *se;
+    bool has_load_threads;
 
     trace_loadvm_state_cleanup();
+
+    /*
+     * Normally joined already by qemu_loadvm_state().  Otherwise, a load
+     * thread may be waiting for the BQL before it notices the abort.
+     */
+    WITH_QEMU_LOCK_GUARD(&load_threads_lock) {
+        has_load_threads = load_threads;
+    }
+    if (has_load_threads) {
+        bool bql = bql_locked();
+
+        qemu_loadvm_abort_load_threads();
+        if (bql) {
+            bql_unlock();
+        }
+        qemu_loadvm_join_load_threads(NULL);
+        if (bql) {
+            bql_lock();
+        }
+    }
+
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (se->ops && se->ops->load_cleanup) {
             se->ops->load_cleanup(se->opaque);
@@ -2950,6 +3161,7 @@ int qemu_loadvm_state(QEMUFile *f)
 {
     MigrationIncomingState *mis = migration_incoming_get_current();
     Error *local_err = NULL;
+    bool has_load_threads;
     int ret;
 
     if (qemu_savevm_state_blocked(&local_err)) {
@@ -2990,6 +3202,29 @@ int qemu_loadvm_state(QEMUFile *f)
         ret = qemu_file_get_error(f);
     }
 
+    /*
+     * The load threads may still be consuming device state that arrived
+     * through the multifd channels; wait for them before the VM can run.
+     * They may need the BQL themselves.
+     */
+    WITH_QEMU_LOCK_GUARD(&load_threads_lock) {
+        has_load_threads = load_threads;
+    }
+    if (has_load_threads) {
+        if (ret != 0) {
+            qemu_loadvm_abort_load_threads();
+        }
+        bql_unlock();
+        if (!qemu_loadvm_join_load_threads(&local_err)) {
+            error_report_err(local_err);
+            local_err = NULL;
+            if (ret == 0) {
+                ret = -EINVAL;
+            }
+        }
+        bql_lock();
+    }
+
     /*
      * Try to read in the VMDESC section as well, so that dumping tools that
      * intercept our migration stream have the chance to see it.
@@ -52,20 +52,70 @@ typedef struct AFXDPState {
     uint32_t             n_queues;
     uint32_t             xdp_flags;
     bool                 inhibit;
+    bool                 busy_poll;
 } AFXDPState;
 
 #define AF_XDP_BATCH_SIZE 64
 
+/* Time spent busy polling per system call, same as the kernel examples. */
+#define AF_XDP_BUSY_POLL_USECS 20
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
 static void af_xdp_send(void *opaque);
 static void af_xdp_writable(void *opaque);
 
+/*
+ * Let the driver process the queue if it is busy polled.  Interrupts are
+ * deferred for busy polled queues, so this is what brings new packets in.
+ */
+static void af_xdp_busy_poll(AFXDPState *s)
+{
+    if (s->busy_poll) {
+        recvfrom(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    }
+}
+
+/*
+ * The io_poll() callback, invoked by the polling loop of the IOThread that
+ * the queue is processed in.  Returns whether there are packets to receive.
+ */
+static bool af_xdp_rx_poll(void *opaque)
+{
+    AFXDPState *s = opaque;
+
+    if (xsk_cons_nb_avail(&s->rx, 1)) {
+        return true;
+    }
+
+    af_xdp_busy_poll(s);
+    return xsk_cons_nb_avail(&s->rx, 1);
+}
+
+/* Set the handlers for the af-xdp backend in @ctx, or the main loop. */
+static void af_xdp_set_fd_handler(AFXDPState *s, AioContext *ctx, bool enable)
+{
+    IOHandler *fd_read = enable && s->read_poll ? af_xdp_send : NULL;
+    IOHandler *fd_write = enable && s->write_poll ? af_xdp_writable : NULL;
+
+    if (ctx) {
+        /* Poll the rx ring directly rather than waiting for the fd. */
+        aio_set_fd_handler(ctx, xsk_socket__fd(s->xsk), fd_read, fd_write,
+                           fd_read ? af_xdp_rx_poll : NULL, fd_read, s);
+    } else {
+        qemu_set_fd_handler(xsk_socket__fd(s->xsk), fd_read, fd_write, s);
+    }
+}
+
 /* Set the event-loop handlers for the af-xdp backend. */
 static void af_xdp_update_fd_handler(AFXDPState *s)
 {
-    qemu_set_fd_handler(xsk_socket__fd(s->xsk),
-                        s->read_poll ? af_xdp_send : NULL,
-                        s->write_poll ? af_xdp_writable : NULL,
-                        s);
+    af_xdp_set_fd_handler(s, s->nc.aio_context, true);
 }
 
 /* Update the read handler. */
@@ -97,6 +147,14 @@ static void af_xdp_poll(NetClientState *nc, bool enable)
     }
 }
 
+static void af_xdp_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    af_xdp_set_fd_handler(s, nc->aio_context, false);
+    af_xdp_set_fd_handler(s, ctx, true);
+}
+
 static void af_xdp_complete_tx(AFXDPState *s)
 {
     uint32_t idx = 0;
@@ -139,10 +197,15 @@ static void af_xdp_writable(void *opaque)
     qemu_flush_queued_packets(&s->nc);
 }
 
-static ssize_t af_xdp_receive(NetClientState *nc,
-                              const uint8_t *buf, size_t size)
+/*
+ * Copy the packet straight from the guest buffers into a umem frame, the
+ * net layer would otherwise first linearize it into a temporary buffer.
+ */
+static ssize_t af_xdp_receive_iov(NetClientState *nc,
+                                  const struct iovec *iov, int iovcnt)
 {
     AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    size_t size = iov_size(iov, iovcnt);
     struct xdp_desc *desc;
     uint32_t idx;
     void *data;
@@ -169,7 +232,7 @@ static ssize_t af_xdp_receive(NetClientState *nc,
     desc->len = size;
 
     data = xsk_umem__get_data(s->buffer, desc->addr);
-    memcpy(data, buf, size);
+    iov_to_buf(iov, iovcnt, 0, data, size);
 
     xsk_ring_prod__submit(&s->tx, 1);
     s->outstanding_tx++;
@@ -181,6 +244,17 @@ static ssize_t af_xdp_receive(NetClientState *nc,
     return size;
 }
 
+static ssize_t af_xdp_receive(NetClientState *nc,
+                              const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size,
+    };
+
+    return af_xdp_receive_iov(nc, &iov, 1);
+}
+
 /*
  * Complete a previous send (backend --> guest) and enable the
  * fd_read callback.
@@ -223,6 +297,7 @@ static void af_xdp_send(void *opaque)
 
     n_rx = xsk_ring_cons__peek(&s->rx, AF_XDP_BATCH_SIZE, &idx);
     if (!n_rx) {
+        af_xdp_busy_poll(s);
         return;
     }
 
@@ -393,6 +468,25 @@ static int af_xdp_socket_create(AFXDPState *s,
 
     s->xdp_flags = cfg.xdp_flags;
 
+    if (opts->has_busy_poll_budget && opts->busy_poll_budget > 0) {
+        int fd = xsk_socket__fd(s->xsk);
+        int prefer = 1, usecs = AF_XDP_BUSY_POLL_USECS;
+        int budget = opts->busy_poll_budget;
+
+        if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                       &prefer, sizeof(prefer))
+            || setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+                          &usecs, sizeof(usecs))
+            || setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+                          &budget, sizeof(budget))) {
+            error_setg_errno(errp, errno,
+                             "failed to enable busy polling for %s "
+                             "queue_id: %d", s->ifname, queue_id);
+            return -1;
+        }
+        s->busy_poll = true;
+    }
+
     return 0;
 }
 
@@ -401,8 +495,10 @@ static NetClientInfo net_af_xdp_info = {
     .type = NET_CLIENT_DRIVER_AF_XDP,
     .size = sizeof(AFXDPState),
     .receive = af_xdp_receive,
+    .receive_iov = af_xdp_receive_iov,
     .poll = af_xdp_poll,
     .cleanup = af_xdp_cleanup,
+    .set_aio_context = af_xdp_set_aio_context,
 };
 
 static int *parse_socket_fds(const char *sock_fds_str,
@@ -465,6 +561,13 @@ int net_init_af_xdp(const Netdev *netdev,
         return -1;
     }
 
+    if (opts->has_busy_poll_budget &&
+        (opts->busy_poll_budget < 0 || opts->busy_poll_budget > UINT16_MAX)) {
+        error_setg(errp, "invalid busy-poll-budget (%" PRIi64 ") for '%s'",
+                   opts->busy_poll_budget, opts->ifname);
+        return -1;
+    }
+
     if ((opts->has_inhibit && opts->inhibit) != !!opts->sock_fds) {
         error_setg(errp, "'inhibit=on' requires 'sock-fds' and vice versa");
         return -1;
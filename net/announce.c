@@ -8,6 +8,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "block/aio-wait.h"
 #include "net/announce.h"
 #include "net/net.h"
 #include "qapi/clone-visitor.h"
@@ -133,6 +134,36 @@ static const char *qemu_ether_ntoa(const MACAddr *mac)
     return ret;
 }
 
+typedef struct AnnounceSendData {
+    NetClientState *nc;
+    const uint8_t *buf;
+    int len;
+} AnnounceSendData;
+
+static void qemu_announce_send_bh(void *opaque)
+{
+    AnnounceSendData *data = opaque;
+
+    qemu_send_packet_raw(data->nc, data->buf, data->len);
+}
+
+/*
+ * The backend of a NIC may be processed in an IOThread, see
+ * qemu_set_aio_context().  Its queue is then only accessed from there, so
+ * send the packet from that AioContext as well.
+ */
+static void qemu_announce_send(NetClientState *nc, const uint8_t *buf, int len)
+{
+    AnnounceSendData data = { .nc = nc, .buf = buf, .len = len };
+
+    if (nc->peer && nc->peer->aio_context) {
+        aio_wait_bh_oneshot(nc->peer->aio_context, qemu_announce_send_bh,
+                            &data);
+    } else {
+        qemu_announce_send_bh(&data);
+    }
+}
+
 static void qemu_announce_self_iter(NICState *nic, void *opaque)
 {
     AnnounceTimer *timer = opaque;
@@ -164,7 +195,7 @@ static void qemu_announce_self_iter(NICState *nic, void *opaque)
     if (!skip) {
         len = announce_self_create(buf, nic->conf->macaddr.a);
 
-        qemu_send_packet_raw(qemu_get_queue(nic), buf, len);
+        qemu_announce_send(qemu_get_queue(nic), buf, len);
 
         /* if the NIC provides it's own announcement support, use it as well */
         if (nic->ncs->info->announce) {
@@ -585,6 +585,36 @@ int qemu_set_vnet_be(NetClientState *nc, bool is_be)
 #endif
 }
 
+/*
+ * Whether the I/O handlers of @nc can be moved out of the main loop.  Network
+ * filters expect to run in the main loop, so backends with filters attached
+ * cannot be moved.
+ */
+bool qemu_can_set_aio_context(NetClientState *nc)
+{
+    return nc && nc->info->set_aio_context && QTAILQ_EMPTY(&nc->filters);
+}
+
+/*
+ * Move the I/O handlers of @nc to @ctx, or back to the main loop if @ctx is
+ * NULL.  Afterwards @nc only calls into its peer from @ctx, so the peer must
+ * process its side of the connection there as well.
+ *
+ * The backend's set_aio_context callback runs while nc->aio_context still
+ * points to the old context.
+ */
+void qemu_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    assert(nc->info->set_aio_context);
+
+    if (nc->aio_context == ctx) {
+        return;
+    }
+
+    nc->info->set_aio_context(nc, ctx);
+    nc->aio_context = ctx;
+}
+
 int qemu_can_receive_packet(NetClientState *nc)
 {
     if (nc->receive_disabled) {
@@ -1462,6 +1492,12 @@ void qmp_netdev_del(const char *id, Error **errp)
         return;
     }
 
+    if (nc->aio_context) {
+        error_setg(errp, "Device '%s' is processed in an IOThread, "
+                   "unplug the NIC first", id);
+        return;
+    }
+
     qemu_del_net_client(nc);
 
     /*
@@ -48,12 +48,23 @@ typedef struct NetSocketState {
 static void net_socket_accept(void *opaque);
 static void net_socket_writable(void *opaque);
 
+static void net_socket_set_fd_handler(NetSocketState *s, AioContext *ctx,
+                                      bool enable)
+{
+    IOHandler *fd_read = enable && s->read_poll ? s->send_fn : NULL;
+    IOHandler *fd_write =
+        enable && s->write_poll ? net_socket_writable : NULL;
+
+    if (ctx) {
+        aio_set_fd_handler(ctx, s->fd, fd_read, fd_write, NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
+}
+
 static void net_socket_update_fd_handler(NetSocketState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll ? s->send_fn : NULL,
-                        s->write_poll ? net_socket_writable : NULL,
-                        s);
+    net_socket_set_fd_handler(s, s->nc.aio_context, true);
 }
 
 static void net_socket_read_poll(NetSocketState *s, bool enable)
@@ -410,11 +421,28 @@ static void net_socket_connect(void *opaque)
     net_socket_read_poll(s, true);
 }
 
+static void net_socket_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+
+    /*
+     * Nothing to move while not connected, net_socket_connect() sets up the
+     * handlers in nc->aio_context once the connection is there.
+     */
+    if (s->fd < 0 || (!s->read_poll && !s->write_poll)) {
+        return;
+    }
+
+    net_socket_set_fd_handler(s, nc->aio_context, false);
+    net_socket_set_fd_handler(s, ctx, true);
+}
+
 static NetClientInfo net_socket_info = {
     .type = NET_CLIENT_DRIVER_SOCKET,
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_stream(NetClientState *peer,
@@ -135,6 +135,19 @@ void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
     }
 }
 
+void qemu_plugin_register_vcpu_tb_exec_record(struct qemu_plugin_tb *tb,
+                                              struct qemu_plugin_ring *ring,
+                                              uint32_t flags)
+{
+    const DisasContextBase *db = tcg_ctx->plugin_db;
+
+    if (!tb_is_mem_only()) {
+        plugin_register_record(&tb->cbs, ring, 0, db->pc_first,
+                               db->pc_next - db->pc_first,
+                               flags | QEMU_PLUGIN_RECORD_TB);
+    }
+}
+
 void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
                                             qemu_plugin_vcpu_udata_cb_t cb,
                                             enum qemu_plugin_cb_flags flags,
@@ -176,6 +189,15 @@ void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
     }
 }
 
+void qemu_plugin_register_vcpu_insn_exec_record(struct qemu_plugin_insn *insn,
+                                                struct qemu_plugin_ring *ring,
+                                                uint32_t flags)
+{
+    if (!tb_is_mem_only()) {
+        plugin_register_record(&insn->insn_cbs, ring, 0, insn->vaddr,
+                               insn->len, flags | QEMU_PLUGIN_RECORD_INSN);
+    }
+}
 
 /*
  * We always plant memory instrumentation because they don't finalise until
@@ -190,6 +212,17 @@ void qemu_plugin_register_vcpu_mem_cb(struct qemu_plugin_insn *insn,
     plugin_register_vcpu_mem_cb(&insn->mem_cbs, cb, flags, rw, udata);
 }
 
+void qemu_plugin_register_vcpu_mem_filtered_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_mem_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    const struct qemu_plugin_mem_filter *filter,
+    void *udata)
+{
+    plugin_register_vcpu_mem_filtered_cb(&insn->mem_cbs, cb, flags,
+                                         filter, udata);
+}
+
 void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     struct qemu_plugin_insn *insn,
     enum qemu_plugin_mem_rw rw,
@@ -200,6 +233,15 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     plugin_register_inline_op_on_entry(&insn->mem_cbs, rw, op, entry, imm);
 }
 
+void qemu_plugin_register_vcpu_mem_record(struct qemu_plugin_insn *insn,
+                                          struct qemu_plugin_ring *ring,
+                                          enum qemu_plugin_mem_rw rw,
+                                          uint32_t flags)
+{
+    /* The size and the kind of access are only known when it happens */
+    plugin_register_record(&insn->mem_cbs, ring, rw, insn->vaddr, 0, flags);
+}
+
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
                                            qemu_plugin_vcpu_tb_trans_cb_t cb)
 {
@@ -640,6 +682,30 @@ uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry)
     return total;
 }
 
+struct qemu_plugin_ring *qemu_plugin_ring_new(size_t n_records,
+                                              enum qemu_plugin_ring_mode mode)
+{
+    return plugin_ring_new(n_records, mode);
+}
+
+void qemu_plugin_ring_free(struct qemu_plugin_ring *ring)
+{
+    plugin_ring_free(ring);
+}
+
+size_t qemu_plugin_ring_read(struct qemu_plugin_ring *ring,
+                             unsigned int vcpu_index,
+                             qemu_plugin_record *records, size_t n)
+{
+    return plugin_ring_read(ring, vcpu_index, records, n);
+}
+
+uint64_t qemu_plugin_ring_lost(struct qemu_plugin_ring *ring,
+                               unsigned int vcpu_index)
+{
+    return plugin_ring_lost(ring, vcpu_index);
+}
+
 /*
  * Time control
  */
@@ -21,6 +21,7 @@
 #include "qemu/queue.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
+#include "qemu/host-utils.h"
 #include "qemu/rcu.h"
 #include "hw/core/cpu.h"
 
@@ -212,6 +213,28 @@ CPUPluginState *qemu_plugin_create_vcpu_state(void)
     return g_new0(CPUPluginState, 1);
 }
 
+static inline struct qemu_plugin_ring_vcpu *
+plugin_ring_vcpu(struct qemu_plugin_ring *ring, unsigned int vcpu_index)
+{
+    return &g_array_index(ring->vcpus->data, struct qemu_plugin_ring_vcpu,
+                          vcpu_index);
+}
+
+/* Give a buffer to the entries of the scoreboard that do not have one */
+static void plugin_ring_alloc_records__locked(struct qemu_plugin_ring *ring)
+{
+    unsigned int i;
+
+    for (i = 0; i < ring->vcpus->data->len; i++) {
+        struct qemu_plugin_ring_vcpu *v = plugin_ring_vcpu(ring, i);
+
+        if (!v->records) {
+            /* One more for the records that do not fit, see gen_record() */
+            v->records = g_new(qemu_plugin_record, ring->mask + 2);
+        }
+    }
+}
+
 static void plugin_grow_scoreboards__locked(CPUState *cpu)
 {
     size_t scoreboard_size = plugin.scoreboard_alloc_size;
@@ -250,9 +273,13 @@ static void plugin_grow_scoreboards__locked(CPUState *cpu)
     /* in case another vcpu is created between unlock and exclusive section. */
     if (scoreboard_size > plugin.scoreboard_alloc_size) {
         struct qemu_plugin_scoreboard *score;
+        struct qemu_plugin_ring *ring;
         QLIST_FOREACH(score, &plugin.scoreboards, entry) {
             g_array_set_size(score->data, scoreboard_size);
         }
+        QLIST_FOREACH(ring, &plugin.rings, entry) {
+            plugin_ring_alloc_records__locked(ring);
+        }
         plugin.scoreboard_alloc_size = scoreboard_size;
         /* force all tb to be flushed, as scoreboard pointers were changed. */
         tb_flush(cpu);
@@ -425,11 +452,7 @@ void plugin_register_dyn_cond_cb__udata(GArray **arr,
     dyn_cb->cond = cond_cb;
 }
 
-void plugin_register_vcpu_mem_cb(GArray **arr,
-                                 void *cb,
-                                 enum qemu_plugin_cb_flags flags,
-                                 enum qemu_plugin_mem_rw rw,
-                                 void *udata)
+static TCGHelperInfo *plugin_mem_cb_info(enum qemu_plugin_cb_flags flags)
 {
     /*
      * Expect that the underlying type for enum qemu_plugin_meminfo_t
@@ -456,15 +479,73 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     };
     assert((unsigned)flags < ARRAY_SIZE(info));
 
+    return &info[flags];
+}
+
+void plugin_register_vcpu_mem_cb(GArray **arr,
+                                 void *cb,
+                                 enum qemu_plugin_cb_flags flags,
+                                 enum qemu_plugin_mem_rw rw,
+                                 void *udata)
+{
     struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
-    struct qemu_plugin_regular_cb regular_cb = { .userp = udata,
-                                                 .rw = rw,
-                                                 .f.vcpu_mem = cb,
-                                                 .info = &info[flags] };
+    struct qemu_plugin_regular_cb regular_cb = {
+        .userp = udata,
+        .rw = rw,
+        .f.vcpu_mem = cb,
+        .info = plugin_mem_cb_info(flags),
+    };
     dyn_cb->type = PLUGIN_CB_MEM_REGULAR;
     dyn_cb->regular = regular_cb;
 }
 
+static TCGHelperInfo *
+plugin_mem_filtered_cb_info(enum qemu_plugin_cb_flags flags)
+{
+    static TCGHelperInfo info[3] = {
+        [QEMU_PLUGIN_CB_NO_REGS].flags = TCG_CALL_NO_RWG,
+        [QEMU_PLUGIN_CB_R_REGS].flags = TCG_CALL_NO_WG,
+        /*
+         * Match plugin_mem_filtered_cb:
+         *   void (*)(uint32_t, uint32_t, uint64_t, void *, void *, uint32_t)
+         */
+        [0 ... 2].typemask =
+            (dh_typemask(void, 0) |
+             dh_typemask(i32, 1) |
+             dh_typemask(i32, 2) |
+             dh_typemask(i64, 3) |
+             dh_typemask(ptr, 4) |
+             dh_typemask(ptr, 5) |
+             dh_typemask(i32, 6))
+    };
+    assert((unsigned)flags < ARRAY_SIZE(info));
+
+    return &info[flags];
+}
+
+void plugin_register_vcpu_mem_filtered_cb(GArray **arr,
+                                          void *cb,
+                                          enum qemu_plugin_cb_flags flags,
+                                          const struct qemu_plugin_mem_filter *f,
+                                          void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_filtered_cb filtered_cb = {
+        .regular = { .userp = udata,
+                     .rw = f->rw,
+                     .f.vcpu_mem = cb,
+                     .info = plugin_mem_cb_info(flags) },
+        .filter_info = plugin_mem_filtered_cb_info(flags),
+        .size_mask = f->size_mask ? f->size_mask : UINT_MAX,
+        .addr_min = f->addr_min,
+        .addr_max = f->addr_max ? f->addr_max : UINT64_MAX,
+        .period = f->period,
+        .counter = f->counter,
+    };
+    dyn_cb->type = PLUGIN_CB_MEM_FILTERED;
+    dyn_cb->filtered = filtered_cb;
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -601,6 +682,125 @@ void exec_inline_op(enum plugin_dyn_cb_type type,
     }
 }
 
+void plugin_register_record(GArray **arr,
+                            struct qemu_plugin_ring *ring,
+                            enum qemu_plugin_mem_rw rw,
+                            uint64_t pc, uint32_t size, uint32_t flags)
+{
+    static TCGHelperInfo info = {
+        .flags = TCG_CALL_NO_RWG,
+        /*
+         * Match plugin_ring_append_full:
+         *   void (*)(uint32_t, void *, uint64_t, uint64_t, uint64_t)
+         */
+        .typemask = (dh_typemask(void, 0) |
+                     dh_typemask(i32, 1) |
+                     dh_typemask(ptr, 2) |
+                     dh_typemask(i64, 3) |
+                     dh_typemask(i64, 4) |
+                     dh_typemask(i64, 5))
+    };
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_record_cb record_cb = { .ring = ring,
+                                               .info = &info,
+                                               .pc = pc,
+                                               .size = size,
+                                               .flags = flags,
+                                               .rw = rw };
+    dyn_cb->type = PLUGIN_CB_RECORD;
+    dyn_cb->record = record_cb;
+}
+
+/*
+ * Append a record to the ring of a vcpu.  This is called by the generated
+ * code in QEMU_PLUGIN_RING_BLOCK mode, and for the memory accesses done by
+ * helpers.
+ */
+static void plugin_ring_append(struct qemu_plugin_ring *ring,
+                               unsigned int cpu_index, uint64_t pc,
+                               uint64_t vaddr, uint32_t size, uint32_t flags)
+{
+    struct qemu_plugin_ring_vcpu *v = plugin_ring_vcpu(ring, cpu_index);
+    qemu_plugin_record *rec;
+
+    if (v->head - qatomic_load_acquire(&v->tail) > ring->mask) {
+        if (ring->mode == QEMU_PLUGIN_RING_DROP) {
+            v->lost++;
+            return;
+        }
+
+        qemu_mutex_lock(&ring->lock);
+        qatomic_inc(&ring->waiters);
+        smp_mb__after_rmw();
+        while (v->head - qatomic_load_acquire(&v->tail) > ring->mask) {
+            qemu_cond_wait(&ring->room, &ring->lock);
+        }
+        qatomic_dec(&ring->waiters);
+        qemu_mutex_unlock(&ring->lock);
+    }
+
+    rec = &v->records[v->head & ring->mask];
+    rec->pc = pc;
+    rec->vaddr = vaddr;
+    rec->size = size;
+    rec->flags = flags;
+    qatomic_store_release(&v->head, v->head + 1);
+}
+
+void plugin_ring_append_full(uint32_t cpu_index, void *ring, uint64_t pc,
+                             uint64_t vaddr, uint64_t size_flags)
+{
+    plugin_ring_append(ring, cpu_index, pc, vaddr,
+                       extract64(size_flags, 0, 32),
+                       extract64(size_flags, 32, 32));
+}
+
+/*
+ * Called by the generated code for every access of the kind and size
+ * selected by a filtered callback, with the result of the rest of the
+ * filter in @match, see gen_mem_filtered_cb().
+ */
+QEMU_DISABLE_CFI
+void plugin_mem_filtered_cb(uint32_t cpu_index, uint32_t meminfo,
+                            uint64_t vaddr, void *userp, void *cb,
+                            uint32_t match)
+{
+    if (match) {
+        ((qemu_plugin_vcpu_mem_cb_t)cb)(cpu_index, meminfo, vaddr, userp);
+    }
+}
+
+/*
+ * Apply the filter of a filtered callback to an access that goes through
+ * a helper, the same way as plugin-gen.c does in the generated code.
+ */
+static bool mem_filter_match(struct qemu_plugin_filtered_cb *cb,
+                             int cpu_index, uint64_t vaddr,
+                             MemOpIdx oi, enum qemu_plugin_mem_rw rw)
+{
+    GArray *arr;
+    uint64_t *counter;
+
+    if (!(rw & cb->regular.rw) ||
+        !(cb->size_mask & (1u << (get_memop(oi) & MO_SIZE))) ||
+        vaddr < cb->addr_min || vaddr > cb->addr_max) {
+        return false;
+    }
+    if (cb->period <= 1) {
+        return true;
+    }
+
+    arr = cb->counter.score->data;
+    counter = (uint64_t *)(arr->data + cb->counter.offset +
+                           cpu_index * g_array_get_element_size(arr));
+    if (++*counter < cb->period) {
+        return false;
+    }
+    *counter = 0;
+    return true;
+}
+
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              uint64_t value_low,
                              uint64_t value_high,
@@ -628,6 +828,26 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                                        vaddr, cb->regular.userp);
             }
             break;
+        case PLUGIN_CB_MEM_FILTERED:
+            if (mem_filter_match(&cb->filtered, cpu->cpu_index,
+                                 vaddr, oi, rw)) {
+                cb->filtered.regular.f.vcpu_mem(cpu->cpu_index,
+                                                make_plugin_meminfo(oi, rw),
+                                                vaddr,
+                                                cb->filtered.regular.userp);
+            }
+            break;
+        case PLUGIN_CB_RECORD:
+            if (rw & cb->record.rw) {
+                plugin_ring_append(cb->record.ring, cpu->cpu_index,
+                                   cb->record.pc, vaddr,
+                                   memop_size(get_memop(oi)),
+                                   cb->record.flags |
+                                   (rw & QEMU_PLUGIN_MEM_W
+                                    ? QEMU_PLUGIN_RECORD_MEM_W
+                                    : QEMU_PLUGIN_RECORD_MEM_R));
+            }
+            break;
         case PLUGIN_CB_INLINE_ADD_U64:
         case PLUGIN_CB_INLINE_STORE_U64:
             if (rw & cb->inline_insn.rw) {
@@ -733,6 +953,7 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QLIST_INIT(&plugin.scoreboards);
+    QLIST_INIT(&plugin.rings);
     plugin.scoreboard_alloc_size = 16; /* avoid frequent reallocation */
     QTAILQ_INIT(&plugin.ctxs);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
@@ -768,3 +989,85 @@ void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
     g_array_free(score->data, TRUE);
     g_free(score);
 }
+
+struct qemu_plugin_ring *plugin_ring_new(size_t n_records,
+                                         enum qemu_plugin_ring_mode mode)
+{
+    struct qemu_plugin_ring *ring;
+
+    g_assert(is_power_of_2(n_records) && n_records <= (1 << 24));
+
+    ring = g_new0(struct qemu_plugin_ring, 1);
+    ring->mask = n_records - 1;
+    ring->mode = mode;
+    qemu_mutex_init(&ring->lock);
+    qemu_cond_init(&ring->room);
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    ring->vcpus = plugin_scoreboard_new(sizeof(struct qemu_plugin_ring_vcpu));
+    plugin_ring_alloc_records__locked(ring);
+    QLIST_INSERT_HEAD(&plugin.rings, ring, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return ring;
+}
+
+void plugin_ring_free(struct qemu_plugin_ring *ring)
+{
+    unsigned int i;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(ring, entry);
+    for (i = 0; i < ring->vcpus->data->len; i++) {
+        g_free(plugin_ring_vcpu(ring, i)->records);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    plugin_scoreboard_free(ring->vcpus);
+    qemu_cond_destroy(&ring->room);
+    qemu_mutex_destroy(&ring->lock);
+    g_free(ring);
+}
+
+size_t plugin_ring_read(struct qemu_plugin_ring *ring, unsigned int vcpu_index,
+                        qemu_plugin_record *records, size_t n)
+{
+    struct qemu_plugin_ring_vcpu *v;
+    uint32_t head, tail, start, count, first;
+
+    /* The scoreboard moves when it grows, which happens with the lock held */
+    QEMU_LOCK_GUARD(&plugin.lock);
+    if (vcpu_index >= ring->vcpus->data->len) {
+        return 0;
+    }
+
+    v = plugin_ring_vcpu(ring, vcpu_index);
+    tail = v->tail;
+    head = qatomic_load_acquire(&v->head);
+    count = MIN(head - tail, n);
+    start = tail & ring->mask;
+    first = MIN(count, ring->mask + 1 - start);
+    memcpy(records, &v->records[start], first * sizeof(*records));
+    memcpy(records + first, v->records, (count - first) * sizeof(*records));
+    qatomic_store_release(&v->tail, tail + count);
+
+    /* Pairs with smp_mb__after_rmw() in plugin_ring_append() */
+    smp_mb();
+    if (count && qatomic_read(&ring->waiters)) {
+        qemu_mutex_lock(&ring->lock);
+        qemu_cond_broadcast(&ring->room);
+        qemu_mutex_unlock(&ring->lock);
+    }
+
+    return count;
+}
+
+uint64_t plugin_ring_lost(struct qemu_plugin_ring *ring,
+                          unsigned int vcpu_index)
+{
+    QEMU_LOCK_GUARD(&plugin.lock);
+    if (vcpu_index >= ring->vcpus->data->len) {
+        return 0;
+    }
+    return plugin_ring_vcpu(ring, vcpu_index)->lost;
+}
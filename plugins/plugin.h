@@ -32,6 +32,7 @@ struct qemu_plugin_state {
      */
     GHashTable *cpu_ht;
     QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
+    QLIST_HEAD(, qemu_plugin_ring) rings;
     size_t scoreboard_alloc_size;
     DECLARE_BITMAP(mask, QEMU_PLUGIN_EV_MAX);
     /*
@@ -108,6 +109,17 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
+void plugin_register_vcpu_mem_filtered_cb(GArray **arr,
+                                          void *cb,
+                                          enum qemu_plugin_cb_flags flags,
+                                          const struct qemu_plugin_mem_filter *f,
+                                          void *udata);
+
+void plugin_register_record(GArray **arr,
+                            struct qemu_plugin_ring *ring,
+                            enum qemu_plugin_mem_rw rw,
+                            uint64_t pc, uint32_t size, uint32_t flags);
+
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
                     int cpu_index);
@@ -118,4 +130,15 @@ struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
 
 void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
 
+struct qemu_plugin_ring *plugin_ring_new(size_t n_records,
+                                         enum qemu_plugin_ring_mode mode);
+
+void plugin_ring_free(struct qemu_plugin_ring *ring);
+
+size_t plugin_ring_read(struct qemu_plugin_ring *ring, unsigned int vcpu_index,
+                        qemu_plugin_record *records, size_t n);
+
+uint64_t plugin_ring_lost(struct qemu_plugin_ring *ring,
+                          unsigned int vcpu_index);
+
 #endif /* PLUGIN_H */
@@ -107,6 +107,7 @@ static void help(void)
 #ifdef CONFIG_FUSE
 "  --export [type=]fuse,id=<id>,node-name=<node-name>,mountpoint=<file>\n"
 "           [,growable=on|off][,writable=on|off][,allow-other=on|off|auto]\n"
+"           [,iothreads.<n>=<iothread-id>,...]\n"
 "                         export the specified block node over FUSE\n"
 "\n"
 #endif /* CONFIG_FUSE */
@@ -114,11 +115,13 @@ static void help(void)
 "  --export [type=]vhost-user-blk,id=<id>,node-name=<node-name>,\n"
 "           addr.type=unix,addr.path=<socket-path>[,writable=on|off]\n"
 "           [,logical-block-size=<block-size>][,num-queues=<num-queues>]\n"
+"           [,iothreads.<n>=<iothread-id>,...]\n"
 "                         export the specified block node as a\n"
 "                         vhost-user-blk device over UNIX domain socket\n"
 "  --export [type=]vhost-user-blk,id=<id>,node-name=<node-name>,\n"
 "           addr.type=fd,addr.str=<fd>[,writable=on|off]\n"
 "           [,logical-block-size=<block-size>][,num-queues=<num-queues>]\n"
+"           [,iothreads.<n>=<iothread-id>,...]\n"
 "                         export the specified block node as a\n"
 "                         vhost-user-blk device over file descriptor\n"
 "\n"
@@ -557,6 +557,11 @@ static void arm_cpu_reset_hold(Object *obj, ResetType type)
                               &env->vfp.fp_status_f16);
     set_float_detect_tininess(float_tininess_before_rounding,
                               &env->vfp.standard_fp_status_f16);
+    /* FP exception traps are not implemented, so FPSR.IXC can be lazy. */
+    set_float_lazy_inexact(true, &env->vfp.fp_status);
+    set_float_lazy_inexact(true, &env->vfp.fp_status_f16);
+    set_float_lazy_inexact(true, &env->vfp.standard_fp_status);
+    set_float_lazy_inexact(true, &env->vfp.standard_fp_status_f16);
 #ifndef CONFIG_USER_ONLY
     if (kvm_enabled()) {
         kvm_arm_reset_vcpu(cpu);
@@ -7133,7 +7133,7 @@ static void x86_cpu_reset_hold(Object *obj, ResetType type)
     }
     cpu_set_fpuc(env, 0x37f);
 
-    env->mxcsr = 0x1f80;
+    cpu_set_mxcsr(env, 0x1f80);
     /* All units are in INIT state.  */
     env->xstate_bv = 0;
 
@@ -105,6 +105,10 @@ static void do_fstt(X86Access *ac, target_ulong ptr, floatx80 f)
 
 /* x87 FPU helpers */
 
+/*
+ * The caller computes with the result on the host FPU, which may raise
+ * inexact.  Fold the flag of the SSE status into MXCSR first.
+ */
 static inline double floatx80_to_double(CPUX86State *env, floatx80 a)
 {
     union {
@@ -112,6 +116,7 @@ static inline double floatx80_to_double(CPUX86State *env, floatx80 a)
         double d;
     } u;
 
+    float_lazy_inexact_sync_thread();
     u.f64 = floatx80_to_float64(a, &env->fp_status);
     return u.d;
 }
@@ -3199,6 +3204,12 @@ void update_mxcsr_status(CPUX86State *env)
 
     /* set flush to zero */
     set_flush_to_zero((mxcsr & SSE_FZ) ? 1 : 0, &env->sse_status);
+
+    /*
+     * Unmasked SIMD exceptions are not implemented, so the precision
+     * flag can be accumulated by the host FPU until MXCSR is read.
+     */
+    set_float_lazy_inexact(true, &env->sse_status);
 }
 
 void update_mxcsr_from_sse_status(CPUX86State *env)
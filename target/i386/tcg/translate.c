@@ -114,6 +114,7 @@ typedef struct DisasContext {
     bool jmp_opt; /* use direct block chaining for direct jumps */
     bool repz_opt; /* optimize jumps within repz instructions */
     bool cc_op_dirty;
+    bool cc_dead_on_entry; /* first insn overwrites flags, see insn_kills_cc */
 
     CCOp cc_op;  /* current CC operation */
     int mem_index; /* select memory access functions */
@@ -175,6 +176,12 @@ typedef struct DisasContext {
  */
 #define DISAS_EOB_RECHECK_TF   DISAS_TARGET_4
 
+/*
+ * EIP has already been updated by a near jump, which leaves CS and
+ * hflags unchanged.  Like DISAS_JUMP, but the target can be cached.
+ */
+#define DISAS_JUMP_NEAR        DISAS_TARGET_5
+
 /* The environment in which user-only runs is constrained. */
 #ifdef CONFIG_USER_ONLY
 #define PE(S)     true
@@ -257,6 +264,7 @@ STUB_HELPER(write_crN, TCGv_env env, TCGv_i32 reg, TCGv val)
 #endif
 
 static void gen_jmp_rel(DisasContext *s, MemOp ot, int diff, int tb_num);
+static bool gen_jmp_rel_kills_cc(DisasContext *s, MemOp ot, int diff);
 static void gen_jmp_rel_csize(DisasContext *s, int diff, int tb_num);
 static void gen_exception_gpf(DisasContext *s);
 
@@ -365,6 +373,18 @@ static void gen_update_cc_op(DisasContext *s)
     }
 }
 
+/*
+ * The flags are dead at the end of the TB, because the next TB overwrites
+ * them before reading them.  Do not store them back to env.
+ */
+static void gen_discard_cc(DisasContext *s)
+{
+    tcg_gen_discard_tl(cpu_cc_dst);
+    tcg_gen_discard_tl(cpu_cc_src);
+    tcg_gen_discard_tl(cpu_cc_src2);
+    tcg_gen_discard_i32(cpu_cc_op);
+}
+
 #ifdef TARGET_X86_64
 
 #define NB_OP_SIZES 4
@@ -1811,10 +1831,75 @@ static void gen_conditional_jump_labels(DisasContext *s, target_long diff,
     gen_jmp_rel(s, s->dflag, diff, 0);
 }
 
+/*
+ * Conditional jump back to the start of a TB that overwrites the flags
+ * before reading them.  The branch would sync the cc globals, so move them
+ * to temporaries and only write them back on the not-taken path.
+ */
+static void gen_jcc_loop(DisasContext *s, int b, int diff)
+{
+    TCGLabel *taken = gen_new_label();
+    CCPrepare cc = gen_prepare_cc(s, b, NULL);
+    TCGv dst = tcg_temp_new();
+    TCGv src = tcg_temp_new();
+    TCGv src2 = tcg_temp_new();
+    int live = cc_op_live[s->cc_op];
+
+    assert(s->cc_op != CC_OP_DYNAMIC);
+    if (live & USES_CC_DST) {
+        tcg_gen_mov_tl(dst, cpu_cc_dst);
+    }
+    if (live & USES_CC_SRC) {
+        tcg_gen_mov_tl(src, cpu_cc_src);
+    }
+    if (live & USES_CC_SRC2) {
+        tcg_gen_mov_tl(src2, cpu_cc_src2);
+    }
+    if (cc.reg == cpu_cc_dst) {
+        cc.reg = dst;
+    } else if (cc.reg == cpu_cc_src) {
+        cc.reg = src;
+    } else if (cc.reg == cpu_cc_src2) {
+        cc.reg = src2;
+    }
+    if (cc.use_reg2) {
+        if (cc.reg2 == cpu_cc_dst) {
+            cc.reg2 = dst;
+        } else if (cc.reg2 == cpu_cc_src) {
+            cc.reg2 = src;
+        } else if (cc.reg2 == cpu_cc_src2) {
+            cc.reg2 = src2;
+        }
+    }
+    gen_discard_cc(s);
+
+    if (cc.use_reg2) {
+        tcg_gen_brcond_tl(cc.cond, cc.reg, cc.reg2, taken);
+    } else {
+        tcg_gen_brcondi_tl(cc.cond, cc.reg, cc.imm, taken);
+    }
+
+    if (live & USES_CC_DST) {
+        tcg_gen_mov_tl(cpu_cc_dst, dst);
+    }
+    if (live & USES_CC_SRC) {
+        tcg_gen_mov_tl(cpu_cc_src, src);
+    }
+    if (live & USES_CC_SRC2) {
+        tcg_gen_mov_tl(cpu_cc_src2, src2);
+    }
+    gen_update_cc_op(s);
+    gen_conditional_jump_labels(s, diff, NULL, taken);
+}
+
 static void gen_jcc(DisasContext *s, int b, int diff)
 {
     TCGLabel *l1 = gen_new_label();
 
+    if (s->cc_op != CC_OP_DYNAMIC && gen_jmp_rel_kills_cc(s, s->dflag, diff)) {
+        gen_jcc_loop(s, b, diff);
+        return;
+    }
     gen_jcc1(s, b, l1);
     gen_conditional_jump_labels(s, diff, NULL, l1);
 }
@@ -2149,10 +2234,20 @@ gen_eob(DisasContext *s, int mode)
         tcg_gen_exit_tb(NULL, 0);
     } else if ((s->flags & HF_TF_MASK) && mode != DISAS_EOB_INHIBIT_IRQ) {
         gen_helper_single_step(tcg_env);
-    } else if (mode == DISAS_JUMP &&
+    } else if ((mode == DISAS_JUMP || mode == DISAS_JUMP_NEAR) &&
                /* give irqs a chance to happen */
                !inhibit_reset) {
-        tcg_gen_lookup_and_goto_ptr();
+        /* bnd_jmp may clear HF_MPX_IU_MASK.  */
+        if (mode == DISAS_JUMP_NEAR && s->jmp_opt &&
+            !(s->flags & HF_MPX_IU_MASK)) {
+            TCGv_i64 pc = tcg_temp_new_i64();
+
+            tcg_gen_addi_tl(s->tmp0, cpu_eip, s->cs_base);
+            tcg_gen_extu_tl_i64(pc, s->tmp0);
+            tcg_gen_lookup_and_goto_ptr_cached(pc);
+        } else {
+            tcg_gen_lookup_and_goto_ptr();
+        }
     } else {
         tcg_gen_exit_tb(NULL, 0);
     }
@@ -2160,9 +2255,41 @@ gen_eob(DisasContext *s, int mode)
     s->base.is_jmp = DISAS_NORETURN;
 }
 
+/*
+ * Return true if the jump to eip+diff is chained directly to the start of
+ * this TB, and the flags are dead there.  The first instruction has been
+ * decoded already, and writing to it would also invalidate this TB.
+ */
+static bool gen_jmp_rel_kills_cc(DisasContext *s, MemOp ot, int diff)
+{
+    target_ulong new_pc = s->pc + diff;
+    target_ulong new_eip = new_pc - s->cs_base;
+
+    if (!s->cc_dead_on_entry || !s->jmp_opt) {
+        return false;
+    }
+    /* Keep in sync with gen_jmp_rel. */
+    if (!CODE64(s)) {
+        target_ulong mask = ot == MO_16 ? 0xffff : 0xffffffff;
+
+        if (ot == MO_16 && (tb_cflags(s->base.tb) & CF_PCREL) && CODE32(s)) {
+            return false;
+        }
+        if ((new_eip & mask) != new_eip) {
+            return false;
+        }
+        if (!(tb_cflags(s->base.tb) & CF_PCREL)) {
+            new_pc = (uint32_t)(new_eip + s->cs_base);
+        }
+    }
+    return new_pc == s->base.pc_first &&
+           translator_use_goto_tb(&s->base, new_pc);
+}
+
 /* Jump to eip+diff, truncating the result to OT. */
 static void gen_jmp_rel(DisasContext *s, MemOp ot, int diff, int tb_num)
 {
+    bool kills_cc = gen_jmp_rel_kills_cc(s, ot, diff);
     bool use_goto_tb = s->jmp_opt;
     target_ulong mask = -1;
     target_ulong new_pc = s->pc + diff;
@@ -2200,6 +2327,9 @@ static void gen_jmp_rel(DisasContext *s, MemOp ot, int diff, int tb_num)
 
     if (use_goto_tb && translator_use_goto_tb(&s->base, new_pc)) {
         /* jump to same page: we can use a direct jump */
+        if (kills_cc) {
+            gen_discard_cc(s);
+        }
         tcg_gen_goto_tb(tb_num);
         if (!(tb_cflags(s->base.tb) & CF_PCREL)) {
             tcg_gen_movi_tl(cpu_eip, new_eip);
@@ -2207,11 +2337,18 @@ static void gen_jmp_rel(DisasContext *s, MemOp ot, int diff, int tb_num)
         tcg_gen_exit_tb(s->base.tb, tb_num);
         s->base.is_jmp = DISAS_NORETURN;
     } else {
+        assert(!kills_cc);
         if (!(tb_cflags(s->base.tb) & CF_PCREL)) {
             tcg_gen_movi_tl(cpu_eip, new_eip);
         }
         if (s->jmp_opt) {
-            gen_eob(s, DISAS_JUMP);   /* jump to another page */
+            /*
+             * Jump to another page.
+             * Exit 1 is always followed by exit 0 of the other path, see
+             * gen_conditional_jump_labels().  Only the last exit of the TB
+             * may use the cached lookup, which takes the unused slots.
+             */
+            gen_eob(s, tb_num == 0 ? DISAS_JUMP_NEAR : DISAS_JUMP);
         } else {
             gen_eob(s, DISAS_EOB_ONLY);  /* exit to main loop */
         }
@@ -3616,6 +3753,7 @@ static void i386_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cpu)
 
     dc->cc_op = CC_OP_DYNAMIC;
     dc->cc_op_dirty = false;
+    dc->cc_dead_on_entry = false;
     /* select memory access functions */
     dc->mem_index = cpu_mmu_index(cpu, false);
     dc->cpuid_features = env->features[FEAT_1_EDX];
@@ -3763,6 +3901,7 @@ static void i386_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
     case DISAS_EOB_ONLY:
     case DISAS_EOB_RECHECK_TF:
     case DISAS_JUMP:
+    case DISAS_JUMP_NEAR:
         gen_eob(dc, dc->base.is_jmp);
         break;
     default:
@@ -25,11 +25,34 @@
 #include "exec/cpu_ldst.h"
 #include "tcg/helper-tcg.h"
 #include "tcg/seg_helper.h"
+#ifdef CONFIG_LINUX_USER
+#include "linux-user/qemu.h"
+#include "linux-user/user-internals.h"
+#endif
 
 void helper_syscall(CPUX86State *env, int next_eip_addend)
 {
     CPUState *cs = env_cpu(env);
 
+#if defined(CONFIG_LINUX_USER) && defined(TARGET_X86_64)
+    abi_long ret;
+
+    /*
+     * Simple system calls need nothing from the CPU loop, so issue them
+     * without leaving the TB.  The translator expects the flags to be
+     * in CC_OP_EFLAGS form after the call in 64-bit mode.
+     */
+    if ((env->hflags & HF_LMA_MASK) &&
+        do_syscall_passthrough(env, env->regs[R_EAX], env->regs[R_EDI],
+                               env->regs[R_ESI], &ret)) {
+        get_task_state(cs)->orig_ax = env->regs[R_EAX];
+        env->regs[R_EAX] = ret;
+        env->eip += next_eip_addend;
+        cpu_load_eflags(env, cpu_compute_eflags(env), 0);
+        return;
+    }
+#endif
+
     cs->exception_index = EXCP_SYSCALL;
     env->exception_is_int = 0;
     env->exception_next_eip = env->eip + next_eip_addend;
@@ -318,6 +318,15 @@ void tcg_gen_mb(TCGBar mb_type)
     }
 }
 
+/*
+ * Unlike tcg_gen_mb, never elide the barrier: it orders accesses to host
+ * memory that other host threads read even when a single vcpu runs.
+ */
+void tcg_gen_host_mb(TCGBar mb_type)
+{
+    tcg_gen_op1(INDEX_op_mb, mb_type);
+}
+
 void tcg_gen_plugin_cb(unsigned from)
 {
     tcg_gen_op1(INDEX_op_plugin_cb, from);
@@ -3310,11 +3319,9 @@ void tcg_gen_exit_tb(const TranslationBlock *tb, unsigned idx)
     if (tb == NULL) {
         tcg_debug_assert(idx == 0);
     } else if (idx <= TB_EXIT_IDXMAX) {
-#ifdef CONFIG_DEBUG_TCG
         /* This is an exit following a goto_tb.  Verify that we have
            seen this numbered exit before, via tcg_gen_goto_tb.  */
         tcg_debug_assert(tcg_ctx->goto_tb_issue_mask & (1 << idx));
-#endif
     } else {
         /* This is an exit via the exitreq label.  */
         tcg_debug_assert(idx == TB_EXIT_REQUESTED);
@@ -3329,11 +3336,9 @@ void tcg_gen_goto_tb(unsigned idx)
     tcg_debug_assert(!(tcg_ctx->gen_tb->cflags & CF_NO_GOTO_TB));
     /* We only support two chained exits.  */
     tcg_debug_assert(idx <= TB_EXIT_IDXMAX);
-#ifdef CONFIG_DEBUG_TCG
     /* Verify that we haven't seen this numbered exit before.  */
     tcg_debug_assert((tcg_ctx->goto_tb_issue_mask & (1 << idx)) == 0);
     tcg_ctx->goto_tb_issue_mask |= 1 << idx;
-#endif
     plugin_gen_disable_mem_helpers();
     tcg_gen_op1i(INDEX_op_goto_tb, idx);
 }
@@ -3353,3 +3358,74 @@ void tcg_gen_lookup_and_goto_ptr(void)
     tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
     tcg_temp_free_ptr(ptr);
 }
+
+void tcg_gen_lookup_and_goto_ptr_cached(TCGv_i64 pc)
+{
+    TranslationBlock *tb = tcg_ctx->gen_tb;
+    int slots = ~tcg_ctx->goto_tb_issue_mask & MAKE_64BIT_MASK(0, 2);
+    TCGv_ptr tbp;
+    TCGv_i64 t0, t1;
+    int n;
+
+    if (!slots || (tb->cflags & (CF_NO_GOTO_TB | CF_NO_GOTO_PTR))) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+#ifndef CONFIG_USER_ONLY
+    /* The same TB may run at different virtual addresses. */
+    if (tb->cflags & CF_PCREL) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+#endif
+
+    tbp = tcg_constant_ptr(tb);
+    t0 = tcg_temp_ebb_new_i64();
+    t1 = tcg_temp_ebb_new_i64();
+
+    /*
+     * Each free slot caches one target pc, stored both as is and
+     * complemented.  A slot matches if both words match, so that a
+     * slot that is being claimed never matches a different pc.
+     */
+    for (n = 0; n <= TB_EXIT_IDXMAX; n++) {
+        TCGLabel *miss;
+
+        if (!(slots & (1 << n))) {
+            continue;
+        }
+        miss = gen_new_label();
+        tcg_gen_ld_i64(t0, tbp, offsetof(TranslationBlock, jmp_ind_pc[n][0]));
+        tcg_gen_ld_i64(t1, tbp, offsetof(TranslationBlock, jmp_ind_pc[n][1]));
+        tcg_gen_xor_i64(t0, t0, pc);
+        tcg_gen_eqv_i64(t1, t1, pc);
+        tcg_gen_or_i64(t0, t0, t1);
+        tcg_gen_brcondi_i64(TCG_COND_NE, t0, 0, miss);
+        tcg_gen_goto_tb(n);
+        tcg_gen_exit_tb(tb, n);
+        gen_set_label(miss);
+        tcg_ctx->goto_tb_ind_mask |= 1 << n;
+    }
+
+    /*
+     * Let the main loop claim and link any slot that is still unused.
+     * Slots that it cannot link are disabled rather than left unused, so
+     * the lookup below takes over for them.
+     */
+    for (n = 0; n <= TB_EXIT_IDXMAX; n++) {
+        TCGLabel *next;
+
+        if (!(slots & (1 << n))) {
+            continue;
+        }
+        next = gen_new_label();
+        tcg_gen_ld_i64(t1, tbp, offsetof(TranslationBlock, jmp_ind_pc[n][1]));
+        tcg_gen_brcondi_i64(TCG_COND_NE, t1, 0, next);
+        tcg_gen_exit_tb(tb, n);
+        gen_set_label(next);
+    }
+    tcg_temp_free_i64(t0);
+    tcg_temp_free_i64(t1);
+
+    tcg_gen_lookup_and_goto_ptr();
+}
@@ -1502,9 +1502,8 @@ void tcg_func_start(TCGContext *s)
     s->nb_labels = 0;
     s->current_frame_offset = s->frame_start;
 
-#ifdef CONFIG_DEBUG_TCG
     s->goto_tb_issue_mask = 0;
-#endif
+    s->goto_tb_ind_mask = 0;
 
     QTAILQ_INIT(&s->ops);
     QTAILQ_INIT(&s->free_ops);
@@ -2415,6 +2414,8 @@ static void tcg_reg_alloc_start(TCGContext *s)
     }
 
     memset(s->reg_to_temp, 0, sizeof(s->reg_to_temp));
+    s->nb_spills = 0;
+    s->nb_fills = 0;
 }
 
 static char *tcg_get_arg_str_ptr(TCGContext *s, char *buf, int buf_size,
@@ -4281,6 +4282,7 @@ static void temp_sync(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs,
         case TEMP_VAL_REG:
             tcg_out_st(s, ts->type, ts->reg,
                        ts->mem_base->reg, ts->mem_offset);
+            s->nb_spills++;
             break;
 
         case TEMP_VAL_MEM:
@@ -4465,6 +4467,7 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
                             preferred_regs, ts->indirect_base);
         tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
         ts->mem_coherent = 1;
+        s->nb_fills++;
         break;
     case TEMP_VAL_DEAD:
     default:
@@ -4509,6 +4512,77 @@ static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * At a conditional branch to a label with no other branches to it,
+ * record which registers hold globals and TB temps.  All of them are
+ * synced, so if the label is reached only via this branch, the code
+ * after the label can keep using them instead of reloading from memory.
+ */
+static void tcg_reg_alloc_record_branch(TCGContext *s, const TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    TCGLabel *l = arg_label(op->args[def->nb_oargs + def->nb_iargs
+                                     + def->nb_cargs - 1]);
+    TCGLabelUse *u = QSIMPLEQ_FIRST(&l->branches);
+    bool any = false;
+
+    if (l->has_value || !u || u->op != op || QSIMPLEQ_NEXT(u, next)) {
+        return;
+    }
+
+    l->reg_to_temp = tcg_malloc(sizeof(s->reg_to_temp));
+    for (int i = 0; i < TCG_TARGET_NB_REGS; i++) {
+        TCGTemp *ts = s->reg_to_temp[i];
+
+        if (ts
+            && (ts->kind == TEMP_GLOBAL || ts->kind == TEMP_TB)
+            && !ts->indirect_reg) {
+            tcg_debug_assert(ts->val_type == TEMP_VAL_REG && ts->reg == i);
+            tcg_debug_assert(ts->mem_coherent);
+            l->reg_to_temp[i] = ts;
+            any = true;
+        } else {
+            l->reg_to_temp[i] = NULL;
+        }
+    }
+    if (!any) {
+        l->reg_to_temp = NULL;
+    }
+}
+
+/*
+ * At a label that cannot be reached by falling through from the previous
+ * op, restore the register contents recorded at the only branch to it.
+ * Must be called after tcg_reg_alloc_bb_end, with all values in memory.
+ */
+static void tcg_reg_alloc_label(TCGContext *s, TCGOp *op)
+{
+    TCGLabel *l = arg_label(op->args[0]);
+    TCGOp *prev = QTAILQ_PREV(op, link);
+
+    if (!l->reg_to_temp || !prev) {
+        return;
+    }
+    switch (prev->opc) {
+    case INDEX_op_br:
+    case INDEX_op_exit_tb:
+    case INDEX_op_goto_ptr:
+        break;
+    default:
+        return;
+    }
+
+    for (int i = 0; i < TCG_TARGET_NB_REGS; i++) {
+        TCGTemp *ts = l->reg_to_temp[i];
+
+        if (ts) {
+            tcg_debug_assert(ts->val_type == TEMP_VAL_MEM);
+            set_temp_val_reg(s, ts, i);
+            ts->mem_coherent = 1;
+        }
+    }
+}
+
 /* at the end of a basic block, we assume all temporaries are dead and
    all globals are stored at their canonical location. */
 static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
@@ -4640,6 +4714,7 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOp *op)
             temp_allocate_frame(s, ots);
         }
         tcg_out_st(s, otype, ireg, ots->mem_base->reg, ots->mem_offset);
+        s->nb_spills++;
         if (IS_DEAD_ARG(1)) {
             temp_dead(s, ts);
         }
@@ -5058,6 +5133,7 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
 
     if (def->flags & TCG_OPF_COND_BRANCH) {
         tcg_reg_alloc_cbranch(s, i_allocated_regs);
+        tcg_reg_alloc_record_branch(s, op);
     } else if (def->flags & TCG_OPF_BB_END) {
         tcg_reg_alloc_bb_end(s, i_allocated_regs);
     } else {
@@ -6161,6 +6237,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     tb->jmp_reset_offset[1] = TB_JMP_OFFSET_INVALID;
     tb->jmp_insn_offset[0] = TB_JMP_OFFSET_INVALID;
     tb->jmp_insn_offset[1] = TB_JMP_OFFSET_INVALID;
+    tb->jmp_ind_mask = s->goto_tb_ind_mask;
 
     tcg_reg_alloc_start(s);
 
@@ -6217,6 +6294,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
             break;
         case INDEX_op_set_label:
             tcg_reg_alloc_bb_end(s, s->reserved_regs);
+            tcg_reg_alloc_label(s, op);
             tcg_out_label(s, arg_label(op->args[0]));
             break;
         case INDEX_op_call:
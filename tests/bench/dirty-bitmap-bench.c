@@ -0,0 +1,132 @@
+/*
+ * QEMU dirty bitmap update speed benchmark
+ *
+ * Measures bdrv_set_dirty() throughput when several threads write to the
+ * same node, which is what iothreads serving a multiqueue device do.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/thread.h"
+#include "qemu/main-loop.h"
+#include "qapi/error.h"
+#include "block/block.h"
+#include "block/block_int.h"
+#include "block/dirty-bitmap.h"
+
+#define DISK_SIZE       (1 * GiB)
+#define REQUEST_SIZE    (4 * KiB)
+#define MAX_THREADS     8
+
+typedef struct {
+    unsigned nb_threads;
+    unsigned nb_bitmaps;
+    /* Bytes of the disk each thread keeps rewriting */
+    int64_t working_set;
+} DirtyBitmapBenchOpts;
+
+typedef struct {
+    QemuThread thread;
+    BlockDriverState *bs;
+    int64_t start;
+    int64_t working_set;
+    uint64_t ops;
+} DirtyBitmapBenchThread;
+
+static bool stop;
+
+static void *bench_thread(void *opaque)
+{
+    DirtyBitmapBenchThread *t = opaque;
+    int64_t offset = 0;
+
+    while (!qatomic_read(&stop)) {
+        bdrv_set_dirty(t->bs, t->start + offset, REQUEST_SIZE);
+        offset = (offset + REQUEST_SIZE) % t->working_set;
+        t->ops++;
+    }
+    return NULL;
+}
+
+static void test_set_dirty_speed(const void *opaque)
+{
+    const DirtyBitmapBenchOpts *opts = opaque;
+    DirtyBitmapBenchThread threads[MAX_THREADS] = {};
+    BdrvDirtyBitmap *bitmaps[4] = {};
+    BlockDriverState *bs;
+    uint64_t ops = 0;
+    unsigned i;
+
+    g_assert(opts->nb_threads <= MAX_THREADS);
+    g_assert(opts->nb_bitmaps <= ARRAY_SIZE(bitmaps));
+
+    bs = bdrv_open("null-co://", NULL, NULL, BDRV_O_RDWR, &error_abort);
+    for (i = 0; i < opts->nb_bitmaps; i++) {
+        bitmaps[i] = bdrv_create_dirty_bitmap(bs, 64 * KiB, NULL, &error_abort);
+    }
+
+    qatomic_set(&stop, false);
+    g_test_timer_start();
+    for (i = 0; i < opts->nb_threads; i++) {
+        threads[i].bs = bs;
+        threads[i].start = i * (DISK_SIZE / MAX_THREADS);
+        threads[i].working_set = opts->working_set;
+        qemu_thread_create(&threads[i].thread, "dirty-bitmap-bench",
+                           bench_thread, &threads[i], QEMU_THREAD_JOINABLE);
+    }
+
+    g_usleep(G_USEC_PER_SEC / 2);
+    qatomic_set(&stop, true);
+
+    for (i = 0; i < opts->nb_threads; i++) {
+        qemu_thread_join(&threads[i].thread);
+        ops += threads[i].ops;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("set_dirty: %u thread(s) %u bitmap(s) working set %" PRId64
+                   " MB: %.2f Mops/sec", opts->nb_threads, opts->nb_bitmaps,
+                   opts->working_set / MiB, ops / g_test_timer_last() / 1e6);
+
+    for (i = 0; i < opts->nb_bitmaps; i++) {
+        bdrv_release_dirty_bitmap(bitmaps[i]);
+    }
+    bdrv_unref(bs);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned nb_threads[] = { 1, 4 };
+    static const unsigned nb_bitmaps[] = { 0, 1, 4 };
+    static const int64_t working_sets[] = { 1 * MiB, DISK_SIZE / MAX_THREADS };
+    size_t i, j, k;
+
+    g_test_init(&argc, &argv, NULL);
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+
+    for (i = 0; i < ARRAY_SIZE(nb_threads); i++) {
+        for (j = 0; j < ARRAY_SIZE(nb_bitmaps); j++) {
+            for (k = 0; k < ARRAY_SIZE(working_sets); k++) {
+                DirtyBitmapBenchOpts *opts = g_new(DirtyBitmapBenchOpts, 1);
+                char *path;
+
+                opts->nb_threads = nb_threads[i];
+                opts->nb_bitmaps = nb_bitmaps[j];
+                opts->working_set = working_sets[k];
+                path = g_strdup_printf("/dirty-bitmap/set-dirty/%u-threads/"
+                                       "%u-bitmaps/%" PRId64 "M",
+                                       opts->nb_threads, opts->nb_bitmaps,
+                                       opts->working_set / MiB);
+                g_test_add_data_func_full(path, opts, test_set_dirty_speed,
+                                          g_free);
+                g_free(path);
+            }
+        }
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,426 @@
+/*
+ * Guest-less vhost-user-blk client for benchmarking vhost-user-blk exports
+ *
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ *
+ * Connects to a vhost-user-blk socket like a VMM would, sets up the
+ * virtqueues in its own memory and submits random reads (or writes) with a
+ * fixed queue depth on every virtqueue, each from its own thread.  This
+ * measures the throughput of the backend without the overhead of a guest.
+ *
+ * Example, serving four virtqueues in two iothreads:
+ *
+ *   $ qemu-storage-daemon \
+ *       --object iothread,id=iothread0 --object iothread,id=iothread1 \
+ *       --blockdev null-co,node-name=null,size=1G,read-zeroes=on \
+ *       --export vhost-user-blk,id=exp,node-name=null,num-queues=4,\
+ *                addr.type=unix,addr.path=vhost-user-blk.sock,\
+ *                iothreads.0=iothread0,iothreads.1=iothread1 &
+ *   $ vhost-user-blk-bench -q 4 -d 32 -t 10 vhost-user-blk.sock
+ */
+
+#include "qemu/osdep.h"
+#include <sys/eventfd.h>
+#include "qemu/atomic.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/memfd.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/bswap.h"
+#include "qapi/error.h"
+#include "subprojects/libvhost-user/libvhost-user.h" /* only for the type definitions */
+#include "standard-headers/linux/virtio_blk.h"
+#include "standard-headers/linux/virtio_config.h"
+
+#define QUEUE_SIZE 256
+#define DESCS_PER_REQ 3
+
+typedef struct BenchReq {
+    struct virtio_blk_outhdr hdr;
+    uint8_t status;
+} BenchReq;
+
+typedef struct BenchQueue {
+    int index;
+    struct vring vring;
+    uint16_t avail_idx;
+    uint16_t last_used_idx;
+    int kick_fd;
+    int call_fd;
+    BenchReq *reqs;
+    uint8_t *data;
+    GRand *rand;
+    QemuThread thread;
+    uint64_t completed;
+    uint64_t errors;
+} BenchQueue;
+
+static int sock = -1;
+static unsigned num_queues = 1;
+static unsigned depth = 32;
+static unsigned block_size = 4096;
+static unsigned seconds = 10;
+static bool write_reqs;
+static uint64_t num_blocks;
+static int stop;
+
+static void vu_send(VhostUserRequest request, const void *payload,
+                    size_t size, int *fds, int nfds)
+{
+    VhostUserMsg msg = {
+        .request = request,
+        .flags = 1, /* version */
+        .size = size,
+    };
+    struct iovec iov[2] = {
+        { .iov_base = &msg, .iov_len = VHOST_USER_HDR_SIZE },
+        { .iov_base = (void *)payload, .iov_len = size },
+    };
+    char control[CMSG_SPACE(sizeof(int) * VHOST_MEMORY_BASELINE_NREGIONS)];
+    struct msghdr mh = {
+        .msg_iov = iov,
+        .msg_iovlen = size ? 2 : 1,
+    };
+
+    if (nfds) {
+        struct cmsghdr *cmsg;
+
+        memset(control, 0, sizeof(control));
+        mh.msg_control = control;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    if (sendmsg(sock, &mh, 0) != VHOST_USER_HDR_SIZE + size) {
+        error_report("Failed to send vhost-user message %d: %s",
+                     request, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void vu_recv(VhostUserRequest request, void *payload, size_t size)
+{
+    VhostUserMsg msg;
+
+    if (recv(sock, &msg, VHOST_USER_HDR_SIZE, MSG_WAITALL) !=
+            VHOST_USER_HDR_SIZE ||
+        msg.request != request || msg.size != size ||
+        recv(sock, payload, size, MSG_WAITALL) != size) {
+        error_report("Invalid reply to vhost-user message %d", request);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t vu_get_u64(VhostUserRequest request)
+{
+    uint64_t val;
+
+    vu_send(request, NULL, 0, NULL, 0);
+    vu_recv(request, &val, sizeof(val));
+    return val;
+}
+
+static void vu_set_u64(VhostUserRequest request, uint64_t val, int fd)
+{
+    vu_send(request, &val, sizeof(val), &fd, fd >= 0);
+}
+
+static void vu_set_state(VhostUserRequest request, unsigned index,
+                         unsigned num)
+{
+    struct vhost_vring_state state = { .index = index, .num = num };
+
+    vu_send(request, &state, sizeof(state), NULL, 0);
+}
+
+static void submit_req(BenchQueue *q, unsigned slot)
+{
+    BenchReq *req = &q->reqs[slot];
+    uint16_t head = slot * DESCS_PER_REQ;
+    uint64_t block = ((uint64_t)g_rand_int(q->rand) << 32 |
+                      g_rand_int(q->rand)) % num_blocks;
+
+    req->hdr.type = cpu_to_le32(write_reqs ? VIRTIO_BLK_T_OUT :
+                                             VIRTIO_BLK_T_IN);
+    req->hdr.sector = cpu_to_le64(block * (block_size / 512));
+    req->status = 0xff;
+
+    q->vring.avail->ring[q->avail_idx % QUEUE_SIZE] = cpu_to_le16(head);
+    q->avail_idx++;
+}
+
+static void publish_and_kick(BenchQueue *q)
+{
+    uint64_t one = 1;
+
+    qatomic_store_release(&q->vring.avail->idx, cpu_to_le16(q->avail_idx));
+    smp_mb();
+    if (!(le16_to_cpu(qatomic_read(&q->vring.used->flags)) &
+          VRING_USED_F_NO_NOTIFY)) {
+        if (write(q->kick_fd, &one, sizeof(one)) != sizeof(one)) {
+            error_report("Failed to kick virtqueue %d", q->index);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void *queue_thread(void *opaque)
+{
+    BenchQueue *q = opaque;
+    unsigned in_flight = 0;
+    unsigned i;
+
+    for (i = 0; i < depth; i++) {
+        submit_req(q, i);
+        in_flight++;
+    }
+    publish_and_kick(q);
+
+    while (in_flight) {
+        bool stopping = qatomic_read(&stop);
+        uint16_t used_idx;
+        uint64_t val;
+        bool resubmitted = false;
+
+        if (read(q->call_fd, &val, sizeof(val)) != sizeof(val) &&
+            errno != EINTR) {
+            error_report("Failed to wait for virtqueue %d", q->index);
+            exit(EXIT_FAILURE);
+        }
+
+        used_idx = le16_to_cpu(qatomic_load_acquire(&q->vring.used->idx));
+        while (q->last_used_idx != used_idx) {
+            struct vring_used_elem *e =
+                &q->vring.used->ring[q->last_used_idx % QUEUE_SIZE];
+            unsigned slot = le32_to_cpu(e->id) / DESCS_PER_REQ;
+
+            q->last_used_idx++;
+            in_flight--;
+            if (q->reqs[slot].status == VIRTIO_BLK_S_OK) {
+                q->completed++;
+            } else {
+                q->errors++;
+            }
+
+            if (!stopping) {
+                submit_req(q, slot);
+                in_flight++;
+                resubmitted = true;
+            }
+        }
+        if (resubmitted) {
+            publish_and_kick(q);
+        }
+    }
+    return NULL;
+}
+
+/* Lay out the rings and buffers of @q in @mem, return the size used */
+static size_t init_queue(BenchQueue *q, uint8_t *mem)
+{
+    size_t ring_size = ROUND_UP(vring_size(QUEUE_SIZE, 4096),
+                                qemu_real_host_page_size());
+    size_t reqs_size = ROUND_UP(depth * sizeof(BenchReq),
+                                qemu_real_host_page_size());
+    unsigned i;
+
+    if (!mem) {
+        return ring_size + reqs_size + (size_t)depth * block_size;
+    }
+
+    vring_init(&q->vring, QUEUE_SIZE, mem, 4096);
+    q->reqs = (BenchReq *)(mem + ring_size);
+    q->data = mem + ring_size + reqs_size;
+
+    for (i = 0; i < depth; i++) {
+        struct vring_desc *d = &q->vring.desc[i * DESCS_PER_REQ];
+
+        d[0].addr = cpu_to_le64((uintptr_t)&q->reqs[i].hdr);
+        d[0].len = cpu_to_le32(sizeof(q->reqs[i].hdr));
+        d[0].flags = cpu_to_le16(VRING_DESC_F_NEXT);
+        d[0].next = cpu_to_le16(i * DESCS_PER_REQ + 1);
+        d[1].addr = cpu_to_le64((uintptr_t)(q->data + (size_t)i * block_size));
+        d[1].len = cpu_to_le32(block_size);
+        d[1].flags = cpu_to_le16(VRING_DESC_F_NEXT |
+                                 (write_reqs ? 0 : VRING_DESC_F_WRITE));
+        d[1].next = cpu_to_le16(i * DESCS_PER_REQ + 2);
+        d[2].addr = cpu_to_le64((uintptr_t)&q->reqs[i].status);
+        d[2].len = cpu_to_le32(1);
+        d[2].flags = cpu_to_le16(VRING_DESC_F_WRITE);
+    }
+
+    q->kick_fd = eventfd(0, EFD_CLOEXEC);
+    q->call_fd = eventfd(0, EFD_CLOEXEC);
+    if (q->kick_fd < 0 || q->call_fd < 0) {
+        error_report("Failed to create eventfds: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    q->rand = g_rand_new_with_seed(q->index);
+
+    return ring_size + reqs_size + (size_t)depth * block_size;
+}
+
+static void start_queue(BenchQueue *q)
+{
+    struct vhost_vring_addr addr = {
+        .index = q->index,
+        .desc_user_addr = (uintptr_t)q->vring.desc,
+        .avail_user_addr = (uintptr_t)q->vring.avail,
+        .used_user_addr = (uintptr_t)q->vring.used,
+    };
+
+    vu_set_state(VHOST_USER_SET_VRING_NUM, q->index, QUEUE_SIZE);
+    vu_set_state(VHOST_USER_SET_VRING_BASE, q->index, 0);
+    vu_send(VHOST_USER_SET_VRING_ADDR, &addr, sizeof(addr), NULL, 0);
+    vu_set_u64(VHOST_USER_SET_VRING_CALL, q->index, q->call_fd);
+    vu_set_u64(VHOST_USER_SET_VRING_KICK, q->index, q->kick_fd);
+    vu_set_state(VHOST_USER_SET_VRING_ENABLE, q->index, 1);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-q queues] [-d depth] [-b block-size] [-t seconds] "
+           "[-w] SOCKET\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct virtio_blk_config *blkcfg;
+    VhostUserMemory mem = { .nregions = 1 };
+    VhostUserConfig cfg = {
+        .size = sizeof(struct virtio_blk_config),
+    };
+    g_autofree BenchQueue *queues = NULL;
+    uint64_t total = 0, errors = 0;
+    uint64_t features;
+    size_t mem_size = 0;
+    uint8_t *buf, *p;
+    int64_t start, elapsed;
+    int mem_fd, opt;
+    unsigned i;
+
+    while ((opt = getopt(argc, argv, "q:d:b:t:wh")) != -1) {
+        switch (opt) {
+        case 'q':
+            num_queues = atoi(optarg);
+            break;
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 'b':
+            block_size = atoi(optarg);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'w':
+            write_reqs = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1 || !num_queues || !depth ||
+        depth * DESCS_PER_REQ > QUEUE_SIZE ||
+        !block_size || block_size % 512) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    pstrcpy(addr.sun_path, sizeof(addr.sun_path), argv[optind]);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+        error_report("Failed to connect to %s: %s", argv[optind],
+                     strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* Negotiate features, no event index or indirect descriptors */
+    features = vu_get_u64(VHOST_USER_GET_FEATURES);
+    if (!(features & (1ULL << VHOST_USER_F_PROTOCOL_FEATURES)) ||
+        !(features & (1ULL << VIRTIO_BLK_F_MQ))) {
+        error_report("The backend does not support multiqueue");
+        return EXIT_FAILURE;
+    }
+    vu_set_u64(VHOST_USER_SET_FEATURES,
+               features & (1ULL << VIRTIO_F_VERSION_1 |
+                           1ULL << VIRTIO_BLK_F_MQ |
+                           1ULL << VIRTIO_BLK_F_FLUSH |
+                           1ULL << VHOST_USER_F_PROTOCOL_FEATURES), -1);
+    vu_set_u64(VHOST_USER_SET_PROTOCOL_FEATURES,
+               vu_get_u64(VHOST_USER_GET_PROTOCOL_FEATURES) &
+               (1ULL << VHOST_USER_PROTOCOL_F_CONFIG), -1);
+    vu_send(VHOST_USER_SET_OWNER, NULL, 0, NULL, 0);
+
+    vu_send(VHOST_USER_GET_CONFIG, &cfg, VHOST_USER_CONFIG_HDR_SIZE + cfg.size,
+            NULL, 0);
+    vu_recv(VHOST_USER_GET_CONFIG, &cfg, VHOST_USER_CONFIG_HDR_SIZE + cfg.size);
+    blkcfg = (struct virtio_blk_config *)cfg.region;
+    num_blocks = le64_to_cpu(blkcfg->capacity) * 512 / block_size;
+    if (num_queues > le16_to_cpu(blkcfg->num_queues) || !num_blocks) {
+        error_report("The backend has %u virtqueues and %" PRIu64 " blocks",
+                     le16_to_cpu(blkcfg->num_queues), num_blocks);
+        return EXIT_FAILURE;
+    }
+
+    /* Guest physical addresses are identical to our virtual addresses */
+    queues = g_new0(BenchQueue, num_queues);
+    for (i = 0; i < num_queues; i++) {
+        queues[i].index = i;
+        mem_size += init_queue(&queues[i], NULL);
+    }
+    buf = qemu_memfd_alloc("vhost-user-blk-bench", mem_size, 0, &mem_fd,
+                           &error_fatal);
+    for (p = buf, i = 0; i < num_queues; i++) {
+        p += init_queue(&queues[i], p);
+    }
+
+    mem.regions[0] = (VhostUserMemoryRegion) {
+        .guest_phys_addr = (uintptr_t)buf,
+        .memory_size = mem_size,
+        .userspace_addr = (uintptr_t)buf,
+    };
+    vu_send(VHOST_USER_SET_MEM_TABLE, &mem,
+            offsetof(VhostUserMemory, regions[1]), &mem_fd, 1);
+
+    for (i = 0; i < num_queues; i++) {
+        start_queue(&queues[i]);
+    }
+    /* Wait for the backend to process the messages above */
+    vu_get_u64(VHOST_USER_GET_FEATURES);
+
+    start = get_clock();
+    for (i = 0; i < num_queues; i++) {
+        qemu_thread_create(&queues[i].thread, "queue", queue_thread,
+                           &queues[i], QEMU_THREAD_JOINABLE);
+    }
+    sleep(seconds);
+    qatomic_set(&stop, 1);
+    for (i = 0; i < num_queues; i++) {
+        qemu_thread_join(&queues[i].thread);
+    }
+    elapsed = get_clock() - start;
+
+    for (i = 0; i < num_queues; i++) {
+        printf("queue %u: %.0f IOPS\n", i,
+               queues[i].completed * 1e9 / elapsed);
+        total += queues[i].completed;
+        errors += queues[i].errors;
+    }
+    printf("total: %.0f IOPS, %.1f MiB/s, %" PRIu64 " errors\n",
+           total * 1e9 / elapsed,
+           total * block_size * 1e9 / elapsed / (1024 * 1024), errors);
+
+    close(sock);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
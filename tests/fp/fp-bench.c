@@ -34,6 +34,12 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_TO_INT32,
+    OP_TO_INT64,
+    OP_ROUND_TO_INT,
+    OP_MIN,
+    OP_MAX,
+    OP_CVT,
     OP_MAX_NR,
 };
 
@@ -45,6 +51,12 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_TO_INT32] = "to_int32",
+    [OP_TO_INT64] = "to_int64",
+    [OP_ROUND_TO_INT] = "round_to_int",
+    [OP_MIN] = "min",
+    [OP_MAX] = "max",
+    [OP_CVT] = "cvt",
     [OP_MAX_NR] = NULL,
 };
 
@@ -75,6 +87,14 @@ static const char * const round_names[] = {
     [ROUND_TIEAWAY] = "tieaway",
 };
 
+/* Constraints on the random inputs */
+enum input {
+    INPUT_ANY,
+    INPUT_NO_NEG,
+    /* Magnitude in [1, 2^31), so that conversions to int32 fit */
+    INPUT_INT,
+};
+
 enum tester {
     TESTER_SOFT,
     TESTER_HOST,
@@ -122,6 +142,7 @@ static float128 random_quad_ops[MAX_OPERANDS] = {
     {SEED_A, SEED_B}, {SEED_B, SEED_C}, {SEED_C, SEED_A},
 };
 static float_status soft_status;
+static bool clear_flags;
 static enum precision precision;
 static enum op operation;
 static enum tester tester;
@@ -192,29 +213,51 @@ static void update_random_ops(int n_ops, enum precision prec)
 }
 
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        enum input input)
 {
+    bool no_neg = input == INPUT_NO_NEG;
     int i;
 
     for (i = 0; i < n_ops; i++) {
         switch (prec) {
         case PREC_SINGLE:
         case PREC_FLOAT32:
-            ops[i].f32 = make_float32(random_ops[i]);
+        {
+            uint32_t r = random_ops[i];
+
+            if (input == INPUT_INT) {
+                r = (r & 0x807fffff) | ((127 + (r >> 23) % 31) << 23);
+            }
+            ops[i].f32 = make_float32(r);
             if (no_neg && float32_is_neg(ops[i].f32)) {
                 ops[i].f32 = float32_chs(ops[i].f32);
             }
             break;
+        }
         case PREC_DOUBLE:
         case PREC_FLOAT64:
-            ops[i].f64 = make_float64(random_ops[i]);
+        {
+            uint64_t r = random_ops[i];
+
+            if (input == INPUT_INT) {
+                r = (r & 0x800fffffffffffffULL) |
+                    ((1023 + (r >> 52) % 31) << 52);
+            }
+            ops[i].f64 = make_float64(r);
             if (no_neg && float64_is_neg(ops[i].f64)) {
                 ops[i].f64 = float64_chs(ops[i].f64);
             }
             break;
+        }
         case PREC_QUAD:
         case PREC_FLOAT128:
             ops[i].f128 = random_quad_ops[i];
+            if (input == INPUT_INT) {
+                uint64_t hi = ops[i].f128.high;
+
+                ops[i].f128.high = (hi & 0x8000ffffffffffffULL) |
+                                   ((16383 + (hi >> 48) % 31) << 48);
+            }
             if (no_neg && float128_is_neg(ops[i].f128)) {
                 ops[i].f128 = float128_chs(ops[i].f128);
             }
@@ -229,7 +272,8 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
  * The main benchmark function. Instead of (ab)using macros, we rely
  * on the compiler to unfold this at compile-time.
  */
-static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
+static void bench(enum precision prec, enum op op, int n_ops,
+                  enum input input)
 {
     int64_t tf = get_clock() + duration * 1000000000LL;
 
@@ -241,7 +285,7 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
         update_random_ops(n_ops, prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, input);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -270,13 +314,31 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_TO_INT32:
+                    res.u64 = (int32_t)lrintf(a);
+                    break;
+                case OP_TO_INT64:
+                    res.u64 = llrintf(a);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.f = rintf(a);
+                    break;
+                case OP_MIN:
+                    res.f = fminf(a, b);
+                    break;
+                case OP_MAX:
+                    res.f = fmaxf(a, b);
+                    break;
+                case OP_CVT:
+                    res.d = a;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, input);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -305,19 +367,40 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_TO_INT32:
+                    res.u64 = (int32_t)lrint(a);
+                    break;
+                case OP_TO_INT64:
+                    res.u64 = llrint(a);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.d = rint(a);
+                    break;
+                case OP_MIN:
+                    res.d = fmin(a, b);
+                    break;
+                case OP_MAX:
+                    res.d = fmax(a, b);
+                    break;
+                case OP_CVT:
+                    res.f = a;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, input);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
                 float32 b = ops[1].f32;
                 float32 c = ops[2].f32;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f32 = float32_add(a, b, &soft_status);
@@ -340,19 +423,40 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT32:
+                    res.u64 = float32_to_int32(a, &soft_status);
+                    break;
+                case OP_TO_INT64:
+                    res.u64 = float32_to_int64(a, &soft_status);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.f32 = float32_round_to_int(a, &soft_status);
+                    break;
+                case OP_MIN:
+                    res.f32 = float32_minnum(a, b, &soft_status);
+                    break;
+                case OP_MAX:
+                    res.f32 = float32_maxnum(a, b, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f64 = float32_to_float64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, input);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
                 float64 b = ops[1].f64;
                 float64 c = ops[2].f64;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f64 = float64_add(a, b, &soft_status);
@@ -375,19 +479,40 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT32:
+                    res.u64 = float64_to_int32(a, &soft_status);
+                    break;
+                case OP_TO_INT64:
+                    res.u64 = float64_to_int64(a, &soft_status);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.f64 = float64_round_to_int(a, &soft_status);
+                    break;
+                case OP_MIN:
+                    res.f64 = float64_minnum(a, b, &soft_status);
+                    break;
+                case OP_MAX:
+                    res.f64 = float64_maxnum(a, b, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f32 = float64_to_float32(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT128:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, input);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float128 a = ops[0].f128;
                 float128 b = ops[1].f128;
                 float128 c = ops[2].f128;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f128 = float128_add(a, b, &soft_status);
@@ -410,6 +535,24 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float128_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT32:
+                    res.u64 = float128_to_int32(a, &soft_status);
+                    break;
+                case OP_TO_INT64:
+                    res.u64 = float128_to_int64(a, &soft_status);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.f128 = float128_round_to_int(a, &soft_status);
+                    break;
+                case OP_MIN:
+                    res.f128 = float128_minnum(a, b, &soft_status);
+                    break;
+                case OP_MAX:
+                    res.f128 = float128_maxnum(a, b, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f64 = float128_to_float64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -426,13 +569,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
 #define GEN_BENCH(name, type, prec, op, n_ops)          \
     static void __attribute__((flatten)) name(void)     \
     {                                                   \
-        bench(prec, op, n_ops, false);                  \
+        bench(prec, op, n_ops, INPUT_ANY);              \
     }
 
 #define GEN_BENCH_NO_NEG(name, type, prec, op, n_ops)   \
     static void __attribute__((flatten)) name(void)     \
     {                                                   \
-        bench(prec, op, n_ops, true);                   \
+        bench(prec, op, n_ops, INPUT_NO_NEG);           \
+    }
+
+#define GEN_BENCH_INT(name, type, prec, op, n_ops)      \
+    static void __attribute__((flatten)) name(void)     \
+    {                                                   \
+        bench(prec, op, n_ops, INPUT_INT);              \
     }
 
 #define GEN_BENCH_ALL_TYPES(opname, op, n_ops)                          \
@@ -448,6 +597,9 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(min, OP_MIN, 2)
+GEN_BENCH_ALL_TYPES(max, OP_MAX, 2)
+GEN_BENCH_ALL_TYPES(cvt, OP_CVT, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -460,6 +612,19 @@ GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
 GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
 #undef GEN_BENCH_ALL_TYPES_NO_NEG
 
+#define GEN_BENCH_ALL_TYPES_INT(name, op, n)                            \
+    GEN_BENCH_INT(bench_ ## name ## _float, float, PREC_SINGLE, op, n)   \
+    GEN_BENCH_INT(bench_ ## name ## _double, double, PREC_DOUBLE, op, n) \
+    GEN_BENCH_INT(bench_ ## name ## _float32, float32, PREC_FLOAT32, op, n) \
+    GEN_BENCH_INT(bench_ ## name ## _float64, float64, PREC_FLOAT64, op, n) \
+    GEN_BENCH_INT(bench_ ## name ## _float128, float128, PREC_FLOAT128, op, n)
+
+GEN_BENCH_ALL_TYPES_INT(to_int32, OP_TO_INT32, 1)
+GEN_BENCH_ALL_TYPES_INT(to_int64, OP_TO_INT64, 1)
+GEN_BENCH_ALL_TYPES_INT(round_to_int, OP_ROUND_TO_INT, 1)
+#undef GEN_BENCH_ALL_TYPES_INT
+
+#undef GEN_BENCH_INT
 #undef GEN_BENCH_NO_NEG
 #undef GEN_BENCH
 
@@ -480,6 +645,12 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(to_int32, OP_TO_INT32),
+    GEN_BENCH_FUNCS(to_int64, OP_TO_INT64),
+    GEN_BENCH_FUNCS(round_to_int, OP_ROUND_TO_INT),
+    GEN_BENCH_FUNCS(min, OP_MIN),
+    GEN_BENCH_FUNCS(max, OP_MAX),
+    GEN_BENCH_FUNCS(cvt, OP_CVT),
 };
 
 #undef GEN_BENCH_FUNCS
@@ -515,6 +686,9 @@ static void usage_complete(int argc, char *argv[])
     fprintf(stderr, "options:\n");
     fprintf(stderr, " -d = duration, in seconds. Default: %d\n",
             DEFAULT_DURATION_SECS);
+    fprintf(stderr, " -e = clear the exception flags before each operation "
+            "(soft tester only), like targets that compute them for every "
+            "instruction. Default: disabled\n");
     fprintf(stderr, " -h = show this help message.\n");
     fprintf(stderr, " -o = floating point operation (%s). Default: %s\n",
             op_list, op_names[0]);
@@ -615,7 +789,7 @@ static void parse_args(int argc, char *argv[])
     int rounding = ROUND_EVEN;
 
     for (;;) {
-        c = getopt(argc, argv, "d:ho:p:r:t:zZ");
+        c = getopt(argc, argv, "d:eho:p:r:t:zZ");
         if (c < 0) {
             break;
         }
@@ -623,6 +797,9 @@ static void parse_args(int argc, char *argv[])
         case 'd':
             duration = atoi(optarg);
             break;
+        case 'e':
+            clear_flags = true;
+            break;
         case 'h':
             usage_complete(argc, argv);
             exit(EXIT_SUCCESS);
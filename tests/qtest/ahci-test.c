@@ -1518,6 +1518,167 @@ static void test_ncq_simple(void)
     ahci_shutdown(ahci);
 }
 
+/*** IOThread tests ***/
+
+#define AHCI_BENCH_IOS 512
+
+G_GNUC_PRINTF(1, 2)
+static AHCIQState *ahci_boot_iothread(const char *iothread, ...)
+{
+    g_autofree char *cli = NULL;
+    AHCIQState *ahci;
+    va_list ap;
+
+    va_start(ap, iothread);
+    cli = g_strdup_vprintf(iothread, ap);
+    va_end(ap);
+
+    ahci = ahci_boot_and_enable("%s "
+                                "-drive if=none,id=drive0,file=%s,"
+                                "cache=writeback,format=%s "
+                                "-M q35 "
+                                "-device ide-hd,drive=drive0 "
+                                "-global ide-hd.serial=%s "
+                                "-global ide-hd.ver=%s",
+                                cli, tmp_path, imgfmt, "testdisk", "version");
+    return ahci;
+}
+
+/*
+ * Reset the HBA and wait for GHC.HR to clear, which happens in the main
+ * loop when the HBA uses an iothread.
+ */
+static void ahci_hba_reset_wait(AHCIQState *ahci)
+{
+    ahci_set(ahci, AHCI_GHC, AHCI_GHC_HR);
+    while (ahci_rreg(ahci, AHCI_GHC) & AHCI_GHC_HR) {
+        g_usleep(1000);
+    }
+    ahci_clean_mem(ahci);
+}
+
+static void test_iothread_io(void)
+{
+    AHCIQState *ahci;
+    int i;
+
+    ahci = ahci_boot_iothread("-object iothread,id=thread0 "
+                              "-global ich9-ahci.iothread=thread0");
+
+    for (i = 0; i < 2; i++) {
+        ahci_test_io_rw_simple(ahci, 4096, 0,
+                               CMD_READ_DMA_EXT,
+                               CMD_WRITE_DMA_EXT);
+        ahci_test_io_rw_simple(ahci, 65536, 16,
+                               READ_FPDMA_QUEUED,
+                               WRITE_FPDMA_QUEUED);
+        ahci_test_nondata(ahci, CMD_FLUSH_CACHE);
+
+        /* IDENTIFY runs in the main loop, check that it comes back. */
+        ahci_hba_reset_wait(ahci);
+        ahci_hba_enable(ahci);
+        ahci_test_identify(ahci);
+    }
+
+    ahci_shutdown(ahci);
+}
+
+/*
+ * Issue a command while the VM is stopped, which the iothread must not
+ * start, then check that it completes on the destination of a migration.
+ */
+static void test_iothread_migrate(void)
+{
+    AHCIQState *src, *dst;
+    AHCICommand *cmd;
+    uint8_t px;
+    char *uri = g_strdup_printf("unix:%s", mig_socket);
+
+    src = ahci_boot_and_enable("-object iothread,id=thread0 "
+                               "-global ich9-ahci.iothread=thread0 "
+                               "-drive if=none,id=drive0,file=%s,"
+                               "cache=writeback,format=%s "
+                               "-M q35 "
+                               "-device ide-hd,drive=drive0 ",
+                               tmp_path, imgfmt);
+    dst = ahci_boot("-object iothread,id=thread0 "
+                    "-global ich9-ahci.iothread=thread0 "
+                    "-drive if=none,id=drive0,file=%s,"
+                    "cache=writeback,format=%s "
+                    "-M q35 "
+                    "-device ide-hd,drive=drive0 "
+                    "-incoming %s", tmp_path, imgfmt, uri);
+
+    px = ahci_port_select(src);
+    ahci_port_clear(src, px);
+    make_dirty(src, px);
+
+    qtest_qmp_assert_success(src->parent->qts, "{'execute': 'stop'}");
+    cmd = ahci_command_create(CMD_FLUSH_CACHE);
+    ahci_command_commit(src, cmd, px);
+    ahci_command_issue_async(src, cmd);
+    g_assert_cmphex(ahci_px_rreg(src, px, AHCI_PX_CI), !=, 0);
+
+    ahci_migrate(src, dst, uri);
+
+    qtest_qmp_send(dst->parent->qts, "{'execute':'cont' }");
+    qtest_qmp_eventwait(dst->parent->qts, "RESUME");
+    ahci_command_wait(dst, cmd);
+    ahci_command_verify(dst, cmd);
+
+    ahci_command_free(cmd);
+    ahci_shutdown(src);
+    ahci_shutdown(dst);
+    g_free(uri);
+}
+
+/*
+ * Time 4 KiB reads, one at a time, with and without an iothread.  This
+ * measures the latency of a command from the doorbell write to the
+ * interrupt; the numbers are only reported, because timing is too noisy
+ * to be checked in CI.
+ */
+static void ahci_bench(const char *name, const char *iothread,
+                       uint8_t read_cmd)
+{
+    AHCIQState *ahci;
+    uint64_t ptr;
+    uint8_t port;
+    gint64 start, elapsed;
+    int i;
+
+    ahci = ahci_boot_iothread("%s", iothread);
+    port = ahci_port_select(ahci);
+    ahci_port_clear(ahci, port);
+    ptr = ahci_alloc(ahci, 4096);
+    g_assert(ptr);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < AHCI_BENCH_IOS; i++) {
+        ahci_guest_io(ahci, port, read_cmd, ptr, 4096,
+                      (i * 8) % 0x10000);
+    }
+    elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    g_test_message("%s: %d reads, %.0f IOPS, %.1f us per read", name,
+                   AHCI_BENCH_IOS, AHCI_BENCH_IOS * 1e6 / elapsed,
+                   (double)elapsed / AHCI_BENCH_IOS);
+
+    ahci_free(ahci, ptr);
+    ahci_shutdown(ahci);
+}
+
+static void test_iothread_bench(void)
+{
+    const char *iothread = "-object iothread,id=thread0 "
+                           "-global ich9-ahci.iothread=thread0";
+
+    ahci_bench("dma, main loop", "", CMD_READ_DMA_EXT);
+    ahci_bench("dma, iothread", iothread, CMD_READ_DMA_EXT);
+    ahci_bench("ncq, main loop", "", READ_FPDMA_QUEUED);
+    ahci_bench("ncq, iothread", iothread, READ_FPDMA_QUEUED);
+}
+
 static int prepare_iso(size_t size, unsigned char **buf, char **name)
 {
     g_autofree char *cdrom_path = NULL;
@@ -2034,6 +2195,9 @@ int main(int argc, char **argv)
     qtest_add_func("/ahci/io/ncq/simple", test_ncq_simple);
     qtest_add_func("/ahci/migrate/ncq/simple", test_migrate_ncq);
     qtest_add_func("/ahci/io/ncq/retry", test_halted_ncq);
+    qtest_add_func("/ahci/io/iothread/simple", test_iothread_io);
+    qtest_add_func("/ahci/io/iothread/migrate", test_iothread_migrate);
+    qtest_add_func("/ahci/io/iothread/bench", test_iothread_bench);
     qtest_add_func("/ahci/migrate/ncq/halted", test_migrate_halted_ncq);
 
     qtest_add_func("/ahci/cdrom/dma/single", test_cdrom_dma);
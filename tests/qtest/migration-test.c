@@ -3062,6 +3062,54 @@ static void test_multifd_tcp_uadk(void)
 }
 #endif
 
+/*
+ * Migrating the state of a VFIO device needs two host devices that support
+ * it, e.g. two VFs of the same NIC.  Their PCI addresses are given in these
+ * variables; the test is skipped otherwise.
+ */
+#define VFIO_MIGRATION_ENV_SRC "QTEST_VFIO_MIGRATION_SRC"
+#define VFIO_MIGRATION_ENV_DST "QTEST_VFIO_MIGRATION_DST"
+
+static void test_multifd_tcp_vfio_finish(QTestState *from, QTestState *to,
+                                         void *opaque)
+{
+    QDict *rsp_return, *rsp_vfio;
+
+    rsp_return = migrate_query_not_failed(from);
+    g_assert(qdict_haskey(rsp_return, "vfio"));
+    rsp_vfio = qdict_get_qdict(rsp_return, "vfio");
+    g_assert_cmpint(qdict_get_int(rsp_vfio, "transferred"), >, 0);
+    qobject_unref(rsp_return);
+}
+
+static void test_multifd_tcp_vfio_device_state(void)
+{
+    /*
+     * With x-migration-multifd-transfer=on, the destination refuses
+     * device state that arrives through the main migration stream.
+     */
+    g_autofree char *opts_source =
+        g_strdup_printf("-device vfio-pci,host=%s,"
+                        "x-migration-multifd-transfer=on",
+                        getenv(VFIO_MIGRATION_ENV_SRC));
+    g_autofree char *opts_target =
+        g_strdup_printf("-device vfio-pci,host=%s,"
+                        "x-migration-multifd-transfer=on",
+                        getenv(VFIO_MIGRATION_ENV_DST));
+    MigrateCommon args = {
+        .start = {
+            .opts_source = opts_source,
+            .opts_target = opts_target,
+        },
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_start,
+        .finish_hook = test_multifd_tcp_vfio_finish,
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
 #ifdef CONFIG_GNUTLS
 static void *
 test_migrate_multifd_tcp_tls_psk_start_match(QTestState *from,
@@ -3967,6 +4015,11 @@ int main(int argc, char **argv)
     migration_test_add("/migration/multifd/tcp/plain/uadk",
                        test_multifd_tcp_uadk);
 #endif
+    if (getenv(VFIO_MIGRATION_ENV_SRC) && getenv(VFIO_MIGRATION_ENV_DST) &&
+        qtest_has_device("vfio-pci")) {
+        migration_test_add("/migration/multifd/tcp/vfio/device-state",
+                           test_multifd_tcp_vfio_device_state);
+    }
 #ifdef CONFIG_GNUTLS
     migration_test_add("/migration/multifd/tcp/tls/psk/match",
                        test_multifd_tcp_tls_psk_match);
@@ -142,6 +142,222 @@ static void nvmetest_pmr_reg_test(void *obj, void *data, QGuestAllocator *alloc)
     qpci_iounmap(pdev, pmr_bar);
 }
 
+#define NVME_TEST_QSIZE      64
+#define NVME_TEST_QDEPTH     16
+#define NVME_TEST_IOQPAIRS   4
+#define NVME_TEST_NR_READS   2048
+#define NVME_TEST_TIMEOUT_US (10 * G_USEC_PER_SEC)
+
+typedef struct NvmeTestQueue {
+    uint64_t sq;
+    uint64_t cq;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    uint16_t phase;
+    unsigned inflight;
+} NvmeTestQueue;
+
+typedef struct NvmeTest {
+    QPCIDevice *pdev;
+    QTestState *qts;
+    QPCIBar bar;
+    uint64_t buf;
+    uint16_t cid;
+    NvmeTestQueue q[NVME_TEST_IOQPAIRS + 1];
+} NvmeTest;
+
+static void nvmetest_submit(NvmeTest *t, uint16_t qid, NvmeCmd *cmd)
+{
+    NvmeTestQueue *q = &t->q[qid];
+
+    cmd->cid = cpu_to_le16(t->cid++);
+    qtest_memwrite(t->qts, q->sq + q->sq_tail * sizeof(*cmd), cmd,
+                   sizeof(*cmd));
+    q->sq_tail = (q->sq_tail + 1) % NVME_TEST_QSIZE;
+    q->inflight++;
+}
+
+static void nvmetest_ring(NvmeTest *t, uint16_t qid)
+{
+    qpci_io_writel(t->pdev, t->bar, 0x1000 + (qid << 3), t->q[qid].sq_tail);
+}
+
+/* Reap the completions that are available, returns how many there were */
+static unsigned nvmetest_reap(NvmeTest *t, uint16_t qid)
+{
+    NvmeTestQueue *q = &t->q[qid];
+    unsigned n = 0;
+    NvmeCqe cqe;
+
+    for (;;) {
+        qtest_memread(t->qts, q->cq + q->cq_head * sizeof(cqe), &cqe,
+                      sizeof(cqe));
+        if ((le16_to_cpu(cqe.status) & 1) != q->phase) {
+            break;
+        }
+
+        g_assert_cmphex(le16_to_cpu(cqe.status) >> 1, ==, NVME_SUCCESS);
+        g_assert_cmpint(le16_to_cpu(cqe.sq_id), ==, qid);
+
+        if (++q->cq_head == NVME_TEST_QSIZE) {
+            q->cq_head = 0;
+            q->phase ^= 1;
+        }
+        q->inflight--;
+        n++;
+    }
+
+    if (n) {
+        qpci_io_writel(t->pdev, t->bar, 0x1000 + (qid << 3) + 4, q->cq_head);
+    }
+    return n;
+}
+
+static void nvmetest_wait(NvmeTest *t, uint16_t qid)
+{
+    gint64 end = g_get_monotonic_time() + NVME_TEST_TIMEOUT_US;
+
+    while (t->q[qid].inflight) {
+        nvmetest_reap(t, qid);
+        g_assert_cmpint(g_get_monotonic_time(), <, end);
+    }
+}
+
+static void nvmetest_admin(NvmeTest *t, uint8_t opcode, uint64_t prp1,
+                           uint32_t cdw10, uint32_t cdw11)
+{
+    NvmeCmd cmd = {
+        .opcode = opcode,
+        .dptr.prp1 = cpu_to_le64(prp1),
+        .cdw10 = cpu_to_le32(cdw10),
+        .cdw11 = cpu_to_le32(cdw11),
+    };
+
+    nvmetest_submit(t, 0, &cmd);
+    nvmetest_ring(t, 0);
+    nvmetest_wait(t, 0);
+}
+
+static void nvmetest_init_queue(NvmeTest *t, QGuestAllocator *alloc,
+                                uint16_t qid)
+{
+    NvmeTestQueue *q = &t->q[qid];
+
+    q->sq = guest_alloc(alloc, NVME_TEST_QSIZE * sizeof(NvmeCmd));
+    q->cq = guest_alloc(alloc, NVME_TEST_QSIZE * sizeof(NvmeCqe));
+    qtest_memset(t->qts, q->cq, 0, NVME_TEST_QSIZE * sizeof(NvmeCqe));
+    q->phase = 1;
+}
+
+static void nvmetest_start(NvmeTest *t, QNvme *nvme, QGuestAllocator *alloc)
+{
+    gint64 end = g_get_monotonic_time() + NVME_TEST_TIMEOUT_US;
+    uint32_t cc = 0;
+    uint16_t qid;
+
+    t->pdev = &nvme->dev;
+    t->qts = t->pdev->bus->qts;
+
+    qpci_device_enable(t->pdev);
+    qpci_msix_enable(t->pdev);
+    t->bar = qpci_iomap(t->pdev, 0, NULL);
+    t->buf = guest_alloc(alloc, 4 * KiB);
+
+    nvmetest_init_queue(t, alloc, 0);
+    qpci_io_writel(t->pdev, t->bar, NVME_REG_AQA,
+                   (NVME_TEST_QSIZE - 1) << 16 | (NVME_TEST_QSIZE - 1));
+    qpci_io_writeq(t->pdev, t->bar, NVME_REG_ASQ, t->q[0].sq);
+    qpci_io_writeq(t->pdev, t->bar, NVME_REG_ACQ, t->q[0].cq);
+
+    NVME_SET_CC_EN(cc, 1);
+    NVME_SET_CC_IOSQES(cc, 6);
+    NVME_SET_CC_IOCQES(cc, 4);
+    qpci_io_writel(t->pdev, t->bar, NVME_REG_CC, cc);
+    while (!NVME_CSTS_RDY(qpci_io_readl(t->pdev, t->bar, NVME_REG_CSTS))) {
+        g_assert_cmpint(g_get_monotonic_time(), <, end);
+    }
+
+    for (qid = 1; qid <= NVME_TEST_IOQPAIRS; qid++) {
+        uint32_t cdw10 = (NVME_TEST_QSIZE - 1) << 16 | qid;
+
+        nvmetest_init_queue(t, alloc, qid);
+        nvmetest_admin(t, NVME_ADM_CMD_CREATE_CQ, t->q[qid].cq, cdw10,
+                       qid << 16 | NVME_CQ_IEN | NVME_CQ_PC);
+        nvmetest_admin(t, NVME_ADM_CMD_CREATE_SQ, t->q[qid].sq, cdw10,
+                       qid << 16 | NVME_SQ_PC);
+    }
+}
+
+/* Read the first block @NVME_TEST_NR_READS times from @nr_queues queues */
+static double nvmetest_read_iops(NvmeTest *t, uint16_t nr_queues)
+{
+    gint64 start = g_get_monotonic_time();
+    gint64 end = start + NVME_TEST_TIMEOUT_US;
+    unsigned submitted = 0, completed = 0;
+    NvmeCmd cmd = {
+        .opcode = NVME_CMD_READ,
+        .nsid = cpu_to_le32(1),
+        .dptr.prp1 = cpu_to_le64(t->buf),
+    };
+    uint16_t qid;
+
+    while (completed < NVME_TEST_NR_READS) {
+        for (qid = 1; qid <= nr_queues; qid++) {
+            bool ring = false;
+
+            while (t->q[qid].inflight < NVME_TEST_QDEPTH &&
+                   submitted < NVME_TEST_NR_READS) {
+                nvmetest_submit(t, qid, &cmd);
+                submitted++;
+                ring = true;
+            }
+            if (ring) {
+                nvmetest_ring(t, qid);
+            }
+        }
+
+        for (qid = 1; qid <= nr_queues; qid++) {
+            completed += nvmetest_reap(t, qid);
+        }
+        g_assert_cmpint(g_get_monotonic_time(), <, end);
+    }
+
+    return NVME_TEST_NR_READS * (double)G_USEC_PER_SEC /
+           (g_get_monotonic_time() - start);
+}
+
+/*
+ * Spread reads over an increasing number of queue pairs.  Timing in a
+ * test environment is too noisy to check the scaling, so just report it.
+ */
+static void nvmetest_io_queues_test(void *obj, void *data,
+                                    QGuestAllocator *alloc)
+{
+    NvmeTest t = { 0 };
+    uint16_t nr_queues, qid;
+
+    nvmetest_start(&t, obj, alloc);
+
+    for (nr_queues = 1; nr_queues <= NVME_TEST_IOQPAIRS; nr_queues *= 2) {
+        g_test_message("%u queue pair(s): %.0f IOPS", nr_queues,
+                       nvmetest_read_iops(&t, nr_queues));
+    }
+
+    /* Deleting the queues must wait for the iothread */
+    for (qid = 1; qid <= NVME_TEST_IOQPAIRS; qid++) {
+        nvmetest_admin(&t, NVME_ADM_CMD_DELETE_SQ, 0, qid, 0);
+        nvmetest_admin(&t, NVME_ADM_CMD_DELETE_CQ, 0, qid, 0);
+    }
+
+    qpci_iounmap(t.pdev, t.bar);
+}
+
+static void *nvme_setup_iothread(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line, " -object iothread,id=thread0 ");
+    return arg;
+}
+
 static void nvme_register_nodes(void)
 {
     QOSGraphEdgeOptions opts = {
@@ -168,6 +384,25 @@ static void nvme_register_nodes(void)
     });
 
     qos_add_test("reg-read", "nvme", nvmetest_reg_read_test, NULL);
+
+    qos_add_test("io-queues", "nvme", nvmetest_io_queues_test,
+                 &(QOSGraphTestOptions) {
+        .edge.extra_device_opts = "msix-exclusive-bar=on"
+    });
+
+    qos_add_test("iothread-io-queues", "nvme", nvmetest_io_queues_test,
+                 &(QOSGraphTestOptions) {
+        .before = nvme_setup_iothread,
+        .edge.extra_device_opts = "msix-exclusive-bar=on,iothread=thread0"
+    });
+
+    /* completions are reaped without waiting for the coalesced interrupts */
+    qos_add_test("intc-io-queues", "nvme", nvmetest_io_queues_test,
+                 &(QOSGraphTestOptions) {
+        .before = nvme_setup_iothread,
+        .edge.extra_device_opts = "msix-exclusive-bar=on,iothread=thread0,"
+                                  "intc.thr=7,intc.time=1"
+    });
 }
 
 libqos_init(nvme_register_nodes);
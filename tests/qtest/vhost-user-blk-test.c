@@ -764,6 +764,128 @@ static void multiqueue(void *obj, void *data, QGuestAllocator *t_alloc)
     qpci_unplug_acpi_device_test(qts, "drv1", PCI_SLOT_HP);
 }
 
+#define MQ_IOTHREADS_NUM_QUEUES 4
+
+/* Queue a 512 byte request on @vq and kick it, returning its address */
+static uint64_t mq_iothreads_req(QVirtioDevice *dev, QGuestAllocator *alloc,
+                                 QVirtQueue *vq, uint32_t type,
+                                 uint64_t sector, const char *text,
+                                 uint32_t *free_head)
+{
+    QTestState *qts = global_qtest;
+    QVirtioBlkReq req = {
+        .type = type,
+        .ioprio = 1,
+        .sector = sector,
+    };
+    uint64_t req_addr;
+
+    req.data = g_malloc0(512);
+    if (text) {
+        strcpy(req.data, text);
+    }
+    req_addr = virtio_blk_request(alloc, dev, &req, 512);
+    g_free(req.data);
+
+    *free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 512, type == VIRTIO_BLK_T_IN, true);
+    qvirtqueue_add(qts, vq, req_addr + 528, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, *free_head);
+    return req_addr;
+}
+
+/*
+ * Use all virtqueues of an export whose virtqueues are spread over two
+ * iothreads.  Requests are queued on every virtqueue before waiting for any
+ * of them, and each sector is read back through a virtqueue of the other
+ * iothread.
+ */
+static void multiqueue_iothreads(void *obj, void *data,
+                                 QGuestAllocator *t_alloc)
+{
+    QVirtioPCIDevice *pdev1 = obj;
+    QTestState *qts = pdev1->pdev->bus->qts;
+    QVirtQueue *vqs[MQ_IOTHREADS_NUM_QUEUES];
+    uint64_t req_addr[MQ_IOTHREADS_NUM_QUEUES];
+    uint32_t free_head[MQ_IOTHREADS_NUM_QUEUES];
+    QVirtioPCIDevice *pdev;
+    QVirtioDevice *dev;
+    uint64_t features;
+    int i;
+
+    if (pdev1->pdev->bus->not_hotpluggable) {
+        g_test_skip("bus pci.0 does not support hotplug");
+        return;
+    }
+
+    qtest_qmp_device_add(qts, "vhost-user-blk-pci", "drv1",
+                         "{'addr': %s, 'chardev': 'char2', 'num-queues': %d}",
+                         stringify(PCI_SLOT_HP) ".0", MQ_IOTHREADS_NUM_QUEUES);
+
+    pdev = virtio_pci_new(pdev1->pdev->bus,
+                          &(QPCIAddress) {
+                              .devfn = QPCI_DEVFN(PCI_SLOT_HP, 0)
+                          });
+    g_assert_nonnull(pdev);
+    qos_object_start_hw(&pdev->obj);
+
+    dev = &pdev->vdev;
+    features = qvirtio_get_features(dev);
+    g_assert_cmpint(features & (1u << VIRTIO_BLK_F_MQ),
+                    ==,
+                    (1u << VIRTIO_BLK_F_MQ));
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    for (i = 0; i < MQ_IOTHREADS_NUM_QUEUES; i++) {
+        vqs[i] = qvirtqueue_setup(dev, t_alloc, i);
+    }
+    qvirtio_set_driver_ok(dev);
+
+    for (i = 0; i < MQ_IOTHREADS_NUM_QUEUES; i++) {
+        g_autofree char *text = g_strdup_printf("TEST%d", i);
+
+        req_addr[i] = mq_iothreads_req(dev, t_alloc, vqs[i], VIRTIO_BLK_T_OUT,
+                                       i, text, &free_head[i]);
+    }
+    for (i = 0; i < MQ_IOTHREADS_NUM_QUEUES; i++) {
+        qvirtio_wait_used_elem(qts, dev, vqs[i], free_head[i], NULL,
+                               QVIRTIO_BLK_TIMEOUT_US);
+        g_assert_cmpint(readb(req_addr[i] + 528), ==, 0);
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    for (i = 0; i < MQ_IOTHREADS_NUM_QUEUES; i++) {
+        QVirtQueue *vq = vqs[(i + 1) % MQ_IOTHREADS_NUM_QUEUES];
+
+        req_addr[i] = mq_iothreads_req(dev, t_alloc, vq, VIRTIO_BLK_T_IN,
+                                       i, NULL, &free_head[i]);
+    }
+    for (i = 0; i < MQ_IOTHREADS_NUM_QUEUES; i++) {
+        QVirtQueue *vq = vqs[(i + 1) % MQ_IOTHREADS_NUM_QUEUES];
+        g_autofree char *text = g_strdup_printf("TEST%d", i);
+        char buf[512];
+
+        qvirtio_wait_used_elem(qts, dev, vq, free_head[i], NULL,
+                               QVIRTIO_BLK_TIMEOUT_US);
+        g_assert_cmpint(readb(req_addr[i] + 528), ==, 0);
+        qtest_memread(qts, req_addr[i] + 16, buf, sizeof(buf));
+        g_assert_cmpstr(buf, ==, text);
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    for (i = 0; i < MQ_IOTHREADS_NUM_QUEUES; i++) {
+        qvirtqueue_cleanup(dev->bus, vqs[i], t_alloc);
+    }
+    qvirtio_pci_device_disable(pdev);
+    qos_object_destroy(&pdev->obj);
+
+    qpci_unplug_acpi_device_test(qts, "drv1", PCI_SLOT_HP);
+}
+
 /*
  * Check that setting the vring addr on a non-existent virtqueue does
  * not crash.
@@ -893,7 +1015,7 @@ static void quit_storage_daemon(void *data)
 }
 
 static void start_vhost_user_blk(GString *cmd_line, int vus_instances,
-                                 int num_queues)
+                                 int num_queues, int num_iothreads)
 {
     const char *vhost_user_blk_bin = qtest_qemu_storage_daemon_binary();
     int i;
@@ -909,8 +1031,13 @@ static void start_vhost_user_blk(GString *cmd_line, int vus_instances,
             " -object memory-backend-shm,id=mem,size=256M "
             " -M memory-backend=mem -m 256M ");
 
+    for (i = 0; i < num_iothreads; i++) {
+        g_string_append_printf(storage_daemon_command,
+                               "--object iothread,id=iothread%d ", i);
+    }
+
     for (i = 0; i < vus_instances; i++) {
-        int fd;
+        int fd, j;
         char *sock_path = create_listen_socket(&fd);
 
         /* create image file */
@@ -918,8 +1045,13 @@ static void start_vhost_user_blk(GString *cmd_line, int vus_instances,
         g_string_append_printf(storage_daemon_command,
             "--blockdev driver=file,node-name=disk%d,filename=%s "
             "--export type=vhost-user-blk,id=disk%d,addr.type=fd,addr.str=%d,"
-            "node-name=disk%i,writable=on,num-queues=%d ",
+            "node-name=disk%i,writable=on,num-queues=%d",
             i, img_path, i, fd, i, num_queues);
+        for (j = 0; j < num_iothreads; j++) {
+            g_string_append_printf(storage_daemon_command,
+                                   ",iothreads.%d=iothread%d", j, j);
+        }
+        g_string_append_c(storage_daemon_command, ' ');
 
         g_string_append_printf(cmd_line, "-chardev socket,id=char%d,path=%s ",
                                i + 1, sock_path);
@@ -953,7 +1085,7 @@ static void start_vhost_user_blk(GString *cmd_line, int vus_instances,
 
 static void *vhost_user_blk_test_setup(GString *cmd_line, void *arg)
 {
-    start_vhost_user_blk(cmd_line, 1, 1);
+    start_vhost_user_blk(cmd_line, 1, 1, 0);
     return arg;
 }
 
@@ -967,13 +1099,27 @@ static void *vhost_user_blk_test_setup(GString *cmd_line, void *arg)
 static void *vhost_user_blk_hotplug_test_setup(GString *cmd_line, void *arg)
 {
     /* "-chardev socket,id=char2" is used for pci_hotplug*/
-    start_vhost_user_blk(cmd_line, 2, 1);
+    start_vhost_user_blk(cmd_line, 2, 1, 0);
     return arg;
 }
 
 static void *vhost_user_blk_multiqueue_test_setup(GString *cmd_line, void *arg)
 {
-    start_vhost_user_blk(cmd_line, 2, 8);
+    start_vhost_user_blk(cmd_line, 2, 8, 0);
+    return arg;
+}
+
+/* Process the virtqueues of the export in iothreads */
+static void *vhost_user_blk_iothreads_test_setup(GString *cmd_line, void *arg)
+{
+    start_vhost_user_blk(cmd_line, 1, 2, 2);
+    return arg;
+}
+
+static void *vhost_user_blk_multiqueue_iothreads_test_setup(GString *cmd_line,
+                                                            void *arg)
+{
+    start_vhost_user_blk(cmd_line, 2, MQ_IOTHREADS_NUM_QUEUES, 2);
     return arg;
 }
 
@@ -1009,6 +1155,14 @@ static void register_vhost_user_blk_test(void)
 
     opts.before = vhost_user_blk_multiqueue_test_setup;
     qos_add_test("multiqueue", "vhost-user-blk-pci", multiqueue, &opts);
+
+    opts.before = vhost_user_blk_iothreads_test_setup;
+    qos_add_test("basic-iothreads", "vhost-user-blk", basic, &opts);
+    qos_add_test("indirect-iothreads", "vhost-user-blk", indirect, &opts);
+
+    opts.before = vhost_user_blk_multiqueue_iothreads_test_setup;
+    qos_add_test("multiqueue-iothreads", "vhost-user-blk-pci",
+                 multiqueue_iothreads, &opts);
 }
 
 libqos_init(register_vhost_user_blk_test);
@@ -29,6 +29,9 @@
 #define tsymlink(...) v9fs_tsymlink((TsymlinkOpt) __VA_ARGS__)
 #define tlink(...) v9fs_tlink((TlinkOpt) __VA_ARGS__)
 #define tunlinkat(...) v9fs_tunlinkat((TunlinkatOpt) __VA_ARGS__)
+#define topen(...) v9fs_topen((TOpenOpt) __VA_ARGS__)
+#define tread(...) v9fs_tread((TReadOpt) __VA_ARGS__)
+#define tclunk(...) v9fs_tclunk((TClunkOpt) __VA_ARGS__)
 
 static void pci_config(void *obj, void *data, QGuestAllocator *t_alloc)
 {
@@ -504,6 +507,90 @@ static void fs_readdir_split_512(void *obj, void *data,
 }
 
 
+#define BENCH_OPS 1000
+
+static double bench_rate(gint64 start)
+{
+    return BENCH_OPS * (double)G_USEC_PER_SEC /
+           (g_get_monotonic_time() - start);
+}
+
+/*
+ * Measure the rate of metadata requests. Timing in a test environment is
+ * too noisy to check the results, so just report them.
+ */
+static void fs_metadata_bench(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtio9P *v9p = obj;
+    v9fs_set_allocator(t_alloc);
+    g_autofree char *path = g_strdup_printf(
+        QTEST_V9FS_SYNTH_READDIR_DIR "/" QTEST_V9FS_SYNTH_READDIR_FILE, 0
+    );
+    g_autofree uint32_t *fids = g_new(uint32_t, BENCH_OPS);
+    struct V9fsDirent *entries;
+    uint32_t fid, count, nentries;
+    gint64 start;
+    int i;
+
+    tattach({ .client = v9p });
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < BENCH_OPS; i++) {
+        fids[i] = twalk({ .client = v9p, .path = path }).newfid;
+    }
+    g_test_message("walk: %.0f ops/s", bench_rate(start));
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < BENCH_OPS; i++) {
+        tgetattr({
+            .client = v9p, .fid = fids[0], .request_mask = P9_GETATTR_BASIC
+        });
+    }
+    g_test_message("getattr: %.0f ops/s", bench_rate(start));
+
+    /* release the fids outside of the measurements */
+    for (i = 0; i < BENCH_OPS; i++) {
+        tclunk({ .client = v9p, .fid = fids[i] });
+    }
+
+    /* what a client does to look up a file */
+    start = g_get_monotonic_time();
+    for (i = 0; i < BENCH_OPS; i++) {
+        fids[i] = twalk({ .client = v9p, .path = path }).newfid;
+        tgetattr({
+            .client = v9p, .fid = fids[i], .request_mask = P9_GETATTR_BASIC
+        });
+    }
+    g_test_message("walk+getattr: %.0f ops/s", bench_rate(start));
+
+    for (i = 0; i < BENCH_OPS; i++) {
+        tclunk({ .client = v9p, .fid = fids[i] });
+    }
+
+    fid = twalk({ .client = v9p, .path = QTEST_V9FS_SYNTH_READDIR_DIR }).newfid;
+    tlopen({ .client = v9p, .fid = fid, .flags = O_DIRECTORY });
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < BENCH_OPS; i++) {
+        entries = NULL;
+        treaddir({
+            .client = v9p, .fid = fid, .offset = 0, .count = P9_MAX_SIZE - 11,
+            .rreaddir = {
+                .count = &count, .nentries = &nentries, .entries = &entries
+            }
+        });
+        g_assert_cmpint(
+            nentries, ==,
+            QTEST_V9FS_SYNTH_READDIR_NFILES + 2 /* "." and ".." */
+        );
+        v9fs_free_dirents(entries);
+    }
+    g_test_message("readdir of %d entries: %.0f ops/s", nentries,
+                   bench_rate(start));
+
+    tclunk({ .client = v9p, .fid = fid });
+}
+
 /* tests using the 9pfs 'local' fs driver */
 
 static void fs_create_dir(void *obj, void *data, QGuestAllocator *t_alloc)
@@ -693,6 +780,124 @@ static void fs_unlinkat_hardlink(void *obj, void *data,
     g_assert(stat(real_file, &st_real) == 0);
 }
 
+static void fs_getattr_after_write(void *obj, void *data,
+                                   QGuestAllocator *t_alloc)
+{
+    QVirtio9P *v9p = obj;
+    v9fs_set_allocator(t_alloc);
+    static const uint32_t write_count = 100;
+    g_autofree char *buf = g_malloc0(write_count);
+    g_autofree char *host_path = virtio_9p_test_path("09/file");
+    struct v9fs_attr attr;
+    uint32_t fid;
+
+    tattach({ .client = v9p });
+    tmkdir({ .client = v9p, .atPath = "/", .name = "09" });
+    tlcreate({ .client = v9p, .atPath = "09", .name = "file" });
+
+    fid = twalk({ .client = v9p, .path = "09/file" }).newfid;
+    tgetattr({
+        .client = v9p, .fid = fid, .request_mask = P9_GETATTR_BASIC,
+        .rgetattr.attr = &attr
+    });
+    g_assert_cmpint(attr.size, ==, 0);
+
+    /*
+     * The cached attributes do not expire during this test, so a change
+     * done on the host side does not show up ...
+     */
+    g_assert(truncate(host_path, 1) == 0);
+    tgetattr({
+        .client = v9p, .fid = fid, .request_mask = P9_GETATTR_BASIC,
+        .rgetattr.attr = &attr
+    });
+    g_assert_cmpint(attr.size, ==, 0);
+
+    tlopen({ .client = v9p, .fid = fid, .flags = O_WRONLY });
+    twrite({
+        .client = v9p, .fid = fid, .offset = 0, .count = write_count,
+        .data = buf
+    });
+
+    /* ... but attributes read before a write must not be returned anymore */
+    tgetattr({
+        .client = v9p, .fid = fid, .request_mask = P9_GETATTR_BASIC,
+        .rgetattr.attr = &attr
+    });
+    g_assert_cmpint(attr.size, ==, write_count);
+}
+
+/* size[2] type[2] dev[4] qid[13] mode[4] atime[4] mtime[4] length[8] name[s] */
+#define V9FS_STAT_LENGTH_OFFSET 33
+#define V9FS_STAT_NAME_OFFSET 41
+
+static void fs_read_dir_9p2000u(void *obj, void *data,
+                                QGuestAllocator *t_alloc)
+{
+    QVirtio9P *v9p = obj;
+    v9fs_set_allocator(t_alloc);
+    static const int nfiles = 20;
+    g_autofree char *dir = virtio_9p_test_path("10");
+    g_autofree char *buf = g_malloc(P9_MAX_SIZE);
+    g_autofree bool *seen = g_new0(bool, nfiles);
+    uint64_t offset = 0;
+    uint32_t fid, count;
+    int i, nentries = 0;
+    P9Req *req;
+
+    g_assert(mkdir(dir, 0700) == 0);
+    for (i = 0; i < nfiles; i++) {
+        g_autofree char *file = g_strdup_printf("%s/file%d", dir, i);
+        g_autofree char *content = g_strnfill(i, 'x');
+
+        g_assert(g_file_set_contents(file, content, i, NULL));
+    }
+
+    tversion({ .client = v9p, .version = "9P2000.u" });
+    req = tattach({ .client = v9p, .requestOnly = true }).req;
+    v9fs_req_wait_for_reply(req, NULL);
+    v9fs_rattach(req, NULL);
+
+    fid = twalk({ .client = v9p, .path = "10" }).newfid;
+    topen({ .client = v9p, .fid = fid });
+
+    /* read in small chunks, so that entries are split across requests */
+    do {
+        size_t off = 0;
+
+        tread({
+            .client = v9p, .fid = fid, .offset = offset, .count = 256,
+            .rread = { .count = &count, .data = buf }
+        });
+        while (off < count) {
+            uint16_t size = lduw_le_p(buf + off);
+            uint16_t name_len = lduw_le_p(buf + off + V9FS_STAT_NAME_OFFSET);
+            g_autofree char *name = g_strndup(
+                buf + off + V9FS_STAT_NAME_OFFSET + 2, name_len
+            );
+
+            g_assert_cmpint(off + 2 + size, <=, count);
+            if (strcmp(name, ".") && strcmp(name, "..")) {
+                g_assert(sscanf(name, "file%d", &i) == 1);
+                g_assert_cmpint(i, >=, 0);
+                g_assert_cmpint(i, <, nfiles);
+                g_assert(!seen[i]);
+                seen[i] = true;
+                /* the attributes must belong to this very entry */
+                g_assert_cmpint(
+                    ldq_le_p(buf + off + V9FS_STAT_LENGTH_OFFSET), ==, i
+                );
+                nentries++;
+            }
+            off += 2 + size;
+        }
+        offset += count;
+    } while (count);
+
+    g_assert_cmpint(nentries, ==, nfiles);
+    tclunk({ .client = v9p, .fid = fid });
+}
+
 static void cleanup_9p_local_driver(void *data)
 {
     /* remove previously created test dir when test is completed */
@@ -710,6 +915,14 @@ static void *assign_9p_local_driver(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *assign_9p_local_driver_attr_cache(GString *cmd_line, void *arg)
+{
+    /* keep cached attributes valid for the whole test */
+    g_string_append(cmd_line,
+                    " -global virtio-9p-device.x-attr-cache-ms=3600000");
+    return assign_9p_local_driver(cmd_line, arg);
+}
+
 static void register_virtio_9p_test(void)
 {
 
@@ -743,6 +956,8 @@ static void register_virtio_9p_test(void)
                  fs_readdir_split_256,  &opts);
     qos_add_test("synth/readdir/split_128", "virtio-9p",
                  fs_readdir_split_128,  &opts);
+    qos_add_test("synth/bench/metadata", "virtio-9p", fs_metadata_bench,
+                 &opts);
 
 
     /* 9pfs test cases using the 'local' filesystem driver */
@@ -758,6 +973,12 @@ static void register_virtio_9p_test(void)
     qos_add_test("local/hardlink_file", "virtio-9p", fs_hardlink_file, &opts);
     qos_add_test("local/unlinkat_hardlink", "virtio-9p", fs_unlinkat_hardlink,
                  &opts);
+    qos_add_test("local/read_dir_9p2000u", "virtio-9p", fs_read_dir_9p2000u,
+                 &opts);
+
+    opts.before = assign_9p_local_driver_attr_cache;
+    qos_add_test("local/getattr_after_write", "virtio-9p",
+                 fs_getattr_after_write, &opts);
 }
 
 libqos_init(register_virtio_9p_test);
@@ -694,6 +694,130 @@ static void idx(void *obj, void *u_data, QGuestAllocator *t_alloc)
     qvirtqueue_cleanup(dev->bus, vq, t_alloc);
 }
 
+/* Interrupt moderation policy of the irq-moderation test */
+#define IRQ_MOD_USECS   1000000
+#define IRQ_MOD_FRAMES  3
+
+static uint32_t irq_moderation_write(QTestState *qts, QGuestAllocator *alloc,
+                                     QVirtioDevice *dev, QVirtQueue *vq,
+                                     uint64_t sector, uint64_t *req_addr)
+{
+    QVirtioBlkReq req;
+    uint32_t free_head;
+
+    req.type = VIRTIO_BLK_T_OUT;
+    req.ioprio = 1;
+    req.sector = sector;
+    req.data = g_malloc0(512);
+    strcpy(req.data, "TEST");
+
+    *req_addr = virtio_blk_request(alloc, dev, &req, 512);
+
+    g_free(req.data);
+
+    free_head = qvirtqueue_add(qts, vq, *req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, *req_addr + 16, 512, false, true);
+    qvirtqueue_add(qts, vq, *req_addr + 528, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    return free_head;
+}
+
+/*
+ * Interrupts of a busy virtqueue are held back until IRQ_MOD_USECS have
+ * passed since the last one, or until IRQ_MOD_FRAMES notifications have
+ * been coalesced.
+ */
+static void irq_moderation(void *obj, void *u_data, QGuestAllocator *t_alloc)
+{
+    QVirtQueue *vq;
+    QVirtioBlkPCI *blk = obj;
+    QVirtioPCIDevice *pdev = &blk->pci_vdev;
+    QVirtioDevice *dev = &pdev->vdev;
+    uint64_t req_addr[IRQ_MOD_FRAMES];
+    uint32_t free_head[IRQ_MOD_FRAMES];
+    uint64_t features;
+    uint32_t desc_idx;
+    uint8_t status;
+    QOSGraphObject *blk_object = obj;
+    QPCIDevice *pci_dev = blk_object->get_driver(blk_object, "pci-device");
+    QTestState *qts = global_qtest;
+    int i;
+
+    if (qpci_check_buggy_msi(pci_dev)) {
+        return;
+    }
+
+    qpci_msix_enable(pdev->pdev);
+    qvirtio_pci_set_msix_configuration_vector(pdev, t_alloc, 0);
+
+    /* Without EVENT_IDX, the guest never suppresses a notification */
+    features = qvirtio_get_features(dev);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+    qvirtqueue_pci_msix_setup(pdev, (QVirtQueuePCI *)vq, t_alloc, 1);
+
+    qvirtio_set_driver_ok(dev);
+
+    /* A queue that has been quiet for long enough interrupts right away */
+    qtest_clock_step(qts, IRQ_MOD_USECS * 1000LL);
+    free_head[0] = irq_moderation_write(qts, t_alloc, dev, vq, 0,
+                                        &req_addr[0]);
+    qvirtio_wait_used_elem(qts, dev, vq, free_head[0], NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    guest_free(t_alloc, req_addr[0]);
+
+    /* The next completion is held back until the interval has elapsed */
+    free_head[0] = irq_moderation_write(qts, t_alloc, dev, vq, 1,
+                                        &req_addr[0]);
+    status = qvirtio_wait_status_byte_no_isr(qts, dev, vq, req_addr[0] + 528,
+                                             QVIRTIO_BLK_TIMEOUT_US);
+    g_assert_cmpint(status, ==, 0);
+    g_assert(!dev->bus->get_queue_isr_status(dev, vq));
+
+    qtest_clock_step(qts, IRQ_MOD_USECS * 1000LL);
+    qvirtio_wait_used_elem(qts, dev, vq, free_head[0], NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    guest_free(t_alloc, req_addr[0]);
+
+    /*
+     * The timer just sent an interrupt, so the queue is busy again.  The
+     * completions are held back until IRQ_MOD_FRAMES of them are pending.
+     */
+    for (i = 0; i < IRQ_MOD_FRAMES - 1; i++) {
+        free_head[i] = irq_moderation_write(qts, t_alloc, dev, vq, 2 + i,
+                                            &req_addr[i]);
+        status = qvirtio_wait_status_byte_no_isr(qts, dev, vq,
+                                                 req_addr[i] + 528,
+                                                 QVIRTIO_BLK_TIMEOUT_US);
+        g_assert_cmpint(status, ==, 0);
+    }
+    g_assert(!dev->bus->get_queue_isr_status(dev, vq));
+
+    free_head[i] = irq_moderation_write(qts, t_alloc, dev, vq, 2 + i,
+                                        &req_addr[i]);
+    qvirtio_wait_used_elem(qts, dev, vq, free_head[0], NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    for (i = 1; i < IRQ_MOD_FRAMES; i++) {
+        g_assert(qvirtqueue_get_buf(qts, vq, &desc_idx, NULL));
+        g_assert_cmpint(desc_idx, ==, free_head[i]);
+    }
+    for (i = 0; i < IRQ_MOD_FRAMES; i++) {
+        g_assert_cmpint(readb(req_addr[i] + 528), ==, 0);
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    /* End test */
+    qpci_msix_disable(pdev->pdev);
+
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
 static void pci_hotplug(void *obj, void *data, QGuestAllocator *t_alloc)
 {
     QVirtioPCIDevice *dev1 = obj;
@@ -802,6 +926,11 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+    opts.edge.extra_device_opts =
+        "x-irq-moderation-usecs=" stringify(IRQ_MOD_USECS) ","
+        "x-irq-moderation-frames=" stringify(IRQ_MOD_FRAMES);
+    qos_add_test("irq-moderation", "virtio-blk-pci", irq_moderation, &opts);
 }
 
 libqos_init(register_virtio_blk_test);
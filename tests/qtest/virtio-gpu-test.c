@@ -0,0 +1,474 @@
+/*
+ * QTest testcase for virtio-gpu 2D resources
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Drives the control queue like a guest driver would, and checks what the
+ * scanout shows with screendump.  Each test runs with the default copying
+ * transfers and with zero-copy=on, where the image of a resource maps its
+ * backing pages through udmabuf.
+ */
+
+#include "qemu/osdep.h"
+#include <glib/gstdio.h>
+#include "qemu/bswap.h"
+#include "qemu/memfd.h"
+#include "libqtest.h"
+#include "libqos/libqos-pc.h"
+#include "libqos/virtio.h"
+#include "libqos/virtio-pci.h"
+#include "standard-headers/linux/virtio_gpu.h"
+#include "standard-headers/linux/virtio_ring.h"
+
+#define QVIRTIO_GPU_TIMEOUT_US  (30 * 1000 * 1000)
+
+#define GPU_DEVFN       QPCI_DEVFN(4, 0)
+#define GPU_RES_ID      1
+#define GPU_WIDTH       64
+#define GPU_HEIGHT      64
+#define GPU_STRIDE      (GPU_WIDTH * 4)
+#define GPU_FB_SIZE     (GPU_STRIDE * GPU_HEIGHT)
+
+#define COLOR_A         0x00ff0000
+#define COLOR_B         0x0000ff00
+#define COLOR_C         0x000000ff
+#define COLOR_D         0x00ffff00
+
+static char *tmpdir;
+
+typedef struct GPUTest {
+    QOSState *qs;
+    QVirtioPCIDevice *dev;
+    QVirtQueue *vq;
+    uint64_t backing;
+} GPUTest;
+
+static bool have_zero_copy(void)
+{
+    return access("/dev/udmabuf", R_OK | W_OK) == 0 &&
+           qemu_memfd_check(MFD_ALLOW_SEALING);
+}
+
+static void gpu_boot(GPUTest *t, bool zero_copy, const char *extra)
+{
+    QPCIAddress addr = { .devfn = GPU_DEVFN };
+
+    /* udmabuf needs guest RAM in a memfd */
+    t->qs = qtest_pc_boot("-vga none -m 256M %s "
+                          "-device virtio-gpu-pci,id=gpu0,addr=04.0,"
+                          "zero-copy=%s %s",
+                          zero_copy ? "-object memory-backend-memfd,id=mem,"
+                                      "size=256M "
+                                      "-machine memory-backend=mem" : "",
+                          zero_copy ? "on" : "off", extra);
+    t->dev = virtio_pci_new(t->qs->pcibus, &addr);
+    g_assert(t->dev);
+}
+
+static void gpu_start(GPUTest *t)
+{
+    uint64_t features;
+
+    qvirtio_pci_device_enable(t->dev);
+    qvirtio_start_device(&t->dev->vdev);
+    features = qvirtio_get_features(&t->dev->vdev);
+    features &= ~(QVIRTIO_F_BAD_FEATURE |
+                  (1ull << VIRTIO_RING_F_INDIRECT_DESC) |
+                  (1ull << VIRTIO_RING_F_EVENT_IDX));
+    qvirtio_set_features(&t->dev->vdev, features);
+    t->vq = qvirtqueue_setup(&t->dev->vdev, &t->qs->alloc, 0);
+    qvirtio_set_driver_ok(&t->dev->vdev);
+}
+
+static void gpu_shutdown(GPUTest *t)
+{
+    if (t->vq) {
+        qvirtqueue_cleanup(t->dev->vdev.bus, t->vq, &t->qs->alloc);
+    }
+    qvirtio_pci_device_disable(t->dev);
+    g_free(t->dev->pdev);
+    g_free(t->dev);
+    qtest_shutdown(t->qs);
+}
+
+/* Send a control command and return the response type */
+static uint32_t gpu_cmd(GPUTest *t, const void *req, size_t len)
+{
+    QTestState *qts = t->qs->qts;
+    struct virtio_gpu_ctrl_hdr resp;
+    uint64_t req_addr, resp_addr;
+    uint32_t free_head;
+
+    req_addr = guest_alloc(&t->qs->alloc, len);
+    resp_addr = guest_alloc(&t->qs->alloc, sizeof(resp));
+    qtest_memwrite(qts, req_addr, req, len);
+
+    free_head = qvirtqueue_add(qts, t->vq, req_addr, len, false, true);
+    qvirtqueue_add(qts, t->vq, resp_addr, sizeof(resp), true, false);
+    qvirtqueue_kick(qts, &t->dev->vdev, t->vq, free_head);
+    qvirtio_wait_used_elem(qts, &t->dev->vdev, t->vq, free_head, NULL,
+                           QVIRTIO_GPU_TIMEOUT_US);
+
+    qtest_memread(qts, resp_addr, &resp, sizeof(resp));
+    guest_free(&t->qs->alloc, req_addr);
+    guest_free(&t->qs->alloc, resp_addr);
+    return le32_to_cpu(resp.type);
+}
+
+static void gpu_rect(struct virtio_gpu_rect *r, uint32_t y, uint32_t height)
+{
+    r->x = 0;
+    r->y = cpu_to_le32(y);
+    r->width = cpu_to_le32(GPU_WIDTH);
+    r->height = cpu_to_le32(height);
+}
+
+static void gpu_create(GPUTest *t)
+{
+    struct virtio_gpu_resource_create_2d req = {
+        .hdr.type = cpu_to_le32(VIRTIO_GPU_CMD_RESOURCE_CREATE_2D),
+        .resource_id = cpu_to_le32(GPU_RES_ID),
+        .format = cpu_to_le32(VIRTIO_GPU_FORMAT_B8G8R8X8_UNORM),
+        .width = cpu_to_le32(GPU_WIDTH),
+        .height = cpu_to_le32(GPU_HEIGHT),
+    };
+
+    g_assert_cmphex(gpu_cmd(t, &req, sizeof(req)), ==,
+                    VIRTIO_GPU_RESP_OK_NODATA);
+}
+
+static void gpu_attach(GPUTest *t)
+{
+    struct {
+        struct virtio_gpu_resource_attach_backing ab;
+        struct virtio_gpu_mem_entry entry;
+    } req = {
+        .ab.hdr.type = cpu_to_le32(VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING),
+        .ab.resource_id = cpu_to_le32(GPU_RES_ID),
+        .ab.nr_entries = cpu_to_le32(1),
+    };
+
+    /* udmabuf only maps whole pages */
+    t->backing = guest_alloc(&t->qs->alloc, GPU_FB_SIZE);
+    g_assert(QEMU_IS_ALIGNED(t->backing, 4096));
+    req.entry.addr = cpu_to_le64(t->backing);
+    req.entry.length = cpu_to_le32(GPU_FB_SIZE);
+
+    g_assert_cmphex(gpu_cmd(t, &req, sizeof(req)), ==,
+                    VIRTIO_GPU_RESP_OK_NODATA);
+}
+
+static void gpu_detach(GPUTest *t)
+{
+    struct virtio_gpu_resource_detach_backing req = {
+        .hdr.type = cpu_to_le32(VIRTIO_GPU_CMD_RESOURCE_DETACH_BACKING),
+        .resource_id = cpu_to_le32(GPU_RES_ID),
+    };
+
+    g_assert_cmphex(gpu_cmd(t, &req, sizeof(req)), ==,
+                    VIRTIO_GPU_RESP_OK_NODATA);
+}
+
+/* Create a blob resource backed by guest memory, with no backing yet */
+static void gpu_create_blob(GPUTest *t)
+{
+    struct virtio_gpu_resource_create_blob req = {
+        .hdr.type = cpu_to_le32(VIRTIO_GPU_CMD_RESOURCE_CREATE_BLOB),
+        .resource_id = cpu_to_le32(GPU_RES_ID),
+        .blob_mem = cpu_to_le32(VIRTIO_GPU_BLOB_MEM_GUEST),
+        .size = cpu_to_le64(GPU_FB_SIZE),
+    };
+
+    g_assert_cmphex(gpu_cmd(t, &req, sizeof(req)), ==,
+                    VIRTIO_GPU_RESP_OK_NODATA);
+}
+
+static void gpu_set_scanout(GPUTest *t)
+{
+    struct virtio_gpu_set_scanout req = {
+        .hdr.type = cpu_to_le32(VIRTIO_GPU_CMD_SET_SCANOUT),
+        .scanout_id = 0,
+        .resource_id = cpu_to_le32(GPU_RES_ID),
+    };
+
+    gpu_rect(&req.r, 0, GPU_HEIGHT);
+    g_assert_cmphex(gpu_cmd(t, &req, sizeof(req)), ==,
+                    VIRTIO_GPU_RESP_OK_NODATA);
+}
+
+/* Transfer rows @y to @y + @height from @offset in the backing store */
+static void gpu_transfer(GPUTest *t, uint32_t y, uint32_t height,
+                         uint64_t offset)
+{
+    struct virtio_gpu_transfer_to_host_2d req = {
+        .hdr.type = cpu_to_le32(VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D),
+        .offset = cpu_to_le64(offset),
+        .resource_id = cpu_to_le32(GPU_RES_ID),
+    };
+
+    gpu_rect(&req.r, y, height);
+    g_assert_cmphex(gpu_cmd(t, &req, sizeof(req)), ==,
+                    VIRTIO_GPU_RESP_OK_NODATA);
+}
+
+static void gpu_flush(GPUTest *t)
+{
+    struct virtio_gpu_resource_flush req = {
+        .hdr.type = cpu_to_le32(VIRTIO_GPU_CMD_RESOURCE_FLUSH),
+        .resource_id = cpu_to_le32(GPU_RES_ID),
+    };
+
+    gpu_rect(&req.r, 0, GPU_HEIGHT);
+    g_assert_cmphex(gpu_cmd(t, &req, sizeof(req)), ==,
+                    VIRTIO_GPU_RESP_OK_NODATA);
+}
+
+/* Fill the top half of the backing store with @top, the rest with @bottom */
+static void gpu_fill(GPUTest *t, uint32_t top, uint32_t bottom)
+{
+    g_autofree uint32_t *fb = g_new(uint32_t, GPU_WIDTH * GPU_HEIGHT);
+    int i;
+
+    for (i = 0; i < GPU_WIDTH * GPU_HEIGHT; i++) {
+        fb[i] = cpu_to_le32(i < GPU_WIDTH * GPU_HEIGHT / 2 ? top : bottom);
+    }
+    qtest_memwrite(t->qs->qts, t->backing, fb, GPU_FB_SIZE);
+}
+
+/* Return the pixel at (@x, @y) of the scanout as 0xRRGGBB */
+static uint32_t gpu_pixel(GPUTest *t, int x, int y)
+{
+    g_autofree char *path = g_build_filename(tmpdir, "screen.ppm", NULL);
+    g_autofree char *data = NULL;
+    const uint8_t *pixel;
+    int width, height, header = 0;
+    gsize len;
+
+    qtest_qmp_assert_success(t->qs->qts,
+                             "{'execute': 'screendump', 'arguments': {"
+                             "'filename': %s, 'device': 'gpu0' }}", path);
+    g_assert(g_file_get_contents(path, &data, &len, NULL));
+    g_unlink(path);
+
+    g_assert_cmpint(sscanf(data, "P6 %d %d 255%n", &width, &height, &header),
+                    ==, 2);
+    g_assert_cmpint(width, ==, GPU_WIDTH);
+    g_assert_cmpint(height, ==, GPU_HEIGHT);
+    header++;
+    g_assert_cmpint(len, ==, header + width * height * 3);
+
+    pixel = (const uint8_t *)data + header + (y * width + x) * 3;
+    return pixel[0] << 16 | pixel[1] << 8 | pixel[2];
+}
+
+static void gpu_setup_resource(GPUTest *t)
+{
+    gpu_create(t);
+    gpu_attach(t);
+    gpu_set_scanout(t);
+}
+
+static bool gpu_skip(bool zero_copy)
+{
+    if (zero_copy && !have_zero_copy()) {
+        g_test_skip("zero-copy needs /dev/udmabuf and memfd");
+        return true;
+    }
+    return false;
+}
+
+static void test_transfer(const void *data)
+{
+    bool zero_copy = GPOINTER_TO_INT(data);
+    GPUTest t;
+
+    if (gpu_skip(zero_copy)) {
+        return;
+    }
+
+    gpu_boot(&t, zero_copy, "");
+    gpu_start(&t);
+    gpu_setup_resource(&t);
+
+    gpu_fill(&t, COLOR_A, COLOR_A);
+    gpu_transfer(&t, 0, GPU_HEIGHT, 0);
+    gpu_flush(&t);
+    g_assert_cmphex(gpu_pixel(&t, 10, 10), ==, COLOR_A);
+
+    gpu_fill(&t, COLOR_C, COLOR_D);
+    gpu_transfer(&t, 0, GPU_HEIGHT, 0);
+    gpu_flush(&t);
+    g_assert_cmphex(gpu_pixel(&t, 0, 0), ==, COLOR_C);
+    g_assert_cmphex(gpu_pixel(&t, 0, GPU_HEIGHT - 1), ==, COLOR_D);
+
+    /*
+     * Copy the top half of the backing store to the bottom half of the
+     * image.  This does not match the layout of the image, so zero-copy
+     * has to fall back to a private copy of the image.
+     */
+    gpu_transfer(&t, GPU_HEIGHT / 2, GPU_HEIGHT / 2, 0);
+    gpu_flush(&t);
+    g_assert_cmphex(gpu_pixel(&t, 0, 0), ==, COLOR_C);
+    g_assert_cmphex(gpu_pixel(&t, 0, GPU_HEIGHT - 1), ==, COLOR_C);
+
+    /* Without a transfer, the image must not change */
+    gpu_fill(&t, COLOR_B, COLOR_B);
+    gpu_flush(&t);
+    g_assert_cmphex(gpu_pixel(&t, 0, 0), ==, COLOR_C);
+
+    /* A full transfer shows the backing store again */
+    gpu_transfer(&t, 0, GPU_HEIGHT, 0);
+    gpu_flush(&t);
+    g_assert_cmphex(gpu_pixel(&t, 0, GPU_HEIGHT - 1), ==, COLOR_B);
+
+    gpu_shutdown(&t);
+}
+
+static void test_detach(const void *data)
+{
+    bool zero_copy = GPOINTER_TO_INT(data);
+    GPUTest t;
+
+    if (gpu_skip(zero_copy)) {
+        return;
+    }
+
+    gpu_boot(&t, zero_copy, "");
+    gpu_start(&t);
+    gpu_setup_resource(&t);
+
+    gpu_fill(&t, COLOR_A, COLOR_A);
+    gpu_transfer(&t, 0, GPU_HEIGHT, 0);
+    gpu_flush(&t);
+
+    /* The image keeps its contents when the backing store goes away */
+    gpu_detach(&t);
+    gpu_fill(&t, COLOR_B, COLOR_B);
+    gpu_flush(&t);
+    g_assert_cmphex(gpu_pixel(&t, 10, 10), ==, COLOR_A);
+
+    /* Attach new backing and show its contents */
+    guest_free(&t.qs->alloc, t.backing);
+    gpu_attach(&t);
+    gpu_fill(&t, COLOR_C, COLOR_C);
+    gpu_transfer(&t, 0, GPU_HEIGHT, 0);
+    gpu_flush(&t);
+    g_assert_cmphex(gpu_pixel(&t, 10, 10), ==, COLOR_C);
+
+    gpu_shutdown(&t);
+}
+
+/* Blob resources have no image, so zero-copy must leave them alone */
+static void test_blob(const void *data)
+{
+    bool zero_copy = GPOINTER_TO_INT(data);
+    GPUTest t;
+
+    if (gpu_skip(zero_copy)) {
+        return;
+    }
+    if (!zero_copy && access("/dev/udmabuf", R_OK | W_OK)) {
+        g_test_skip("blob resources need /dev/udmabuf");
+        return;
+    }
+
+    gpu_boot(&t, zero_copy, "-global virtio-gpu-device.blob=on");
+    gpu_start(&t);
+    gpu_create_blob(&t);
+
+    gpu_attach(&t);
+    gpu_detach(&t);
+    guest_free(&t.qs->alloc, t.backing);
+
+    /* The device still works after attaching backing again */
+    gpu_attach(&t);
+    gpu_detach(&t);
+
+    gpu_shutdown(&t);
+}
+
+static void test_migrate(const void *data)
+{
+    bool zero_copy = GPOINTER_TO_INT(data);
+    g_autofree char *sock = g_build_filename(tmpdir, "migrate.sock", NULL);
+    g_autofree char *uri = g_strdup_printf("unix:%s", sock);
+    g_autofree char *incoming = g_strdup_printf("-incoming %s", uri);
+    GPUTest src, dst;
+
+    if (gpu_skip(zero_copy)) {
+        return;
+    }
+
+    gpu_boot(&src, zero_copy, "");
+    gpu_boot(&dst, zero_copy, incoming);
+    gpu_start(&src);
+    gpu_setup_resource(&src);
+
+    gpu_fill(&src, COLOR_A, COLOR_D);
+    gpu_transfer(&src, 0, GPU_HEIGHT, 0);
+    gpu_flush(&src);
+
+    migrate(src.qs, dst.qs, uri);
+
+    /* The BAR and the virtqueue are part of the migrated guest state */
+    dst.dev->bar = src.dev->bar;
+    dst.dev->vdev = src.dev->vdev;
+    dst.vq = src.vq;
+    dst.vq->vdev = &dst.dev->vdev;
+    dst.backing = src.backing;
+    src.vq = NULL;
+
+    g_assert_cmphex(gpu_pixel(&dst, 0, 0), ==, COLOR_A);
+    g_assert_cmphex(gpu_pixel(&dst, 0, GPU_HEIGHT - 1), ==, COLOR_D);
+
+    /* The destination picks up new contents of the backing store */
+    gpu_fill(&dst, COLOR_B, COLOR_C);
+    gpu_transfer(&dst, 0, GPU_HEIGHT, 0);
+    gpu_flush(&dst);
+    g_assert_cmphex(gpu_pixel(&dst, 0, 0), ==, COLOR_B);
+    g_assert_cmphex(gpu_pixel(&dst, 0, GPU_HEIGHT - 1), ==, COLOR_C);
+
+    gpu_detach(&dst);
+    g_assert_cmphex(gpu_pixel(&dst, 0, 0), ==, COLOR_B);
+
+    gpu_shutdown(&src);
+    gpu_shutdown(&dst);
+}
+
+static void add_gpu_test(const char *name, GTestDataFunc fn)
+{
+    g_autofree char *copy = g_strdup_printf("/virtio-gpu/copy/%s", name);
+    g_autofree char *zero_copy = g_strdup_printf("/virtio-gpu/zero-copy/%s",
+                                                 name);
+
+    qtest_add_data_func(copy, GINT_TO_POINTER(false), fn);
+    qtest_add_data_func(zero_copy, GINT_TO_POINTER(true), fn);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    if (!qtest_has_device("virtio-gpu-pci")) {
+        return g_test_run();
+    }
+
+    tmpdir = g_dir_make_tmp("virtio-gpu-test-XXXXXX", NULL);
+    g_assert(tmpdir);
+
+    add_gpu_test("transfer", test_transfer);
+    add_gpu_test("detach", test_detach);
+    add_gpu_test("blob", test_blob);
+    add_gpu_test("migrate", test_migrate);
+
+    ret = g_test_run();
+
+    g_rmdir(tmpdir);
+    g_free(tmpdir);
+    return ret;
+}
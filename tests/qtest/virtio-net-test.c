@@ -12,10 +12,16 @@
 #include "qemu/iov.h"
 #include "qemu/module.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 #include "hw/virtio/virtio-net.h"
 #include "libqos/qgraph.h"
 #include "libqos/virtio-net.h"
 
+#ifdef CONFIG_AF_XDP
+#include <linux/if_packet.h>
+#include <net/if.h>
+#endif
+
 #ifndef ETH_P_RARP
 #define ETH_P_RARP 0x8035
 #endif
@@ -166,6 +172,132 @@ static void stop_cont_test(void *obj, void *data, QGuestAllocator *t_alloc)
     rx_stop_cont_test(dev, t_alloc, rx, sv[0]);
 }
 
+static void iothread_test(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioNetPCI *net_pci = obj;
+
+    send_recv_test(&net_pci->net, data, t_alloc);
+    stop_cont_test(&net_pci->net, data, t_alloc);
+}
+
+/* Send a command on the control virtqueue and return the ack */
+static uint8_t ctrl_cmd(QVirtioDevice *dev, QGuestAllocator *alloc,
+                        QVirtQueue *vq, uint8_t class, uint8_t cmd,
+                        const void *data, size_t len)
+{
+    QTestState *qts = global_qtest;
+    struct virtio_net_ctrl_hdr hdr = { .class = class, .cmd = cmd };
+    uint64_t req_addr, ack_addr;
+    uint32_t free_head;
+    uint8_t ack;
+
+    req_addr = guest_alloc(alloc, sizeof(hdr) + len);
+    ack_addr = guest_alloc(alloc, sizeof(ack));
+    memwrite(req_addr, &hdr, sizeof(hdr));
+    memwrite(req_addr + sizeof(hdr), data, len);
+    writeb(ack_addr, 0xff);
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, sizeof(hdr) + len,
+                               false, true);
+    qvirtqueue_add(qts, vq, ack_addr, sizeof(ack), true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_NET_TIMEOUT_US);
+
+    ack = readb(ack_addr);
+    guest_free(alloc, req_addr);
+    guest_free(alloc, ack_addr);
+    return ack;
+}
+
+/*
+ * iothread-vq-mapping can only be given in JSON, so the device under test
+ * is hotplugged next to the one from the graph.  None of the backends that
+ * run without privileges has more than one queue, so there is a single
+ * queue pair even though multiqueue is negotiated.
+ */
+static void iothread_vq_mapping_test(void *obj, void *data,
+                                     QGuestAllocator *t_alloc)
+{
+    QVirtioPCIDevice *graph_dev = obj;
+    QPCIBus *bus = graph_dev->pdev->bus;
+    QTestState *qts = bus->qts;
+    QPCIAddress addr = { .devfn = QPCI_DEVFN(PCI_SLOT_HP, 0) };
+    static const uint8_t mac[ETH_ALEN] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x99 };
+    const char *arch = qtest_get_arch();
+    struct virtio_net_ctrl_mq mq;
+    QVirtioPCIDevice *dev;
+    QVirtQueue *rx, *tx, *ctrl;
+    uint64_t features;
+    QDict *rsp, *filter;
+    int *sv = data;
+
+    if (bus->not_hotpluggable) {
+        g_test_skip("pci bus does not support hotplug");
+        return;
+    }
+
+    qtest_qmp_device_add(qts, "virtio-net-pci", "net1",
+                         "{'addr': %s, 'netdev': 'hs1', 'mq': true,"
+                         " 'iothread-vq-mapping': [{'iothread': 'thread0'},"
+                         "                         {'iothread': 'thread1'}]}",
+                         stringify(PCI_SLOT_HP));
+
+    dev = virtio_pci_new(bus, &addr);
+    g_assert(dev);
+    qvirtio_pci_device_enable(dev);
+    qvirtio_start_device(&dev->vdev);
+    features = qvirtio_get_features(&dev->vdev);
+    g_assert(features & (1ull << VIRTIO_NET_F_MQ));
+    g_assert(features & (1ull << VIRTIO_NET_F_CTRL_VQ));
+    features &= ~(QVIRTIO_F_BAD_FEATURE |
+                  (1ull << VIRTIO_RING_F_INDIRECT_DESC) |
+                  (1ull << VIRTIO_RING_F_EVENT_IDX));
+    qvirtio_set_features(&dev->vdev, features);
+    g_assert_cmpint(qvirtio_config_readw(&dev->vdev, 8), ==, 1);
+
+    rx = qvirtqueue_setup(&dev->vdev, t_alloc, 0);
+    tx = qvirtqueue_setup(&dev->vdev, t_alloc, 1);
+    ctrl = qvirtqueue_setup(&dev->vdev, t_alloc, 2);
+
+    /* Starts the dataplane, with the guest notifiers set up */
+    qvirtio_set_driver_ok(&dev->vdev);
+
+    rx_test(&dev->vdev, t_alloc, rx, sv[2]);
+    tx_test(&dev->vdev, t_alloc, tx, sv[2]);
+
+    /* Control commands move the queue pair to the main loop and back */
+    mq.virtqueue_pairs = qvirtio_is_big_endian(&dev->vdev) ?
+                         cpu_to_be16(1) : cpu_to_le16(1);
+    g_assert_cmpint(ctrl_cmd(&dev->vdev, t_alloc, ctrl, VIRTIO_NET_CTRL_MQ,
+                             VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+                             &mq, sizeof(mq)), ==, VIRTIO_NET_OK);
+    g_assert_cmpint(ctrl_cmd(&dev->vdev, t_alloc, ctrl, VIRTIO_NET_CTRL_MAC,
+                             VIRTIO_NET_CTRL_MAC_ADDR_SET,
+                             mac, sizeof(mac)), ==, VIRTIO_NET_OK);
+
+    rsp = qtest_qmp(qts, "{'execute': 'query-rx-filter',"
+                         " 'arguments': {'name': 'net1'}}");
+    filter = qobject_to(QDict, qlist_peek(qdict_get_qlist(rsp, "return")));
+    g_assert_cmpstr(qdict_get_str(filter, "main-mac"), ==,
+                    "52:54:00:12:34:99");
+    qobject_unref(rsp);
+
+    rx_test(&dev->vdev, t_alloc, rx, sv[2]);
+    tx_test(&dev->vdev, t_alloc, tx, sv[2]);
+
+    qvirtqueue_cleanup(dev->vdev.bus, rx, t_alloc);
+    qvirtqueue_cleanup(dev->vdev.bus, tx, t_alloc);
+    qvirtqueue_cleanup(dev->vdev.bus, ctrl, t_alloc);
+    qvirtio_pci_device_disable(dev);
+    g_free(dev->pdev);
+    g_free(dev);
+
+    if (strcmp(arch, "i386") == 0 || strcmp(arch, "x86_64") == 0) {
+        qpci_unplug_acpi_device_test(qts, "net1", PCI_SLOT_HP);
+    }
+}
+
 static void hotplug(void *obj, void *data, QGuestAllocator *t_alloc)
 {
     QVirtioPCIDevice *dev = obj;
@@ -285,6 +417,333 @@ static void *virtio_net_test_setup(GString *cmd_line, void *arg)
     return sv;
 }
 
+static void *virtio_net_test_setup_iothread(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line, " -object iothread,id=thread0 ");
+    return virtio_net_test_setup(cmd_line, arg);
+}
+
+static void virtio_net_test_cleanup_vq_mapping(void *sockets)
+{
+    int *sv = sockets;
+
+    close(sv[0]);
+    close(sv[2]);
+    qos_invalidate_command_line();
+    close(sv[1]);
+    close(sv[3]);
+    g_free(sv);
+}
+
+/* hs0 is used by the device from the graph, hs1 by the hotplugged one */
+static void *virtio_net_test_setup_vq_mapping(GString *cmd_line, void *arg)
+{
+    int ret;
+    int *sv = g_new(int, 4);
+
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, sv);
+    g_assert_cmpint(ret, !=, -1);
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, sv + 2);
+    g_assert_cmpint(ret, !=, -1);
+
+    g_string_append_printf(cmd_line,
+                           " -object iothread,id=thread0"
+                           " -object iothread,id=thread1"
+                           " -netdev socket,fd=%d,id=hs0"
+                           " -netdev socket,fd=%d,id=hs1 ", sv[1], sv[3]);
+
+    g_test_queue_destroy(virtio_net_test_cleanup_vq_mapping, sv);
+    return sv;
+}
+
+#ifdef CONFIG_AF_XDP
+/*
+ * Throughput of an af-xdp backend processed in an IOThread.  Like pktgen,
+ * bursts of frames are sent into one end of a veth pair, while the af-xdp
+ * backend is attached to the other end.  Creating the veth pair changes the
+ * host network configuration and needs CAP_NET_ADMIN, so the test only runs
+ * when AF_XDP_TEST_ENV is set, and is skipped otherwise.
+ */
+
+#define AF_XDP_TEST_ENV         "QTEST_AF_XDP"
+
+#define AF_XDP_TEST_PACKETS     128
+#define AF_XDP_TEST_FRAME_SIZE  60
+#define AF_XDP_TEST_BUF_SIZE    128
+#define AF_XDP_TEST_ETH_P       0x88b5 /* local experimental */
+
+typedef struct AFXDPTest {
+    char ifname[IFNAMSIZ];      /* veth end used by the test */
+    char peer_ifname[IFNAMSIZ]; /* veth end used by the backend */
+    bool enabled;               /* AF_XDP_TEST_ENV is set */
+    int sock;                   /* AF_PACKET socket on ifname, or -1 */
+    int sv[2];                  /* fallback backend when sock is -1 */
+} AFXDPTest;
+
+static bool af_xdp_test_ip(const char *fmt, ...)
+{
+    g_autofree char *args = NULL;
+    g_autofree char *cmd = NULL;
+    int status;
+    va_list ap;
+
+    va_start(ap, fmt);
+    args = g_strdup_vprintf(fmt, ap);
+    va_end(ap);
+
+    cmd = g_strdup_printf("ip %s", args);
+    return g_spawn_command_line_sync(cmd, NULL, NULL, &status, NULL) &&
+           g_spawn_check_exit_status(status, NULL);
+}
+
+static int af_xdp_test_socket(const char *ifname)
+{
+    struct sockaddr_ll addr = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(AF_XDP_TEST_ETH_P),
+        .sll_ifindex = if_nametoindex(ifname),
+    };
+    struct timeval tv = { .tv_sec = 5 };
+    int fd;
+
+    fd = socket(AF_PACKET, SOCK_RAW, htons(AF_XDP_TEST_ETH_P));
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void af_xdp_test_frame(uint8_t *frame, unsigned int seq)
+{
+    static const uint8_t src[ETH_ALEN] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+    uint16_t proto = htons(AF_XDP_TEST_ETH_P);
+
+    memset(frame, 0, AF_XDP_TEST_FRAME_SIZE);
+    memset(frame, 0xff, ETH_ALEN);
+    memcpy(frame + ETH_ALEN, src, ETH_ALEN);
+    memcpy(frame + 2 * ETH_ALEN, &proto, sizeof(proto));
+    memcpy(frame + 2 * ETH_ALEN + sizeof(proto), &seq, sizeof(seq));
+}
+
+/*
+ * Check that @frame is one of the test frames, and that it was not seen
+ * before according to @seen.
+ */
+static void af_xdp_test_check_frame(const uint8_t *frame, bool *seen)
+{
+    uint8_t expected[AF_XDP_TEST_FRAME_SIZE];
+    unsigned int seq;
+
+    memcpy(&seq, frame + 2 * ETH_ALEN + sizeof(uint16_t), sizeof(seq));
+    g_assert_cmpuint(seq, <, AF_XDP_TEST_PACKETS);
+    g_assert(!seen[seq]);
+    seen[seq] = true;
+
+    af_xdp_test_frame(expected, seq);
+    g_assert_cmpmem(frame, AF_XDP_TEST_FRAME_SIZE, expected, sizeof(expected));
+}
+
+static void af_xdp_test_report(const char *dir, gint64 start)
+{
+    gint64 us = MAX(g_get_monotonic_time() - start, 1);
+
+    g_test_message("af-xdp %s: %d packets in %" PRId64 " us, %.0f pps",
+                   dir, AF_XDP_TEST_PACKETS, us,
+                   AF_XDP_TEST_PACKETS * 1e6 / us);
+}
+
+/* Backend to guest: the frames must all land in the rx queue */
+static void af_xdp_rx_throughput(QVirtioDevice *dev, QGuestAllocator *alloc,
+                                 QVirtQueue *vq, AFXDPTest *t)
+{
+    QTestState *qts = global_qtest;
+    /* Leave room for whatever else the kernel sends on the link */
+    int n_bufs = MIN(vq->size, AF_XDP_TEST_PACKETS * 3 / 2);
+    uint8_t frame[AF_XDP_TEST_FRAME_SIZE];
+    bool seen[AF_XDP_TEST_PACKETS] = { false };
+    uint64_t req_addr;
+    uint32_t first_head = 0;
+    int i, received = 0;
+    gint64 start;
+
+    req_addr = guest_alloc(alloc, n_bufs * AF_XDP_TEST_BUF_SIZE);
+    for (i = 0; i < n_bufs; i++) {
+        uint32_t head = qvirtqueue_add(qts, vq,
+                                       req_addr + i * AF_XDP_TEST_BUF_SIZE,
+                                       AF_XDP_TEST_BUF_SIZE, true, false);
+        if (i == 0) {
+            first_head = head;
+        }
+        qvirtqueue_kick(qts, dev, vq, head);
+    }
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < AF_XDP_TEST_PACKETS; i++) {
+        af_xdp_test_frame(frame, i);
+        g_assert_cmpint(send(t->sock, frame, sizeof(frame), 0), ==,
+                        sizeof(frame));
+    }
+
+    while (received < AF_XDP_TEST_PACKETS) {
+        uint32_t desc_idx, len;
+        uint16_t proto;
+
+        if (!qvirtqueue_get_buf(qts, vq, &desc_idx, &len)) {
+            g_assert(g_get_monotonic_time() - start <=
+                     QVIRTIO_NET_TIMEOUT_US);
+            continue;
+        }
+
+        g_assert_cmpint(desc_idx - first_head, <, n_bufs);
+        memread(req_addr + (desc_idx - first_head) * AF_XDP_TEST_BUF_SIZE +
+                VNET_HDR_SIZE, frame, sizeof(frame));
+        memcpy(&proto, frame + 2 * ETH_ALEN, sizeof(proto));
+        if (proto != htons(AF_XDP_TEST_ETH_P)) {
+            continue;
+        }
+
+        g_assert_cmpuint(len, ==, VNET_HDR_SIZE + AF_XDP_TEST_FRAME_SIZE);
+        af_xdp_test_check_frame(frame, seen);
+        received++;
+    }
+    af_xdp_test_report("rx", start);
+
+    guest_free(alloc, req_addr);
+}
+
+/* Guest to backend: the frames must all come out of the veth pair */
+static void af_xdp_tx_throughput(QVirtioDevice *dev, QGuestAllocator *alloc,
+                                 QVirtQueue *vq, AFXDPTest *t)
+{
+    QTestState *qts = global_qtest;
+    uint8_t buf[VNET_HDR_SIZE + AF_XDP_TEST_FRAME_SIZE] = { 0 };
+    bool seen[AF_XDP_TEST_PACKETS] = { false };
+    uint64_t req_addr;
+    int i, completed = 0, received = 0;
+    gint64 start;
+
+    req_addr = guest_alloc(alloc, AF_XDP_TEST_PACKETS * AF_XDP_TEST_BUF_SIZE);
+    for (i = 0; i < AF_XDP_TEST_PACKETS; i++) {
+        af_xdp_test_frame(buf + VNET_HDR_SIZE, i);
+        memwrite(req_addr + i * AF_XDP_TEST_BUF_SIZE, buf, sizeof(buf));
+    }
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < AF_XDP_TEST_PACKETS; i++) {
+        uint32_t head = qvirtqueue_add(qts, vq,
+                                       req_addr + i * AF_XDP_TEST_BUF_SIZE,
+                                       sizeof(buf), false, false);
+        qvirtqueue_kick(qts, dev, vq, head);
+    }
+
+    while (completed < AF_XDP_TEST_PACKETS) {
+        if (qvirtqueue_get_buf(qts, vq, NULL, NULL)) {
+            completed++;
+            continue;
+        }
+        g_assert(g_get_monotonic_time() - start <= QVIRTIO_NET_TIMEOUT_US);
+    }
+
+    while (received < AF_XDP_TEST_PACKETS) {
+        struct sockaddr_ll addr;
+        socklen_t addrlen = sizeof(addr);
+        ssize_t ret;
+
+        ret = recvfrom(t->sock, buf, sizeof(buf), 0,
+                       (struct sockaddr *)&addr, &addrlen);
+        g_assert_cmpint(ret, ==, AF_XDP_TEST_FRAME_SIZE);
+        if (addr.sll_pkttype != PACKET_OUTGOING) {
+            af_xdp_test_check_frame(buf, seen);
+            received++;
+        }
+    }
+    af_xdp_test_report("tx", start);
+
+    guest_free(alloc, req_addr);
+}
+
+static void af_xdp_throughput(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioNetPCI *net_pci = obj;
+    QVirtioNet *net_if = &net_pci->net;
+    AFXDPTest *t = data;
+
+    if (!t->enabled) {
+        g_test_skip("set " AF_XDP_TEST_ENV "=1 to create a veth pair");
+        return;
+    }
+    if (t->sock < 0) {
+        g_test_skip("creating a veth pair requires CAP_NET_ADMIN");
+        return;
+    }
+
+    af_xdp_rx_throughput(net_if->vdev, t_alloc, net_if->queues[0], t);
+    af_xdp_tx_throughput(net_if->vdev, t_alloc, net_if->queues[1], t);
+}
+
+static void virtio_net_test_cleanup_af_xdp(void *data)
+{
+    AFXDPTest *t = data;
+
+    qos_invalidate_command_line();
+    if (t->sock >= 0) {
+        close(t->sock);
+        af_xdp_test_ip("link del %s", t->ifname);
+    } else {
+        close(t->sv[0]);
+        close(t->sv[1]);
+    }
+    g_free(t);
+}
+
+static void *virtio_net_test_setup_af_xdp(GString *cmd_line, void *arg)
+{
+    AFXDPTest *t = g_new0(AFXDPTest, 1);
+    int ret;
+
+    g_string_append(cmd_line, " -object iothread,id=thread0 ");
+
+    snprintf(t->ifname, sizeof(t->ifname), "qtxdp%d", getpid());
+    snprintf(t->peer_ifname, sizeof(t->peer_ifname), "qtxdp%dp", getpid());
+    t->enabled = getenv(AF_XDP_TEST_ENV) != NULL;
+    t->sock = -1;
+
+    if (t->enabled &&
+        af_xdp_test_ip("link add %s type veth peer name %s",
+                       t->ifname, t->peer_ifname)) {
+        /* No IPv6 autoconfiguration traffic on the link, please */
+        if (af_xdp_test_ip("link set %s addrgenmode none up", t->ifname) &&
+            af_xdp_test_ip("link set %s addrgenmode none up",
+                           t->peer_ifname)) {
+            t->sock = af_xdp_test_socket(t->ifname);
+        }
+        if (t->sock < 0) {
+            af_xdp_test_ip("link del %s", t->ifname);
+        }
+    }
+
+    if (t->sock >= 0) {
+        g_string_append_printf(cmd_line,
+                               " -netdev af-xdp,id=hs0,ifname=%s,mode=skb ",
+                               t->peer_ifname);
+    } else {
+        /* QEMU must still start, the test is skipped */
+        ret = socketpair(PF_UNIX, SOCK_STREAM, 0, t->sv);
+        g_assert_cmpint(ret, !=, -1);
+        g_string_append_printf(cmd_line, " -netdev socket,fd=%d,id=hs0 ",
+                               t->sv[1]);
+    }
+
+    g_test_queue_destroy(virtio_net_test_cleanup_af_xdp, t);
+    return t;
+}
+#endif /* CONFIG_AF_XDP */
+
 #endif /* _WIN32 */
 
 static void large_tx(void *obj, void *data, QGuestAllocator *t_alloc)
@@ -328,6 +787,22 @@ static void register_virtio_net_test(void)
     qos_add_test("basic", "virtio-net", send_recv_test, &opts);
     qos_add_test("rx_stop_cont", "virtio-net", stop_cont_test, &opts);
     qos_add_test("announce-self", "virtio-net", announce_self, &opts);
+
+    opts.before = virtio_net_test_setup_iothread;
+    opts.edge = (QOSGraphEdgeOptions) {
+        .extra_device_opts = "iothread=thread0",
+    };
+    qos_add_test("iothread", "virtio-net-pci", iothread_test, &opts);
+#ifdef CONFIG_AF_XDP
+    opts.before = virtio_net_test_setup_af_xdp;
+    qos_add_test("af-xdp/throughput", "virtio-net-pci", af_xdp_throughput,
+                 &opts);
+#endif
+    opts.edge = (QOSGraphEdgeOptions) { };
+
+    opts.before = virtio_net_test_setup_vq_mapping;
+    qos_add_test("iothread-vq-mapping", "virtio-net-pci",
+                 iothread_vq_mapping_test, &opts);
 #endif
 
     /* These tests do not need a loopback backend.  */
@@ -0,0 +1,80 @@
+/*
+ * Test that the inexact flag is exact, even while it is clear.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Guests often clear the FP exception flags and then test them after a
+ * few operations.  QEMU may compute the inexact flag lazily in that case,
+ * so check that it is set by exactly the operations that round, and that
+ * the flags are correct after a system call too.
+ */
+#include <fenv.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef FE_INEXACT
+static volatile double d_three = 3.0, d_one = 1.0, d_half = 0.5;
+static volatile float f_three = 3.0f, f_one = 1.0f;
+
+static void check(bool expect, const char *what)
+{
+    if (!!fetestexcept(FE_INEXACT) != expect) {
+        fprintf(stderr, "%s: inexact flag %s\n", what,
+                expect ? "not set" : "set");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(void)
+{
+    volatile double d;
+    volatile float f;
+    int i;
+
+    /* Nothing to test if the guest ABI does not support FP exceptions. */
+    if (feraiseexcept(FE_INEXACT) || !fetestexcept(FE_INEXACT)) {
+        return EXIT_SUCCESS;
+    }
+
+    for (i = 0; i < 1000; i++) {
+        feclearexcept(FE_ALL_EXCEPT);
+        d = d_one + d_half;
+        d = d * d_three;
+        check(false, "exact double ops");
+
+        d = d_one / d_three;
+        check(true, "inexact double div");
+
+        feclearexcept(FE_INEXACT);
+        f = f_one * f_three;
+        check(false, "exact float mul");
+
+        f = f_one / f_three;
+        check(true, "inexact float div");
+
+        /* The flag must survive leaving the emulation loop. */
+        getpid();
+        check(true, "inexact flag after syscall");
+
+        feclearexcept(FE_INEXACT);
+        getpid();
+        d = d_one - d_half;
+        check(false, "exact double sub after syscall");
+
+        d = d_one / d_three;
+        feclearexcept(FE_INEXACT);
+        f = d;
+        check(true, "inexact conversion");
+    }
+    (void)d;
+    (void)f;
+    return EXIT_SUCCESS;
+}
+#else
+int main(void)
+{
+    return EXIT_SUCCESS;
+}
+#endif
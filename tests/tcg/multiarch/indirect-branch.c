@@ -0,0 +1,137 @@
+/*
+ * Test indirect branches whose targets change between executions.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * QEMU may cache the targets of an indirect branch in the translated
+ * code.  Call through a single function pointer call site with targets
+ * that vary per thread and per iteration, and check that the right
+ * function is called every time.  Recursion exercises returns to many
+ * different call sites as well.
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#define THREAD_COUNT 4
+#define ITERATIONS 200000
+
+typedef unsigned (*op_fn)(unsigned);
+
+static unsigned __attribute__((noinline)) op_add(unsigned x)
+{
+    return x + 3;
+}
+
+static unsigned __attribute__((noinline)) op_xor(unsigned x)
+{
+    return x ^ 0x55;
+}
+
+static unsigned __attribute__((noinline)) op_mul(unsigned x)
+{
+    return x * 5;
+}
+
+static unsigned __attribute__((noinline)) op_shr(unsigned x)
+{
+    return x >> 1;
+}
+
+static unsigned __attribute__((noinline)) op_not(unsigned x)
+{
+    return ~x;
+}
+
+static op_fn ops[] = { op_add, op_xor, op_mul, op_shr, op_not };
+#define N_OPS (sizeof(ops) / sizeof(ops[0]))
+
+static unsigned __attribute__((noinline)) dispatch(op_fn fn, unsigned x)
+{
+    return fn(x);
+}
+
+static unsigned __attribute__((noinline)) emulate(int i, unsigned x)
+{
+    switch (i) {
+    case 0:
+        return x + 3;
+    case 1:
+        return x ^ 0x55;
+    case 2:
+        return x * 5;
+    case 3:
+        return x >> 1;
+    default:
+        return ~x;
+    }
+}
+
+static unsigned __attribute__((noinline)) recurse(unsigned depth, unsigned x)
+{
+    if (depth == 0) {
+        return x;
+    }
+    if (depth & 1) {
+        return recurse(depth - 1, x + depth);
+    }
+    return recurse(depth - 1, x ^ depth) + 1;
+}
+
+static unsigned recurse_expected(unsigned depth, unsigned x)
+{
+    unsigned add = 0;
+
+    for (; depth; depth--) {
+        if (depth & 1) {
+            x += depth;
+        } else {
+            x ^= depth;
+            add++;
+        }
+    }
+    return x + add;
+}
+
+static void *thread_func(void *arg)
+{
+    unsigned id = (unsigned)(long)arg;
+    unsigned x = id, y = id;
+    int i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        /*
+         * Mostly one or two targets per thread, with occasional
+         * others, and a different mix in each thread.
+         */
+        int op = (i % 17 == 0) ? (i / 17) % N_OPS
+                 : (id + (i & 1)) % N_OPS;
+
+        x = dispatch(ops[op], x);
+        y = emulate(op, y);
+        assert(x == y);
+    }
+    for (i = 0; i < 64; i++) {
+        assert(recurse(i, id) == recurse_expected(i, id));
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[THREAD_COUNT];
+    long i;
+    int ret;
+
+    /* Run once without threads, then with concurrent claims. */
+    thread_func((void *)(long)THREAD_COUNT);
+    for (i = 0; i < THREAD_COUNT; i++) {
+        ret = pthread_create(&threads[i], NULL, thread_func, (void *)i);
+        assert(ret == 0);
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        ret = pthread_join(threads[i], NULL);
+        assert(ret == 0);
+    }
+    return EXIT_SUCCESS;
+}
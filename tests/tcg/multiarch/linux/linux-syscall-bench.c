@@ -0,0 +1,80 @@
+/*
+ * Measure the cost of simple system calls.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Print the average time taken by cheap system calls, both ones that
+ * QEMU can pass straight to the host and ones that need conversion,
+ * and check that they still return the right values.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COUNT 100000
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double start)
+{
+    printf("%-12s %8.1f ns/call\n", name, (now() - start) / COUNT);
+}
+
+int main(void)
+{
+    pid_t pid = getpid();
+    uid_t uid = getuid(), u;
+    mode_t mask = umask(022);
+    int fd[2], i, ret;
+    char c = 'x';
+    double start;
+
+    start = now();
+    for (i = 0; i < COUNT; i++) {
+        /* Bypass any caching of the pid in the C library. */
+        ret = syscall(SYS_getpid);
+        assert(ret == pid);
+    }
+    report("getpid", start);
+
+    start = now();
+    for (i = 0; i < COUNT; i++) {
+        u = getuid();
+        assert(u == uid);
+    }
+    report("getuid", start);
+
+    start = now();
+    for (i = 0; i < COUNT; i++) {
+        ret = umask(i & 1 ? 022 : 077);
+        assert(ret == (i & 1 ? 077 : 022));
+    }
+    report("umask", start);
+    umask(mask);
+
+    ret = pipe(fd);
+    assert(ret == 0);
+    start = now();
+    for (i = 0; i < COUNT; i++) {
+        ret = write(fd[1], &c, 1);
+        assert(ret == 1);
+        ret = read(fd[0], &c, 1);
+        assert(ret == 1 && c == 'x');
+    }
+    report("write+read", start);
+    close(fd[0]);
+    close(fd[1]);
+
+    return EXIT_SUCCESS;
+}
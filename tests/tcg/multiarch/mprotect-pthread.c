@@ -0,0 +1,178 @@
+/*
+ * Test that concurrent mapping changes do not race.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Each worker thread owns a private region of memory and repeatedly
+ * changes its protection, remaps, discards and unmaps pages in it,
+ * checking that the contents always match what the thread expects.
+ * At the same time, all workers flip the protection of a shared region
+ * between read-only and read-write, while checking that its contents
+ * stay readable and unchanged.
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define THREAD_COUNT 4
+#define PAGES_PER_THREAD 16
+#define SHARED_PAGES 8
+#define ITERATIONS 5000
+
+struct context {
+    int pagesize;
+    char *shared;
+};
+
+struct worker {
+    pthread_t thread;
+    struct context *ctx;
+    unsigned int seed;
+    char *region;
+    /* Pattern of each page, or 0 if it is zero-filled. */
+    unsigned char pattern[PAGES_PER_THREAD];
+};
+
+static void check_page(const char *p, unsigned char pattern, int pagesize)
+{
+    int i;
+
+    for (i = 0; i < pagesize; i += 64) {
+        assert((unsigned char)p[i] == pattern);
+    }
+}
+
+static void fill_page(char *p, unsigned char pattern, int pagesize)
+{
+    memset(p, pattern, pagesize);
+}
+
+static void private_step(struct worker *w)
+{
+    int pagesize = w->ctx->pagesize;
+    int idx = rand_r(&w->seed) % PAGES_PER_THREAD;
+    int npages = 1 + rand_r(&w->seed) % (PAGES_PER_THREAD - idx);
+    char *p = w->region + (size_t)idx * pagesize;
+    size_t len = (size_t)npages * pagesize;
+    unsigned char pattern;
+    int i, ret;
+
+    switch (rand_r(&w->seed) % 4) {
+    case 0:
+        /* Drop write access, check that the contents survive. */
+        ret = mprotect(p, len, PROT_READ);
+        assert(ret == 0);
+        for (i = 0; i < npages; i++) {
+            check_page(p + i * pagesize, w->pattern[idx + i], pagesize);
+        }
+        ret = mprotect(p, len, PROT_READ | PROT_WRITE);
+        assert(ret == 0);
+        break;
+    case 1:
+        /* Rewrite the pages. */
+        pattern = 1 + rand_r(&w->seed) % 255;
+        for (i = 0; i < npages; i++) {
+            fill_page(p + i * pagesize, pattern, pagesize);
+            w->pattern[idx + i] = pattern;
+        }
+        break;
+    case 2:
+        /* Discard the pages, which must read back as zero. */
+        ret = madvise(p, len, MADV_DONTNEED);
+        assert(ret == 0);
+        memset(&w->pattern[idx], 0, npages);
+        break;
+    case 3:
+        /* Unmap and map fresh anonymous memory at the same address. */
+        ret = munmap(p, len);
+        assert(ret == 0);
+        p = mmap(p, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        assert(p != MAP_FAILED);
+        memset(&w->pattern[idx], 0, npages);
+        break;
+    }
+
+    for (i = 0; i < npages; i++) {
+        check_page(p + i * pagesize, w->pattern[idx + i], pagesize);
+    }
+}
+
+static void shared_step(struct worker *w)
+{
+    struct context *ctx = w->ctx;
+    int idx = rand_r(&w->seed) % SHARED_PAGES;
+    int npages = 1 + rand_r(&w->seed) % (SHARED_PAGES - idx);
+    char *p = ctx->shared + (size_t)idx * ctx->pagesize;
+    int prot = PROT_READ | (rand_r(&w->seed) & 1 ? PROT_WRITE : 0);
+    int i, ret;
+
+    ret = mprotect(p, (size_t)npages * ctx->pagesize, prot);
+    assert(ret == 0);
+
+    for (i = 0; i < SHARED_PAGES; i++) {
+        check_page(ctx->shared + i * ctx->pagesize, 0x5a, ctx->pagesize);
+    }
+}
+
+static void *thread_func(void *arg)
+{
+    struct worker *w = arg;
+    int i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        private_step(w);
+        shared_step(w);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    struct worker workers[THREAD_COUNT];
+    struct context ctx;
+    size_t region_size;
+    char *base;
+    int i, ret;
+
+    ctx.pagesize = getpagesize();
+    region_size = (size_t)PAGES_PER_THREAD * ctx.pagesize;
+
+    ctx.shared = mmap(NULL, (size_t)SHARED_PAGES * ctx.pagesize,
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    assert(ctx.shared != MAP_FAILED);
+    memset(ctx.shared, 0x5a, (size_t)SHARED_PAGES * ctx.pagesize);
+
+    /* Place the private regions next to each other, to share host pages. */
+    base = mmap(NULL, region_size * THREAD_COUNT, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(base != MAP_FAILED);
+
+    for (i = 0; i < THREAD_COUNT; i++) {
+        workers[i].ctx = &ctx;
+        workers[i].seed = i + 1;
+        workers[i].region = base + i * region_size;
+        memset(workers[i].pattern, 0, sizeof(workers[i].pattern));
+        ret = pthread_create(&workers[i].thread, NULL, thread_func,
+                             &workers[i]);
+        assert(ret == 0);
+    }
+
+    for (i = 0; i < THREAD_COUNT; i++) {
+        ret = pthread_join(workers[i].thread, NULL);
+        assert(ret == 0);
+    }
+
+    ret = munmap(base, region_size * THREAD_COUNT);
+    assert(ret == 0);
+    ret = munmap(ctx.shared, (size_t)SHARED_PAGES * ctx.pagesize);
+    assert(ret == 0);
+
+    return EXIT_SUCCESS;
+}
@@ -24,9 +24,22 @@ typedef struct {
     uint64_t tb_cond_track_count;
     uint64_t insn_cond_num_trigger;
     uint64_t insn_cond_track_count;
+    uint64_t mem_sample_num_trigger;
+    uint64_t mem_sample_track_count;
+    uint64_t mem_filter_expected;
+    uint64_t mem_filter_count;
 } CPUCount;
 
 static const uint64_t cond_trigger_limit = 100;
+static const uint64_t mem_sample_period = 7;
+
+/* 4 and 8 byte accesses within the low 4 GiB, except the first 64 KiB */
+static const struct qemu_plugin_mem_filter mem_filter = {
+    .rw = QEMU_PLUGIN_MEM_RW,
+    .addr_min = 0x10000,
+    .addr_max = 0xffffffff,
+    .size_mask = (1 << 2) | (1 << 3),
+};
 
 typedef struct {
     uint64_t data_insn;
@@ -45,6 +58,10 @@ static qemu_plugin_u64 tb_cond_num_trigger;
 static qemu_plugin_u64 tb_cond_track_count;
 static qemu_plugin_u64 insn_cond_num_trigger;
 static qemu_plugin_u64 insn_cond_track_count;
+static qemu_plugin_u64 mem_sample_num_trigger;
+static qemu_plugin_u64 mem_sample_track_count;
+static qemu_plugin_u64 mem_filter_expected;
+static qemu_plugin_u64 mem_filter_count;
 static struct qemu_plugin_scoreboard *data;
 static qemu_plugin_u64 data_insn;
 static qemu_plugin_u64 data_tb;
@@ -142,20 +159,34 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
             qemu_plugin_u64_get(insn_cond_num_trigger, i);
         const uint64_t insn_cond_left =
             qemu_plugin_u64_get(insn_cond_track_count, i);
+        const uint64_t mem_sample_trigger =
+            qemu_plugin_u64_get(mem_sample_num_trigger, i);
+        const uint64_t mem_sample_left =
+            qemu_plugin_u64_get(mem_sample_track_count, i);
+        const uint64_t mem_filter_exp =
+            qemu_plugin_u64_get(mem_filter_expected, i);
+        const uint64_t mem_filter_cnt =
+            qemu_plugin_u64_get(mem_filter_count, i);
         g_string_printf(stats, "cpu %d: tb (%" PRIu64 ", %" PRIu64
                         ", %" PRIu64 " * %" PRIu64 " + %" PRIu64
                         ") | "
                         "insn (%" PRIu64 ", %" PRIu64
                         ", %" PRIu64 " * %" PRIu64 " + %" PRIu64
                         ") | "
-                        "mem (%" PRIu64 ", %" PRIu64 ")"
+                        "mem (%" PRIu64 ", %" PRIu64
+                        ", %" PRIu64 " * %" PRIu64 " + %" PRIu64
+                        ", filtered %" PRIu64 " of %" PRIu64
+                        ")"
                         "\n",
                         i,
                         tb, tb_inline,
                         tb_cond_trigger, cond_trigger_limit, tb_cond_left,
                         insn, insn_inline,
                         insn_cond_trigger, cond_trigger_limit, insn_cond_left,
-                        mem, mem_inline);
+                        mem, mem_inline,
+                        mem_sample_trigger, mem_sample_period,
+                        mem_sample_left,
+                        mem_filter_cnt, mem_filter_exp);
         qemu_plugin_outs(stats->str);
         g_assert(tb == tb_inline);
         g_assert(insn == insn_inline);
@@ -164,6 +195,9 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
         g_assert(tb_cond_left == tb % cond_trigger_limit);
         g_assert(insn_cond_trigger == insn / cond_trigger_limit);
         g_assert(insn_cond_left == insn % cond_trigger_limit);
+        g_assert(mem_sample_trigger == mem / mem_sample_period);
+        g_assert(mem_sample_left == mem % mem_sample_period);
+        g_assert(mem_filter_cnt == mem_filter_exp);
     }
 
     stats_tb();
@@ -211,18 +245,49 @@ static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
     g_mutex_unlock(&insn_lock);
 }
 
+static bool mem_filter_match(qemu_plugin_meminfo_t info, uint64_t vaddr)
+{
+    unsigned int size_shift = qemu_plugin_mem_size_shift(info);
+
+    return vaddr >= mem_filter.addr_min && vaddr <= mem_filter.addr_max &&
+           (mem_filter.size_mask & (1 << size_shift));
+}
+
 static void vcpu_mem_access(unsigned int cpu_index,
                             qemu_plugin_meminfo_t info,
                             uint64_t vaddr,
                             void *udata)
 {
     qemu_plugin_u64_add(count_mem, cpu_index, 1);
+    if (mem_filter_match(info, vaddr)) {
+        qemu_plugin_u64_add(mem_filter_expected, cpu_index, 1);
+    }
     g_assert(qemu_plugin_u64_get(data_mem, cpu_index) == (uintptr_t) udata);
     g_mutex_lock(&mem_lock);
     global_count_mem++;
     g_mutex_unlock(&mem_lock);
 }
 
+static void vcpu_mem_sampled_access(unsigned int cpu_index,
+                                    qemu_plugin_meminfo_t info,
+                                    uint64_t vaddr,
+                                    void *udata)
+{
+    g_assert(qemu_plugin_u64_get(mem_sample_track_count, cpu_index) == 0);
+    g_assert(qemu_plugin_u64_get(data_mem, cpu_index) == (uintptr_t) udata);
+    qemu_plugin_u64_add(mem_sample_num_trigger, cpu_index, 1);
+}
+
+static void vcpu_mem_filtered_access(unsigned int cpu_index,
+                                     qemu_plugin_meminfo_t info,
+                                     uint64_t vaddr,
+                                     void *udata)
+{
+    g_assert(mem_filter_match(info, vaddr));
+    g_assert(qemu_plugin_u64_get(data_mem, cpu_index) == (uintptr_t) udata);
+    qemu_plugin_u64_add(mem_filter_count, cpu_index, 1);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     void *tb_store = tb;
@@ -270,6 +335,18 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             insn, QEMU_PLUGIN_MEM_RW,
             QEMU_PLUGIN_INLINE_ADD_U64,
             count_mem_inline, 1);
+
+        struct qemu_plugin_mem_filter sample = {
+            .rw = QEMU_PLUGIN_MEM_RW,
+            .period = mem_sample_period,
+            .counter = mem_sample_track_count,
+        };
+        qemu_plugin_register_vcpu_mem_filtered_cb(
+            insn, vcpu_mem_sampled_access, QEMU_PLUGIN_CB_NO_REGS,
+            &sample, mem_store);
+        qemu_plugin_register_vcpu_mem_filtered_cb(
+            insn, vcpu_mem_filtered_access, QEMU_PLUGIN_CB_NO_REGS,
+            &mem_filter, mem_store);
     }
 }
 
@@ -298,6 +375,14 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         counts, CPUCount, insn_cond_num_trigger);
     insn_cond_track_count = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, insn_cond_track_count);
+    mem_sample_num_trigger = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, mem_sample_num_trigger);
+    mem_sample_track_count = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, mem_sample_track_count);
+    mem_filter_expected = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, mem_filter_expected);
+    mem_filter_count = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, mem_filter_count);
     data = qemu_plugin_scoreboard_new(sizeof(CPUData));
     data_insn = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_insn);
     data_tb = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_tb);
@@ -0,0 +1,189 @@
+/*
+ * Demonstrates and tests usage of trace record rings.
+ *
+ * Records are read by a separate thread while the guest runs, and
+ * checked against inline counters at exit. The rings are kept small
+ * so that vcpus regularly have to wait for the reader.
+ *
+ * The same events are also recorded into an even smaller ring in
+ * QEMU_PLUGIN_RING_DROP mode, which the reader does not always keep up
+ * with: every record must then be either read or counted as lost.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define RING_SIZE 256
+#define DROP_RING_SIZE 16
+#define READ_BATCH 64
+
+typedef struct {
+    uint64_t tb;
+    uint64_t insn;
+    uint64_t mem;
+} CPUCount;
+
+/* Reader side state, only accessed by the reader */
+typedef struct {
+    CPUCount count;
+    uint64_t last_insn_pc;
+    uint64_t dropring_read;
+} CPURead;
+
+static struct qemu_plugin_ring *ring;
+static struct qemu_plugin_ring *dropring;
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 count_tb;
+static qemu_plugin_u64 count_insn;
+static qemu_plugin_u64 count_mem;
+
+static GArray *reads;
+static GThread *reader;
+static gint stop_reader;
+
+static void check_record(CPURead *r, const qemu_plugin_record *rec)
+{
+    switch (rec->flags) {
+    case QEMU_PLUGIN_RECORD_TB:
+        g_assert(rec->vaddr == rec->pc && rec->size > 0);
+        r->count.tb++;
+        break;
+    case QEMU_PLUGIN_RECORD_INSN:
+        g_assert(rec->vaddr == rec->pc && rec->size > 0);
+        r->last_insn_pc = rec->pc;
+        r->count.insn++;
+        break;
+    case QEMU_PLUGIN_RECORD_MEM_R:
+    case QEMU_PLUGIN_RECORD_MEM_W:
+        g_assert(rec->pc == r->last_insn_pc);
+        g_assert(rec->size > 0 && rec->size <= 16);
+        r->count.mem++;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* Returns the number of records read */
+static size_t read_rings(void)
+{
+    qemu_plugin_record records[READ_BATCH];
+    size_t total = 0;
+
+    for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+        size_t n;
+
+        if (i >= reads->len) {
+            g_array_set_size(reads, i + 1);
+        }
+        while ((n = qemu_plugin_ring_read(ring, i, records, READ_BATCH))) {
+            for (size_t j = 0; j < n; j++) {
+                check_record(&g_array_index(reads, CPURead, i), &records[j]);
+            }
+            total += n;
+        }
+        /* Records may be missing, so only count them */
+        while ((n = qemu_plugin_ring_read(dropring, i, records, READ_BATCH))) {
+            g_array_index(reads, CPURead, i).dropring_read += n;
+            total += n;
+        }
+    }
+    return total;
+}
+
+static gpointer reader_thread(gpointer data)
+{
+    while (!g_atomic_int_get(&stop_reader)) {
+        if (!read_rings()) {
+            g_usleep(100);
+        }
+    }
+    return NULL;
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *udata)
+{
+    g_autoptr(GString) stats = g_string_new("");
+
+    g_atomic_int_set(&stop_reader, 1);
+    g_thread_join(reader);
+    read_rings();
+
+    for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+        CPURead *r = &g_array_index(reads, CPURead, i);
+
+        g_string_printf(stats, "cpu %d: tb %" PRIu64 " insn %" PRIu64
+                        " mem %" PRIu64 "\n",
+                        i, r->count.tb, r->count.insn, r->count.mem);
+        qemu_plugin_outs(stats->str);
+        g_assert(r->count.tb == qemu_plugin_u64_get(count_tb, i));
+        g_assert(r->count.insn == qemu_plugin_u64_get(count_insn, i));
+        g_assert(r->count.mem == qemu_plugin_u64_get(count_mem, i));
+        g_assert(qemu_plugin_ring_lost(ring, i) == 0);
+
+        g_string_printf(stats, "cpu %d: drop ring read %" PRIu64
+                        " lost %" PRIu64 "\n",
+                        i, r->dropring_read,
+                        qemu_plugin_ring_lost(dropring, i));
+        qemu_plugin_outs(stats->str);
+        g_assert(r->dropring_read + qemu_plugin_ring_lost(dropring, i) ==
+                 r->count.tb + r->count.insn + r->count.mem);
+    }
+
+    g_array_free(reads, TRUE);
+    qemu_plugin_ring_free(ring);
+    qemu_plugin_ring_free(dropring);
+    qemu_plugin_scoreboard_free(counts);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    qemu_plugin_register_vcpu_tb_exec_record(tb, ring, 0);
+    qemu_plugin_register_vcpu_tb_exec_record(tb, dropring, 0);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, count_tb, 1);
+
+    for (int idx = 0; idx < qemu_plugin_tb_n_insns(tb); ++idx) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, idx);
+
+        qemu_plugin_register_vcpu_insn_exec_record(insn, ring, 0);
+        qemu_plugin_register_vcpu_insn_exec_record(insn, dropring, 0);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, count_insn, 1);
+        qemu_plugin_register_vcpu_mem_record(insn, ring, QEMU_PLUGIN_MEM_RW,
+                                             0);
+        qemu_plugin_register_vcpu_mem_record(insn, dropring,
+                                             QEMU_PLUGIN_MEM_RW, 0);
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            count_mem, 1);
+    }
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    ring = qemu_plugin_ring_new(RING_SIZE, QEMU_PLUGIN_RING_BLOCK);
+    dropring = qemu_plugin_ring_new(DROP_RING_SIZE, QEMU_PLUGIN_RING_DROP);
+    counts = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    count_tb = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, tb);
+    count_insn = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, insn);
+    count_mem = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, mem);
+    reads = g_array_new(FALSE, TRUE, sizeof(CPURead));
+    reader = g_thread_new("ring-reader", reader_thread, NULL);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+
+    return 0;
+}
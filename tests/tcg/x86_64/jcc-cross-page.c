@@ -0,0 +1,38 @@
+/*
+ * Test a conditional jump whose fall-through path leaves the page.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * The not-taken path continues on the next page, so it ends the TB with
+ * a lookup of the next TB, while the taken path stays on the page and
+ * is chained with goto_tb.  The two exits must not share a jump slot.
+ */
+#include <assert.h>
+
+int jcc_cross_page(int taken);
+
+asm(".pushsection .text\n"
+    ".p2align 12\n"
+    "1: movl $2, %eax\n"
+    "ret\n"
+    ".fill 4096 - 6 - 8, 1, 0xcc\n"
+    ".globl jcc_cross_page\n"
+    "jcc_cross_page: testl %edi, %edi\n"
+    ".byte 0x0f, 0x85\n"             /* jne rel32 */
+    ".long 1b - (. + 4)\n"
+    "movl $1, %eax\n"                /* next page */
+    "ret\n"
+    ".popsection\n");
+
+#define COUNT 10000
+
+int main(void)
+{
+    int i;
+
+    for (i = 0; i < COUNT; i++) {
+        assert(jcc_cross_page(0) == 1);
+        assert(jcc_cross_page(1) == 2);
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Check the flags after loops that jump back to an instruction that
+ * overwrites them.  QEMU does not store the flags on the backward jump,
+ * so they must be computed correctly when the loop exits.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+
+#define ARITH_FLAGS 0x8d5
+
+static uint64_t loop_add_jnc(uint32_t *x)
+{
+    uint64_t flags;
+
+    asm("1: addl $0x40000000, %k0\n\t"
+        "jnc 1b\n\t"
+        "pushf\n\t"
+        "pop %1"
+        : "+r"(*x), "=r"(flags));
+    return flags & ARITH_FLAGS;
+}
+
+static uint64_t loop_adc_jnz(uint32_t *x)
+{
+    uint64_t flags;
+    uint32_t tmp;
+
+    asm("1: subl $1, %k0\n\t"
+        "movl %k0, %k2\n\t"
+        "adcl $0, %k2\n\t"
+        "jnz 1b\n\t"
+        "pushf\n\t"
+        "pop %1"
+        : "+r"(*x), "=r"(flags), "=&r"(tmp));
+    return flags & ARITH_FLAGS;
+}
+
+static uint64_t loop_cmp_jl(uint32_t *x)
+{
+    uint64_t flags;
+
+    asm("1: addl $3, %k0\n\t"
+        "cmpl $100, %k0\n\t"
+        "jl 1b\n\t"
+        "pushf\n\t"
+        "pop %1"
+        : "+r"(*x), "=r"(flags));
+    return flags & ARITH_FLAGS;
+}
+
+int main(void)
+{
+    uint32_t x;
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        x = 0;
+        assert(loop_add_jnc(&x) == 0x45);   /* CF PF ZF */
+        assert(x == 0);
+
+        x = 1000;
+        assert(loop_adc_jnz(&x) == 0x44);   /* PF ZF */
+        assert(x == 0);
+
+        x = 0;
+        assert(loop_cmp_jl(&x) == 0);
+        assert(x == 102);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Test writes to a page that holds code which keeps running.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * JIT compilers often write data or new code next to code that they
+ * keep executing.  QEMU may reuse the translation of unmodified code
+ * after such writes; check that it is reused only when the code is
+ * really unchanged, including when just the immediate of an
+ * instruction is patched.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int get_patched(void);
+int get_fixed(void);
+extern unsigned char patched_imm[4];
+extern unsigned char scratch[64];
+
+asm(".pushsection .rwx,\"awx\",@progbits\n"
+    ".p2align 12\n"
+    ".globl get_patched\n"
+    "get_patched: .byte 0xb8\n"      /* movl $imm32, %eax */
+    ".globl patched_imm\n"
+    "patched_imm: .long 0\n"
+    "ret\n"
+    ".globl get_fixed\n"
+    "get_fixed: movl $1234, %eax\n"
+    "ret\n"
+    ".p2align 6\n"
+    ".globl scratch\n"
+    "scratch: .fill 64, 1, 0\n"
+    ".popsection\n");
+
+#define COUNT 10000
+
+int main(void)
+{
+    int32_t expect = 0;
+    int i;
+
+    for (i = 0; i < COUNT; i++) {
+        /* Write data next to the code, which must keep working. */
+        scratch[i % sizeof(scratch)] = i;
+        assert(get_fixed() == 1234);
+        assert(get_patched() == expect);
+
+        /* Patch the code, which must be retranslated. */
+        if (i % 7 == 0) {
+            expect = i * 3;
+            memcpy(patched_imm, &expect, sizeof(expect));
+            assert(get_patched() == expect);
+        }
+
+        /* Rewrite the same value, which changes nothing. */
+        if (i % 11 == 0) {
+            memcpy(patched_imm, &expect, sizeof(expect));
+            assert(get_patched() == expect);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
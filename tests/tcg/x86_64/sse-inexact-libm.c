@@ -0,0 +1,72 @@
+/*
+ * Test that x87 transcendental instructions do not set MXCSR.PE.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * QEMU may leave the SSE inexact flag in the host FPU while it is clear.
+ * FSIN, FCOS and FPTAN are emulated with the host libm, which also raises
+ * inexact on the host; check that this does not leak into MXCSR.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MXCSR_PE 0x20
+
+static volatile double d_three = 3.0, d_one = 1.0, d_half = 0.5;
+
+static uint32_t get_mxcsr(void)
+{
+    uint32_t mxcsr;
+
+    asm volatile("stmxcsr %0" : "=m"(mxcsr));
+    return mxcsr;
+}
+
+static void clear_mxcsr_flags(void)
+{
+    uint32_t mxcsr = get_mxcsr() & ~0x3f;
+
+    asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+}
+
+static void check(int expect, const char *what)
+{
+    if (!!(get_mxcsr() & MXCSR_PE) != expect) {
+        fprintf(stderr, "%s: MXCSR.PE %s\n", what, expect ? "clear" : "set");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(void)
+{
+    volatile double d;
+    long double x;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        clear_mxcsr_flags();
+        d = d_one + d_half;
+        x = 1.0L;
+        asm volatile("fsin" : "+t"(x));
+        check(0, "fsin after exact SSE add");
+
+        d = d * d_three;
+        x = 1.0L;
+        asm volatile("fcos" : "+t"(x));
+        check(0, "fcos after exact SSE mul");
+
+        d = d - d_half;
+        x = 1.0L;
+        asm volatile("fptan\n\tfstp %%st(0)" : "+t"(x));
+        check(0, "fptan after exact SSE sub");
+
+        d = d_one / d_three;
+        x = 1.0L;
+        asm volatile("fsin" : "+t"(x));
+        check(1, "fsin after inexact SSE div");
+    }
+    (void)d;
+    (void)x;
+    return EXIT_SUCCESS;
+}
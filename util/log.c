@@ -466,6 +466,8 @@ const QEMULogItem qemu_log_items[] = {
       "show micro ops after optimization" },
     { CPU_LOG_TB_OP_IND, "op_ind",
       "show micro ops before indirect lowering" },
+    { CPU_LOG_TB_REGALLOC, "regalloc",
+      "show register allocator spills and fills for each compiled TB" },
 #ifdef CONFIG_PLUGIN
     { LOG_TB_OP_PLUGIN, "op_plugin",
       "show micro ops before plugin injection" },
@@ -52,6 +52,14 @@
  * possible by QIOChannel's support for spurious coroutine re-entry in
  * qio_channel_yield(). The coroutine will restart I/O when re-entered from the
  * new AioContext.
+ *
+ * Virtqueues can be assigned their own AioContexts with
+ * vhost_user_server_set_vq_aio_contexts(), so that several threads process
+ * them in parallel. vu_client_trip() still runs in VuServer->ctx. Each
+ * virtqueue's state in libvhost-user is then protected by
+ * VuServer->vq_locks[i], which is held while the virtqueue is processed.
+ * vu_client_trip() takes all of them while a vhost-user message is
+ * processed, because messages change the state of all virtqueues.
  */
 
 static void vmsg_close_fds(VhostUserMsg *vmsg)
@@ -89,14 +97,14 @@ static void panic_cb(VuDev *vu_dev, const char *buf)
 
 void vhost_user_server_inc_in_flight(VuServer *server)
 {
-    assert(!server->wait_idle);
+    assert(!qatomic_read(&server->wait_idle));
     qatomic_inc(&server->in_flight);
 }
 
 void vhost_user_server_dec_in_flight(VuServer *server)
 {
     if (qatomic_fetch_dec(&server->in_flight) == 1) {
-        if (server->wait_idle) {
+        if (qatomic_xchg(&server->wait_idle, false)) {
             aio_co_wake(server->co_trip);
         }
     }
@@ -107,6 +115,47 @@ bool vhost_user_server_has_in_flight(VuServer *server)
     return qatomic_load_acquire(&server->in_flight) > 0;
 }
 
+void vhost_user_server_lock_vq(VuServer *server, int idx)
+{
+    if (server->vq_locks) {
+        qemu_rec_mutex_lock(&server->vq_locks[idx]);
+    }
+}
+
+void vhost_user_server_unlock_vq(VuServer *server, int idx)
+{
+    if (server->vq_locks) {
+        qemu_rec_mutex_unlock(&server->vq_locks[idx]);
+    }
+}
+
+/* Stop virtqueue processing in other threads */
+static void vu_lock_all_vqs(VuServer *server)
+{
+    int i;
+
+    if (!server->vq_locks || server->vq_locks_held) {
+        return;
+    }
+    for (i = 0; i < server->max_queues; i++) {
+        qemu_rec_mutex_lock(&server->vq_locks[i]);
+    }
+    server->vq_locks_held = true;
+}
+
+static void vu_unlock_all_vqs(VuServer *server)
+{
+    int i;
+
+    if (!server->vq_locks_held) {
+        return;
+    }
+    for (i = 0; i < server->max_queues; i++) {
+        qemu_rec_mutex_unlock(&server->vq_locks[i]);
+    }
+    server->vq_locks_held = false;
+}
+
 static bool coroutine_fn
 vu_message_read(VuDev *vu_dev, int conn_fd, VhostUserMsg *vmsg)
 {
@@ -199,6 +248,11 @@ vu_message_read(VuDev *vu_dev, int conn_fd, VhostUserMsg *vmsg)
         }
     }
 
+    /*
+     * The message is processed when we return, released again in
+     * vu_client_trip().  Nothing yields until then.
+     */
+    vu_lock_all_vqs(server);
     return true;
 
 fail:
@@ -213,26 +267,38 @@ static coroutine_fn void vu_client_trip(void *opaque)
     VuDev *vu_dev = &server->vu_dev;
 
     while (!vu_dev->broken) {
+        bool ok;
+
         if (server->quiescing) {
             server->co_trip = NULL;
             aio_wait_kick();
             return;
         }
+        ok = vu_dispatch(vu_dev);
+        vu_unlock_all_vqs(server);
+
         /* vu_dispatch() returns false if server->ctx went away */
-        if (!vu_dispatch(vu_dev) && server->ctx) {
+        if (!ok && server->ctx) {
             break;
         }
     }
 
-    if (vhost_user_server_has_in_flight(server)) {
-        /* Wait for requests to complete before we can unmap the memory */
-        server->wait_idle = true;
+    /*
+     * Wait for requests to complete before we can unmap the memory.  Requests
+     * may complete in other threads, so the last one to complete clears
+     * wait_idle to tell that it is waking us up.
+     */
+    qatomic_set(&server->wait_idle, true);
+    smp_mb();
+    if (vhost_user_server_has_in_flight(server) ||
+        !qatomic_xchg(&server->wait_idle, false)) {
         qemu_coroutine_yield();
-        server->wait_idle = false;
     }
     assert(!vhost_user_server_has_in_flight(server));
 
+    vu_lock_all_vqs(server);
     vu_deinit(vu_dev);
+    vu_unlock_all_vqs(server);
 
     /* vu_deinit() should have called remove_watch() */
     assert(QTAILQ_EMPTY(&server->vu_fd_watches));
@@ -261,15 +327,34 @@ static void kick_handler(void *opaque)
 {
     VuFdWatch *vu_fd_watch = opaque;
     VuDev *vu_dev = vu_fd_watch->vu_dev;
+    VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+    int idx = (intptr_t)vu_fd_watch->pvt;
 
-    vu_fd_watch->cb(vu_dev, 0, vu_fd_watch->pvt);
+    vhost_user_server_lock_vq(server, idx);
 
-    /* Stop vu_client_trip() if an error occurred in vu_fd_watch->cb() */
-    if (vu_dev->broken) {
-        VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+    /* The watch may have been removed while we waited for the lock */
+    if (!vu_fd_watch->removed) {
+        vu_fd_watch->cb(vu_dev, 0, vu_fd_watch->pvt);
 
-        qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+        /* Stop vu_client_trip() if an error occurred in vu_fd_watch->cb() */
+        if (vu_dev->broken) {
+            qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+        }
     }
+
+    vhost_user_server_unlock_vq(server, idx);
+}
+
+/* The AioContext in which the virtqueue of @vu_fd_watch is processed */
+static AioContext *vu_fd_watch_get_aio_context(VuServer *server,
+                                               VuFdWatch *vu_fd_watch)
+{
+    int idx = (intptr_t)vu_fd_watch->pvt;
+
+    if (server->vq_ctx && server->vq_ctx[idx]) {
+        return server->vq_ctx[idx];
+    }
+    return server->ctx;
 }
 
 static VuFdWatch *find_vu_fd_watch(VuServer *server, int fd)
@@ -303,14 +388,19 @@ set_watch(VuDev *vu_dev, int fd, int vu_evt,
 
         vu_fd_watch->fd = fd;
         vu_fd_watch->cb = cb;
-        qemu_socket_set_nonblock(fd);
-        aio_set_fd_handler(server->ctx, fd, kick_handler,
-                           NULL, NULL, NULL, vu_fd_watch);
         vu_fd_watch->vu_dev = vu_dev;
         vu_fd_watch->pvt = pvt;
+        qemu_socket_set_nonblock(fd);
+        aio_set_fd_handler(vu_fd_watch_get_aio_context(server, vu_fd_watch),
+                           fd, kick_handler, NULL, NULL, NULL, vu_fd_watch);
     }
 }
 
+static void vu_fd_watch_free_bh(void *opaque)
+{
+    g_free(opaque);
+}
+
 
 static void remove_watch(VuDev *vu_dev, int fd)
 {
@@ -325,10 +415,23 @@ static void remove_watch(VuDev *vu_dev, int fd)
     if (!vu_fd_watch) {
         return;
     }
-    aio_set_fd_handler(server->ctx, fd, NULL, NULL, NULL, NULL, NULL);
+    aio_set_fd_handler(vu_fd_watch_get_aio_context(server, vu_fd_watch),
+                       fd, NULL, NULL, NULL, NULL, NULL);
 
     QTAILQ_REMOVE(&server->vu_fd_watches, vu_fd_watch, next);
-    g_free(vu_fd_watch);
+
+    if (server->vq_ctx) {
+        /*
+         * kick_handler() may be running in another thread and waiting for
+         * the virtqueue lock.  Free the watch only after it has returned.
+         */
+        vu_fd_watch->removed = true;
+        aio_bh_schedule_oneshot(vu_fd_watch_get_aio_context(server,
+                                                            vu_fd_watch),
+                                vu_fd_watch_free_bh, vu_fd_watch);
+    } else {
+        g_free(vu_fd_watch);
+    }
 }
 
 
@@ -375,6 +478,10 @@ static void vu_accept(QIONetListener *listener, QIOChannelSocket *sioc,
     vhost_user_server_attach_aio_context(server, server->ctx);
 }
 
+static void vu_sync_bh(void *opaque)
+{
+}
+
 /* server->ctx acquired by caller */
 void vhost_user_server_stop(VuServer *server)
 {
@@ -385,7 +492,9 @@ void vhost_user_server_stop(VuServer *server)
         VuFdWatch *vu_fd_watch;
 
         QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-            aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
+            aio_set_fd_handler(vu_fd_watch_get_aio_context(server,
+                                                           vu_fd_watch),
+                               vu_fd_watch->fd,
                                NULL, NULL, NULL, NULL, vu_fd_watch);
         }
 
@@ -400,6 +509,55 @@ void vhost_user_server_stop(VuServer *server)
     }
 }
 
+/*
+ * Process virtqueue i in vq_ctx[i] instead of the server's AioContext, or in
+ * the server's AioContext if vq_ctx[i] is NULL.  @vq_ctx has one element per
+ * virtqueue.  Must be called after vhost_user_server_start() and before a
+ * client connects, and undone with vhost_user_server_free_vq_aio_contexts().
+ */
+void vhost_user_server_set_vq_aio_contexts(VuServer *server,
+                                           AioContext **vq_ctx)
+{
+    int i;
+
+    assert(!server->sioc && !server->vq_ctx);
+
+    server->vq_ctx = g_memdup2(vq_ctx, server->max_queues * sizeof(vq_ctx[0]));
+    server->vq_locks = g_new(QemuRecMutex, server->max_queues);
+    for (i = 0; i < server->max_queues; i++) {
+        qemu_rec_mutex_init(&server->vq_locks[i]);
+    }
+}
+
+/*
+ * Free what vhost_user_server_set_vq_aio_contexts() set up.  Requests that
+ * are still in flight and remove_watch() use it until vu_deinit() has
+ * returned, which can be after vhost_user_server_stop() if the client was
+ * quiesced, so this is only called when the owner of @server frees it.
+ */
+void vhost_user_server_free_vq_aio_contexts(VuServer *server)
+{
+    int i;
+
+    if (!server->vq_ctx) {
+        return;
+    }
+
+    /* Wait for kick_handler() calls that still hold a virtqueue lock */
+    for (i = 0; i < server->max_queues; i++) {
+        if (server->vq_ctx[i]) {
+            aio_wait_bh_oneshot(server->vq_ctx[i], vu_sync_bh, NULL);
+        }
+    }
+    for (i = 0; i < server->max_queues; i++) {
+        qemu_rec_mutex_destroy(&server->vq_locks[i]);
+    }
+    g_free(server->vq_locks);
+    server->vq_locks = NULL;
+    g_free(server->vq_ctx);
+    server->vq_ctx = NULL;
+}
+
 /*
  * Allow the next client to connect to the server. Called from a BH in the main
  * loop.
@@ -424,7 +582,8 @@ void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx)
     }
 
     QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-        aio_set_fd_handler(ctx, vu_fd_watch->fd, kick_handler, NULL,
+        aio_set_fd_handler(vu_fd_watch_get_aio_context(server, vu_fd_watch),
+                           vu_fd_watch->fd, kick_handler, NULL,
                            NULL, NULL, vu_fd_watch);
     }
 
@@ -456,7 +615,9 @@ void vhost_user_server_detach_aio_context(VuServer *server)
         VuFdWatch *vu_fd_watch;
 
         QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-            aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
+            aio_set_fd_handler(vu_fd_watch_get_aio_context(server,
+                                                           vu_fd_watch),
+                               vu_fd_watch->fd,
                                NULL, NULL, NULL, NULL, vu_fd_watch);
         }
     }